@@ -83,8 +83,15 @@ void DirectoryScanner::addScannedDirectory(KFTPEngine::DirectoryTree *tree, KFTP
     sourceUrlBase.addPath((*i)->info().filename());
     destUrlBase.addPath((*i)->info().filename());
     
-    if (KFTPCore::Config::skipEmptyDirs() && !(*i)->directories()->count())
+    if (KFTPCore::Config::skipEmptyDirs() && !(*i)->directories()->count()) {
+      // Skipped directories must not look extraneous on the destination
+      TransferDir::unindex(parent, sourceUrlBase, true);
       continue;
+    }
+    
+    // Directories that already exist on the destination are only kept when
+    // something inside them needs to be synchronized
+    bool synchronized = TransferDir::isSynchronized(parent, sourceUrlBase, (*i)->info());
     
     // Add directory transfer
     KFTPQueue::TransferDir *transfer = new KFTPQueue::TransferDir(parent);
@@ -98,6 +105,9 @@ void DirectoryScanner::addScannedDirectory(KFTPEngine::DirectoryTree *tree, KFTP
     
     QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
     addScannedDirectory(*i, transfer);
+    
+    if (synchronized && !transfer->hasChildren())
+      KFTPQueue::Manager::self()->removeTransfer(transfer, false);
   }
   
   // Files
@@ -112,6 +122,10 @@ void DirectoryScanner::addScannedDirectory(KFTPEngine::DirectoryTree *tree, KFTP
     sourceUrlBase.addPath((*i).filename());
     destUrlBase.addPath((*i).filename());
     
+    // Skip files that are up to date on the destination
+    if (TransferDir::isSynchronized(parent, sourceUrlBase, *i))
+      continue;
+    
     // Add file transfer
     KFTPQueue::TransferFile *transfer = new KFTPQueue::TransferFile(parent);
     transfer->addSize((*i).size());
@@ -189,6 +203,7 @@ void DirectoryScanner::ScannerThread::scanFolder(const QString &path, DirectoryT
     entry.setFilename(file.fileName());
     entry.setType(file.isDir() ? 'd' : 'f');
     entry.setSize(file.size());
+    entry.setTime(file.lastModified().toTime_t());
     
     list.append(entry);
   }
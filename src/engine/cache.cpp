@@ -149,7 +149,10 @@ DirectoryListing Cache::findCached(Socket *socket, const QString &path)
   KUrl url = socket->getCurrentUrl();
   url.setPath(path);
   
-  return findCached(url);
+  DirectoryListing cached = findCached(url);
+  socket->metrics()->counter(cached.isValid() ? MetricsSite::CacheHits : MetricsSite::CacheMisses).add();
+  
+  return cached;
 }
 
 QString Cache::findCachedPath(KUrl &url)
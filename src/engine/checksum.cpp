@@ -0,0 +1,155 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "checksum.h"
+
+#include <QFile>
+#include <QCryptographicHash>
+
+namespace KFTPEngine {
+
+static quint32 crcTable[256];
+
+static void initCrcTable()
+{
+  if (crcTable[1])
+    return;
+  
+  for (quint32 i = 0; i < 256; i++) {
+    quint32 crc = i;
+    
+    for (int j = 0; j < 8; j++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    
+    crcTable[i] = crc;
+  }
+}
+
+Checksum::Checksum()
+  : m_hash(0),
+    m_crc(0xFFFFFFFF),
+    m_remaining(0)
+{
+}
+
+Checksum::~Checksum()
+{
+  delete m_hash;
+}
+
+QStringList Checksum::algorithms()
+{
+  return QStringList() << "SHA-1" << "MD5" << "CRC32";
+}
+
+bool Checksum::open(const QString &fileName, const QString &algorithm, filesize_t offset, filesize_t length)
+{
+  delete m_hash;
+  m_hash = 0;
+  m_crc = 0xFFFFFFFF;
+  m_result.clear();
+  
+  if (algorithm == "SHA-1")
+    m_hash = new QCryptographicHash(QCryptographicHash::Sha1);
+  else if (algorithm == "MD5")
+    m_hash = new QCryptographicHash(QCryptographicHash::Md5);
+  else if (algorithm == "CRC32")
+    initCrcTable();
+  else
+    return false;
+  
+  m_file.close();
+  m_file.setFileName(fileName);
+  
+  if (!m_file.open(QIODevice::ReadOnly) || !m_file.seek(offset))
+    return false;
+  
+  m_remaining = length ? length : m_file.size() - offset;
+  return true;
+}
+
+bool Checksum::update(qint64 maxSize)
+{
+  if (!m_file.isOpen())
+    return true;
+  
+  char buffer[65536];
+  
+  while (m_remaining > 0 && maxSize > 0) {
+    qint64 size = m_file.read(buffer, qMin((filesize_t) qMin((qint64) sizeof(buffer), maxSize), m_remaining));
+    
+    if (size <= 0) {
+      // The file is shorter than the requested range
+      m_file.close();
+      return true;
+    }
+    
+    if (m_hash) {
+      m_hash->addData(buffer, size);
+    } else {
+      for (qint64 i = 0; i < size; i++)
+        m_crc = crcTable[(m_crc ^ (uchar) buffer[i]) & 0xFF] ^ (m_crc >> 8);
+    }
+    
+    m_remaining -= size;
+    maxSize -= size;
+  }
+  
+  if (m_remaining > 0)
+    return false;
+  
+  if (m_hash)
+    m_result = m_hash->result().toHex();
+  else
+    m_result = QString::number(m_crc ^ 0xFFFFFFFF, 16).rightJustified(8, '0');
+  
+  m_file.close();
+  return true;
+}
+
+bool Checksum::equal(const QString &algorithm, const QString &first, const QString &second)
+{
+  if (first.isEmpty() || second.isEmpty())
+    return false;
+  
+  // Some servers strip leading zeroes from CRC values
+  if (algorithm == "CRC32")
+    return first.toULong(0, 16) == second.toULong(0, 16);
+  
+  return first.toLower() == second.toLower();
+}
+
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef KFTPENGINECHECKSUM_H
+#define KFTPENGINECHECKSUM_H
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+
+#include "directorylisting.h"
+
+class QCryptographicHash;
+
+namespace KFTPEngine {
+
+/**
+ * Local checksum computation used to compare files against the checksums
+ * reported by the server (HASH, XSHA1, XMD5 and XCRC commands). Algorithm
+ * names follow the HASH command naming (SHA-1, MD5, CRC32).
+ *
+ * Files are hashed incrementally, so large files can be processed a chunk
+ * at a time without blocking the event loop.
+ */
+class Checksum {
+public:
+    /**
+     * Class constructor.
+     */
+    Checksum();
+    
+    /**
+     * Class destructor.
+     */
+    ~Checksum();
+    
+    /**
+     * Returns the list of algorithms that can be computed localy, ordered
+     * by preference.
+     */
+    static QStringList algorithms();
+    
+    /**
+     * Prepares the computation of the checksum of a local file or a part
+     * of it.
+     *
+     * @param fileName Path to the local file
+     * @param algorithm Algorithm name
+     * @param offset Offset of the first byte to include
+     * @param length Number of bytes to include or 0 for the rest of the file
+     * @return False if the file can't be read or the algorithm is unknown
+     */
+    bool open(const QString &fileName, const QString &algorithm, filesize_t offset = 0, filesize_t length = 0);
+    
+    /**
+     * Hashes the next chunk of the file.
+     *
+     * @param maxSize Maximum number of bytes to process
+     * @return True when the computation is complete (or has failed)
+     */
+    bool update(qint64 maxSize = 1048576);
+    
+    /**
+     * Returns the computed checksum once update has returned true.
+     *
+     * @return A lowercase hex digest or an empty string on failure
+     */
+    QString result() const { return m_result; }
+    
+    /**
+     * Compares two hex digests produced by the given algorithm.
+     *
+     * @param algorithm Algorithm name
+     * @param first First digest
+     * @param second Second digest
+     * @return True if the digests are equal
+     */
+    static bool equal(const QString &algorithm, const QString &first, const QString &second);
+private:
+    QFile m_file;
+    QCryptographicHash *m_hash;
+    quint32 m_crc;
+    filesize_t m_remaining;
+    QString m_result;
+};
+
+}
+
+#endif
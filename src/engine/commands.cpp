@@ -35,6 +35,7 @@
  */
 
 #include "commands.h"
+#include "socket.h"
 
 namespace KFTPEngine {
 
@@ -72,6 +73,11 @@ void Base::wakeup(WakeupEvent *event)
   m_wakeupEvent = 0;
 }
 
+void Base::traceState(int from, int to)
+{
+  m_socket->trace('i', "state", name(), 0, QString("%1 -> %2").arg(from).arg(to));
+}
+
 }
 
 }
@@ -38,11 +38,13 @@
 #define COMMANDS_H
 
 #include "event.h"
+#include "tracer.h"
 
 #define ENGINE_STANDARD_COMMAND_CONSTRUCTOR(class, type, cmd) public: \
-                                                              class(type *socket) : Commands::Base(socket, Commands::cmd), currentState(None) {} \
+                                                              class(type *socket) : Commands::Base(socket, Commands::cmd), currentState(this, None) {} \
+                                                              const char *name() const { return #class; } \
                                                               private: \
-                                                              State currentState; \
+                                                              Commands::TracedState<State> currentState; \
                                                               \
                                                               type *socket() {\
                                                                 return static_cast<type*>(m_socket);\
@@ -67,6 +69,7 @@
                                       nextCommand(); \
                                     } else { \
                                       m_cmdData = new class(this); \
+                                      TraceScope _scope(this, "process", m_cmdData->name()); \
                                       m_cmdData->process(); \
                                     }
 
@@ -79,6 +82,10 @@ namespace Commands {
 enum Type {
   CmdNone,
   CmdWakeup,
+  CmdThrottleWakeup,
+  CmdNextCommand,
+  CmdStartup,
+  CmdShutdown,
   
   // Actual commands
   CmdConnect,
@@ -94,6 +101,7 @@ enum Type {
   CmdChmod,
   CmdRaw,
   CmdFxp,
+  CmdChecksum,
   CmdKeepAlive,
   CmdAbort
 };
@@ -114,6 +122,19 @@ public:
     
     Type command() { return m_command; }
     
+    /**
+     * Returns the name of this command class, used for tracing.
+     */
+    virtual const char *name() const { return "Command"; }
+    
+    /**
+     * Records a state transition of this command class.
+     *
+     * @param from Previous state
+     * @param to New state
+     */
+    void traceState(int from, int to);
+    
     bool isWakeup() { return m_wakeupEvent != 0; }
     virtual void wakeup(WakeupEvent *event);
     virtual void process() = 0;
@@ -131,6 +152,30 @@ protected:
     bool m_clean;
 };
 
+/**
+ * Holds the current state of a command class state machine and records
+ * state transitions when tracing is enabled.
+ */
+template <typename T>
+class TracedState {
+public:
+    TracedState(Base *command, T state) : m_command(command), m_state(state) {}
+    
+    TracedState &operator=(T state)
+    {
+      if (Tracer::isEnabled() && state != m_state)
+        m_command->traceState(m_state, state);
+      
+      m_state = state;
+      return *this;
+    }
+    
+    operator T() const { return m_state; }
+private:
+    Base *m_command;
+    T m_state;
+};
+
 }
 
 }
@@ -52,7 +52,7 @@ ConnectionRetry::ConnectionRetry(Socket *socket)
   m_timer = new QTimer(this);
   
   connect(m_timer, SIGNAL(timeout()), this, SLOT(slotShouldRetry()));
-  connect(m_socket->thread()->eventHandler(), SIGNAL(engineEvent(KFTPEngine::Event*)), this, SLOT(slotEngineEvent(KFTPEngine::Event*)));
+  connect(m_socket->thread()->eventHandler(), SIGNAL(connected()), this, SLOT(slotConnected()));
 }
 
 void ConnectionRetry::startRetry()
@@ -73,6 +73,8 @@ void ConnectionRetry::startRetry()
 void ConnectionRetry::slotShouldRetry()
 {
   m_socket->setCurrentCommand(Commands::CmdNone);
+  m_socket->metrics()->counter(MetricsSite::Reconnects).add();
+  
   if (m_max > 0)
     m_socket->emitEvent(Event::EventMessage, i18n("Retrying connection (%1/%2)...",m_iteration,m_max));
   else
@@ -100,14 +102,12 @@ void ConnectionRetry::abortRetry()
   QObject::deleteLater();
 }
 
-void ConnectionRetry::slotEngineEvent(KFTPEngine::Event *event)
+void ConnectionRetry::slotConnected()
 {
-  if (event->type() == Event::EventConnect) {
-    m_socket->emitEvent(Event::EventRetrySuccess);
-    
-    // This object should be automagicly removed
-    QObject::deleteLater();
-  }
+  m_socket->emitEvent(Event::EventRetrySuccess);
+  
+  // This object should be automagicly removed
+  QObject::deleteLater();
 }
 
 }
@@ -78,7 +78,7 @@ private:
     QTimer *m_timer;
 private slots:
     void slotShouldRetry();
-    void slotEngineEvent(KFTPEngine::Event *event);
+    void slotConnected();
 };
 
 }
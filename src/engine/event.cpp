@@ -35,10 +35,19 @@
  */
 
 #include "event.h"
+#include "eventqueue.h"
+#include "speedmeter.h"
 #include "thread.h"
 
+#include <QCoreApplication>
+#include <QPointer>
+#include <QTimer>
+
 namespace KFTPEngine {
 
+/* Minimum time between two deliveries of queued events (in microseconds) */
+static const qint64 frameInterval = 16000;
+
 Event::Event(Type type, QList<QVariant> params)
   : QEvent((QEvent::Type) 65123),
     m_type(type),
@@ -46,34 +55,115 @@ Event::Event(Type type, QList<QVariant> params)
 {
 }
 
+Event::Event(Type type, const QString &text, const QString &detail)
+  : QEvent((QEvent::Type) 65123),
+    m_type(type),
+    m_text(text),
+    m_detail(detail)
+{
+}
+
 Event::~Event()
 {
 }
 
+QVariant Event::getParameter(int index)
+{
+  // Text events have no parameter list
+  if (m_params.isEmpty())
+    return index == 0 ? m_text : m_detail;
+  
+  return m_params[index];
+}
+
 EventHandler::EventHandler(Thread *thread)
   : QObject(),
-    m_thread(thread)
+    m_thread(thread),
+    m_queue(new EventQueue()),
+    m_drainScheduled(0),
+    m_lastDrain(0)
+{
+}
+
+EventHandler::~EventHandler()
+{
+  delete m_queue;
+}
+
+void EventHandler::post(Event::Type type, const QString &text, const QString &detail)
 {
+  EventQueue::Record record;
+  record.type = type;
+  record.text = text;
+  record.detail = detail;
+  
+  m_queue->push(record);
+  scheduleDrain();
+}
+
+void EventHandler::post(Event::Type type, const QList<QVariant> &params)
+{
+  EventQueue::Record record;
+  record.type = type;
+  record.params = params;
+  
+  m_queue->push(record);
+  scheduleDrain();
+}
+
+void EventHandler::scheduleDrain()
+{
+  if (m_drainScheduled.testAndSetOrdered(0, 1))
+    QCoreApplication::postEvent(this, new QEvent((QEvent::Type) 65123));
 }
 
 void EventHandler::customEvent(QEvent *e)
 {
   if (e->type() == 65123) {
-    Event *ev = static_cast<Event*>(e);
-
-    emit engineEvent(ev);
+    qint64 elapsed = SpeedMeter::monotonicTime() - m_lastDrain;
     
-    switch (ev->type()) {
-      case Event::EventConnect: emit connected(); break;
-      case Event::EventDisconnect: emit disconnected(); break;
-      case Event::EventResponse:
-      case Event::EventMultiline: {
-        emit gotResponse(ev->getParameter(0).toString());
-        break;
-      }
-      case Event::EventRaw: emit gotRawResponse(ev->getParameter(0).toString()); break;
-      default: break;
+    if (elapsed < frameInterval)
+      QTimer::singleShot((frameInterval - elapsed) / 1000 + 1, this, SLOT(drain()));
+    else
+      drain();
+  }
+}
+
+void EventHandler::drain()
+{
+  // Events queued from now on need another notification
+  m_drainScheduled.fetchAndStoreOrdered(0);
+  m_lastDrain = SpeedMeter::monotonicTime();
+  
+  // Handlers may destroy the connection while events are being delivered
+  QPointer<EventHandler> guard(this);
+  EventQueue::Record record;
+  
+  while (guard && m_queue->pop(record)) {
+    if (record.params.isEmpty()) {
+      Event event(record.type, record.text, record.detail);
+      dispatch(&event);
+    } else {
+      Event event(record.type, record.params);
+      dispatch(&event);
+    }
+  }
+}
+
+void EventHandler::dispatch(Event *event)
+{
+  emit engineEvent(event);
+  
+  switch (event->type()) {
+    case Event::EventConnect: emit connected(); break;
+    case Event::EventDisconnect: emit disconnected(); break;
+    case Event::EventResponse:
+    case Event::EventMultiline: {
+      emit gotResponse(event->text());
+      break;
     }
+    case Event::EventRaw: emit gotRawResponse(event->text()); break;
+    default: break;
   }
 }
 
@@ -40,6 +40,7 @@
 #include <QObject>
 #include <QEvent>
 #include <QList>
+#include <QAtomicInt>
 
 #include "directorylisting.h"
 
@@ -65,7 +66,19 @@ enum ErrorCode {
   FileNotFound,
   OperationFailed,
   ListFailed,
-  FileOpenFailed
+  FileOpenFailed,
+  VerifyFailed
+};
+
+/**
+ * Checksum verification results, carried by EventChecksum events and returned
+ * by checksum commands.
+ */
+enum ChecksumStatus {
+  ChecksumVerifying,
+  ChecksumMatch,
+  ChecksumMismatch,
+  ChecksumUnavailable
 };
 
 /**
@@ -94,6 +107,11 @@ public:
      * @param type Event type
      */
     WakeupEvent(Type type) : m_type(type) {}
+    
+    /**
+     * Returns the type of this wakeup event.
+     */
+    Type type() const { return m_type; }
 private:
     Type m_type;
 };
@@ -181,6 +199,7 @@ public:
       // Transfer events
       EventTransferComplete,
       EventResumeOffset,
+      EventChecksum,
       
       // Events that require wakeup events
       EventFileExists,
@@ -194,6 +213,16 @@ public:
      * @param params Parameter list
      */
     Event(Type type, QList<QVariant> params);
+    
+    /**
+     * Construct a new text event. Text is stored as is, without wrapping it
+     * into a QVariant.
+     *
+     * @param type Event type
+     * @param text Event text
+     * @param detail Optional second text
+     */
+    Event(Type type, const QString &text, const QString &detail = QString());
     ~Event();
     
     /**
@@ -209,18 +238,30 @@ public:
      * @param index Parameter's index
      * @return A parameter as QVariant
      */
-    QVariant getParameter(int index) { return m_params[index]; }
+    QVariant getParameter(int index);
+    
+    /**
+     * Returns the text of a text event.
+     */
+    const QString &text() const { return m_text; }
 protected:
     Type m_type;
     QList<QVariant> m_params;
+    QString m_text;
+    QString m_detail;
 };
 
 class Thread;
+class EventQueue;
 
 /**
  * This class handles events receieved from the thread and passes them
  * on to the GUI as normal Qt signals.
  *
+ * Events are not posted one by one. The socket thread appends them to an
+ * EventQueue and the GUI thread is only notified when the queue was empty.
+ * The queue is then drained in a single batch, at most once per frame.
+ *
  * @author Jernej Kos <kostko@jweb-network.net>
  */
 class EventHandler : public QObject {
@@ -232,10 +273,53 @@ public:
      * @param thread The thread this event handler belongs to
      */
     EventHandler(Thread *thread);
+    
+    /**
+     * Class destructor.
+     */
+    ~EventHandler();
+    
+    /**
+     * Queues a text event for delivery to the GUI. This method must only
+     * be called from the socket thread.
+     *
+     * @param type Event type
+     * @param text Event text
+     * @param detail Optional second text
+     */
+    void post(Event::Type type, const QString &text, const QString &detail);
+    
+    /**
+     * Queues an event with a parameter list for delivery to the GUI. This
+     * method must only be called from the socket thread.
+     *
+     * @param type Event type
+     * @param params Parameter list
+     */
+    void post(Event::Type type, const QList<QVariant> &params);
 protected:
     void customEvent(QEvent *e);
+    
+    /**
+     * Notifies the GUI thread unless a drain is already pending.
+     */
+    void scheduleDrain();
+    
+    /**
+     * Emits a single event.
+     */
+    void dispatch(Event *event);
+protected slots:
+    /**
+     * Delivers all queued events.
+     */
+    void drain();
 protected:
     Thread *m_thread;
+    EventQueue *m_queue;
+    
+    QAtomicInt m_drainScheduled;
+    qint64 m_lastDrain;
 signals:
     void engineEvent(KFTPEngine::Event *event);
     
@@ -0,0 +1,102 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "eventqueue.h"
+
+#include <QMutexLocker>
+
+namespace KFTPEngine {
+
+EventQueue::EventQueue(int capacity)
+  : m_ring(capacity + 1),
+    m_head(0),
+    m_tail(0),
+    m_overflowing(0)
+{
+}
+
+void EventQueue::push(const Record &record)
+{
+  // Once the ring has overflowed, everything goes to the overflow list until
+  // the consumer takes it, otherwise newer records could overtake older ones
+  if (!m_overflowing) {
+    int tail = m_tail;
+    int next = (tail + 1) % m_ring.size();
+    
+    if (next != m_head.fetchAndAddAcquire(0)) {
+      m_ring[tail] = record;
+      m_tail.fetchAndStoreRelease(next);
+      return;
+    }
+  }
+  
+  QMutexLocker locker(&m_overflowMutex);
+  m_overflow.append(record);
+  m_overflowing = 1;
+}
+
+bool EventQueue::pop(Record &record)
+{
+  if (!m_drained.isEmpty()) {
+    record = m_drained.takeFirst();
+    return true;
+  }
+  
+  int head = m_head;
+  
+  if (head != m_tail.fetchAndAddAcquire(0)) {
+    record = m_ring[head];
+    m_ring[head] = Record();
+    m_head.fetchAndStoreRelease((head + 1) % m_ring.size());
+    return true;
+  }
+  
+  // The ring is empty, continue with the records that have overflowed
+  {
+    QMutexLocker locker(&m_overflowMutex);
+    m_drained.swap(m_overflow);
+    m_overflowing = 0;
+  }
+  
+  if (!m_drained.isEmpty()) {
+    record = m_drained.takeFirst();
+    return true;
+  }
+  
+  return false;
+}
+
+}
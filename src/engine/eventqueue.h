@@ -0,0 +1,110 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef KFTPENGINEEVENTQUEUE_H
+#define KFTPENGINEEVENTQUEUE_H
+
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <QAtomicInt>
+
+#include "event.h"
+
+namespace KFTPEngine {
+
+/**
+ * A bounded single-producer single-consumer queue that carries engine events
+ * from the socket thread to the GUI thread. Records are stored in a ring that
+ * is allocated once, so pushing an event doesn't allocate anything besides
+ * its payload. Text events are stored as typed strings, other events keep
+ * their parameter list.
+ *
+ * When the ring is full, records are appended to a locked overflow list so
+ * that no event is ever lost and the order of events is kept.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class EventQueue {
+public:
+    /**
+     * A single queued event.
+     */
+    struct Record {
+      Event::Type type;
+      QString text;
+      QString detail;
+      QList<QVariant> params;
+    };
+    
+    /**
+     * Class constructor.
+     *
+     * @param capacity Number of records the ring can hold
+     */
+    EventQueue(int capacity = 1024);
+    
+    /**
+     * Appends a record to the queue. Must only be called by the producer.
+     *
+     * @param record The record to append
+     */
+    void push(const Record &record);
+    
+    /**
+     * Removes the oldest record from the queue. Must only be called by the
+     * consumer.
+     *
+     * @param record Where the record should be stored
+     * @return True if a record has been removed, false if the queue is empty
+     */
+    bool pop(Record &record);
+private:
+    QVector<Record> m_ring;
+    QAtomicInt m_head;
+    QAtomicInt m_tail;
+    
+    QMutex m_overflowMutex;
+    QList<Record> m_overflow;
+    QAtomicInt m_overflowing;
+    
+    // Overflowed records owned by the consumer
+    QList<Record> m_drained;
+};
+
+}
+
+#endif
@@ -442,7 +442,7 @@ bool FtpDirectoryParser::parseLine(const QString &line, DirectoryEntry &entry)
   entry.timeStruct.tm_isdst = 0;
   
   // Attempt machine friendly format first, when socket supports MLSD
-  if (m_socket->getConfig<bool>("feat.mlsd"))
+  if (m_socket->getConfig<bool>(Settings::FeatMlsd))
     done = parseMlsd(line, entry);
   
   if (!done)
@@ -40,12 +40,15 @@
 #include "cache.h"
 #include "speedlimiter.h"
 #include "otpgenerator.h"
+#include "checksum.h"
 
 #include "misc/config.h"
 
 #include <qdir.h>
+#include <qfileinfo.h>
 
 #include <QByteArray>
+#include <QRegExp>
 #include <QSslCipher>
 #include <QSslKey>
 #include <QHostInfo>
@@ -86,6 +89,12 @@ FtpSocket::FtpSocket(Thread *thread)
    Socket(thread, "ftp"),
    SpeedLimiterItem(),
    m_login(false),
+   m_peerVerifyPending(false),
+   m_commandSent(0),
+   m_dataConnectStart(0),
+   m_tlsStart(0),
+   m_dataTlsStart(0),
+   m_listParseTime(0),
    m_transferSocket(0),
    m_serverSocket(0),
    m_directoryParser(0)
@@ -94,6 +103,11 @@ FtpSocket::FtpSocket(Thread *thread)
   connect(m_keepaliveTimer, SIGNAL(timeout()), this, SLOT(timerUpdate()));
   m_keepaliveTimer->start(1000);
   
+  // Retries a transfer the speed limiter has stopped
+  m_throttleTimer = new QTimer(this);
+  m_throttleTimer->setSingleShot(true);
+  connect(m_throttleTimer, SIGNAL(timeout()), this, SLOT(slotThrottleTimeout()));
+  
   // Control socket signals
   connect(this, SIGNAL(readyRead()), this, SLOT(slotControlTryRead()));
   connect(this, SIGNAL(connected()), this, SLOT(slotConnected()));
@@ -116,6 +130,10 @@ void FtpSocket::timerUpdate()
 
 void FtpSocket::slotDisconnected()
 {
+  // Failed handshake while the user is still verifying the peer
+  if (m_peerVerifyPending)
+    return;
+  
   protoDisconnect();
 }
 
@@ -151,6 +169,9 @@ void FtpSocket::slotControlTryRead()
 
 void FtpSocket::parseLine(const QString &line)
 {
+  if (Tracer::isEnabled())
+    trace('i', "wire", "receive", 0, line);
+  
   // Is this the end of multiline response ?
   if (!m_multiLineCode.isEmpty() && line.left(4) == m_multiLineCode) {
     m_multiLineCode = "";
@@ -165,6 +186,12 @@ void FtpSocket::parseLine(const QString &line)
     emitEvent(Event::EventResponse, line);
   }
   
+  // Record the command round trip once the final response arrives
+  if (m_multiLineCode.isEmpty() && m_commandSent) {
+    metrics()->histogram(MetricsSite::CommandRtt).add(SpeedMeter::monotonicTime() - m_commandSent);
+    m_commandSent = 0;
+  }
+  
   timeoutWait(false);
   
   // Parse our response
@@ -186,11 +213,17 @@ bool FtpSocket::isResponse(const QString &code)
 
 void FtpSocket::sendCommand(const QString &command)
 {
+  if (Tracer::isEnabled())
+    trace('i', "wire", "send", 0, command.left(4) == "PASS" ? QString("PASS (hidden)") : command);
+  
   emitEvent(Event::EventCommand, command);
   QByteArray buffer = m_remoteEncoding->encode(command) + "\r\n";
   
   write(buffer.data(), buffer.length());  
   timeoutWait(true);
+  
+  if (!m_commandSent)
+    m_commandSent = SpeedMeter::monotonicTime();
 }
 
 void FtpSocket::resetCommandClass(ResetCode code)
@@ -265,6 +298,7 @@ public:
         }
         case SentAuthTls: {
           if (socket()->isResponse("2")) {
+            socket()->m_tlsStart = SpeedMeter::monotonicTime();
             socket()->startClientEncryption();
             currentState = WaitEncryption;
           } else {
@@ -299,7 +333,7 @@ public:
           } else if (socket()->isResponse("230")) {
             // Some servers imediately send the 230 response for anonymous accounts
             if (!socket()->isMultiline()) {
-              if (socket()->getConfig<bool>("ssl")) {
+              if (socket()->getConfig<bool>(Settings::Ssl)) {
                 currentState = SentPbsz;
                 socket()->sendCommand("PBSZ 0");
               } else {
@@ -319,7 +353,7 @@ public:
         case SentPass: {
           if (socket()->isResponse("230")) {
             if (!socket()->isMultiline()) {
-              if (socket()->getConfig<bool>("ssl")) {
+              if (socket()->getConfig<bool>(Settings::Ssl)) {
                 currentState = SentPbsz;
                 socket()->sendCommand("PBSZ 0");
               } else {
@@ -340,7 +374,7 @@ public:
           currentState = SentProt;
           QString prot = "PROT ";
           
-          if (socket()->getConfig<int>("ssl.prot_mode") == 0) 
+          if (socket()->getConfig<int>(Settings::SslProtMode) == 0) 
             prot.append('P');
           else
             prot.append('C');
@@ -351,7 +385,7 @@ public:
         case SentProt: {
           if (socket()->isResponse("5")) {
             // Fallback to unencrypted data channel
-            socket()->setConfig("ssl.prot_mode", 2);
+            socket()->setConfig(Settings::SslProtMode, 2);
           }
           
           currentState = DoingSyst;
@@ -406,23 +440,46 @@ public:
       
       if (feat.left(4) == "MDTM") {
         // Server has MDTM (MoDification TiMe) support
-        socket()->setConfig("feat.mdtm", true);
+        socket()->setConfig(Settings::FeatMdtm, true);
       } else if (feat.left(4) == "PRET") {
         // Server is a distributed ftp server and requires PRET for transfers
-        socket()->setConfig("feat.pret", true);
+        socket()->setConfig(Settings::FeatPret, true);
       } else if (feat.left(4) == "MLSD") {
         // Server supports machine-friendly directory listings
-        socket()->setConfig("feat.mlsd", true);
+        socket()->setConfig(Settings::FeatMlsd, true);
       } else if (feat.left(4) == "REST") {
         // Server supports resume operations
-        socket()->setConfig("feat.rest", true);
+        socket()->setConfig(Settings::FeatRest, true);
       } else if (feat.left(4) == "SSCN") {
         // Server supports SSCN for secure site-to-site transfers
-        socket()->setConfig("feat.sscn", true);
-        socket()->setConfig("feat.cpsv", false);
-      } else if (feat.left(4) == "CPSV" && !socket()->getConfig<bool>("feat.sscn")) {
+        socket()->setConfig(Settings::FeatSscn, true);
+        socket()->setConfig(Settings::FeatCpsv, false);
+      } else if (feat.left(4) == "CPSV" && !socket()->getConfig<bool>(Settings::FeatSscn)) {
         // Server supports CPSV for secure site-to-site transfers
-        socket()->setConfig("feat.cpsv", true);
+        socket()->setConfig(Settings::FeatCpsv, true);
+      } else if (feat.left(5) == "HASH ") {
+        // Server supports the HASH command, the current algorithm is marked
+        // with an asterisk (for example "HASH SHA-1*;MD5;CRC32")
+        QStringList algorithms;
+
+        foreach (QString algorithm, feat.mid(5).split(';', QString::SkipEmptyParts)) {
+          algorithm = algorithm.trimmed();
+
+          if (algorithm.endsWith('*')) {
+            algorithm.chop(1);
+            socket()->setConfig("feat.hash.current", algorithm);
+          }
+
+          algorithms.append(algorithm);
+        }
+
+        socket()->setConfig("feat.hash", algorithms);
+      } else if (feat == "XSHA1") {
+        socket()->setConfig("feat.xsha1", true);
+      } else if (feat == "XMD5") {
+        socket()->setConfig("feat.xmd5", true);
+      } else if (feat == "XCRC") {
+        socket()->setConfig("feat.xcrc", true);
       }
     }
 };
@@ -459,12 +516,17 @@ void FtpSocket::slotConnected()
   emitEvent(Event::EventMessage, i18n("Connected with server, waiting for welcome message..."));
   setupCommandClass(FtpCommandConnect);
   
-  if (getConfig<bool>("ssl.use_implicit"))
+  if (getConfig<bool>("ssl.use_implicit")) {
+    m_tlsStart = SpeedMeter::monotonicTime();
     startClientEncryption();
+  }
 }
 
 void FtpSocket::slotError()
 {
+  if (m_peerVerifyPending)
+    return;
+  
   emitEvent(Event::EventMessage, i18n("Failed to connect (%1.)", errorString()));
   emitError(ConnectFailed, errorString());
   
@@ -474,9 +536,10 @@ void FtpSocket::slotError()
 void FtpSocket::slotSslNegotiated()
 {
   QSslCipher cipher = sessionCipher();
+  metrics()->histogram(MetricsSite::TlsHandshake).add(SpeedMeter::monotonicTime() - m_tlsStart);
               
   emitEvent(Event::EventMessage, i18n("SSL negotiation successful. Connection is secured with %1 bit cipher %2.", cipher.usedBits(), cipher.name()));
-  setConfig("ssl", true);
+  setConfig(Settings::Ssl, true);
   
   // Proceed with the next command
   if (!getConfig<bool>("ssl.use_implicit"))
@@ -490,21 +553,63 @@ void FtpSocket::slotSslErrors(const QList<QSslError> &errors)
     return;
   }
   
-  // Request immediate action from the user
-  QVariantList elist;
+  // Errors the user has already accepted for this peer
+  bool accepted = true;
+  QList<QSslError> elist;
+  
   foreach (QSslError error, errors) {
-    elist << QVariant::fromValue(QSslError(error.error(), peerCertificate()));
+    QSslError peerError(error.error(), peerCertificate());
+    
+    if (!m_acceptedSslErrors.contains(peerError))
+      accepted = false;
+    
+    elist << peerError;
   }
   
-  PeerVerifyWakeupEvent *response = static_cast<PeerVerifyWakeupEvent*>(emitEventAndWait(Event::EventPeerVerify, elist));
-  if (response && response->peerOk) {
-    // Certificate was deemed acceptable, so ignore errors and continue
+  if (accepted) {
     ignoreSslErrors();
+    return;
+  }
+  
+  // The handshake fails now, the connection is retried once the user
+  // has accepted the certificate (see wakeup)
+  m_peerVerifyPending = true;
+  m_pendingSslErrors = elist;
+  
+  QVariantList vlist;
+  foreach (QSslError error, elist) {
+    vlist << QVariant::fromValue(error);
+  }
+  
+  emitEvent(Event::EventPeerVerify, vlist);
+}
+
+void FtpSocket::wakeup(WakeupEvent *event)
+{
+  if (!m_peerVerifyPending || event->type() != WakeupEvent::WakeupPeerVerify) {
+    Socket::wakeup(event);
+    return;
+  }
+  
+  m_peerVerifyPending = false;
+  
+  if (static_cast<PeerVerifyWakeupEvent*>(event)->peerOk) {
+    // Certificate was deemed acceptable, so reconnect and ignore its errors
+    m_acceptedSslErrors << m_pendingSslErrors;
+    m_pendingSslErrors.clear();
+    
+    blockSignals(true);
+    QSslSocket::abort();
+    blockSignals(false);
+    
+    protoConnect(getCurrentUrl());
   } else {
-    // Negotiation has failed, disconnect will ocurr
+    // Negotiation has failed
+    m_pendingSslErrors.clear();
+    
     emitEvent(Event::EventMessage, i18n("SSL negotiation failed. Connection aborted."));
-    resetCommandClass(Failed);
-    protoAbort();
+    emitError(ConnectFailed, i18n("Identity of the peer cannot be established."));
+    protoDisconnect();
   }
 }
 
@@ -526,6 +631,7 @@ void FtpSocket::protoDisconnect()
 void FtpSocket::protoAbort()
 {
   Socket::protoAbort();
+  m_peerVerifyPending = false;
   
   if (getCurrentCommand() != Commands::CmdNone) {
     // Abort current command
@@ -566,7 +672,7 @@ public:
     {
       switch (currentState) {
         case None: {
-          if (socket()->getConfig<bool>("sscn.activated")) {
+          if (socket()->getConfig<bool>(Settings::SscnActivated)) {
             // First disable SSCN
             currentState = SentSscnOff;
             socket()->sendCommand("SSCN OFF");
@@ -575,37 +681,37 @@ public:
         }
         case SentSscnOff: {
           if (currentState == SentSscnOff)
-            socket()->setConfig("sscn.activated", false);
+            socket()->setConfig(Settings::SscnActivated, false);
           
           // Change type
           currentState = SentType;
           socket()->resetTransferStart();
           
           QString type = "TYPE ";
-          type.append(socket()->getConfig<char>("params.data_type", 'I'));
+          type.append(socket()->getConfig<char>(Settings::DataType, 'I'));
           socket()->sendCommand(type);
           break;
         }
         case SentType: {
-          if (socket()->getConfig<bool>("ssl") && socket()->getConfig<int>("ssl.prot_mode") == 1) {
+          if (socket()->getConfig<bool>(Settings::Ssl) && socket()->getConfig<int>(Settings::SslProtMode) == 1) {
             currentState = SentProt;
             
             if (socket()->getPreviousCommand() == Commands::CmdList)
               socket()->sendCommand("PROT P");
             else
               socket()->sendCommand("PROT C"); 
-          } else if (socket()->getConfig<bool>("feat.pret")) {
+          } else if (socket()->getConfig<bool>(Settings::FeatPret)) {
             currentState = SentPret;
-            socket()->sendCommand("PRET " + socket()->getConfig("params.data_command"));
+            socket()->sendCommand("PRET " + socket()->getConfig(Settings::DataCommand));
           } else {
             negotiateDataConnection();
           }
           break;
         }
         case SentProt: {
-          if (socket()->getConfig<bool>("feat.pret")) {
+          if (socket()->getConfig<bool>(Settings::FeatPret)) {
             currentState = SentPret;
-            socket()->sendCommand("PRET " + socket()->getConfig("params.data_command"));
+            socket()->sendCommand("PRET " + socket()->getConfig(Settings::DataCommand));
           } else {
             negotiateDataConnection();
           }
@@ -623,7 +729,7 @@ public:
             return;
           } else if (socket()->isResponse("5")) {
             // PRET is not supported, disable for future use
-            socket()->setConfig("feat.pret", false);
+            socket()->setConfig(Settings::FeatPret, false);
           }
           
           negotiateDataConnection();
@@ -634,18 +740,18 @@ public:
         case NegotiatePasv: negotiatePasv(); break;
         case HaveConnection: {
           // We have the connection
-          if (socket()->getConfig<bool>("params.data_rest_do")) {
+          if (socket()->getConfig<bool>(Settings::DataRestDo)) {
             currentState = SentRest;
-            socket()->sendCommand("REST " + QString::number(socket()->getConfig<filesize_t>("params.data_rest")));
+            socket()->sendCommand("REST " + QString::number(socket()->getConfig<filesize_t>(Settings::DataRest)));
           } else {
             currentState = SentDataCmd;
-            socket()->sendCommand(socket()->getConfig("params.data_command"));
+            socket()->sendCommand(socket()->getConfig(Settings::DataCommand));
           }
           break;
         }
         case SentRest: {
           if (!socket()->isResponse("2") && !socket()->isResponse("3")) {
-            socket()->setConfig("feat.rest", false);
+            socket()->setConfig(Settings::FeatRest, false);
             socket()->getTransferFile()->close();
             
             bool ok;
@@ -665,7 +771,7 @@ public:
           
           // We have sent REST, now send the data command
           currentState = SentDataCmd;
-          socket()->sendCommand(socket()->getConfig("params.data_command"));
+          socket()->sendCommand(socket()->getConfig(Settings::DataCommand));
           break;
         }
         case SentDataCmd: {
@@ -699,9 +805,9 @@ public:
     
     void negotiateDataConnection()
     {
-      if (socket()->getConfig<bool>("feat.epsv")) {
+      if (socket()->getConfig<bool>(Settings::FeatEpsv)) {
         negotiateEpsv();
-      } else if (socket()->getConfig<bool>("feat.pasv")) {
+      } else if (socket()->getConfig<bool>(Settings::FeatPasv)) {
         negotiatePasv();
       } else {
         negotiateActive();
@@ -713,7 +819,7 @@ public:
       if (currentState == NegotiateEpsv) {
         if (!socket()->isResponse("2")) {
           // Negotiation failed
-          socket()->setConfig("feat.epsv", false);
+          socket()->setConfig(Settings::FeatEpsv, false);
           
           // Try the next thing
           negotiateDataConnection();
@@ -728,7 +834,7 @@ public:
       
         if (!port) {
           // Unable to parse, try the next thing
-          socket()->setConfig("feat.epsv", false);
+          socket()->setConfig(Settings::FeatEpsv, false);
           negotiateDataConnection();
           return;
         }
@@ -749,7 +855,7 @@ public:
       if (currentState == NegotiatePasv) {
         if (!socket()->isResponse("2")) {
           // Negotiation failed
-          socket()->setConfig("feat.pasv", false);
+          socket()->setConfig(Settings::FeatPasv, false);
           
           // Try the next thing
           negotiateDataConnection();
@@ -767,7 +873,7 @@ public:
         if (!begin || (sscanf(begin, "(%d,%d,%d,%d,%d,%d)",&ip[0], &ip[1], &ip[2], &ip[3], &ip[4], &ip[5]) != 6 &&
                        sscanf(begin, "=%d,%d,%d,%d,%d,%d",&ip[0], &ip[1], &ip[2], &ip[3], &ip[4], &ip[5]) != 6)) {
           // Unable to parse, try the next thing
-          socket()->setConfig("feat.pasv", false);
+          socket()->setConfig(Settings::FeatPasv, false);
           negotiateDataConnection();
           return;
         }
@@ -782,7 +888,7 @@ public:
         // If the reported IP address is from a private IP range, this might be because the
         // remote server is not properly configured. So we just use the server's real IP instead
         // of the one we got (if the host is really local, then this should work as well).
-        if (!socket()->getConfig<bool>("feat.pret")) {
+        if (!socket()->getConfig<bool>(Settings::FeatPret)) {
           if (host.startsWith("192.168.") || host.startsWith("10.") || host.startsWith("172.16."))
             host = socket()->peerAddress().toString();
         }
@@ -802,8 +908,8 @@ public:
     {
       if (currentState == NegotiateActive) {
         if (!socket()->isResponse("2")) {
-          if (socket()->getConfig<bool>("feat.eprt")) {
-            socket()->setConfig("feat.eprt", false);
+          if (socket()->getConfig<bool>(Settings::FeatEprt)) {
+            socket()->setConfig(Settings::FeatEprt, false);
           } else {
             // Negotiation failed, reset since active is the last fallback
             socket()->resetCommandClass(Failed);
@@ -821,7 +927,7 @@ public:
       
       SocketAddress address = socket()->setupActiveTransferSocket();
       if (!address.ip.isNull()) {
-        if (socket()->getConfig<bool>("feat.eprt")) {
+        if (socket()->getConfig<bool>(Settings::FeatEprt)) {
           int ianaFamily = address.ip.protocol() == QSslSocket::IPv4Protocol ? 1 : 2;
           
           socket()->sendCommand(QString("EPRT |%1|%2|%3").arg(ianaFamily).arg(address.ip.toString()).arg(address.port));
@@ -858,13 +964,12 @@ void FtpSocket::initializeTransferSocket()
   m_transferBufferSize = 4096;
   m_transferBuffer = (char*) malloc(m_transferBufferSize);
   
-  m_speedLastTime = time(0);
-  m_speedLastBytes = 0;
+  m_speedMeter.reset();
   
   // Setup the speed limiter
   switch (getPreviousCommand()) {
-    case Commands::CmdGet: SpeedLimiter::self()->append(this, SpeedLimiter::Download); break;
-    case Commands::CmdPut: SpeedLimiter::self()->append(this, SpeedLimiter::Upload); break;
+    case Commands::CmdGet: setupSpeedLimiter(this, SpeedLimiter::Download); break;
+    case Commands::CmdPut: setupSpeedLimiter(this, SpeedLimiter::Upload); break;
     default: break;
   }
 }
@@ -883,6 +988,7 @@ void FtpSocket::setupPassiveTransferSocket(const QString &host, int port)
     m_transferSocket = new QSslSocket();
     
   initializeTransferSocket();
+  m_dataConnectStart = SpeedMeter::monotonicTime();
   m_transferSocket->connectToHost(realHost, port);
 }
 
@@ -894,6 +1000,7 @@ SocketAddress FtpSocket::setupActiveTransferSocket()
   }
   
   connect(m_serverSocket, SIGNAL(newConnection()), this, SLOT(slotDataAccept()));
+  m_dataConnectStart = SpeedMeter::monotonicTime();
   
   if (KFTPCore::Config::activeForcePort()) {
     // Bind only to ports in a specified portrange
@@ -959,6 +1066,7 @@ void FtpSocket::slotDataAccept()
 {
   m_transferSocket = m_serverSocket->nextPendingConnection();
   initializeTransferSocket();
+  metrics()->histogram(MetricsSite::DataConnect).add(SpeedMeter::monotonicTime() - m_dataConnectStart);
   
   // Socket has been accepted so the server is not needed anymore
   m_serverSocket->deleteLater();
@@ -996,12 +1104,13 @@ void FtpSocket::checkTransferStart()
 {
   if (++m_transferStart >= 2) {
     // Setup SSL data connection
-    if (getConfig<bool>("ssl") && (getConfig<int>("ssl.prot_mode") == 0 ||
-      (getConfig<int>("ssl.prot_mode") == 1 && getToplevelCommand() == Commands::CmdList))) {
+    if (getConfig<bool>(Settings::Ssl) && (getConfig<int>(Settings::SslProtMode) == 0 ||
+      (getConfig<int>(Settings::SslProtMode) == 1 && getToplevelCommand() == Commands::CmdList))) {
       // Connect to notification events and proceed with SSL negotiation
       connect(m_transferSocket, SIGNAL(encrypted()), this, SLOT(slotDataSslNegotiated()));
       
       m_transferSocket->ignoreSslErrors();
+      m_dataTlsStart = SpeedMeter::monotonicTime();
       m_transferSocket->startClientEncryption();
       return;
     }
@@ -1011,9 +1120,54 @@ void FtpSocket::checkTransferStart()
   }
 }
 
+void FtpSocket::speedLimiterWakeup()
+{
+  // We are called from the speed limiter, continue in our own thread
+  m_thread->throttleWakeup();
+}
+
+void FtpSocket::scheduleThrottleWakeup()
+{
+  // Try again once the limiter should have refilled our bucket, unless it
+  // wakes us up sooner
+  if (!m_throttleTimer->isActive())
+    m_throttleTimer->start(SpeedLimiter::self()->wakeupDelay(this));
+}
+
+void FtpSocket::slotThrottleTimeout()
+{
+  throttleWakeup();
+}
+
+void FtpSocket::throttleWakeup()
+{
+  m_throttleTimer->stop();
+  
+  if (!m_transferSocket || m_transferStart < 2)
+    return;
+  
+  switch (getToplevelCommand()) {
+    case Commands::CmdGet: {
+      // Only read when there is something waiting, otherwise the transfer
+      // would be considered complete
+      if (m_transferSocket->bytesAvailable() > 0)
+        slotDataTryRead();
+      break;
+    }
+    case Commands::CmdPut: {
+      // Wait for the data channel to be secured when required
+      if (m_transferSocket->mode() == QSslSocket::UnencryptedMode || m_transferSocket->isEncrypted())
+        slotDataTryWrite();
+      break;
+    }
+    default: break;
+  }
+}
+
 void FtpSocket::slotDataSslNegotiated()
 {
   disconnect(m_transferSocket, SIGNAL(encrypted()), this, SLOT(slotDataSslNegotiated()));
+  metrics()->histogram(MetricsSite::TlsHandshake).add(SpeedMeter::monotonicTime() - m_dataTlsStart);
   emitEvent(Event::EventMessage, i18n("Data channel secured with %1 bit SSL.", m_transferSocket->sessionCipher().usedBits()));
   
   if (getToplevelCommand() == Commands::CmdPut)
@@ -1039,6 +1193,7 @@ void FtpSocket::checkTransferEnd()
 
 void FtpSocket::slotDataConnected()
 {
+  metrics()->histogram(MetricsSite::DataConnect).add(SpeedMeter::monotonicTime() - m_dataConnectStart);
   emitEvent(Event::EventMessage, i18n("Data connection established."));
   
   checkTransferStart();
@@ -1072,13 +1227,16 @@ void FtpSocket::slotDataTryWrite()
   bool updateVariableBuffer = true;
   
   // Enforce speed limits
-  if (allowedBytes() > -1) {
-    m_transferBufferSize = allowedBytes();
+  int allowed = allowedBytes();
+  if (allowed > -1) {
+    m_transferBufferSize = allowed;
     
-    if (m_transferBufferSize > 32768)
+    if (m_transferBufferSize > 32768) {
       m_transferBufferSize = 32768;
-    else if (m_transferBufferSize == 0)
+    } else if (m_transferBufferSize == 0) {
+      scheduleThrottleWakeup();
       return;
+    }
       
     m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
     updateVariableBuffer = false;
@@ -1108,6 +1266,8 @@ void FtpSocket::slotDataTryWrite()
   }
     
   m_transferBytes += size;
+  m_speedMeter.add(size);
+  metrics()->counter(MetricsSite::BytesUploaded).add(size);
   updateUsage(size);
   timeoutPing();
   
@@ -1126,13 +1286,16 @@ void FtpSocket::slotDataTryRead()
   bool updateVariableBuffer = true;
   
   // Enforce speed limits
-  if (allowedBytes() > -1) {
-    m_transferBufferSize = allowedBytes();
+  int allowed = allowedBytes();
+  if (allowed > -1) {
+    m_transferBufferSize = allowed;
     
-    if (m_transferBufferSize > 32768)
+    if (m_transferBufferSize > 32768) {
       m_transferBufferSize = 32768;
-    else if (m_transferBufferSize == 0)
+    } else if (m_transferBufferSize == 0) {
+      scheduleThrottleWakeup();
       return;
+    }
     
     m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
     updateVariableBuffer = false;
@@ -1154,14 +1317,19 @@ void FtpSocket::slotDataTryRead()
   switch (getPreviousCommand()) {
     case Commands::CmdList: {
       // Feed the data to the directory listing parser
-      if (m_directoryParser)
+      if (m_directoryParser) {
+        qint64 start = SpeedMeter::monotonicTime();
         m_directoryParser->addData(m_transferBuffer, size);
+        m_listParseTime += SpeedMeter::monotonicTime() - start;
+      }
       break;
     }
     case Commands::CmdGet: {
       // Write to file
       getTransferFile()->write(m_transferBuffer, size);
       m_transferBytes += size;
+      m_speedMeter.add(size);
+      metrics()->counter(MetricsSite::BytesDownloaded).add(size);
       break;
     }
     default: {
@@ -1195,7 +1363,7 @@ public:
     {
       switch (currentState) {
         case None: {
-          path = socket()->getConfig("params.list.path");
+          path = socket()->getConfig(Settings::ListPath);
           
           if (socket()->isChained())
             socket()->m_lastDirectoryListing = DirectoryListing();
@@ -1229,9 +1397,10 @@ public:
           }
           
           socket()->m_directoryParser = new FtpDirectoryParser(socket());
+          socket()->m_listParseTime = 0;
           
           // Support for faster stat directory listings over the control connection
-          if (socket()->getConfig<bool>("feat.stat")) {
+          if (socket()->getConfig<bool>(Settings::FeatStat)) {
             currentState = SentStat;
             socket()->sendCommand("STAT .");
             return;
@@ -1239,13 +1408,13 @@ public:
           
           // First we have to initialize the data connection, another class will
           // do this for us, so we just add it to the command chain
-          socket()->setConfig("params.data_rest_do", 0);
-          socket()->setConfig("params.data_type", 'A');
+          socket()->setConfig(Settings::DataRestDo, 0);
+          socket()->setConfig(Settings::DataType, 'A');
           
-          if (socket()->getConfig<bool>("feat.mlsd"))
-            socket()->setConfig("params.data_command", "MLSD");
+          if (socket()->getConfig<bool>(Settings::FeatMlsd))
+            socket()->setConfig(Settings::DataCommand, "MLSD");
           else
-            socket()->setConfig("params.data_command", "LIST -a");
+            socket()->setConfig(Settings::DataCommand, "LIST -a");
           
           currentState = WaitList;
           chainCommandClass(FtpCommandNegotiateData);
@@ -1254,15 +1423,15 @@ public:
         case SentStat: {
           if (!socket()->isResponse("2")) {
             // The server doesn't support STAT, disable it and fallback
-            socket()->setConfig("feat.stat", false);
+            socket()->setConfig(Settings::FeatStat, false);
             
-            socket()->setConfig("params.data_rest_do", 0);
-            socket()->setConfig("params.data_type", 'A');
+            socket()->setConfig(Settings::DataRestDo, 0);
+            socket()->setConfig(Settings::DataType, 'A');
             
-            if (socket()->getConfig<bool>("feat.mlsd"))
-              socket()->setConfig("params.data_command", "MLSD");
+            if (socket()->getConfig<bool>(Settings::FeatMlsd))
+              socket()->setConfig(Settings::DataCommand, "MLSD");
             else
-              socket()->setConfig("params.data_command", "LIST -a");
+              socket()->setConfig(Settings::DataCommand, "LIST -a");
             
             currentState = WaitList;
             chainCommandClass(FtpCommandNegotiateData);
@@ -1291,6 +1460,7 @@ public:
           
           // Cache the directory listing
           Cache::self()->addDirectory(socket(), socket()->m_directoryParser->getListing());
+          socket()->metrics()->histogram(MetricsSite::ListParse).add(socket()->m_listParseTime);
           
           delete socket()->m_directoryParser;
           socket()->m_directoryParser = 0;
@@ -1308,11 +1478,217 @@ void FtpSocket::protoList(const KUrl &path)
   emitEvent(Event::EventMessage, i18n("Fetching directory listing..."));
   
   // Set the directory that should be listed
-  setConfig("params.list.path", path.path());
+  setConfig(Settings::ListPath, path.path());
   
   activateCommandClass(FtpCommandList);
 }
 
+// *******************************************************************************************
+// ***************************************** CHECKSUM ****************************************
+// *******************************************************************************************
+
+/**
+ * Selects the preferred checksum algorithm and the command used to request
+ * it from the server.
+ *
+ * @return False if the server supports no usable checksum command
+ */
+static bool checksumAlgorithm(FtpSocket *socket, QString &algorithm, QString &command)
+{
+  QStringList hash = socket->getConfig<QStringList>("feat.hash");
+  
+  foreach (const QString &candidate, Checksum::algorithms()) {
+    if (hash.contains(candidate)) {
+      algorithm = candidate;
+      command = "HASH";
+      return true;
+    }
+  }
+  
+  // Fall back to the older extension commands
+  if (socket->getConfig<bool>("feat.xsha1")) {
+    algorithm = "SHA-1";
+    command = "XSHA1";
+  } else if (socket->getConfig<bool>("feat.xmd5")) {
+    algorithm = "MD5";
+    command = "XMD5";
+  } else if (socket->getConfig<bool>("feat.xcrc")) {
+    algorithm = "CRC32";
+    command = "XCRC";
+  } else {
+    return false;
+  }
+  
+  return true;
+}
+
+class FtpCommandChecksum : public Commands::Base {
+public:
+    enum State {
+      None,
+      SentOpts,
+      SentRange,
+      SentHash,
+      HashingLocal
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandChecksum, FtpSocket, CmdChecksum)
+    
+    KUrl remoteFile;
+    QString localFile;
+    filesize_t offset;
+    filesize_t length;
+    QString algorithm;
+    QString command;
+    QString remoteDigest;
+    Checksum localChecksum;
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          remoteFile.setPath(socket()->getConfig(Settings::ChecksumRemote));
+          localFile = socket()->getConfig(Settings::ChecksumLocal);
+          offset = socket()->getConfig<filesize_t>(Settings::ChecksumOffset);
+          length = socket()->getConfig<filesize_t>(Settings::ChecksumLength);
+          
+          if (!checksumAlgorithm(socket(), algorithm, command)) {
+            finish(ChecksumUnavailable);
+            return;
+          }
+          
+          socket()->setConfig(Settings::ChecksumAlgorithm, algorithm);
+          
+          if (command == "HASH" && socket()->getConfig("feat.hash.current") != algorithm) {
+            // Switch the server to our preferred algorithm first
+            currentState = SentOpts;
+            socket()->sendCommand("OPTS HASH " + algorithm);
+            break;
+          }
+        }
+        case SentOpts: {
+          if (currentState == SentOpts) {
+            if (!socket()->isResponse("2")) {
+              finish(ChecksumUnavailable);
+              return;
+            }
+            
+            socket()->setConfig("feat.hash.current", algorithm);
+          }
+          
+          if (command == "HASH" && length > 0) {
+            // Only a part of the file should be hashed, RANG end offset is inclusive
+            currentState = SentRange;
+            socket()->sendCommand(QString("RANG %1 %2").arg(offset).arg(offset + length - 1));
+            break;
+          }
+        }
+        case SentRange: {
+          if (currentState == SentRange && !socket()->isResponse("350")) {
+            finish(ChecksumUnavailable);
+            return;
+          }
+          
+          currentState = SentHash;
+          
+          if (command != "HASH" && length > 0)
+            socket()->sendCommand(QString("%1 \"%2\" %3 %4").arg(command).arg(remoteFile.path()).arg(offset).arg(offset + length));
+          else
+            socket()->sendCommand(command + " " + remoteFile.path());
+          break;
+        }
+        case SentHash: {
+          if (socket()->isMultiline())
+            return;
+          
+          if (!socket()->isResponse("2")) {
+            if (command != "HASH") {
+              // Don't try the extension command again on this connection
+              socket()->setConfig(QString("feat.%1").arg(command.toLower()), false);
+            }
+            
+            finish(ChecksumUnavailable);
+            return;
+          }
+          
+          remoteDigest = parseDigest(socket()->getResponse().mid(4));
+          if (remoteDigest.isEmpty() || !localChecksum.open(localFile, algorithm, offset, length)) {
+            finish(ChecksumUnavailable);
+            return;
+          }
+          
+          currentState = HashingLocal;
+          socket()->nextCommandAsync();
+          break;
+        }
+        case HashingLocal: {
+          // Hash one chunk per event loop pass, so other connections served by
+          // this thread don't stall while a large file is being verified
+          if (!localChecksum.update()) {
+            socket()->nextCommandAsync();
+            return;
+          }
+          
+          QString localDigest = localChecksum.result();
+          if (localDigest.isEmpty()) {
+            finish(ChecksumUnavailable);
+            return;
+          }
+          
+          finish(Checksum::equal(algorithm, localDigest, remoteDigest) ? ChecksumMatch : ChecksumMismatch);
+          break;
+        }
+      }
+    }
+    
+    QString parseDigest(const QString &response)
+    {
+      QStringList tokens = response.trimmed().split(' ', QString::SkipEmptyParts);
+      
+      if (command == "HASH") {
+        // 213 <algorithm> <range> <digest> <filename>
+        return tokens.value(2);
+      }
+      
+      // Extension commands differ between servers, so take the first token
+      // that looks like a digest of the requested algorithm
+      int maxLength = algorithm == "CRC32" ? 8 : (algorithm == "MD5" ? 32 : 40);
+      QRegExp digest(QString("[0-9a-fA-F]{1,%1}").arg(maxLength));
+      
+      foreach (QString token, tokens) {
+        if (algorithm != "CRC32" && token.length() != maxLength)
+          continue;
+        
+        if (digest.exactMatch(token))
+          return token;
+      }
+      
+      return QString();
+    }
+    
+    void finish(ChecksumStatus status)
+    {
+      socket()->setReturnValue((int) status);
+      
+      if (!socket()->isChained())
+        socket()->emitEvent(Event::EventChecksum, QVariant((int) status));
+      
+      socket()->resetCommandClass();
+    }
+};
+
+void FtpSocket::protoChecksum(const KUrl &remote, const KUrl &local, filesize_t offset, filesize_t length)
+{
+  emitEvent(Event::EventState, i18n("Verifying..."));
+  
+  setConfig(Settings::ChecksumRemote, remote.path());
+  setConfig(Settings::ChecksumLocal, local.path());
+  setConfig(Settings::ChecksumOffset, offset);
+  setConfig(Settings::ChecksumLength, length);
+  
+  activateCommandClass(FtpCommandChecksum);
+}
+
 // *******************************************************************************************
 // ******************************************* GET *******************************************
 // *******************************************************************************************
@@ -1324,8 +1700,10 @@ public:
       SentCwd,
       SentMdtm,
       StatDone,
+      VerifiedExisting,
       DestChecked,
-      WaitTransfer
+      WaitTransfer,
+      Verified
     };
     
     ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandGet, FtpSocket, CmdGet)
@@ -1333,14 +1711,16 @@ public:
     KUrl sourceFile;
     KUrl destinationFile;
     time_t modificationTime;
+    filesize_t resumeOffset;
     
     void process()
     {
       switch (currentState) {
         case None: {
           modificationTime = 0;
-          sourceFile.setPath(socket()->getConfig("params.get.source"));
-          destinationFile.setPath(socket()->getConfig("params.get.destination"));
+          resumeOffset = 0;
+          sourceFile.setPath(socket()->getConfig(Settings::GetSource));
+          destinationFile.setPath(socket()->getConfig(Settings::GetDestination));
           
           // Attempt to CWD to the parent directory
           currentState = SentCwd;
@@ -1349,7 +1729,7 @@ public:
         }
         case SentCwd: {
           // Send MDTM
-          if (socket()->getConfig<bool>("feat.mdtm")) {
+          if (socket()->getConfig<bool>(Settings::FeatMdtm)) {
             currentState = SentMdtm;
             socket()->sendCommand("MDTM " + sourceFile.path());
             break;
@@ -1362,7 +1742,7 @@ public:
             if (socket()->isResponse("550")) {
               // The file probably doesn't exist, just ignore it
             } else if (!socket()->isResponse("213")) {
-              socket()->setConfig("feat.mdtm", false);
+              socket()->setConfig(Settings::FeatMdtm, false);
             } else {
               // Parse MDTM response
               struct tm dt = {0,0,0,0,0,0,0,0,0,0,0};
@@ -1392,6 +1772,27 @@ public:
         }
         case StatDone: {
           if (currentState == StatDone) {
+            DirectoryEntry entry = socket()->getStatResponse();
+            
+            if ((KFTPCore::Config::checksumSkipIdentical() || socket()->getConfig<bool>("transfer.checksum_skip")) && !entry.filename().isEmpty() &&
+                entry.size() == (filesize_t) QFileInfo(destinationFile.path()).size()) {
+              // Sizes are equal, compare checksums before asking what to do
+              currentState = VerifiedExisting;
+              socket()->protoChecksum(sourceFile, destinationFile);
+              return;
+            }
+          }
+        }
+        case VerifiedExisting: {
+          if (currentState == StatDone || currentState == VerifiedExisting) {
+            if (currentState == VerifiedExisting && socket()->returnValue<int>() == ChecksumMatch) {
+              // Files are identical, there is nothing to transfer
+              socket()->emitEvent(Event::EventMessage, i18n("File '%1' is identical, skipping.", sourceFile.fileName()));
+              socket()->emitEvent(Event::EventTransferComplete);
+              socket()->resetCommandClass();
+              return;
+            }
+            
             DirectoryListing list;
             list.addEntry(socket()->getStatResponse());
             
@@ -1401,13 +1802,13 @@ public:
           }
         }
         case DestChecked: {
-          socket()->setConfig("params.data_rest_do", 0);
+          socket()->setConfig(Settings::DataRestDo, 0);
           
           if (isWakeup()) {
             // We have been waken up because a decision has been made
             FileExistsWakeupEvent *event = static_cast<FileExistsWakeupEvent*>(m_wakeupEvent);
             
-            if (!socket()->getConfig<bool>("feat.rest") && event->action == FileExistsWakeupEvent::Resume)
+            if (!socket()->getConfig<bool>(Settings::FeatRest) && event->action == FileExistsWakeupEvent::Resume)
               event->action = FileExistsWakeupEvent::Overwrite;
             
             switch (event->action) {
@@ -1419,9 +1820,9 @@ public:
                 socket()->getTransferFile()->setFileName(destinationFile.path());
                 socket()->getTransferFile()->open(QIODevice::WriteOnly | QIODevice::Truncate);
                 
-                if (socket()->getConfig<bool>("feat.rest")) {
-                  socket()->setConfig("params.data_rest_do", true);
-                  socket()->setConfig("params.data_rest", 0);
+                if (socket()->getConfig<bool>(Settings::FeatRest)) {
+                  socket()->setConfig(Settings::DataRestDo, true);
+                  socket()->setConfig(Settings::DataRest, 0);
                 }
                 break;
               }
@@ -1432,8 +1833,9 @@ public:
                 // Signal resume
                 socket()->emitEvent(Event::EventResumeOffset, socket()->getTransferFile()->size());
                 
-                socket()->setConfig("params.data_rest_do", true);
-                socket()->setConfig("params.data_rest", (filesize_t) socket()->getTransferFile()->size());
+                resumeOffset = socket()->getTransferFile()->size();
+                socket()->setConfig(Settings::DataRestDo, true);
+                socket()->setConfig(Settings::DataRest, resumeOffset);
                 break;
               }
               case FileExistsWakeupEvent::Skip: {
@@ -1458,8 +1860,8 @@ public:
           
           // First we have to initialize the data connection, another class will
           // do this for us, so we just add it to the command chain
-          socket()->setConfig("params.data_type", KFTPCore::Config::self()->ftpMode(sourceFile.path()));
-          socket()->setConfig("params.data_command", "RETR " + sourceFile.fileName());
+          socket()->setConfig(Settings::DataType, KFTPCore::Config::self()->ftpMode(sourceFile.path()));
+          socket()->setConfig(Settings::DataCommand, "RETR " + sourceFile.fileName());
           
           currentState = WaitTransfer;
           chainCommandClass(FtpCommandNegotiateData);
@@ -1477,6 +1879,36 @@ public:
             utime(destinationFile.path().toAscii(), &tmp);
           }
           
+          if (KFTPCore::Config::checksumVerify()) {
+            // Verify the transferred part of the file, resumed transfers only
+            // need the appended range to be compared
+            filesize_t size = QFileInfo(destinationFile.path()).size();
+            
+            socket()->emitEvent(Event::EventChecksum, QVariant((int) ChecksumVerifying));
+            currentState = Verified;
+            socket()->protoChecksum(sourceFile, destinationFile, resumeOffset, resumeOffset > 0 ? size - resumeOffset : 0);
+            return;
+          }
+        }
+        case Verified: {
+          if (currentState == Verified) {
+            switch (socket()->returnValue<int>()) {
+              case ChecksumMismatch: {
+                socket()->emitError(VerifyFailed);
+                socket()->resetCommandClass(Failed);
+                return;
+              }
+              case ChecksumMatch: {
+                socket()->emitEvent(Event::EventMessage, i18n("Checksum of file '%1' verified.", sourceFile.fileName()));
+                break;
+              }
+              default: {
+                socket()->emitEvent(Event::EventMessage, i18n("Checksum of file '%1' could not be verified.", sourceFile.fileName()));
+                break;
+              }
+            }
+          }
+          
           socket()->emitEvent(Event::EventTransferComplete);
           socket()->emitEvent(Event::EventReloadNeeded);
           socket()->resetCommandClass();
@@ -1492,8 +1924,8 @@ void FtpSocket::protoGet(const KUrl &source, const KUrl &destination)
   emitEvent(Event::EventMessage, i18n("Downloading file '%1'...",source.fileName()));
   
   // Set the source and destination
-  setConfig("params.get.source", source.path());
-  setConfig("params.get.destination", destination.path());
+  setConfig(Settings::GetSource, source.path());
+  setConfig(Settings::GetDestination, destination.path());
   
   activateCommandClass(FtpCommandGet);
 }
@@ -1526,7 +1958,7 @@ public:
       switch (currentState) {
         case None: {
           socket()->setReturnValue(true);
-          targetDirectory = socket()->getConfig("params.cwd.path");
+          targetDirectory = socket()->getConfig(Settings::CwdPath);
           
           // If we are already there, no need to CWD
           if (socket()->getCurrentDirectory() == targetDirectory) {
@@ -1547,7 +1979,7 @@ public:
           currentState = SentCwd;
           currentPart = 0;
           numParts = targetDirectory.count('/');
-          shouldCreate = socket()->getConfig<bool>("params.cwd.create");
+          shouldCreate = socket()->getConfig<bool>(Settings::CwdCreate);
           
           socket()->sendCommand("CWD " + targetDirectory);
           break;
@@ -1635,8 +2067,8 @@ public:
 void FtpSocket::changeWorkingDirectory(const QString &path, bool shouldCreate)
 {
   // Set the path to cwd to
-  setConfig("params.cwd.path", path);
-  setConfig("params.cwd.create", shouldCreate);
+  setConfig(Settings::CwdPath, path);
+  setConfig(Settings::CwdCreate, shouldCreate);
   
   activateCommandClass(FtpCommandCwd);
 }
@@ -1652,8 +2084,10 @@ public:
       WaitCwd,
       SentSize,
       StatDone,
+      VerifiedExisting,
       DestChecked,
-      WaitTransfer
+      WaitTransfer,
+      Verified
     };
     
     ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandPut, FtpSocket, CmdPut)
@@ -1663,6 +2097,7 @@ public:
     
     bool fetchedSize;
     filesize_t destinationSize;
+    filesize_t resumeOffset;
     
     void cleanup()
     {
@@ -1674,9 +2109,10 @@ public:
     {
       switch (currentState) {
         case None: {
-          sourceFile.setPath(socket()->getConfig("params.get.source"));
-          destinationFile.setPath(socket()->getConfig("params.get.destination"));
+          sourceFile.setPath(socket()->getConfig(Settings::GetSource));
+          destinationFile.setPath(socket()->getConfig(Settings::GetDestination));
           fetchedSize = false;
+          resumeOffset = 0;
           
           // Check if the local file exists
           if (!QDir::root().exists(sourceFile.path())) {
@@ -1693,7 +2129,7 @@ public:
         }
         case WaitCwd: {
           // Check if the remote file exists
-          if (socket()->getConfig<bool>("feat.size")) {
+          if (socket()->getConfig<bool>(Settings::FeatSize)) {
             currentState = SentSize;
             socket()->sendCommand("SIZE " + destinationFile.path());
           } else {
@@ -1713,7 +2149,7 @@ public:
             socket()->protoStat(destinationFile);
           } else if (socket()->isResponse("500") || socket()->getResponse().contains("Operation not permitted")) {
             // Yes, some servers don't support the SIZE command :/
-            socket()->setConfig("feat.size", false);
+            socket()->setConfig(Settings::FeatSize, false);
             
             currentState = StatDone;
             socket()->protoStat(destinationFile);
@@ -1736,25 +2172,29 @@ public:
               }
             }
             
-            // Remote file exists, emit a request for action
-            DirectoryListing list;
-            list.addEntry(socket()->getStatResponse());
+            if ((KFTPCore::Config::checksumSkipIdentical() || socket()->getConfig<bool>("transfer.checksum_skip")) &&
+                socket()->getStatResponse().size() == (filesize_t) QFileInfo(sourceFile.path()).size()) {
+              // Sizes are equal, compare checksums before asking what to do
+              currentState = VerifiedExisting;
+              socket()->protoChecksum(destinationFile, sourceFile);
+              return;
+            }
             
-            currentState = DestChecked;
-            socket()->emitEvent(Event::EventFileExists, list);
+            // Remote file exists, emit a request for action
+            requestAction();
             return;
           }
           
           // Don't break here
         }
         case DestChecked: {
-          socket()->setConfig("params.data_rest_do", 0);
+          socket()->setConfig(Settings::DataRestDo, 0);
           
           if (isWakeup()) {
             // We have been waken up because a decision has been made
             FileExistsWakeupEvent *event = static_cast<FileExistsWakeupEvent*>(m_wakeupEvent);
             
-            if (!socket()->getConfig<bool>("feat.rest") && event->action == FileExistsWakeupEvent::Resume)
+            if (!socket()->getConfig<bool>(Settings::FeatRest) && event->action == FileExistsWakeupEvent::Resume)
               event->action = FileExistsWakeupEvent::Overwrite;
             
             switch (event->action) {
@@ -1766,9 +2206,9 @@ public:
                 socket()->getTransferFile()->setFileName(sourceFile.path());
                 socket()->getTransferFile()->open(QIODevice::ReadOnly);
                 
-                if (socket()->getConfig<bool>("feat.rest")) {
-                  socket()->setConfig("params.data_rest_do", true);
-                  socket()->setConfig("params.data_rest", 0);
+                if (socket()->getConfig<bool>(Settings::FeatRest)) {
+                  socket()->setConfig(Settings::DataRestDo, true);
+                  socket()->setConfig(Settings::DataRest, 0);
                 }
                 break;
               }
@@ -1780,8 +2220,9 @@ public:
                 // Signal resume
                 socket()->emitEvent(Event::EventResumeOffset, socket()->getStatResponse().size());
                 
-                socket()->setConfig("params.data_rest_do", true);
-                socket()->setConfig("params.data_rest", (filesize_t) socket()->getStatResponse().size());
+                socket()->setConfig(Settings::DataRestDo, true);
+                resumeOffset = socket()->getStatResponse().size();
+                socket()->setConfig(Settings::DataRest, resumeOffset);
                 break;
               }
               case FileExistsWakeupEvent::Skip: {
@@ -1808,8 +2249,8 @@ public:
           
           // First we have to initialize the data connection, another class will
           // do this for us, so we just add it to the command chain
-          socket()->setConfig("params.data_type", KFTPCore::Config::self()->ftpMode(destinationFile.path()));
-          socket()->setConfig("params.data_command", "STOR " + destinationFile.fileName());
+          socket()->setConfig(Settings::DataType, KFTPCore::Config::self()->ftpMode(destinationFile.path()));
+          socket()->setConfig(Settings::DataCommand, "STOR " + destinationFile.fileName());
           
           currentState = WaitTransfer;
           chainCommandClass(FtpCommandNegotiateData);
@@ -1821,13 +2262,66 @@ public:
           socket()->getTransferFile()->close();
           markClean();
           
+          if (KFTPCore::Config::checksumVerify()) {
+            // Verify the transferred part of the file, resumed transfers only
+            // need the appended range to be compared
+            filesize_t size = QFileInfo(sourceFile.path()).size();
+            
+            socket()->emitEvent(Event::EventChecksum, QVariant((int) ChecksumVerifying));
+            currentState = Verified;
+            socket()->protoChecksum(destinationFile, sourceFile, resumeOffset, resumeOffset > 0 ? size - resumeOffset : 0);
+            return;
+          }
+        }
+        case Verified: {
+          if (currentState == Verified) {
+            switch (socket()->returnValue<int>()) {
+              case ChecksumMismatch: {
+                socket()->emitError(VerifyFailed);
+                socket()->resetCommandClass(Failed);
+                return;
+              }
+              case ChecksumMatch: {
+                socket()->emitEvent(Event::EventMessage, i18n("Checksum of file '%1' verified.", sourceFile.fileName()));
+                break;
+              }
+              default: {
+                socket()->emitEvent(Event::EventMessage, i18n("Checksum of file '%1' could not be verified.", sourceFile.fileName()));
+                break;
+              }
+            }
+          }
+          
           socket()->emitEvent(Event::EventTransferComplete);
           socket()->emitEvent(Event::EventReloadNeeded);
           socket()->resetCommandClass();
           break;
         }
+        case VerifiedExisting: {
+          if (socket()->returnValue<int>() == ChecksumMatch) {
+            // Files are identical, there is nothing to transfer
+            markClean();
+            
+            socket()->emitEvent(Event::EventMessage, i18n("File '%1' is identical, skipping.", sourceFile.fileName()));
+            socket()->emitEvent(Event::EventTransferComplete);
+            socket()->resetCommandClass();
+            return;
+          }
+          
+          requestAction();
+          break;
+        }
       }
     }
+    
+    void requestAction()
+    {
+      DirectoryListing list;
+      list.addEntry(socket()->getStatResponse());
+      
+      currentState = DestChecked;
+      socket()->emitEvent(Event::EventFileExists, list);
+    }
 };
 
 void FtpSocket::protoPut(const KUrl &source, const KUrl &destination)
@@ -1836,8 +2330,8 @@ void FtpSocket::protoPut(const KUrl &source, const KUrl &destination)
   emitEvent(Event::EventMessage, i18n("Uploading file '%1'...",source.fileName()));
   
   // Set the source and destination
-  setConfig("params.get.source", source.path());
-  setConfig("params.get.destination", destination.path());
+  setConfig(Settings::GetSource, source.path());
+  setConfig(Settings::GetDestination, destination.path());
   
   activateCommandClass(FtpCommandPut);
 }
@@ -1863,12 +2357,12 @@ public:
     {
       switch (currentState) {
         case None: {
-          destinationPath = socket()->getConfig("params.remove.path");
-          parentDirectory = socket()->getConfig("params.remove.parent");
+          destinationPath = socket()->getConfig(Settings::RemovePath);
+          parentDirectory = socket()->getConfig(Settings::RemoveParent);
           
           currentState = SentRemove;
           
-          if (socket()->getConfig<bool>("params.remove.directory")) {
+          if (socket()->getConfig<bool>(Settings::RemoveDirectory)) {
             if (socket()->getCurrentDirectory() != parentDirectory) {
               // We should change working directory to parent directory before removing
               currentState = SentCwd;
@@ -1920,12 +2414,136 @@ void FtpSocket::protoRemove(const KUrl &path)
   emitEvent(Event::EventState, i18n("Removing..."));
   
   // Set the file to remove
-  setConfig("params.remove.parent", path.directory());
-  setConfig("params.remove.path", path.path());
+  setConfig(Settings::RemoveParent, path.directory());
+  setConfig(Settings::RemovePath, path.path());
   
   activateCommandClass(FtpCommandRemove);
 }
 
+/**
+ * A bounded window of per-file requests in a single directory. Batch commands
+ * use it to pipeline one request per file while keeping at most pipeline.depth
+ * of them in flight.
+ */
+class FtpFilePipeline {
+public:
+    enum Status {
+      Waiting,
+      Done,
+      Error
+    };
+    
+    void start(const QString &parent, const QStringList &list, const QString &command)
+    {
+      parentDirectory = parent;
+      files = list;
+      prefix = command;
+      nextFile = 0;
+      pending = 0;
+      failed = false;
+      
+      if (parentDirectory.endsWith('/'))
+        parentDirectory.chop(1);
+    }
+    
+    bool isEmpty() const { return files.isEmpty(); }
+    
+    void sendPending(FtpSocket *socket)
+    {
+      int depth = qMax(1, socket->getConfig<int>(Settings::PipelineDepth, 1));
+      
+      while (!failed && nextFile < files.count() && pending < depth) {
+        socket->sendCommand(prefix + parentDirectory + "/" + files.at(nextFile++));
+        pending++;
+      }
+    }
+    
+    Status processResponse(FtpSocket *socket)
+    {
+      if (socket->isMultiline())
+        return Waiting;
+      
+      pending--;
+      
+      if (!socket->isResponse("2")) {
+        // Stop issuing new requests, but we have to wait for the ones that
+        // are already in flight
+        failed = true;
+      }
+      
+      if (!failed && nextFile < files.count()) {
+        sendPending(socket);
+        return Waiting;
+      }
+      
+      if (pending > 0)
+        return Waiting;
+      
+      // The listing of the parent directory is stale now, invalidate it once
+      // for the whole batch instead of once per file
+      Cache::self()->invalidateEntry(socket, parentDirectory);
+      return failed ? Error : Done;
+    }
+private:
+    QString parentDirectory;
+    QStringList files;
+    QString prefix;
+    int nextFile;
+    int pending;
+    bool failed;
+};
+
+class FtpCommandRemoveMultiple : public Commands::Base {
+public:
+    enum State {
+      None,
+      SentRemove
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandRemoveMultiple, FtpSocket, CmdNone)
+    
+    FtpFilePipeline pipeline;
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          pipeline.start(socket()->getConfig(Settings::RemoveParent),
+                         socket()->getConfig<QStringList>(Settings::RemoveFiles),
+                         "DELE ");
+          
+          if (pipeline.isEmpty()) {
+            socket()->resetCommandClass();
+            return;
+          }
+          
+          currentState = SentRemove;
+          pipeline.sendPending(socket());
+          break;
+        }
+        case SentRemove: {
+          switch (pipeline.processResponse(socket())) {
+            case FtpFilePipeline::Waiting: break;
+            case FtpFilePipeline::Done: socket()->resetCommandClass(); break;
+            case FtpFilePipeline::Error: socket()->resetCommandClass(Failed); break;
+          }
+          break;
+        }
+      }
+    }
+};
+
+void FtpSocket::protoRemoveMultiple(const KUrl &parent, const QStringList &files)
+{
+  emitEvent(Event::EventState, i18n("Removing..."));
+  
+  // Set the files to remove
+  setConfig(Settings::RemoveParent, parent.path());
+  setConfig(Settings::RemoveFiles, files);
+  
+  activateCommandClass(FtpCommandRemoveMultiple);
+}
+
 // *******************************************************************************************
 // **************************************** RENAME *******************************************
 // *******************************************************************************************
@@ -1947,8 +2565,8 @@ public:
     {
       switch (currentState) {
         case None: {
-          sourcePath = socket()->getConfig("params.rename.source");
-          destinationPath = socket()->getConfig("params.rename.destination");
+          sourcePath = socket()->getConfig(Settings::RenameSource);
+          destinationPath = socket()->getConfig(Settings::RenameDestination);
           
           currentState = SentRnfr;
           socket()->sendCommand("RNFR " + sourcePath);
@@ -1986,8 +2604,8 @@ void FtpSocket::protoRename(const KUrl &source, const KUrl &destination)
   emitEvent(Event::EventState, i18n("Renaming..."));
   
   // Set rename options
-  setConfig("params.rename.source", source.path());
-  setConfig("params.rename.destination", destination.path());
+  setConfig(Settings::RenameSource, source.path());
+  setConfig(Settings::RenameDestination, destination.path());
   
   activateCommandClass(FtpCommandRename);
 }
@@ -2012,8 +2630,8 @@ public:
           currentState = SentChmod;
           
           QString chmod;
-          chmod.sprintf("SITE CHMOD %.3d %s", socket()->getConfig<int>("params.chmod.mode", 0644),
-                                              socket()->getConfig("params.chmod.path").toAscii().data());
+          chmod.sprintf("SITE CHMOD %.3d %s", socket()->getConfig<int>(Settings::ChmodMode, 0644),
+                                              socket()->getConfig(Settings::ChmodPath).toAscii().data());
           socket()->sendCommand(chmod);
           break;
         }
@@ -2022,7 +2640,7 @@ public:
             socket()->resetCommandClass(Failed);
           else {
             // Invalidate cached parent entry (if any)
-            Cache::self()->invalidateEntry(socket(), KUrl(socket()->getConfig("params.chmod.path")).directory());
+            Cache::self()->invalidateEntry(socket(), KUrl(socket()->getConfig(Settings::ChmodPath)).directory());
             
             socket()->emitEvent(Event::EventReloadNeeded);
             socket()->resetCommandClass();
@@ -2038,12 +2656,67 @@ void FtpSocket::protoChmodSingle(const KUrl &path, int mode)
   emitEvent(Event::EventState, i18n("Changing mode..."));
   
   // Set chmod options
-  setConfig("params.chmod.path", path.path());
-  setConfig("params.chmod.mode", mode);
+  setConfig(Settings::ChmodPath, path.path());
+  setConfig(Settings::ChmodMode, mode);
   
   activateCommandClass(FtpCommandChmod);
 }
 
+class FtpCommandChmodMultiple : public Commands::Base {
+public:
+    enum State {
+      None,
+      SentChmod
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandChmodMultiple, FtpSocket, CmdNone)
+    
+    FtpFilePipeline pipeline;
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          QString chmod;
+          chmod.sprintf("SITE CHMOD %.3d ", socket()->getConfig<int>(Settings::ChmodMode, 0644));
+          
+          pipeline.start(socket()->getConfig(Settings::ChmodParent),
+                         socket()->getConfig<QStringList>(Settings::ChmodFiles),
+                         chmod);
+          
+          if (pipeline.isEmpty()) {
+            socket()->resetCommandClass();
+            return;
+          }
+          
+          currentState = SentChmod;
+          pipeline.sendPending(socket());
+          break;
+        }
+        case SentChmod: {
+          switch (pipeline.processResponse(socket())) {
+            case FtpFilePipeline::Waiting: break;
+            case FtpFilePipeline::Done: socket()->resetCommandClass(); break;
+            case FtpFilePipeline::Error: socket()->resetCommandClass(Failed); break;
+          }
+          break;
+        }
+      }
+    }
+};
+
+void FtpSocket::protoChmodMultiple(const KUrl &parent, const QStringList &files, int mode)
+{
+  emitEvent(Event::EventState, i18n("Changing mode..."));
+  
+  // Set chmod options
+  setConfig(Settings::ChmodParent, parent.path());
+  setConfig(Settings::ChmodFiles, files);
+  setConfig(Settings::ChmodMode, mode);
+  
+  activateCommandClass(FtpCommandChmodMultiple);
+}
+
 // *******************************************************************************************
 // **************************************** MKDIR ********************************************
 // *******************************************************************************************
@@ -2062,7 +2735,7 @@ public:
       switch (currentState) {
         case None: {
           currentState = SentMkdir;
-          socket()->changeWorkingDirectory(socket()->getConfig("params.mkdir.path"), true);
+          socket()->changeWorkingDirectory(socket()->getConfig(Settings::MkdirPath), true);
           break;
         }
         case SentMkdir: {
@@ -2081,7 +2754,7 @@ void FtpSocket::protoMkdir(const KUrl &path)
 {
   emitEvent(Event::EventState, i18n("Making directory..."));
   
-  setConfig("params.mkdir.path", path.path());
+  setConfig(Settings::MkdirPath, path.path());
   activateCommandClass(FtpCommandMkdir);
 }
 
@@ -2105,7 +2778,7 @@ public:
       switch (currentState) {
         case None: {
           currentState = SentRaw;
-          socket()->sendCommand(socket()->getConfig("params.raw.command"));
+          socket()->sendCommand(socket()->getConfig(Settings::RawCommand));
           break;
         }
         case SentRaw: {
@@ -2123,7 +2796,7 @@ public:
 
 void FtpSocket::protoRaw(const QString &raw)
 {
-  setConfig("params.raw.command", raw);
+  setConfig(Settings::RawCommand, raw);
   activateCommandClass(FtpCommandRaw);
 }
 
@@ -2191,13 +2864,13 @@ public:
     void cleanup()
     {
       // We have been interrupted, so we have to abort the companion as well
-      if (!socket()->getConfig<bool>("params.fxp.abort")) {
-        companion->setConfig("params.fxp.abort", true);
+      if (!socket()->getConfig<bool>(Settings::FxpAbort)) {
+        companion->setConfig(Settings::FxpAbort, true);
         companion->protoAbort();
       }
       
       // Unclean upload termination, be sure to erase the cached stat infos
-      if (!socket()->getConfig<bool>("params.fxp.keep_cache"))
+      if (!socket()->getConfig<bool>(Settings::FxpKeepCache))
         Cache::self()->invalidateEntry(socket(), destinationFile.directory());
     }
     
@@ -2205,20 +2878,20 @@ public:
     {
       switch (currentState) {
         case None: {
-          sourceFile.setPath(socket()->getConfig("params.fxp.source"));
-          destinationFile.setPath(socket()->getConfig("params.fxp.destination"));
-          socket()->setConfig("params.fxp.keep_cache", false);
+          sourceFile.setPath(socket()->getConfig(Settings::FxpSource));
+          destinationFile.setPath(socket()->getConfig(Settings::FxpDestination));
+          socket()->setConfig(Settings::FxpKeepCache, false);
           
           // Who are we ? Where shall we begin ?
-          if (socket()->getConfig<bool>("params.fxp.companion")) {
+          if (socket()->getConfig<bool>(Settings::FxpCompanion)) {
             // We are the companion, so we should check the destination
-            socket()->setConfig("params.fxp.companion", false);
+            socket()->setConfig(Settings::FxpCompanion, false);
             
             currentState = DestSentStat;
             socket()->protoStat(destinationFile);
             return;
           } else {
-            socket()->setConfig("params.transfer.mode", TransferPASV);
+            socket()->setConfig(Settings::TransferMode, TransferPASV);
             
             if (socket()->getCurrentDirectory() != sourceFile.directory()) {
               // Attempt to CWD to the parent directory
@@ -2257,7 +2930,7 @@ public:
             socket()->resetCommandClass(Failed);
           } else {
             // File exists, invoke the companion
-            companion->setConfig("params.fxp.companion", true);
+            companion->setConfig(Settings::FxpCompanion, true);
             companion->Socket::thread()->siteToSite(socket()->Socket::thread(), sourceFile, destinationFile);
             currentState = SourceDestVerified;
           }
@@ -2268,7 +2941,7 @@ public:
             // We have been waken up because a decision has been made
             FileExistsWakeupEvent *event = static_cast<FileExistsWakeupEvent*>(m_wakeupEvent);
             
-            if (!socket()->getConfig<bool>("feat.rest") && event->action == FileExistsWakeupEvent::Resume)
+            if (!socket()->getConfig<bool>(Settings::FeatRest) && event->action == FileExistsWakeupEvent::Resume)
               event->action = FileExistsWakeupEvent::Overwrite;
             
             switch (event->action) {
@@ -2277,19 +2950,19 @@ public:
                 destinationFile.setPath(event->newFileName);
               }
               case FileExistsWakeupEvent::Overwrite: {
-                companion->setConfig("params.fxp.rest", 0);
+                companion->setConfig(Settings::FxpRest, 0);
                 resumeOffset = 0;
                 break;
               }
               case FileExistsWakeupEvent::Resume: {
-                companion->setConfig("params.fxp.rest", companion->getStatResponse().size());
+                companion->setConfig(Settings::FxpRest, companion->getStatResponse().size());
                 resumeOffset = companion->getStatResponse().size();
                 break;
               }
               case FileExistsWakeupEvent::Skip: {
                 // Transfer should be aborted
-                companion->setConfig("params.fxp.keep_cache", true);
-                socket()->setConfig("params.fxp.keep_cache", true);
+                companion->setConfig(Settings::FxpKeepCache, true);
+                socket()->setConfig(Settings::FxpKeepCache, true);
                 
                 socket()->resetCommandClass(UserAbort);
                 socket()->emitEvent(Event::EventTransferComplete);
@@ -2297,7 +2970,7 @@ public:
               }
             }
           } else {
-            companion->setConfig("params.fxp.rest", 0);
+            companion->setConfig(Settings::FxpRest, 0);
             resumeOffset = 0;
           }
           
@@ -2310,23 +2983,23 @@ public:
           break;
         }
         case SourceSentType: {
-          if (socket()->getConfig<bool>("ssl") && socket()->getConfig<int>("ssl.prot_mode") != 2 && !socket()->getConfig<bool>("sscn.activated")) {
-            if (socket()->getConfig<int>("ssl.prot_mode") == 0) {
-              if (socket()->getConfig<bool>("feat.sscn")) {
+          if (socket()->getConfig<bool>(Settings::Ssl) && socket()->getConfig<int>(Settings::SslProtMode) != 2 && !socket()->getConfig<bool>(Settings::SscnActivated)) {
+            if (socket()->getConfig<int>(Settings::SslProtMode) == 0) {
+              if (socket()->getConfig<bool>(Settings::FeatSscn)) {
                 // We support SSCN
                 currentState = SourceSentSscn;
                 socket()->sendCommand("SSCN ON");
-                companion->setConfig("params.ssl.mode", ProtPrivate);
-              } else if (companion->getConfig<bool>("feat.sscn")) {
+                companion->setConfig(Settings::SslMode, ProtPrivate);
+              } else if (companion->getConfig<bool>(Settings::FeatSscn)) {
                 // Companion supports SSCN
                 currentState = SourceWaitType;
-                companion->setConfig("params.ssl.mode", ProtSSCN);
+                companion->setConfig(Settings::SslMode, ProtSSCN);
                 companion->nextCommandAsync();
-              } else if (socket()->getConfig<bool>("feat.cpsv")) {
+              } else if (socket()->getConfig<bool>(Settings::FeatCpsv)) {
                 // We support CPSV
                 currentState = SourceWaitType;
-                socket()->setConfig("params.transfer.mode", TransferCPSV);
-                companion->setConfig("params.ssl.mode", ProtPrivate);
+                socket()->setConfig(Settings::TransferMode, TransferCPSV);
+                companion->setConfig(Settings::SslMode, ProtPrivate);
                 companion->nextCommandAsync();
               } else {
                 // Neither support SSCN, can't do SSL transfer
@@ -2337,7 +3010,7 @@ public:
             } else {
               currentState = SourceSentProt;
               socket()->sendCommand("PROT C");
-              companion->setConfig("params.ssl.mode", ProtClear);
+              companion->setConfig(Settings::SslMode, ProtClear);
             }
           } else {
             currentState = SourceWaitType;
@@ -2349,8 +3022,8 @@ public:
           if (!socket()->isResponse("2")) {
             socket()->resetCommandClass(Failed);
           } else {
-            socket()->setConfig("sscn.activated", true);
-            socket()->setConfig("params.fxp.changed_prot", 0);
+            socket()->setConfig(Settings::SscnActivated, true);
+            socket()->setConfig(Settings::FxpChangedProt, 0);
             
             currentState = SourceWaitType;
             companion->nextCommandAsync();
@@ -2361,7 +3034,7 @@ public:
           if (!socket()->isResponse("2")) {
             socket()->resetCommandClass(Failed);
           } else {
-            socket()->setConfig("params.fxp.changed_prot", 1);
+            socket()->setConfig(Settings::FxpChangedProt, 1);
             
             currentState = SourceWaitType;
             companion->nextCommandAsync();
@@ -2370,13 +3043,13 @@ public:
         }
         case SourceWaitType: {
           // We are ready to invoke file transfer, do PASV
-          if (socket()->getConfig<bool>("feat.pret")) {
+          if (socket()->getConfig<bool>(Settings::FeatPret)) {
             currentState = SourceSentPret;
             socket()->sendCommand("PRET RETR " + sourceFile.fileName());
           } else {
             currentState = SourceSentPasv;
             
-            switch (socket()->getConfig<int>("params.transfer.mode")) {
+            switch (socket()->getConfig<int>(Settings::TransferMode)) {
               case TransferPASV: socket()->sendCommand("PASV"); break;
               case TransferCPSV: socket()->sendCommand("CPSV"); break;
             }
@@ -2394,12 +3067,12 @@ public:
               socket()->resetCommandClass(Failed);
             }
             
-            socket()->setConfig("feat.pret", false);
+            socket()->setConfig(Settings::FeatPret, false);
           }
           
           currentState = SourceSentPasv;
             
-          switch (socket()->getConfig<int>("params.transfer.mode")) {
+          switch (socket()->getConfig<int>(Settings::TransferMode)) {
             case TransferPASV: socket()->sendCommand("PASV"); break;
             case TransferCPSV: socket()->sendCommand("CPSV"); break;
           }
@@ -2415,7 +3088,7 @@ public:
             tmp = tmp.mid(pos, tmp.indexOf(')') - pos);
             
             currentState = SourceDoRest;
-            companion->setConfig("params.fxp.ip", tmp);
+            companion->setConfig(Settings::FxpIp, tmp);
             companion->nextCommandAsync();
           }
           break;
@@ -2427,8 +3100,8 @@ public:
         }
         case SourceSentRest: {
           if (!socket()->isResponse("2") && !socket()->isResponse("3")) {
-            socket()->setConfig("feat.rest", false);
-            companion->setConfig("params.fxp.rest", 0);
+            socket()->setConfig(Settings::FeatRest, false);
+            companion->setConfig(Settings::FxpRest, 0);
           } else {
             // Signal resume
             socket()->emitEvent(Event::EventResumeOffset, resumeOffset);
@@ -2454,12 +3127,12 @@ public:
         case SourceWaitTransfer: {
           if (!socket()->isMultiline()) {
             // Transfer has been completed
-            if (socket()->getConfig<int>("params.fxp.changed_prot")) {
+            if (socket()->getConfig<int>(Settings::FxpChangedProt)) {
               currentState = SourceResetProt;
               
               QString prot = "PROT ";
               
-              if (socket()->getConfig<int>("ssl.prot_mode") == 0) 
+              if (socket()->getConfig<int>(Settings::SslProtMode) == 0) 
                 prot.append('P');
               else
                 prot.append('C');
@@ -2518,12 +3191,12 @@ public:
           break;
         }
         case DestSentType: {
-          if (socket()->getConfig<bool>("ssl")) {
+          if (socket()->getConfig<bool>(Settings::Ssl)) {
             // Check what the source socket has instructed us to do
-            switch (socket()->getConfig<int>("params.ssl.mode")) {
+            switch (socket()->getConfig<int>(Settings::SslMode)) {
               case ProtClear: {
                 // We should use cleartext data channel
-                if (socket()->getConfig<int>("ssl.prot_mode") != 2) {
+                if (socket()->getConfig<int>(Settings::SslProtMode) != 2) {
                   currentState = DestSentProt;
                   socket()->sendCommand("PROT C");
                 } else {
@@ -2534,7 +3207,7 @@ public:
               }
               case ProtPrivate: {
                 // We should use private data channel
-                if (socket()->getConfig<int>("ssl.prot_mode") != 0) {
+                if (socket()->getConfig<int>(Settings::SslProtMode) != 0) {
                   currentState = DestSentProt;
                   socket()->sendCommand("PROT P");
                 } else {
@@ -2545,7 +3218,7 @@ public:
               }
               case ProtSSCN: {
                 // We should initialize SSCN mode
-                if (!socket()->getConfig<bool>("sscn.activated")) {
+                if (!socket()->getConfig<bool>(Settings::SscnActivated)) {
                   currentState = DestSentSscn;
                   socket()->sendCommand("SSCN ON");
                 } else {
@@ -2565,8 +3238,8 @@ public:
           if (!socket()->isResponse("2")) {
             socket()->resetCommandClass(Failed);
           } else {
-            socket()->setConfig("sscn.activated", true);
-            socket()->setConfig("params.fxp.changed_prot", 0);
+            socket()->setConfig(Settings::SscnActivated, true);
+            socket()->setConfig(Settings::FxpChangedProt, 0);
             
             currentState = DestDoPort;
             companion->nextCommandAsync();
@@ -2577,7 +3250,7 @@ public:
           if (!socket()->isResponse("2")) {
             socket()->resetCommandClass(Failed);
           } else {
-            socket()->setConfig("params.fxp.changed_prot", 1);
+            socket()->setConfig(Settings::FxpChangedProt, 1);
             
             currentState = DestDoPort;
             companion->nextCommandAsync();
@@ -2586,7 +3259,7 @@ public:
         }
         case DestDoPort: {
           currentState = DestSentPort;
-          socket()->sendCommand("PORT " + socket()->getConfig("params.fxp.ip"));
+          socket()->sendCommand("PORT " + socket()->getConfig(Settings::FxpIp));
           break;
         }
         case DestSentPort: {
@@ -2594,7 +3267,7 @@ public:
             socket()->resetCommandClass(Failed);
           } else {
             currentState = DestSentRest;
-            socket()->sendCommand("REST " + socket()->getConfig("params.fxp.rest"));
+            socket()->sendCommand("REST " + socket()->getConfig(Settings::FxpRest));
           }
           break;
         }
@@ -2621,12 +3294,12 @@ public:
         case DestWaitTransfer: {
           if (!socket()->isMultiline()) {
             // Transfer has been completed
-            if (socket()->getConfig<bool>("params.fxp.changed_prot")) {
+            if (socket()->getConfig<bool>(Settings::FxpChangedProt)) {
               currentState = DestResetProt;
               
               QString prot = "PROT ";
               
-              if (socket()->getConfig<int>("ssl.prot_mode") == 0) 
+              if (socket()->getConfig<int>(Settings::SslProtMode) == 0) 
                 prot.append('P');
               else
                 prot.append('C');
@@ -2660,13 +3333,15 @@ void FtpSocket::protoSiteToSite(Socket *socket, const KUrl &source, const KUrl &
   emitEvent(Event::EventMessage, i18n("Transferring file '%1'...",source.fileName()));
   
   // Set the source and destination
-  setConfig("params.fxp.abort", 0);
-  setConfig("params.fxp.source", source.path());
-  setConfig("params.fxp.destination", destination.path());
+  setConfig(Settings::FxpAbort, 0);
+  setConfig(Settings::FxpSource, source.path());
+  setConfig(Settings::FxpDestination, destination.path());
   
   FtpCommandFxp *fxp = new FtpCommandFxp(this);
   fxp->companion = static_cast<FtpSocket*>(socket);
   m_cmdData = fxp;
+  
+  TraceScope scope(this, "process", m_cmdData->name());
   m_cmdData->process();
 }
 
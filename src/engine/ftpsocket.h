@@ -101,12 +101,15 @@ public:
     void protoGet(const KUrl &source, const KUrl &destination);
     void protoPut(const KUrl &source, const KUrl &destination);
     void protoRemove(const KUrl &path);
+    void protoRemoveMultiple(const KUrl &parent, const QStringList &files);
     void protoRename(const KUrl &source, const KUrl &destination);
     void protoChmodSingle(const KUrl &path, int mode);
+    void protoChmodMultiple(const KUrl &parent, const QStringList &files, int mode);
     void protoMkdir(const KUrl &path);
     void protoList(const KUrl &path);
     void protoRaw(const QString &raw);
     void protoSiteToSite(Socket *socket, const KUrl &source, const KUrl &destination);
+    void protoChecksum(const KUrl &remote, const KUrl &local, filesize_t offset = 0, filesize_t length = 0);
     void protoKeepAlive();
     
     void changeWorkingDirectory(const QString &path, bool shouldCreate = false);
@@ -114,7 +117,7 @@ public:
     int features() { return SF_FXP_TRANSFER | SF_RAW_COMMAND; }
     
     bool isConnected() { return m_login; }
-    bool isEncrypted() { return isConnected() && getConfig<bool>("ssl", false); }
+    bool isEncrypted() { return isConnected() && getConfig<bool>(Settings::Ssl, false); }
     
     bool isResponse(const QString &code);
     QString getResponse() { return m_response; }
@@ -131,7 +134,13 @@ public:
     void checkTransferEnd();
     void checkTransferStart();
     void resetTransferStart() { m_transferStart = 0; }
+    
+    void throttleWakeup();
+    void wakeup(WakeupEvent *event);
 protected:
+    void speedLimiterWakeup();
+    void scheduleThrottleWakeup();
+    
     void parseLine(const QString &line);
     void variableBufferUpdate(int size);
     void closeDataTransferSocket();
@@ -139,6 +148,16 @@ protected:
     void transferCompleted();
 private:
     bool m_login;
+    bool m_peerVerifyPending;
+    
+    QList<QSslError> m_pendingSslErrors;
+    QList<QSslError> m_acceptedSslErrors;
+    
+    qint64 m_commandSent;
+    qint64 m_dataConnectStart;
+    qint64 m_tlsStart;
+    qint64 m_dataTlsStart;
+    qint64 m_listParseTime;
     
     QString m_buffer;
     QString m_multiLineCode;
@@ -157,6 +176,7 @@ private:
     int m_transferEnd;
     
     QTimer *m_keepaliveTimer;
+    QTimer *m_throttleTimer;
 protected slots:
     /**
      * This method checks for timeouts and acts if needed.
@@ -177,6 +197,7 @@ protected slots:
     void slotDataError(QAbstractSocket::SocketError error);
     void slotDataTryRead();
     void slotDataTryWrite();
+    void slotThrottleTimeout();
 };
 
 }
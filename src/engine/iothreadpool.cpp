@@ -0,0 +1,110 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "iothreadpool.h"
+
+#include <QMutexLocker>
+
+#include <KGlobal>
+
+namespace KFTPEngine {
+
+class IoThreadPoolPrivate
+{
+public:
+    IoThreadPool instance;
+};
+
+K_GLOBAL_STATIC(IoThreadPoolPrivate, ioThreadPoolPrivate)
+
+IoThread::IoThread()
+  : QThread(),
+    m_load(0)
+{
+}
+
+void IoThread::run()
+{
+  exec();
+}
+
+IoThreadPool *IoThreadPool::self()
+{
+  return &ioThreadPoolPrivate->instance;
+}
+
+IoThreadPool::IoThreadPool()
+  : m_size(qMax(2, QThread::idealThreadCount()))
+{
+}
+
+IoThreadPool::~IoThreadPool()
+{
+  foreach (IoThread *thread, m_threads) {
+    thread->quit();
+    thread->wait();
+    delete thread;
+  }
+}
+
+IoThread *IoThreadPool::acquire()
+{
+  QMutexLocker locker(&m_mutex);
+  IoThread *best = 0;
+  
+  foreach (IoThread *thread, m_threads) {
+    if (!best || thread->m_load < best->m_load)
+      best = thread;
+  }
+  
+  // Start another thread while all existing ones are busy
+  if ((!best || best->m_load > 0) && m_threads.count() < m_size) {
+    best = new IoThread();
+    best->start();
+    m_threads.append(best);
+  }
+  
+  best->m_load++;
+  return best;
+}
+
+void IoThreadPool::release(IoThread *thread)
+{
+  QMutexLocker locker(&m_mutex);
+  thread->m_load--;
+}
+
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef KFTPENGINEIOTHREADPOOL_H
+#define KFTPENGINEIOTHREADPOOL_H
+
+#include <QThread>
+#include <QMutex>
+#include <QList>
+
+namespace KFTPEngine {
+
+class IoThreadPoolPrivate;
+
+/**
+ * An I/O thread only runs an event loop. Connections that are assigned to
+ * it create their sockets inside this thread, so all of their I/O is
+ * multiplexed by the same loop.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class IoThread : public QThread {
+friend class IoThreadPool;
+public:
+    /**
+     * Returns the number of connections assigned to this thread.
+     */
+    int load() const { return m_load; }
+protected:
+    /**
+     * Class constructor.
+     */
+    IoThread();
+    
+    /**
+     * Thread entry point.
+     */
+    void run();
+private:
+    int m_load;
+};
+
+/**
+ * This class maintains a small fixed pool of I/O threads that are shared
+ * between all connections, instead of running one thread per connection.
+ * The pool size follows the number of available CPU cores. Threads are
+ * started when they are first needed and connections are always assigned
+ * to the least loaded one.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class IoThreadPool {
+friend class IoThreadPoolPrivate;
+public:
+    /**
+     * Returns the global pool instance.
+     */
+    static IoThreadPool *self();
+    
+    /**
+     * Assigns a new connection to the least loaded I/O thread.
+     *
+     * @return The I/O thread that should run the connection
+     */
+    IoThread *acquire();
+    
+    /**
+     * Removes a connection from an I/O thread. This method must be called
+     * once for every call to acquire.
+     *
+     * @param thread The I/O thread that was running the connection
+     */
+    void release(IoThread *thread);
+    
+    /**
+     * Returns the maximum number of I/O threads.
+     */
+    int size() const { return m_size; }
+protected:
+    /**
+     * Class constructor.
+     */
+    IoThreadPool();
+    
+    /**
+     * Class destructor.
+     */
+    ~IoThreadPool();
+private:
+    QMutex m_mutex;
+    QList<IoThread*> m_threads;
+    int m_size;
+};
+
+}
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "metrics.h"
+#include "misc/config.h"
+
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include <KGlobal>
+
+namespace KFTPEngine {
+
+/* Amount at which the low part of a counter is carried to the high part */
+static const int counterCarry = 1 << 30;
+
+/* Name of the local socket metrics are served on */
+static const char *endpointName = "kftpgrabber-metrics";
+
+MetricsCounter::MetricsCounter()
+  : m_low(0),
+    m_high(0)
+{
+}
+
+void MetricsCounter::add(int value)
+{
+  int low = m_low.fetchAndAddOrdered(value) + value;
+  
+  // Whoever manages to subtract the carry also increments the high part
+  while (low >= counterCarry) {
+    if (m_low.testAndSetOrdered(low, low - counterCarry)) {
+      m_high.ref();
+      break;
+    }
+    
+    low = m_low;
+  }
+}
+
+qint64 MetricsCounter::value() const
+{
+  return (qint64) int(m_high) * counterCarry + int(m_low);
+}
+
+MetricsHistogram::MetricsHistogram()
+  : m_count(0)
+{
+  for (int i = 0; i < BucketCount; i++)
+    m_buckets[i] = 0;
+}
+
+void MetricsHistogram::add(qint64 usec)
+{
+  int bucket = 0;
+  
+  while (bucket < BucketCount - 1 && usec > bucketLimit(bucket))
+    bucket++;
+  
+  m_buckets[bucket].ref();
+  m_count.ref();
+  m_sum.add((int) qMin(usec, (qint64) counterCarry - 1));
+}
+
+int MetricsHistogram::count() const
+{
+  return m_count;
+}
+
+qint64 MetricsHistogram::average() const
+{
+  int samples = m_count;
+  return samples > 0 ? m_sum.value() / samples : 0;
+}
+
+qint64 MetricsHistogram::percentile(int percentile) const
+{
+  int samples = m_count;
+  
+  if (samples == 0)
+    return 0;
+  
+  // Number of samples that are below the percentile
+  qint64 rank = ((qint64) samples * percentile + 99) / 100;
+  qint64 seen = 0;
+  
+  for (int i = 0; i < BucketCount; i++) {
+    seen += int(m_buckets[i]);
+    
+    if (seen >= rank)
+      return bucketLimit(i);
+  }
+  
+  return bucketLimit(BucketCount - 1);
+}
+
+qint64 MetricsHistogram::bucketLimit(int bucket)
+{
+  return (qint64) 1 << bucket;
+}
+
+MetricsSite::MetricsSite(const QString &name)
+  : m_name(name)
+{
+}
+
+QString MetricsSite::counterName(Counter counter)
+{
+  switch (counter) {
+    case BytesDownloaded: return "bytes_downloaded";
+    case BytesUploaded: return "bytes_uploaded";
+    case Reconnects: return "reconnects";
+    case CacheHits: return "cache_hits";
+    case CacheMisses: return "cache_misses";
+    default: return QString();
+  }
+}
+
+QString MetricsSite::histogramName(Histogram histogram)
+{
+  switch (histogram) {
+    case CommandRtt: return "command_rtt";
+    case DataConnect: return "data_connect";
+    case TlsHandshake: return "tls_handshake";
+    case ListParse: return "list_parse";
+    default: return QString();
+  }
+}
+
+QString MetricsSite::commandName(Commands::Type type)
+{
+  switch (type) {
+    case Commands::CmdConnect: return "connect";
+    case Commands::CmdConnectRetry: return "connect_retry";
+    case Commands::CmdDisconnect: return "disconnect";
+    case Commands::CmdList: return "list";
+    case Commands::CmdScan: return "scan";
+    case Commands::CmdGet: return "get";
+    case Commands::CmdPut: return "put";
+    case Commands::CmdDelete: return "delete";
+    case Commands::CmdRename: return "rename";
+    case Commands::CmdMkdir: return "mkdir";
+    case Commands::CmdChmod: return "chmod";
+    case Commands::CmdRaw: return "raw";
+    case Commands::CmdFxp: return "fxp";
+    case Commands::CmdChecksum: return "checksum";
+    case Commands::CmdKeepAlive: return "keepalive";
+    default: return QString();
+  }
+}
+
+class MetricsPrivate
+{
+public:
+    Metrics instance;
+};
+
+K_GLOBAL_STATIC(MetricsPrivate, metricsPrivate)
+
+Metrics *Metrics::self()
+{
+  return &metricsPrivate->instance;
+}
+
+Metrics::Metrics()
+  : QObject(),
+    m_server(0)
+{
+  // Subscribe to config updates and start or stop the endpoint
+  connect(KFTPCore::Config::self(), SIGNAL(configChanged()), this, SLOT(updateEndpoint()));
+  updateEndpoint();
+}
+
+Metrics::~Metrics()
+{
+  qDeleteAll(m_siteList);
+}
+
+MetricsSite *Metrics::site(const KUrl &url)
+{
+  QString name = QString("%1:%2").arg(url.host()).arg(url.port());
+  QMutexLocker locker(&m_mutex);
+  
+  MetricsSite *site = m_sites.value(name);
+  if (!site) {
+    site = new MetricsSite(name);
+    m_sites.insert(name, site);
+    m_siteList.append(site);
+  }
+  
+  return site;
+}
+
+QList<MetricsSite*> Metrics::sites()
+{
+  QMutexLocker locker(&m_mutex);
+  return m_siteList;
+}
+
+void Metrics::dump(QTextStream &stream)
+{
+  foreach (MetricsSite *site, sites()) {
+    stream << "site " << site->name() << '\n';
+    
+    for (int i = 0; i < MetricsSite::CounterCount; i++) {
+      MetricsSite::Counter counter = static_cast<MetricsSite::Counter>(i);
+      stream << "  counter " << MetricsSite::counterName(counter) << ' ' << site->counter(counter).value() << '\n';
+    }
+    
+    for (int i = 0; i < MetricsSite::HistogramCount; i++) {
+      MetricsSite::Histogram histogram = static_cast<MetricsSite::Histogram>(i);
+      MetricsHistogram &h = site->histogram(histogram);
+      
+      stream << "  histogram " << MetricsSite::histogramName(histogram)
+             << " count=" << h.count()
+             << " avg_us=" << h.average()
+             << " p50_us=" << h.percentile(50)
+             << " p95_us=" << h.percentile(95)
+             << " p99_us=" << h.percentile(99) << '\n';
+    }
+    
+    for (int i = 0; i <= Commands::CmdAbort; i++) {
+      Commands::Type type = static_cast<Commands::Type>(i);
+      MetricsHistogram &h = site->command(type);
+      
+      if (MetricsSite::commandName(type).isEmpty() || h.count() == 0)
+        continue;
+      
+      stream << "  command " << MetricsSite::commandName(type)
+             << " count=" << h.count()
+             << " avg_us=" << h.average()
+             << " p50_us=" << h.percentile(50)
+             << " p95_us=" << h.percentile(95)
+             << " p99_us=" << h.percentile(99) << '\n';
+    }
+  }
+  
+  stream.flush();
+}
+
+bool Metrics::dumpToFile(const QString &filename)
+{
+  QFile file(filename);
+  
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    return false;
+  
+  QTextStream stream(&file);
+  dump(stream);
+  file.close();
+  
+  return true;
+}
+
+void Metrics::updateEndpoint()
+{
+  if (KFTPCore::Config::metricsEndpoint() && !m_server) {
+    m_server = new QLocalServer(this);
+    connect(m_server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
+    
+    // Remove a stale socket left behind by a crashed instance
+    QLocalServer::removeServer(endpointName);
+    
+    if (!m_server->listen(endpointName)) {
+      qDebug("WARNING: Unable to listen on metrics endpoint!");
+      delete m_server;
+      m_server = 0;
+    }
+  } else if (!KFTPCore::Config::metricsEndpoint() && m_server) {
+    delete m_server;
+    m_server = 0;
+  }
+}
+
+void Metrics::slotNewConnection()
+{
+  while (QLocalSocket *client = m_server->nextPendingConnection()) {
+    QTextStream stream(client);
+    dump(stream);
+    
+    connect(client, SIGNAL(disconnected()), client, SLOT(deleteLater()));
+    client->disconnectFromServer();
+  }
+}
+
+}
+
+#include "metrics.moc"
@@ -0,0 +1,294 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef KFTPENGINEMETRICS_H
+#define KFTPENGINEMETRICS_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+
+#include <KUrl>
+
+#include "commands.h"
+
+class QTextStream;
+class QLocalServer;
+
+namespace KFTPEngine {
+
+class MetricsPrivate;
+
+/**
+ * A counter that can be updated from any thread without locking. Values
+ * are kept in two atomic integers, so the counter doesn't overflow with
+ * large amounts of transferred data.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class MetricsCounter {
+public:
+    /**
+     * Class constructor.
+     */
+    MetricsCounter();
+    
+    /**
+     * Adds a value to the counter.
+     *
+     * @param value Value to add, must be positive
+     */
+    void add(int value = 1);
+    
+    /**
+     * Returns the current counter value.
+     */
+    qint64 value() const;
+private:
+    QAtomicInt m_low;
+    QAtomicInt m_high;
+};
+
+/**
+ * A latency histogram that can be updated from any thread without locking.
+ * Samples are counted in buckets with power of two limits, ranging from
+ * one microsecond to more than a minute.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class MetricsHistogram {
+public:
+    /**
+     * Number of buckets.
+     */
+    enum { BucketCount = 28 };
+    
+    /**
+     * Class constructor.
+     */
+    MetricsHistogram();
+    
+    /**
+     * Adds a sample to the histogram.
+     *
+     * @param usec Sample duration in microseconds
+     */
+    void add(qint64 usec);
+    
+    /**
+     * Returns the number of samples.
+     */
+    int count() const;
+    
+    /**
+     * Returns the average sample duration in microseconds.
+     */
+    qint64 average() const;
+    
+    /**
+     * Returns an upper bound of the given percentile in microseconds.
+     *
+     * @param percentile Percentile between 0 and 100
+     */
+    qint64 percentile(int percentile) const;
+    
+    /**
+     * Returns the upper limit of a bucket in microseconds.
+     *
+     * @param bucket Bucket index
+     */
+    static qint64 bucketLimit(int bucket);
+private:
+    QAtomicInt m_buckets[BucketCount];
+    QAtomicInt m_count;
+    MetricsCounter m_sum;
+};
+
+/**
+ * Performance counters and histograms of a single site.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class MetricsSite {
+public:
+    /**
+     * Available counters.
+     */
+    enum Counter {
+      BytesDownloaded = 0,
+      BytesUploaded,
+      Reconnects,
+      CacheHits,
+      CacheMisses,
+      CounterCount
+    };
+    
+    /**
+     * Available histograms.
+     */
+    enum Histogram {
+      CommandRtt = 0,
+      DataConnect,
+      TlsHandshake,
+      ListParse,
+      HistogramCount
+    };
+    
+    /**
+     * Class constructor.
+     *
+     * @param name Site name
+     */
+    MetricsSite(const QString &name);
+    
+    /**
+     * Returns the site name.
+     */
+    QString name() const { return m_name; }
+    
+    /**
+     * Returns a counter.
+     */
+    MetricsCounter &counter(Counter counter) { return m_counters[counter]; }
+    
+    /**
+     * Returns a histogram.
+     */
+    MetricsHistogram &histogram(Histogram histogram) { return m_histograms[histogram]; }
+    
+    /**
+     * Returns the histogram of durations of an engine command.
+     *
+     * @param type Command type
+     */
+    MetricsHistogram &command(Commands::Type type) { return m_commands[type]; }
+    
+    /**
+     * Returns the name of a counter as used in dumps.
+     */
+    static QString counterName(Counter counter);
+    
+    /**
+     * Returns the name of a histogram as used in dumps.
+     */
+    static QString histogramName(Histogram histogram);
+    
+    /**
+     * Returns the name of an engine command as used in dumps or an empty
+     * string for internal command types.
+     */
+    static QString commandName(Commands::Type type);
+private:
+    QString m_name;
+    MetricsCounter m_counters[CounterCount];
+    MetricsHistogram m_histograms[HistogramCount];
+    MetricsHistogram m_commands[Commands::CmdAbort + 1];
+};
+
+/**
+ * This class is a registry of engine performance metrics. Metrics are kept
+ * per site (host and port). Looking up a site takes a lock, but sites are
+ * never removed, so sockets keep a pointer to their site and update its
+ * metrics without locking.
+ *
+ * Metrics can be written to a file and, when enabled in the configuration,
+ * are served on a local socket named "kftpgrabber-metrics". Every client
+ * that connects receives the current dump.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class Metrics : public QObject {
+Q_OBJECT
+friend class MetricsPrivate;
+public:
+    /**
+     * Returns the global metrics registry. Should be first called from the
+     * main thread.
+     */
+    static Metrics *self();
+    
+    /**
+     * Returns the metrics of the site an URL belongs to. The site is created
+     * when it doesn't exist yet.
+     *
+     * @param url Site URL
+     */
+    MetricsSite *site(const KUrl &url);
+    
+    /**
+     * Returns all sites that have metrics.
+     */
+    QList<MetricsSite*> sites();
+    
+    /**
+     * Writes all metrics in a plain text format.
+     *
+     * @param stream Destination stream
+     */
+    void dump(QTextStream &stream);
+    
+    /**
+     * Writes all metrics to a file.
+     *
+     * @param filename Destination file
+     * @return True if the file has been written
+     */
+    bool dumpToFile(const QString &filename);
+protected:
+    /**
+     * Class constructor.
+     */
+    Metrics();
+    
+    /**
+     * Class destructor.
+     */
+    ~Metrics();
+private:
+    QMutex m_mutex;
+    QHash<QString, MetricsSite*> m_sites;
+    QList<MetricsSite*> m_siteList;
+    QLocalServer *m_server;
+private slots:
+    void updateEndpoint();
+    void slotNewConnection();
+};
+
+}
+
+#endif
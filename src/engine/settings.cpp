@@ -35,26 +35,148 @@
  */
 #include "settings.h"
 
+#include <QHash>
+
+#include <KGlobal>
+
 namespace KFTPEngine {
 
+/* String keys of registered settings, in the order of Settings::Key */
+static const char *keyNames[Settings::KeyCount] = {
+  "feat.epsv",
+  "feat.eprt",
+  "feat.pasv",
+  "feat.size",
+  "feat.rest",
+  "feat.pret",
+  "feat.mlsd",
+  "feat.sscn",
+  "feat.cpsv",
+  "feat.mdtm",
+  "feat.stat",
+  
+  "ssl",
+  "ssl.prot_mode",
+  "sscn.activated",
+  
+  "keepalive.enabled",
+  "keepalive.timeout",
+  "pipeline.depth",
+  
+  "params.data_command",
+  "params.data_type",
+  "params.data_rest",
+  "params.data_rest_do",
+  "params.transfer.mode",
+  "__returnvalue",
+  
+  "params.checksum.algorithm",
+  "params.checksum.length",
+  "params.checksum.local",
+  "params.checksum.offset",
+  "params.checksum.remote",
+  
+  "params.chmod.files",
+  "params.chmod.mode",
+  "params.chmod.parent",
+  "params.chmod.path",
+  
+  "params.cwd.create",
+  "params.cwd.path",
+  
+  "params.fxp.abort",
+  "params.fxp.changed_prot",
+  "params.fxp.companion",
+  "params.fxp.destination",
+  "params.fxp.ip",
+  "params.fxp.keep_cache",
+  "params.fxp.rest",
+  "params.fxp.source",
+  
+  "params.get.destination",
+  "params.get.source",
+  
+  "params.list.path",
+  "params.mkdir.path",
+  "params.raw.command",
+  
+  "params.remove.directory",
+  "params.remove.files",
+  "params.remove.parent",
+  "params.remove.path",
+  
+  "params.rename.destination",
+  "params.rename.source",
+  "params.ssl.mode"
+};
+
+class SettingsRegistry
+{
+public:
+    SettingsRegistry()
+    {
+      for (int i = 0; i < Settings::KeyCount; i++)
+        keys.insert(keyNames[i], static_cast<Settings::Key>(i));
+    }
+    
+    QHash<QString, Settings::Key> keys;
+};
+
+K_GLOBAL_STATIC(SettingsRegistry, settingsRegistry)
+
 Settings::Settings()
 {
 }
 
+QString Settings::keyName(Key key)
+{
+  return keyNames[key];
+}
+
+Settings::Key Settings::findKey(const QString &name)
+{
+  return settingsRegistry->keys.value(name, KeyCount);
+}
+
+void Settings::setConfig(const QString &key, const QVariant &value)
+{
+  Key slot = findKey(key);
+  
+  if (slot != KeyCount)
+    m_slots[slot] = value;
+  else
+    m_config[key] = value;
+}
+
+QString Settings::getConfig(const QString &key) const
+{
+  // Unregistered keys are looked up in the map first, so they cost a single
+  // lookup as before
+  QMap<QString, QVariant>::const_iterator i = m_config.constFind(key);
+  if (i != m_config.constEnd())
+    return i.value().toString();
+  
+  Key slot = findKey(key);
+  return slot != KeyCount ? getConfig(slot) : QString();
+}
+
 void Settings::initConfig()
 {
   m_config.clear();
   
+  for (int i = 0; i < KeyCount; i++)
+    m_slots[i] = QVariant();
+  
   // Fill in some default values
-  setConfig("feat.epsv", true);
-  setConfig("feat.eprt", true);
-  setConfig("feat.pasv", true);
-  setConfig("feat.size", true);
-  setConfig("ssl.prot_mode", 2);
+  setConfig(FeatEpsv, true);
+  setConfig(FeatEprt, true);
+  setConfig(FeatPasv, true);
+  setConfig(FeatSize, true);
+  setConfig(SslProtMode, 2);
   setConfig("ssl.ignore_errors", false);
-  setConfig("keepalive.enabled", true);
-  setConfig("keepalive.timeout", 60);
+  setConfig(KeepaliveEnabled, true);
+  setConfig(KeepaliveTimeout, 60);
+  setConfig(PipelineDepth, 8);
 }
 
 }
-
@@ -44,23 +44,125 @@ namespace KFTPEngine {
 /**
  * This class holds and per-thread configuration settings.
  *
+ * Settings that are accessed on hot paths (feature flags, data connection
+ * parameters, the command return value) are registered as a Key. These
+ * are stored in fixed slots, so accessing them by their Key doesn't do any
+ * string lookup. All other settings are kept in a map. String keys can be
+ * used for every setting, including the registered ones, so code that
+ * only knows setting names (e.g. bookmarks) keeps working.
+ *
  * @author Jernej Kos <kostko@unimatrix-one.org>
  */
 class Settings
 {
 public:
+    /**
+     * Registered settings. Their string keys are listed in settings.cpp.
+     */
+    enum Key {
+      FeatEpsv,
+      FeatEprt,
+      FeatPasv,
+      FeatSize,
+      FeatRest,
+      FeatPret,
+      FeatMlsd,
+      FeatSscn,
+      FeatCpsv,
+      FeatMdtm,
+      FeatStat,
+      
+      Ssl,
+      SslProtMode,
+      SscnActivated,
+      
+      KeepaliveEnabled,
+      KeepaliveTimeout,
+      PipelineDepth,
+      
+      DataCommand,
+      DataType,
+      DataRest,
+      DataRestDo,
+      TransferMode,
+      ReturnValue,
+      
+      ChecksumAlgorithm,
+      ChecksumLength,
+      ChecksumLocal,
+      ChecksumOffset,
+      ChecksumRemote,
+      
+      ChmodFiles,
+      ChmodMode,
+      ChmodParent,
+      ChmodPath,
+      
+      CwdCreate,
+      CwdPath,
+      
+      FxpAbort,
+      FxpChangedProt,
+      FxpCompanion,
+      FxpDestination,
+      FxpIp,
+      FxpKeepCache,
+      FxpRest,
+      FxpSource,
+      
+      GetDestination,
+      GetSource,
+      
+      ListPath,
+      MkdirPath,
+      RawCommand,
+      
+      RemoveDirectory,
+      RemoveFiles,
+      RemoveParent,
+      RemovePath,
+      
+      RenameDestination,
+      RenameSource,
+      SslMode,
+      
+      KeyCount
+    };
+    
     /**
      * Class constructor.
      */
     Settings();
     
+    /**
+     * Returns the string key of a registered setting.
+     *
+     * @param key Registered setting
+     * @return The setting's string key
+     */
+    static QString keyName(Key key);
+    
+    /**
+     * Finds the registered setting with the given string key.
+     *
+     * @param name String key
+     * @return The registered setting or KeyCount if there is none
+     */
+    static Key findKey(const QString &name);
+    
     /**
      * Set an internal config value.
      *
      * @param key Key
      * @param value Value
      */
-    void setConfig(const QString &key, const QVariant &value) { m_config[key] = value; }
+    void setConfig(const QString &key, const QVariant &value);
+    
+    /**
+     * @overload
+     * Set a registered config value.
+     */
+    void setConfig(Key key, const QVariant &value) { m_slots[key] = value; }
     
     /**
      * Get an internal config value as string.
@@ -68,7 +170,13 @@ public:
      * @param key Key
      * @return The key's value or an empty string if the key doesn't exist
      */
-    QString getConfig(const QString &key) const { return m_config[key].toString(); }
+    QString getConfig(const QString &key) const;
+    
+    /**
+     * @overload
+     * Get a registered config value as string.
+     */
+    QString getConfig(Key key) const { return m_slots[key].toString(); }
     
     /**
      * Get an internal config value.
@@ -78,13 +186,31 @@ public:
      * @return The key's value or the default value if not found
      */
     template <typename T>
-    T getConfig(const QString &key, const T &def = T()) const { return m_config.contains(key) ? m_config[key].value<T>() : def; }
+    T getConfig(const QString &key, const T &def = T()) const
+    {
+      // Registered keys never end up in the map, so a miss there falls
+      // through to the registry exactly once
+      QMap<QString, QVariant>::const_iterator i = m_config.constFind(key);
+      if (i != m_config.constEnd())
+        return i.value().value<T>();
+      
+      Key slot = findKey(key);
+      return slot != KeyCount ? getConfig<T>(slot, def) : def;
+    }
+    
+    /**
+     * @overload
+     * Get a registered config value.
+     */
+    template <typename T>
+    T getConfig(Key key, const T &def = T()) const { return m_slots[key].isValid() ? m_slots[key].value<T>() : def; }
     
     /**
      * This method resets and initializes the configuration map.
      */
     void initConfig();
 private:
+    QVariant m_slots[KeyCount];
     QMap<QString, QVariant> m_config;
 };
 
@@ -39,6 +39,8 @@
 #include "misc/config.h"
 
 #include <qdir.h>
+#include <QSocketNotifier>
+#include <QTimer>
 
 #include <klocale.h>
 #include <kstandarddirs.h>
@@ -48,9 +50,14 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <utime.h>
+#include <sys/socket.h>
+#include <errno.h>
 
 namespace KFTPEngine {
 
+/* Number of blocks transferred before other connections get their turn */
+static const int transferBatch = 16;
+
 SftpSocket::SftpSocket(Thread *thread)
   : QTcpSocket(),
     Socket(thread, "sftp"),
@@ -60,8 +67,18 @@ SftpSocket::SftpSocket(Thread *thread)
     m_login(false),
     m_transferHandle(0),
     m_transferBuffer(0),
-    m_transferBufferSize(0)
+    m_transferBufferSize(0),
+    m_transferPending(0),
+    m_readNotifier(0),
+    m_writeNotifier(0),
+    m_socketWait(false),
+    m_throttled(false)
 {
+  // Retries a transfer the speed limiter has stopped
+  m_throttleTimer = new QTimer(this);
+  m_throttleTimer->setSingleShot(true);
+  connect(m_throttleTimer, SIGNAL(timeout()), this, SLOT(slotThrottleTimeout()));
+  
   // Control socket signals
   connect(this, SIGNAL(connected()), this, SLOT(slotConnected()));
   connect(this, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
@@ -114,13 +131,19 @@ class SftpCommandConnect : public Commands::Base {
 public:
     enum State {
       None,
+      Handshake,
+      WaitPeerVerify,
       ConnectComplete,
-      LoginComplete
+      InteractiveAuth,
+      WaitPubkeyPassword,
+      LoginComplete,
+      SftpInitialized
     };
     
     ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandConnect, SftpSocket, CmdConnect)
     
     LIBSSH2_SESSION *session;
+    QString password;
     static KUrl url;
     
     void process()
@@ -141,13 +164,17 @@ public:
           
           socket()->m_sshSession = session;
           
-          // Set blocking mode for libssh2
+          // Set non-blocking mode for libssh2, we are resumed when the socket is ready
           libssh2_session_set_blocking(session, 0);
-          
+          currentState = Handshake;
+        }
+        case Handshake: {
           // Start handshake
-          int rc;
-          while ((rc = libssh2_session_startup(session, socket()->socketDescriptor())) == LIBSSH2_ERROR_EAGAIN) ;
-          if (rc) {
+          int rc = libssh2_session_startup(session, socket()->socketDescriptor());
+          if (rc == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          } else if (rc) {
             socket()->emitEvent(Event::EventMessage, i18n("Unable to establish SSH connection (error code %1.)", QString::number(rc)));
             socket()->emitError(ConnectFailed, i18n("SSH handshake has failed (error code %1.)", QString::number(rc)));
             socket()->protoAbort();
@@ -160,44 +187,54 @@ public:
             QByteArray qFingerprint = QByteArray(fingerprint, 16);
             
             if (!KFTPCore::Config::self()->certificateStore()->verifyFingerprint(url, qFingerprint)) {
-              PeerVerifyWakeupEvent *response = static_cast<PeerVerifyWakeupEvent*>(socket()->emitEventAndWait(Event::EventPeerVerify, qFingerprint));
-              
-              if (!response || !response->peerOk) {
-                socket()->emitEvent(Event::EventMessage, i18n("Peer verification has failed."));
-                socket()->emitError(ConnectFailed, i18n("Identity of the peer cannot be established."));
-                socket()->protoAbort();
-                return;
-              }
+              // Ask the user and continue when the answer arrives
+              currentState = WaitPeerVerify;
+              socket()->emitEvent(Event::EventPeerVerify, qFingerprint);
+              return;
             }
           }
           
           currentState = ConnectComplete;
+          password = socket()->getConfig<QString>("auth.privkey_password");
+          process();
+          return;
+        }
+        case WaitPeerVerify: {
+          if (!isWakeup())
+            return;
+          
+          PeerVerifyWakeupEvent *response = static_cast<PeerVerifyWakeupEvent*>(m_wakeupEvent);
+          
+          if (!response->peerOk) {
+            socket()->emitEvent(Event::EventMessage, i18n("Peer verification has failed."));
+            socket()->emitError(ConnectFailed, i18n("Identity of the peer cannot be established."));
+            socket()->protoAbort();
+            return;
+          }
+          
+          currentState = ConnectComplete;
+          password = socket()->getConfig<QString>("auth.privkey_password");
         }
         case ConnectComplete: {
           int rc;
           
           if (socket()->getConfig<bool>("auth.pubkey")) {
             // Public key authentication - try without password first
-            QString password = socket()->getConfig<QString>("auth.privkey_password");
+            rc = libssh2_userauth_publickey_fromfile(session, (char*) url.user().toAscii().data(),
+                                                     (char*) socket()->getConfig<QString>("auth.pubkey_path").toAscii().data(),
+                                                     (char*) socket()->getConfig<QString>("auth.privkey_path").toAscii().data(),
+                                                     (char*) password.toAscii().data());
             
-            for (;;) {
-              while ((rc = libssh2_userauth_publickey_fromfile(session, (char*) url.user().toAscii().data(),
-                                                                        (char*) socket()->getConfig<QString>("auth.pubkey_path").toAscii().data(),
-                                                                        (char*) socket()->getConfig<QString>("auth.privkey_path").toAscii().data(),
-                                                                        (char*) password.toAscii().data())) == LIBSSH2_ERROR_EAGAIN) ;
-              
-              if (rc && password.isEmpty()) {
-                PubkeyWakeupEvent *response = static_cast<PubkeyWakeupEvent*>(socket()->emitEventAndWait(Event::EventPubkeyPassword));
-                if (response)
-                  password = response->password;
-                
-                if (password.isEmpty())
-                  break;
-                
-                continue;
-              }
-              
-              break;
+            if (rc == LIBSSH2_ERROR_EAGAIN) {
+              socket()->waitForSocket();
+              return;
+            }
+            
+            if (rc && password.isEmpty()) {
+              // Ask for the password and retry when the answer arrives
+              currentState = WaitPubkeyPassword;
+              socket()->emitEvent(Event::EventPubkeyPassword);
+              return;
             }
             
             if (rc) {
@@ -214,21 +251,20 @@ public:
             socket()->emitEvent(Event::EventMessage, i18n("Public key authentication succeeded."));
           } else if (url.hasPass()) {
             // First let's try simple password authentication
-            while ((rc = libssh2_userauth_password(session,
-                                                   (char*) url.user().toAscii().data(),
-                                                   (char*) url.pass().toAscii().data())) == LIBSSH2_ERROR_EAGAIN) ;
+            rc = libssh2_userauth_password(session,
+                                           (char*) url.user().toAscii().data(),
+                                           (char*) url.pass().toAscii().data());
+            
+            if (rc == LIBSSH2_ERROR_EAGAIN) {
+              socket()->waitForSocket();
+              return;
+            }
+            
             if (rc) {
               // Password authentication has failed, let's try keyboard-interactive
-              while ((rc = libssh2_userauth_keyboard_interactive(session,
-                                                                 (char*) url.user().toAscii().data(),
-                                                                 &keyboardInteractiveCallback)) == LIBSSH2_ERROR_EAGAIN) ;
-              if (rc) {
-                socket()->emitEvent(Event::EventMessage, i18n("Authentication has failed."));
-                socket()->emitError(LoginFailed, i18n("The specified login credentials were rejected by the server."));
-                
-                socket()->protoAbort();
-                return;
-              }
+              currentState = InteractiveAuth;
+              process();
+              return;
             }
             
             socket()->emitEvent(Event::EventMessage, i18n("Authentication succeeded."));
@@ -241,28 +277,83 @@ public:
           }
           
           currentState = LoginComplete;
+          process();
+          return;
         }
-        case LoginComplete: {
-          LIBSSH2_SFTP *sftpSession;
+        case InteractiveAuth: {
+          int rc = libssh2_userauth_keyboard_interactive(session,
+                                                         (char*) url.user().toAscii().data(),
+                                                         &keyboardInteractiveCallback);
           
-          do {
-            sftpSession = libssh2_sftp_init(session);
+          if (rc == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
+          if (rc) {
+            socket()->emitEvent(Event::EventMessage, i18n("Authentication has failed."));
+            socket()->emitError(LoginFailed, i18n("The specified login credentials were rejected by the server."));
             
-            if (!sftpSession && libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN) {
-              socket()->emitEvent(Event::EventMessage, i18n("Unable to initialize SFTP channel."));
-              socket()->emitError(LoginFailed, i18n("SFTP initialization has failed."));
-              
-              socket()->protoAbort();
+            socket()->protoAbort();
+            return;
+          }
+          
+          socket()->emitEvent(Event::EventMessage, i18n("Authentication succeeded."));
+          
+          currentState = LoginComplete;
+          process();
+          return;
+        }
+        case WaitPubkeyPassword: {
+          if (!isWakeup())
+            return;
+          
+          password = static_cast<PubkeyWakeupEvent*>(m_wakeupEvent)->password;
+          
+          if (password.isEmpty()) {
+            socket()->emitEvent(Event::EventMessage, i18n("Public key authentication has failed."));
+            socket()->emitError(LoginFailed, i18n("Unable to decrypt the public key or public key has been rejected by server."));
+            
+            socket()->protoAbort();
+            return;
+          }
+          
+          currentState = ConnectComplete;
+          process();
+          return;
+        }
+        case LoginComplete: {
+          LIBSSH2_SFTP *sftpSession = libssh2_sftp_init(session);
+          
+          if (!sftpSession) {
+            if (socket()->wouldBlock()) {
+              socket()->waitForSocket();
+              return;
             }
-          } while (!sftpSession);
+            
+            socket()->emitEvent(Event::EventMessage, i18n("Unable to initialize SFTP channel."));
+            socket()->emitError(LoginFailed, i18n("SFTP initialization has failed."));
+            
+            socket()->protoAbort();
+            return;
+          }
           
           socket()->m_sftpSession = sftpSession;
-          
+          currentState = SftpInitialized;
+        }
+        case SftpInitialized: {
           // Get the current directory
           char cwd[1024];
-          while (libssh2_sftp_realpath(sftpSession, "./", cwd, sizeof(cwd)) == LIBSSH2_ERROR_EAGAIN) ;
-          socket()->setDefaultDirectory(socket()->remoteEncoding()->decode(cwd));
-          socket()->setCurrentDirectory(socket()->remoteEncoding()->decode(cwd));
+          int rc = libssh2_sftp_realpath(socket()->sftpSession(), "./", cwd, sizeof(cwd) - 1);
+          
+          if (rc == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
+          QString directory = rc > 0 ? socket()->remoteEncoding()->decode(QByteArray(cwd, rc)) : QString("/");
+          socket()->setDefaultDirectory(directory);
+          socket()->setCurrentDirectory(directory);
           
           socket()->emitEvent(Event::EventMessage, i18n("Connected."));
           socket()->emitEvent(Event::EventConnect);
@@ -301,15 +392,26 @@ void SftpSocket::protoConnect(const KUrl &url)
   if (!getConfig("encoding").isEmpty())
     changeEncoding(getConfig("encoding"));
   
-  // Start the connect procedure
+  // Start the connect procedure. The socket is unbuffered, so it never reads
+  // from the connection and all data is left to libssh2.
   setCurrentUrl(url);
-  connectToHost(url.host(), url.port());
+  connectToHost(url.host(), url.port(), QIODevice::ReadWrite | QIODevice::Unbuffered);
 }
 
 void SftpSocket::slotConnected()
 {
   emitEvent(Event::EventState, i18n("Logging in..."));
   emitEvent(Event::EventMessage, i18n("Connected with server, stand by for authentication..."));
+  
+  // Setup notifiers that resume commands once the connection is ready
+  m_readNotifier = new QSocketNotifier(socketDescriptor(), QSocketNotifier::Read, this);
+  m_readNotifier->setEnabled(false);
+  connect(m_readNotifier, SIGNAL(activated(int)), this, SLOT(slotSocketActivated()));
+  
+  m_writeNotifier = new QSocketNotifier(socketDescriptor(), QSocketNotifier::Write, this);
+  m_writeNotifier->setEnabled(false);
+  connect(m_writeNotifier, SIGNAL(activated(int)), this, SLOT(slotSocketActivated()));
+  
   activateCommandClass(SftpCommandConnect);
 }
 
@@ -321,12 +423,104 @@ void SftpSocket::slotError()
   resetCommandClass(FailedSilently);
 }
 
+bool SftpSocket::wouldBlock()
+{
+  return libssh2_session_last_errno(m_sshSession) == LIBSSH2_ERROR_EAGAIN;
+}
+
+void SftpSocket::waitForSocket()
+{
+  int directions = libssh2_session_block_directions(m_sshSession);
+  
+  // Wait for incoming data when libssh2 doesn't tell what it is blocked on
+  if (!(directions & (LIBSSH2_SESSION_BLOCK_INBOUND | LIBSSH2_SESSION_BLOCK_OUTBOUND)))
+    directions = LIBSSH2_SESSION_BLOCK_INBOUND;
+  
+  m_socketWait = true;
+  m_readNotifier->setEnabled(directions & LIBSSH2_SESSION_BLOCK_INBOUND);
+  m_writeNotifier->setEnabled(directions & LIBSSH2_SESSION_BLOCK_OUTBOUND);
+}
+
+void SftpSocket::cancelWait()
+{
+  if (m_readNotifier) {
+    m_readNotifier->setEnabled(false);
+    m_writeNotifier->setEnabled(false);
+  }
+  
+  m_socketWait = false;
+  m_throttled = false;
+  m_throttleTimer->stop();
+}
+
+void SftpSocket::slotSocketActivated()
+{
+  // Notifiers are level triggered, so they stay off until the next wait
+  m_readNotifier->setEnabled(false);
+  m_writeNotifier->setEnabled(false);
+  
+  if (m_socketWait) {
+    // Repeat the libssh2 call the current command has been blocked on
+    m_socketWait = false;
+    nextCommand();
+  } else {
+    // The connection is idle, check if it has been closed by the server
+    char buffer;
+    int rc = ::recv(socketDescriptor(), &buffer, 1, MSG_PEEK);
+    
+    if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      slotDisconnected();
+      return;
+    }
+    
+    if (rc > 0 && m_sftpSession) {
+      // Something like a keepalive or a global request has arrived, let libssh2
+      // process it (a zero sized read consumes pending packets but leaves any
+      // channel data queued) so the notifier doesn't fire again for it
+      char dummy;
+      rc = libssh2_channel_read(libssh2_sftp_get_channel(m_sftpSession), &dummy, 0);
+      
+      if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+        slotDisconnected();
+        return;
+      }
+    }
+    
+    // Keep watching the connection while it is still idle
+    if (m_readNotifier && m_login && !m_cmdData)
+      m_readNotifier->setEnabled(true);
+  }
+}
+
+void SftpSocket::resetCommandClass(ResetCode code)
+{
+  // A reset command can't be waiting anymore, so stale notifications must not
+  // resume the next one
+  cancelWait();
+  
+  Socket::resetCommandClass(code);
+  
+  // Watch the idle connection so we notice when the server closes it
+  if (m_readNotifier && m_login && !m_cmdData)
+    m_readNotifier->setEnabled(true);
+}
+
 // *******************************************************************************************
 // **************************************** DISCONNECT ***************************************
 // *******************************************************************************************
 
 void SftpSocket::protoDisconnect()
 {
+  cancelWait();
+  
+  // We might have been called by a notifier, so they are deleted later
+  if (m_readNotifier) {
+    m_readNotifier->deleteLater();
+    m_writeNotifier->deleteLater();
+    m_readNotifier = 0;
+    m_writeNotifier = 0;
+  }
+  
   if (!m_sshSession)
     return;
   
@@ -373,103 +567,138 @@ void SftpSocket::slotDisconnected()
 class SftpCommandList : public Commands::Base {
 public:
     enum State {
-      None
+      None,
+      OpenDir,
+      ReadDir,
+      CloseDir
     };
     
     ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandList, SftpSocket, CmdList)
     
-    void process()
+    QByteArray directory;
+    LIBSSH2_SFTP_HANDLE *dir;
+    
+    void cleanup()
     {
-      // Check the directory listing cache
-      DirectoryListing cached = Cache::self()->findCached(socket(), socket()->getCurrentDirectory());
-      if (cached.isValid()) {
-        socket()->emitEvent(Event::EventMessage, i18n("Using cached directory listing."));
-        
-        if (socket()->isChained()) {
-          // We don't emit an event, because this list has been called from another
-          // command. Just save the listing.
-          socket()->m_lastDirectoryListing = cached;
-        } else
-          socket()->emitEvent(Event::EventDirectoryListing, cached);
-          
-        socket()->resetCommandClass();
-        return;
+      if (dir) {
+        socket()->m_transferHandle = dir;
+        socket()->closeTransferHandle();
       }
-      
-      socket()->m_lastDirectoryListing = DirectoryListing(socket()->getCurrentDirectory());
-      
-      char directory[1024] = {0,};
-      strcpy(directory, socket()->remoteEncoding()->encode(socket()->getCurrentDirectory()).data());
-      
-      LIBSSH2_SESSION *sshSession = socket()->sshSession();
-      LIBSSH2_SFTP *sftpSession = socket()->sftpSession();
-      LIBSSH2_SFTP_HANDLE *dir;
-      do {
-        dir = libssh2_sftp_opendir(sftpSession, directory);
-        
-        if (!dir && libssh2_session_last_errno(sshSession) != LIBSSH2_ERROR_EAGAIN) {
-          if (socket()->errorReporting()) {
-            socket()->emitError(ListFailed);
-            socket()->resetCommandClass(Failed);
-          } else {
+    }
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          dir = 0;
+          
+          // Check the directory listing cache
+          DirectoryListing cached = Cache::self()->findCached(socket(), socket()->getCurrentDirectory());
+          if (cached.isValid()) {
+            socket()->emitEvent(Event::EventMessage, i18n("Using cached directory listing."));
+            
+            if (socket()->isChained()) {
+              // We don't emit an event, because this list has been called from another
+              // command. Just save the listing.
+              socket()->m_lastDirectoryListing = cached;
+            } else
+              socket()->emitEvent(Event::EventDirectoryListing, cached);
+              
             socket()->resetCommandClass();
+            return;
           }
           
-          return;
+          socket()->m_lastDirectoryListing = DirectoryListing(socket()->getCurrentDirectory());
+          directory = socket()->remoteEncoding()->encode(socket()->getCurrentDirectory());
+          currentState = OpenDir;
         }
-      } while (!dir);
-      
-      // Read the specified directory
-      for (;;) {
-        int rc;
-        char filename[512];
-        LIBSSH2_SFTP_ATTRIBUTES attrs;
-        DirectoryEntry entry;
-        
-        while ((rc = libssh2_sftp_readdir(dir, filename, sizeof(filename), &attrs)) == LIBSSH2_ERROR_EAGAIN) ;
-        if (rc > 0) {
-          entry.setFilename(filename);
+        case OpenDir: {
+          dir = libssh2_sftp_opendir(socket()->sftpSession(), directory.data());
           
-          if (entry.filename() != "." && entry.filename() != "..") {
-            entry.setFilename(socket()->remoteEncoding()->decode(filename));
-            
-            if (attrs.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS) {
-              entry.setPermissions(attrs.permissions);
+          if (!dir) {
+            if (socket()->wouldBlock()) {
+              socket()->waitForSocket();
+              return;
             }
             
-            if (attrs.flags & LIBSSH2_SFTP_ATTR_UIDGID) {
-              entry.setOwner(QString::number(attrs.uid));
-              entry.setGroup(QString::number(attrs.gid));
+            if (socket()->errorReporting()) {
+              socket()->emitError(ListFailed);
+              socket()->resetCommandClass(Failed);
+            } else {
+              socket()->resetCommandClass();
             }
             
-            if (attrs.flags & LIBSSH2_SFTP_ATTR_SIZE) {
-              entry.setSize(attrs.filesize);
-            }
+            return;
+          }
+          
+          currentState = ReadDir;
+        }
+        case ReadDir: {
+          // Read the specified directory
+          for (;;) {
+            int rc;
+            char filename[512];
+            LIBSSH2_SFTP_ATTRIBUTES attrs;
+            DirectoryEntry entry;
             
-            if (attrs.flags & LIBSSH2_SFTP_ATTR_ACMODTIME) {
-              entry.setTime(attrs.mtime);
+            rc = libssh2_sftp_readdir(dir, filename, sizeof(filename), &attrs);
+            if (rc == LIBSSH2_ERROR_EAGAIN) {
+              socket()->waitForSocket();
+              return;
+            } else if (rc > 0) {
+              entry.setFilename(filename);
+              
+              if (entry.filename() != "." && entry.filename() != "..") {
+                entry.setFilename(socket()->remoteEncoding()->decode(filename));
+                
+                if (attrs.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS) {
+                  entry.setPermissions(attrs.permissions);
+                }
+                
+                if (attrs.flags & LIBSSH2_SFTP_ATTR_UIDGID) {
+                  entry.setOwner(QString::number(attrs.uid));
+                  entry.setGroup(QString::number(attrs.gid));
+                }
+                
+                if (attrs.flags & LIBSSH2_SFTP_ATTR_SIZE) {
+                  entry.setSize(attrs.filesize);
+                }
+                
+                if (attrs.flags & LIBSSH2_SFTP_ATTR_ACMODTIME) {
+                  entry.setTime(attrs.mtime);
+                }
+                
+                if (attrs.permissions & S_IFDIR)
+                  entry.setType('d');
+                else
+                  entry.setType('f');
+                
+                socket()->m_lastDirectoryListing.addEntry(entry);
+              }
+            } else {
+              break;
             }
-            
-            if (attrs.permissions & S_IFDIR)
-              entry.setType('d');
-            else
-              entry.setType('f');
-            
-            socket()->m_lastDirectoryListing.addEntry(entry);
           }
-        } else {
+          
+          currentState = CloseDir;
+        }
+        case CloseDir: {
+          if (libssh2_sftp_closedir(dir) == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
+          dir = 0;
+          
+          // Cache the directory listing
+          Cache::self()->addDirectory(socket(), socket()->m_lastDirectoryListing);
+          
+          if (!socket()->isChained())
+            socket()->emitEvent(Event::EventDirectoryListing, socket()->m_lastDirectoryListing);
+          socket()->resetCommandClass();
           break;
         }
       }
-      
-      while (libssh2_sftp_closedir(dir) == LIBSSH2_ERROR_EAGAIN) ;
-      
-      // Cache the directory listing
-      Cache::self()->addDirectory(socket(), socket()->m_lastDirectoryListing);
-      
-      if (!socket()->isChained())
-        socket()->emitEvent(Event::EventDirectoryListing, socket()->m_lastDirectoryListing);
-      socket()->resetCommandClass();
     }
 };
 
@@ -494,25 +723,23 @@ public:
       None,
       WaitStat,
       DestChecked,
-      WaitTransfer
+      OpenFile,
+      Transfer,
+      CloseFile
     };
     
     ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandGet, SftpSocket, CmdGet)
     
     KUrl sourceFile;
     KUrl destinationFile;
+    QByteArray sourcePath;
     filesize_t resumeOffset;
     time_t modificationTime;
-    QTimer pollTimer;
     
     void cleanup()
     {
       socket()->getTransferFile()->close();
-      socket()->disconnect(&pollTimer, SIGNAL(timeout()), socket(), SLOT(slotDataTryRead()));
-      
-      LIBSSH2_SFTP_HANDLE *rfile = socket()->m_transferHandle;
-      if (rfile)
-        while (libssh2_sftp_close(rfile) == LIBSSH2_ERROR_EAGAIN) ;
+      socket()->closeTransferHandle();
       
       free(socket()->m_transferBuffer);
       socket()->m_transferBuffer = 0;
@@ -526,8 +753,8 @@ public:
           // Stat source file
           modificationTime = 0;
           resumeOffset = 0;
-          sourceFile.setPath(socket()->getConfig("params.get.source"));
-          destinationFile.setPath(socket()->getConfig("params.get.destination"));
+          sourceFile.setPath(socket()->getConfig(Settings::GetSource));
+          destinationFile.setPath(socket()->getConfig(Settings::GetDestination));
           
           currentState = WaitStat;
           socket()->protoStat(sourceFile);
@@ -596,24 +823,25 @@ public:
             socket()->getTransferFile()->open(QIODevice::WriteOnly | QIODevice::Truncate);
           }
           
+          sourcePath = socket()->remoteEncoding()->encode(sourceFile.path());
+          currentState = OpenFile;
+        }
+        case OpenFile: {
           // Start the file transfer
-          char path[1024] = {0,};
-          strcpy(path, socket()->remoteEncoding()->encode(sourceFile.path()).data());
-          
-          LIBSSH2_SESSION *sshSession = socket()->sshSession();
-          LIBSSH2_SFTP *sftpSession = socket()->sftpSession();
-          LIBSSH2_SFTP_HANDLE *rfile;
-          do {
-            rfile = libssh2_sftp_open(sftpSession, path, LIBSSH2_FXF_READ, 0);
-            
-            if (!rfile && libssh2_session_last_errno(sshSession) != LIBSSH2_ERROR_EAGAIN) {
-              markClean();
-              
-              socket()->getTransferFile()->close();
-              socket()->resetCommandClass(Failed);
+          LIBSSH2_SFTP_HANDLE *rfile = libssh2_sftp_open(socket()->sftpSession(), sourcePath.data(), LIBSSH2_FXF_READ, 0);
+          
+          if (!rfile) {
+            if (socket()->wouldBlock()) {
+              socket()->waitForSocket();
               return;
             }
-          } while (!rfile);
+            
+            markClean();
+            
+            socket()->getTransferFile()->close();
+            socket()->resetCommandClass(Failed);
+            return;
+          }
           
           if (resumeOffset > 0)
             libssh2_sftp_seek(rfile, resumeOffset);
@@ -623,23 +851,36 @@ public:
           socket()->m_transferBuffer = (char*) malloc(socket()->m_transferBufferSize);
           socket()->m_transferBytes = 0;
           socket()->m_transferHandle = rfile;
-          socket()->m_speedLastTime = time(0);
-          socket()->m_speedLastBytes = 0;
-          SpeedLimiter::self()->append(socket(), SpeedLimiter::Download);
+          socket()->m_speedMeter.reset();
+          socket()->setupSpeedLimiter(socket(), SpeedLimiter::Download);
           
-          // Connect to socket read notifications
-          socket()->connect(&pollTimer, SIGNAL(timeout()), socket(), SLOT(slotDataTryRead()));
-          pollTimer.start(0);
+          currentState = Transfer;
+        }
+        case Transfer: {
+          switch (socket()->transferRead()) {
+            case SftpSocket::TransferPending: return;
+            case SftpSocket::TransferFailed: {
+              // An error has ocurred while reading, transfer is aborted
+              socket()->emitEvent(Event::EventMessage, i18n("Transfer has failed."));
+              socket()->resetCommandClass(Failed);
+              return;
+            }
+            case SftpSocket::TransferComplete: break;
+          }
           
-          currentState = WaitTransfer;
-          break;
+          currentState = CloseFile;
         }
-        case WaitTransfer: {
+        case CloseFile: {
+          if (libssh2_sftp_close(socket()->m_transferHandle) == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
           // Transfer has been completed
           markClean();
           
+          socket()->m_transferHandle = 0;
           socket()->getTransferFile()->close();
-          socket()->disconnect(&pollTimer, SIGNAL(timeout()), socket(), SLOT(slotDataTryRead()));
           
           if (modificationTime != 0) {
             // Use the modification time we got from stating
@@ -649,9 +890,6 @@ public:
             utime(destinationFile.path().toAscii(), &tmp);
           }
           
-          LIBSSH2_SFTP_HANDLE *rfile = socket()->m_transferHandle;
-          while (libssh2_sftp_close(rfile) == LIBSSH2_ERROR_EAGAIN) ;
-          
           free(socket()->m_transferBuffer);
           socket()->m_transferBuffer = 0;
           SpeedLimiter::self()->remove(socket());
@@ -680,52 +918,106 @@ void SftpSocket::variableBufferUpdate(int size)
   }
 }
 
-void SftpSocket::slotDataTryRead()
+void SftpSocket::closeTransferHandle()
 {
   if (!m_transferHandle)
     return;
   
-  bool updateVariableBuffer = true;
-  
-  // Enforce speed limits
-  if (allowedBytes() > -1) {
-    m_transferBufferSize = allowedBytes();
-    
-    if (m_transferBufferSize > 32768)
-      m_transferBufferSize = 32768;
-    else if (m_transferBufferSize == 0)
-      return;
-    
-    m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
-    updateVariableBuffer = false;
-  } else if (m_transferBufferSize == 0) {
-    m_transferBufferSize = 4096;
-    m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
+  // Waiting for the server here could stall every connection served by the
+  // same I/O thread, so when the close would block the session (and the
+  // handle with it) is dropped instead. Nothing may use the half-written
+  // request stream until the disconnect has been processed.
+  if (m_sshSession && libssh2_sftp_close(m_transferHandle) == LIBSSH2_ERROR_EAGAIN) {
+    m_login = false;
+    QTimer::singleShot(0, this, SLOT(slotDisconnected()));
   }
   
-  int readBytes = 0;
-  do {
-    readBytes = libssh2_sftp_read(m_transferHandle, m_transferBuffer, m_transferBufferSize);
-  } while (readBytes == LIBSSH2_ERROR_EAGAIN);
+  m_transferHandle = 0;
+}
+
+void SftpSocket::speedLimiterWakeup()
+{
+  // We are called from the speed limiter, continue in our own thread
+  m_thread->throttleWakeup();
+}
+
+void SftpSocket::scheduleThrottleWakeup()
+{
+  // Try again once the limiter should have refilled our bucket, unless it
+  // wakes us up sooner
+  m_throttled = true;
   
-  if (readBytes == 0) {
-    // Transfer has been completed
-    nextCommand();
-    return;
-  } else if (readBytes < 0) {
-    // An error has ocurred while reading, transfer is aborted
-    emitEvent(Event::EventMessage, i18n("Transfer has failed."));
-    resetCommandClass(Failed);
+  if (!m_throttleTimer->isActive())
+    m_throttleTimer->start(SpeedLimiter::self()->wakeupDelay(this));
+}
+
+void SftpSocket::slotThrottleTimeout()
+{
+  throttleWakeup();
+}
+
+void SftpSocket::throttleWakeup()
+{
+  m_throttleTimer->stop();
+  
+  if (!m_throttled)
     return;
-  } else {
+  
+  m_throttled = false;
+  nextCommand();
+}
+
+SftpSocket::TransferResult SftpSocket::transferRead()
+{
+  // Only transfer a limited number of blocks at once, so other connections
+  // served by the same thread get their turn
+  for (int i = 0; i < transferBatch; i++) {
+    bool updateVariableBuffer = true;
+    
+    // Enforce speed limits
+    int allowed = allowedBytes();
+    if (allowed > -1) {
+      m_transferBufferSize = allowed;
+      
+      if (m_transferBufferSize > 32768) {
+        m_transferBufferSize = 32768;
+      } else if (m_transferBufferSize == 0) {
+        scheduleThrottleWakeup();
+        return TransferPending;
+      }
+      
+      m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
+      updateVariableBuffer = false;
+    } else if (m_transferBufferSize == 0) {
+      m_transferBufferSize = 4096;
+      m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
+    }
+    
+    int readBytes = libssh2_sftp_read(m_transferHandle, m_transferBuffer, m_transferBufferSize);
+    
+    if (readBytes == LIBSSH2_ERROR_EAGAIN) {
+      waitForSocket();
+      return TransferPending;
+    } else if (readBytes == 0) {
+      return TransferComplete;
+    } else if (readBytes < 0) {
+      return TransferFailed;
+    }
+    
     updateUsage(readBytes);
     
     m_transferFile.write(m_transferBuffer, readBytes);
     m_transferBytes += readBytes;
+    m_speedMeter.add(readBytes);
+    metrics()->counter(MetricsSite::BytesDownloaded).add(readBytes);
+    
+    if (updateVariableBuffer)
+      variableBufferUpdate(readBytes);
   }
   
-  if (updateVariableBuffer)
-    variableBufferUpdate(readBytes);
+  // Continue in the next thread loop
+  nextCommandAsync();
+  return TransferPending;
 }
 
 void SftpSocket::protoGet(const KUrl &source, const KUrl &destination)
@@ -734,8 +1026,8 @@ void SftpSocket::protoGet(const KUrl &source, const KUrl &destination)
   emitEvent(Event::EventMessage, i18n("Downloading file '%1'...",source.fileName()));
   
   // Set the source and destination
-  setConfig("params.get.source", source.path());
-  setConfig("params.get.destination", destination.path());
+  setConfig(Settings::GetSource, source.path());
+  setConfig(Settings::GetDestination, destination.path());
   
   activateCommandClass(SftpCommandGet);
 }
@@ -749,26 +1041,30 @@ public:
     enum State {
       None,
       WaitStat,
+      MakeDir,
       DestChecked,
-      WaitTransfer
+      OpenFile,
+      Transfer,
+      SetTime,
+      CloseFile
     };
     
     ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandPut, SftpSocket, CmdPut)
     
     KUrl sourceFile;
     KUrl destinationFile;
+    QByteArray destinationPath;
+    QString destinationDir;
+    int currentPart;
+    int numParts;
     filesize_t resumeOffset;
     time_t modificationTime;
-    QTimer pollTimer;
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
     
     void cleanup()
     {
       socket()->getTransferFile()->close();
-      socket()->disconnect(&pollTimer, SIGNAL(timeout()), socket(), SLOT(slotDataTryWrite()));
-      
-      LIBSSH2_SFTP_HANDLE *rfile = socket()->m_transferHandle;
-      if (rfile)
-        while (libssh2_sftp_close(rfile) == LIBSSH2_ERROR_EAGAIN) ;
+      socket()->closeTransferHandle();
       
       free(socket()->m_transferBuffer);
       socket()->m_transferBuffer = 0;
@@ -782,8 +1078,8 @@ public:
           // Stat source file
           resumeOffset = 0;
           modificationTime = 0;
-          sourceFile.setPath(socket()->getConfig("params.get.source"));
-          destinationFile.setPath(socket()->getConfig("params.get.destination"));
+          sourceFile.setPath(socket()->getConfig(Settings::GetSource));
+          destinationFile.setPath(socket()->getConfig(Settings::GetDestination));
           
           if (!QDir::root().exists(sourceFile.path())) {
             markClean();
@@ -809,20 +1105,25 @@ public:
             currentState = DestChecked;
             socket()->emitEvent(Event::EventFileExists, list);
             return;
-          } else {
-            // Create destination directories
-            socket()->setErrorReporting(false);
-            
-            QString destinationDir = destinationFile.directory();
-            QString fullPath;
-            
-            for (register int i = 1; i <= destinationDir.count('/'); i++) {
-              fullPath += "/" + destinationDir.section('/', i, i);
-              
-              // Create the directory
-              socket()->protoMkdir(fullPath);
-            }
           }
+          
+          // Create destination directories one by one, failures are ignored
+          // since most of them will already exist
+          socket()->setErrorReporting(false);
+          
+          destinationDir = destinationFile.directory();
+          currentPart = 0;
+          numParts = destinationDir.count('/');
+          currentState = MakeDir;
+        }
+        case MakeDir: {
+          if (currentPart < numParts) {
+            socket()->protoMkdir(KUrl("/" + destinationDir.section('/', 1, ++currentPart)));
+            return;
+          }
+          
+          socket()->setErrorReporting(true);
+          currentState = DestChecked;
         }
         case DestChecked: {
           if (isWakeup()) {
@@ -865,28 +1166,30 @@ public:
             socket()->getTransferFile()->open(QIODevice::ReadOnly);
           }
           
+          destinationPath = socket()->remoteEncoding()->encode(destinationFile.path());
+          currentState = OpenFile;
+        }
+        case OpenFile: {
           // Start the file transfer
-          char path[1024] = {0,};
-          strcpy(path, socket()->remoteEncoding()->encode(destinationFile.path()).data());
-          
           int flags = resumeOffset > 0 ? LIBSSH2_FXF_WRITE | LIBSSH2_FXF_APPEND : 
                                          LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC;
           
-          LIBSSH2_SESSION *sshSession = socket()->sshSession();
-          LIBSSH2_SFTP *sftpSession = socket()->sftpSession();
-          LIBSSH2_SFTP_HANDLE *rfile;
-          do {
-            rfile = libssh2_sftp_open(sftpSession, path, flags, LIBSSH2_SFTP_S_IRUSR | LIBSSH2_SFTP_S_IWUSR |
-                                                                LIBSSH2_SFTP_S_IRGRP | LIBSSH2_SFTP_S_IROTH);
-            
-            if (!rfile && libssh2_session_last_errno(sshSession) != LIBSSH2_ERROR_EAGAIN) {
-              markClean();
-              
-              socket()->getTransferFile()->close();
-              socket()->resetCommandClass(Failed);
+          LIBSSH2_SFTP_HANDLE *rfile = libssh2_sftp_open(socket()->sftpSession(), destinationPath.data(), flags,
+                                                         LIBSSH2_SFTP_S_IRUSR | LIBSSH2_SFTP_S_IWUSR |
+                                                         LIBSSH2_SFTP_S_IRGRP | LIBSSH2_SFTP_S_IROTH);
+          
+          if (!rfile) {
+            if (socket()->wouldBlock()) {
+              socket()->waitForSocket();
               return;
             }
-          } while (!rfile);
+            
+            markClean();
+            
+            socket()->getTransferFile()->close();
+            socket()->resetCommandClass(Failed);
+            return;
+          }
           
           if (resumeOffset > 0)
             libssh2_sftp_seek(rfile, resumeOffset);
@@ -894,38 +1197,57 @@ public:
           // Initialize the transfer buffer
           socket()->m_transferBufferSize = 4096;
           socket()->m_transferBuffer = (char*) malloc(socket()->m_transferBufferSize);
+          socket()->m_transferPending = 0;
           socket()->m_transferBytes = 0;
           socket()->m_transferHandle = rfile;
-          socket()->m_speedLastTime = time(0);
-          socket()->m_speedLastBytes = 0;
-          SpeedLimiter::self()->append(socket(), SpeedLimiter::Upload);
+          socket()->m_speedMeter.reset();
+          socket()->setupSpeedLimiter(socket(), SpeedLimiter::Upload);
           
-          // Connect to socket read notifications
-          socket()->connect(&pollTimer, SIGNAL(timeout()), socket(), SLOT(slotDataTryWrite()));
-          pollTimer.start(0);
-          
-          currentState = WaitTransfer;
-          break;
+          currentState = Transfer;
         }
-        case WaitTransfer: {
-          // Transfer has been completed
-          markClean();
-          
-          socket()->getTransferFile()->close();
-          socket()->disconnect(&pollTimer, SIGNAL(timeout()), socket(), SLOT(slotDataTryWrite()));
-          
-          LIBSSH2_SFTP_HANDLE *rfile = socket()->m_transferHandle;
+        case Transfer: {
+          switch (socket()->transferWrite()) {
+            case SftpSocket::TransferPending: return;
+            case SftpSocket::TransferFailed: {
+              // An error has ocurred while writing, transfer is aborted
+              socket()->emitEvent(Event::EventMessage, i18n("Transfer has failed."));
+              socket()->resetCommandClass(Failed);
+              return;
+            }
+            case SftpSocket::TransferComplete: break;
+          }
           
           if (modificationTime != 0) {
             // Use the modification time we got from stating
-            LIBSSH2_SFTP_ATTRIBUTES attrs;
+            attrs.atime = time(0);
             attrs.mtime = modificationTime;
             attrs.flags = LIBSSH2_SFTP_ATTR_ACMODTIME;
-            
-            while (libssh2_sftp_fsetstat(rfile, &attrs) == LIBSSH2_ERROR_EAGAIN) ;
+            currentState = SetTime;
+          } else {
+            currentState = CloseFile;
+            process();
+            return;
+          }
+        }
+        case SetTime: {
+          if (libssh2_sftp_fsetstat(socket()->m_transferHandle, &attrs) == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
           }
           
-          while (libssh2_sftp_close(rfile) == LIBSSH2_ERROR_EAGAIN) ;
+          currentState = CloseFile;
+        }
+        case CloseFile: {
+          if (libssh2_sftp_close(socket()->m_transferHandle) == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
+          // Transfer has been completed
+          markClean();
+          
+          socket()->m_transferHandle = 0;
+          socket()->getTransferFile()->close();
           
           free(socket()->m_transferBuffer);
           socket()->m_transferBuffer = 0;
@@ -940,66 +1262,76 @@ public:
     }
 };
 
-void SftpSocket::slotDataTryWrite()
+SftpSocket::TransferResult SftpSocket::transferWrite()
 {
-  if (!m_transferHandle)
-    return;
-  
-  bool updateVariableBuffer = true;
-  
-  // Enforce speed limits
-  if (allowedBytes() > -1) {
-    m_transferBufferSize = allowedBytes();
-    
-    if (m_transferBufferSize > 32768)
-      m_transferBufferSize = 32768;
-    else if (m_transferBufferSize == 0)
-      return;
-    
-    m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
-    updateVariableBuffer = false;
-  } else if (m_transferBufferSize == 0) {
-    m_transferBufferSize = 4096;
-    m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
-  }
-  
   if (!getTransferFile()->isOpen())
-    return;
+    return TransferFailed;
   
   // If there is nothing to upload, just close the connection right away
-  if (getTransferFile()->size() == 0) {
-    nextCommand();
-    return;
-  }
-  
-  qint64 tmpOffset = getTransferFile()->pos();
-  qint64 readSize = getTransferFile()->read(m_transferBuffer, m_transferBufferSize);
-  int writtenBytes = 0;
+  if (getTransferFile()->size() == 0)
+    return TransferComplete;
   
-  do {
-    writtenBytes = libssh2_sftp_write(m_transferHandle, m_transferBuffer, readSize);
-  } while (writtenBytes == LIBSSH2_ERROR_EAGAIN);
-  
-  if (writtenBytes < 0) {
-    // An error has ocurred while writing, transfer is aborted
-    emitEvent(Event::EventMessage, i18n("Transfer has failed."));
-    resetCommandClass(Failed);
-    return;
-  } else if (writtenBytes < readSize) {
-    getTransferFile()->seek(tmpOffset + writtenBytes);
-  }
-  
-  m_transferBytes += writtenBytes;
-  updateUsage(writtenBytes);
-  
-  if (getTransferFile()->atEnd()) {
+  // Only transfer a limited number of blocks at once, so other connections
+  // served by the same thread get their turn
+  for (int i = 0; i < transferBatch; i++) {
+    bool updateVariableBuffer = true;
+    
+    // A write that would have blocked must be repeated with the same data
+    if (!m_transferPending) {
+      // Enforce speed limits
+      int allowed = allowedBytes();
+      if (allowed > -1) {
+        m_transferBufferSize = allowed;
+        
+        if (m_transferBufferSize > 32768) {
+          m_transferBufferSize = 32768;
+        } else if (m_transferBufferSize == 0) {
+          scheduleThrottleWakeup();
+          return TransferPending;
+        }
+        
+        m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
+        updateVariableBuffer = false;
+      } else if (m_transferBufferSize == 0) {
+        m_transferBufferSize = 4096;
+        m_transferBuffer = (char*) realloc(m_transferBuffer, m_transferBufferSize);
+      }
+      
+      m_transferPending = getTransferFile()->read(m_transferBuffer, m_transferBufferSize);
+      if (m_transferPending < 0) {
+        m_transferPending = 0;
+        return TransferFailed;
+      }
+    }
+    
+    int writtenBytes = libssh2_sftp_write(m_transferHandle, m_transferBuffer, m_transferPending);
+    
+    if (writtenBytes == LIBSSH2_ERROR_EAGAIN) {
+      waitForSocket();
+      return TransferPending;
+    } else if (writtenBytes < 0) {
+      return TransferFailed;
+    } else if (writtenBytes < m_transferPending) {
+      getTransferFile()->seek(getTransferFile()->pos() - (m_transferPending - writtenBytes));
+    }
+    
+    m_transferPending = 0;
+    m_transferBytes += writtenBytes;
+    m_speedMeter.add(writtenBytes);
+    metrics()->counter(MetricsSite::BytesUploaded).add(writtenBytes);
+    updateUsage(writtenBytes);
+    
     // We have reached the end of file, so we should terminate the connection
-    nextCommand();
-    return;
+    if (getTransferFile()->atEnd())
+      return TransferComplete;
+    
+    if (updateVariableBuffer)
+      variableBufferUpdate(writtenBytes);
   }
   
-  if (updateVariableBuffer)
-    variableBufferUpdate(writtenBytes);
+  // Continue in the next thread loop
+  nextCommandAsync();
+  return TransferPending;
 }
 
 void SftpSocket::protoPut(const KUrl &source, const KUrl &destination)
@@ -1008,8 +1340,8 @@ void SftpSocket::protoPut(const KUrl &source, const KUrl &destination)
   emitEvent(Event::EventMessage, i18n("Uploading file '%1'...",source.fileName()));
   
   // Set the source and destination
-  setConfig("params.get.source", source.path());
-  setConfig("params.get.destination", destination.path());
+  setConfig(Settings::GetSource, source.path());
+  setConfig(Settings::GetDestination, destination.path());
   
   activateCommandClass(SftpCommandPut);
 }
@@ -1018,99 +1350,324 @@ void SftpSocket::protoPut(const KUrl &source, const KUrl &destination)
 // **************************************** REMOVE *******************************************
 // *******************************************************************************************
 
+class SftpCommandRemove : public Commands::Base {
+public:
+    enum State {
+      None,
+      SentRemove
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandRemove, SftpSocket, CmdNone)
+    
+    KUrl destinationPath;
+    QByteArray path;
+    bool directory;
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          destinationPath = KUrl(socket()->getConfig(Settings::RemovePath));
+          directory = socket()->getConfig<bool>(Settings::RemoveDirectory);
+          path = socket()->remoteEncoding()->encode(destinationPath.path());
+          
+          currentState = SentRemove;
+        }
+        case SentRemove: {
+          // Remove a file or directory
+          int result;
+          
+          if (directory)
+            result = libssh2_sftp_rmdir(socket()->sftpSession(), path.data());
+          else
+            result = libssh2_sftp_unlink(socket()->sftpSession(), path.data());
+          
+          if (result == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
+          if (result < 0) {
+            socket()->resetCommandClass(Failed);
+          } else {
+            // Invalidate cached parent entry (if any)
+            Cache::self()->invalidateEntry(socket(), destinationPath.directory());
+            
+            socket()->emitEvent(Event::EventReloadNeeded);
+            socket()->resetCommandClass();
+          }
+          break;
+        }
+      }
+    }
+};
+
 void SftpSocket::protoRemove(const KUrl &path)
 {
   emitEvent(Event::EventState, i18n("Removing..."));
   
-  // Remove a file or directory
-  int result = 0;
+  // Set the file to remove
+  setConfig(Settings::RemovePath, path.path());
   
-  if (getConfig<bool>("params.remove.directory"))
-    while ((result = libssh2_sftp_rmdir(m_sftpSession, remoteEncoding()->encode(path.path()).data())) == LIBSSH2_ERROR_EAGAIN) ;
-  else
-    while ((result = libssh2_sftp_unlink(m_sftpSession, remoteEncoding()->encode(path.path()).data())) == LIBSSH2_ERROR_EAGAIN) ;
-    
-  if (result < 0) {
-    resetCommandClass(Failed);
-  } else {
-    // Invalidate cached parent entry (if any)
-    Cache::self()->invalidateEntry(this, path.directory());
-    
-    emitEvent(Event::EventReloadNeeded);
-    resetCommandClass();
-  }
+  activateCommandClass(SftpCommandRemove);
 }
 
 // *******************************************************************************************
 // **************************************** RENAME *******************************************
 // *******************************************************************************************
 
+class SftpCommandRename : public Commands::Base {
+public:
+    enum State {
+      None,
+      SentRename
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandRename, SftpSocket, CmdRename)
+    
+    KUrl sourcePath;
+    KUrl destinationPath;
+    QByteArray source;
+    QByteArray destination;
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          sourcePath = KUrl(socket()->getConfig(Settings::RenameSource));
+          destinationPath = KUrl(socket()->getConfig(Settings::RenameDestination));
+          source = socket()->remoteEncoding()->encode(sourcePath.path());
+          destination = socket()->remoteEncoding()->encode(destinationPath.path());
+          
+          currentState = SentRename;
+        }
+        case SentRename: {
+          int result = libssh2_sftp_rename(socket()->sftpSession(), source.data(), destination.data());
+          
+          if (result == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
+          if (result < 0) {
+            socket()->resetCommandClass(Failed);
+          } else {
+            // Invalidate cached parent entry (if any)
+            Cache::self()->invalidateEntry(socket(), sourcePath.directory());
+            Cache::self()->invalidateEntry(socket(), destinationPath.directory());
+            
+            socket()->emitEvent(Event::EventReloadNeeded);
+            socket()->resetCommandClass();
+          }
+          break;
+        }
+      }
+    }
+};
+
 void SftpSocket::protoRename(const KUrl &source, const KUrl &destination)
 {
   emitEvent(Event::EventState, i18n("Renaming..."));
   
-  int result = 0;
-  while ((result = libssh2_sftp_rename(m_sftpSession,
-                                       remoteEncoding()->encode(source.path()).data(),
-                                       remoteEncoding()->encode(destination.path()).data()) == LIBSSH2_ERROR_EAGAIN)) ;
+  // Set rename options
+  setConfig(Settings::RenameSource, source.path());
+  setConfig(Settings::RenameDestination, destination.path());
   
-  if (result < 0) {
-    resetCommandClass(Failed);
-  } else {
-    // Invalidate cached parent entry (if any)
-    Cache::self()->invalidateEntry(this, source.directory());
-    Cache::self()->invalidateEntry(this, destination.directory());
-    
-    emitEvent(Event::EventReloadNeeded);
-    resetCommandClass();
-  }
+  activateCommandClass(SftpCommandRename);
 }
 
 // *******************************************************************************************
 // **************************************** CHMOD ********************************************
 // *******************************************************************************************
 
+class SftpCommandChmod : public Commands::Base {
+public:
+    enum State {
+      None,
+      SentChmod
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandChmod, SftpSocket, CmdChmod)
+    
+    KUrl destinationPath;
+    QByteArray path;
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          destinationPath = KUrl(socket()->getConfig(Settings::ChmodPath));
+          path = socket()->remoteEncoding()->encode(destinationPath.path());
+          
+          attrs.permissions = socket()->intToPosix(socket()->getConfig<int>(Settings::ChmodMode));
+          attrs.flags = LIBSSH2_SFTP_ATTR_PERMISSIONS;
+          
+          currentState = SentChmod;
+        }
+        case SentChmod: {
+          if (libssh2_sftp_setstat(socket()->sftpSession(), path.data(), &attrs) == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
+          // Invalidate cached parent entry (if any)
+          Cache::self()->invalidateEntry(socket(), destinationPath.directory());
+          
+          socket()->emitEvent(Event::EventReloadNeeded);
+          socket()->resetCommandClass();
+          break;
+        }
+      }
+    }
+};
+
 void SftpSocket::protoChmodSingle(const KUrl &path, int mode)
 {
   emitEvent(Event::EventState, i18n("Changing mode..."));
   
-  LIBSSH2_SFTP_ATTRIBUTES attrs;
-  attrs.permissions = intToPosix(mode);
-  attrs.flags = LIBSSH2_SFTP_ATTR_PERMISSIONS;
+  // Set chmod options
+  setConfig(Settings::ChmodPath, path.path());
+  setConfig(Settings::ChmodMode, mode);
   
-  while (libssh2_sftp_setstat(m_sftpSession, remoteEncoding()->encode(path.path()).data(), &attrs) == LIBSSH2_ERROR_EAGAIN) ;
+  activateCommandClass(SftpCommandChmod);
+}
+
+class SftpCommandChmodMultiple : public Commands::Base {
+public:
+    enum State {
+      None,
+      SentChmod
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandChmodMultiple, SftpSocket, CmdNone)
+    
+    KUrl parentDirectory;
+    QStringList files;
+    int nextFile;
+    QByteArray path;
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          parentDirectory = KUrl(socket()->getConfig(Settings::ChmodParent));
+          files = socket()->getConfig<QStringList>(Settings::ChmodFiles);
+          nextFile = 0;
+          
+          attrs.permissions = socket()->intToPosix(socket()->getConfig<int>(Settings::ChmodMode));
+          attrs.flags = LIBSSH2_SFTP_ATTR_PERMISSIONS;
+          
+          currentState = SentChmod;
+          path = QByteArray();
+        }
+        case SentChmod: {
+          // Change the mode of all files and only invalidate the cache and
+          // reset the command class once
+          while (nextFile < files.count()) {
+            if (path.isEmpty()) {
+              KUrl filePath = parentDirectory;
+              filePath.addPath(files.at(nextFile));
+              path = socket()->remoteEncoding()->encode(filePath.path());
+            }
+            
+            int result = libssh2_sftp_setstat(socket()->sftpSession(), path.data(), &attrs);
+            
+            if (result == LIBSSH2_ERROR_EAGAIN) {
+              socket()->waitForSocket();
+              return;
+            }
+            
+            if (result < 0) {
+              Cache::self()->invalidateEntry(socket(), parentDirectory.path());
+              socket()->resetCommandClass(Failed);
+              return;
+            }
+            
+            path = QByteArray();
+            nextFile++;
+          }
+          
+          // Invalidate cached parent entry (if any)
+          Cache::self()->invalidateEntry(socket(), parentDirectory.path());
+          socket()->resetCommandClass();
+          break;
+        }
+      }
+    }
+};
+
+void SftpSocket::protoChmodMultiple(const KUrl &parent, const QStringList &files, int mode)
+{
+  emitEvent(Event::EventState, i18n("Changing mode..."));
   
-  // Invalidate cached parent entry (if any)
-  Cache::self()->invalidateEntry(this, path.directory());
+  // Set chmod options
+  setConfig(Settings::ChmodParent, parent.path());
+  setConfig(Settings::ChmodFiles, files);
+  setConfig(Settings::ChmodMode, mode);
   
-  emitEvent(Event::EventReloadNeeded);
-  resetCommandClass();
+  activateCommandClass(SftpCommandChmodMultiple);
 }
 
 // *******************************************************************************************
 // **************************************** MKDIR ********************************************
 // *******************************************************************************************
 
-void SftpSocket::protoMkdir(const KUrl &path)
-{
-  int result = 0;
-  while ((result = libssh2_sftp_mkdir(m_sftpSession, remoteEncoding()->encode(path.path()).data(), 0755)) == LIBSSH2_ERROR_EAGAIN) ;
-  
-  if (result < 0) {
-    if (errorReporting(true))
-      resetCommandClass(Failed);
-  } else {
-    // Invalidate cached parent entry (if any)
-    Cache::self()->invalidateEntry(this, path.directory());
+class SftpCommandMkdir : public Commands::Base {
+public:
+    enum State {
+      None,
+      SentMkdir
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(SftpCommandMkdir, SftpSocket, CmdMkdir)
     
-    if (errorReporting(true)) {
-      emitEvent(Event::EventReloadNeeded);
-      resetCommandClass();
+    KUrl destinationPath;
+    QByteArray path;
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          destinationPath = KUrl(socket()->getConfig(Settings::MkdirPath));
+          path = socket()->remoteEncoding()->encode(destinationPath.path());
+          
+          currentState = SentMkdir;
+        }
+        case SentMkdir: {
+          int result = libssh2_sftp_mkdir(socket()->sftpSession(), path.data(), 0755);
+          
+          if (result == LIBSSH2_ERROR_EAGAIN) {
+            socket()->waitForSocket();
+            return;
+          }
+          
+          if (result < 0) {
+            if (socket()->errorReporting())
+              socket()->resetCommandClass(Failed);
+            else
+              socket()->resetCommandClass();
+          } else {
+            // Invalidate cached parent entry (if any)
+            Cache::self()->invalidateEntry(socket(), destinationPath.directory());
+            
+            if (!socket()->isChained())
+              socket()->emitEvent(Event::EventReloadNeeded);
+            socket()->resetCommandClass();
+          }
+          break;
+        }
+      }
     }
-  }
+};
+
+void SftpSocket::protoMkdir(const KUrl &path)
+{
+  setConfig(Settings::MkdirPath, path.path());
+  activateCommandClass(SftpCommandMkdir);
 }
 
 }
 
 #include "sftpsocket.moc"
-
@@ -44,12 +44,20 @@
 #include <QTcpSocket>
 #include <QFile>
 
+class QSocketNotifier;
+class QTimer;
+
 #include "socket.h"
 #include "speedlimiter.h"
 
 namespace KFTPEngine {
 
 /**
+ * This class implements the SFTP protocol on top of libssh2. The SSH
+ * session runs in non-blocking mode and commands are resumed by socket
+ * notifiers once the connection is ready in the direction libssh2 has
+ * blocked on, so waiting connections don't use any CPU time.
+ *
  * @author Jernej Kos <kostko@jweb-network.net>
  */
 class SftpSocket : public QTcpSocket, public Socket, public SpeedLimiterItem {
@@ -58,6 +66,11 @@ friend class SftpCommandConnect;
 friend class SftpCommandList;
 friend class SftpCommandGet;
 friend class SftpCommandPut;
+friend class SftpCommandRemove;
+friend class SftpCommandRename;
+friend class SftpCommandChmod;
+friend class SftpCommandChmodMultiple;
+friend class SftpCommandMkdir;
 public:
     SftpSocket(Thread *thread);
     ~SftpSocket();
@@ -70,6 +83,7 @@ public:
     void protoRemove(const KUrl &path);
     void protoRename(const KUrl &source, const KUrl &destination);
     void protoChmodSingle(const KUrl &path, int mode);
+    void protoChmodMultiple(const KUrl &parent, const QStringList &files, int mode);
     void protoMkdir(const KUrl &path);
     void protoList(const KUrl &path);
     
@@ -82,10 +96,76 @@ public:
     LIBSSH2_SFTP *sftpSession() { return m_sftpSession; }
     
     QFile *getTransferFile() { return &m_transferFile; }
+    
+    void resetCommandClass(ResetCode code = Ok);
+    
+    /**
+     * Resumes a transfer the speed limiter has stopped.
+     */
+    void throttleWakeup();
+    
+    /**
+     * Called by the speed limiter when a stopped transfer may continue.
+     */
+    void speedLimiterWakeup();
 protected:
+    /**
+     * Transfer progress as reported by transferRead() and transferWrite().
+     */
+    enum TransferResult {
+      TransferPending,
+      TransferComplete,
+      TransferFailed
+    };
+    
     QString posixToString(int permissions);
     int intToPosix(int permissions);
     void variableBufferUpdate(int size);
+    
+    /**
+     * Returns true if the last libssh2 call failed because it would block.
+     */
+    bool wouldBlock();
+    
+    /**
+     * Waits until the connection is ready in the direction libssh2 is blocked
+     * on and then resumes the current command. Should be called when a libssh2
+     * call returns LIBSSH2_ERROR_EAGAIN, the call is then repeated.
+     */
+    void waitForSocket();
+    
+    /**
+     * Cancels any pending socket or speed limiter wait.
+     */
+    void cancelWait();
+    
+    /**
+     * Waits until the speed limiter allows the transfer to continue.
+     */
+    void scheduleThrottleWakeup();
+    
+    /**
+     * Downloads a batch of data. The command is resumed when more data can be
+     * read or, once the batch is done, in the next thread loop.
+     *
+     * @return Transfer progress
+     */
+    TransferResult transferRead();
+    
+    /**
+     * Uploads a batch of data. The command is resumed when more data can be
+     * written or, once the batch is done, in the next thread loop.
+     *
+     * @return Transfer progress
+     */
+    TransferResult transferWrite();
+    
+    /**
+     * Closes the current transfer handle. This is used when a command is
+     * aborted and can't wait for the socket, so the connection is dropped
+     * when the close doesn't complete immediately.
+     */
+    void closeTransferHandle();
 private:
     LIBSSH2_SESSION *m_sshSession;
     LIBSSH2_SFTP *m_sftpSession;
@@ -96,13 +176,21 @@ private:
     QFile m_transferFile;
     char *m_transferBuffer;
     int m_transferBufferSize;
+    int m_transferPending;
+    
+    QSocketNotifier *m_readNotifier;
+    QSocketNotifier *m_writeNotifier;
+    bool m_socketWait;
+    
+    QTimer *m_throttleTimer;
+    bool m_throttled;
 private slots:
     void slotDisconnected();
     void slotConnected();
     void slotError();
     
-    void slotDataTryRead();
-    void slotDataTryWrite();
+    void slotSocketActivated();
+    void slotThrottleTimeout();
 };
 
 }
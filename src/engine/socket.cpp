@@ -51,10 +51,11 @@ Socket::Socket(Thread *thread, const QString &protocol)
    m_settings(thread->settings()),
    m_thread(thread),
    m_transferBytes(0),
-   m_speedLastTime(0),
-   m_speedLastBytes(0),
    m_protocol(protocol),
    m_currentCommand(Commands::CmdNone),
+   m_commandStart(0),
+   m_metrics(0),
+   m_traceId(Tracer::nextSocketId()),
    m_errorReporting(true)
 {
 }
@@ -65,6 +66,51 @@ Socket::~Socket()
   delete m_connectionRetry;
 }
 
+MetricsSite *Socket::metrics()
+{
+  if (!m_metrics)
+    m_metrics = Metrics::self()->site(m_currentUrl);
+  
+  return m_metrics;
+}
+
+void Socket::trace(char phase, const char *category, const QString &name, quintptr id, const QString &detail)
+{
+  Tracer::self()->record(this, phase, category, name, id, detail);
+}
+
+void Socket::setCurrentCommand(Commands::Type type)
+{
+  if (Tracer::isEnabled() && type != m_currentCommand) {
+    if (m_currentCommand != Commands::CmdNone)
+      trace('e', "command", MetricsSite::commandName(m_currentCommand), m_traceId);
+    
+    if (type != Commands::CmdNone)
+      trace('b', "command", MetricsSite::commandName(type), m_traceId);
+  }
+  
+  if (m_currentCommand == Commands::CmdNone && type != Commands::CmdNone) {
+    m_commandStart = SpeedMeter::monotonicTime();
+  } else if (m_currentCommand != Commands::CmdNone && type == Commands::CmdNone) {
+    metrics()->command(m_currentCommand).add(SpeedMeter::monotonicTime() - m_commandStart);
+  }
+  
+  m_currentCommand = type;
+}
+
+void Socket::setupSpeedLimiter(SpeedLimiterItem *item, SpeedLimiter::Type type)
+{
+  QString group = QString("%1:%2").arg(m_currentUrl.host()).arg(m_currentUrl.port());
+  
+  SpeedLimiter::self()->setGroupLimit(group, type,
+                                      getConfig<int>(type == SpeedLimiter::Download ? "speed.site_download" : "speed.site_upload"),
+                                      getConfig<int>("speed.site_weight", 1));
+  
+  item->setLimit(getConfig<int>("speed.transfer_limit"));
+  item->setWeight(getConfig<int>("speed.transfer_weight", 1));
+  SpeedLimiter::self()->append(item, type, group);
+}
+
 void Socket::emitError(ErrorCode code, const QString &param1)
 {
   // Intercept connect and login errors and pass them on to the ConnectionRetry class (if enabled)
@@ -86,12 +132,8 @@ void Socket::emitError(ErrorCode code, const QString &param1)
 
 void Socket::emitEvent(Event::Type type, const QString &param1, const QString &param2)
 {
-  QList<QVariant> params;
-  params.append(QVariant(param1));
-  params.append(QVariant(param2));
-  
   // Dispatch the event via socket thread
-  m_thread->emitEvent(type, params);
+  m_thread->emitEvent(type, param1, param2);
 }
 
 void Socket::emitEvent(Event::Type type, DirectoryListing param1)
@@ -113,12 +155,6 @@ void Socket::emitEvent(Event::Type type, const QVariant &param1)
   m_thread->emitEvent(type, params);
 }
 
-WakeupEvent *Socket::emitEventAndWait(Event::Type type, const QVariant &param1)
-{
-  emitEvent(type, param1);
-  return m_thread->waitForWakeup();
-}
-
 void Socket::changeEncoding(const QString &encoding)
 {
   // Alter encoding and change socket config
@@ -161,7 +197,8 @@ void Socket::timeoutCheck()
     if (command == Commands::CmdFxp)
       return;
     
-    if (command == Commands::CmdGet || command == Commands::CmdPut)
+    // Servers may take as long to hash a file as to transfer it
+    if (command == Commands::CmdGet || command == Commands::CmdPut || command == Commands::CmdChecksum)
       timeout = KFTPCore::Config::dataTimeout();
     else
       timeout = KFTPCore::Config::controlTimeout();
@@ -189,8 +226,8 @@ void Socket::keepaliveCheck()
     return;
   }
   
-  if (getConfig<bool>("keepalive.enabled", false) && 
-      m_keepaliveCounter.elapsed() > getConfig<int>("keepalive.timeout", 0) * 1000) {
+  if (getConfig<bool>(Settings::KeepaliveEnabled, false) && 
+      m_keepaliveCounter.elapsed() > getConfig<int>(Settings::KeepaliveTimeout, 0) * 1000) {
     protoKeepAlive();
     
     // Reset the counter
@@ -239,6 +276,9 @@ Commands::Type Socket::getPreviousCommand()
 
 void Socket::resetCommandClass(ResetCode code)
 {
+  if (Tracer::isEnabled())
+    trace('i', "reset", "reset", 0, QString::number(code));
+  
   if (m_commandChain.count() > 0) {
     Commands::Base *current = m_commandChain.top();
     
@@ -249,6 +289,9 @@ void Socket::resetCommandClass(ResetCode code)
       if (!current->isClean())
         current->cleanup();
       
+      if (Tracer::isEnabled())
+        trace('e', "chain", current->name(), (quintptr) current, QString::number(code));
+      
       delete m_commandChain.pop();
     }
     
@@ -287,20 +330,34 @@ void Socket::resetCommandClass(ResetCode code)
   }
 }
 
+void Socket::addToCommandChain(Commands::Base *cmd)
+{
+  if (Tracer::isEnabled())
+    trace('b', "chain", cmd->name(), (quintptr) cmd);
+  
+  m_commandChain.append(cmd);
+}
+
 void Socket::nextCommand()
 {
   if (m_commandChain.count() > 0) {
     Commands::Base *current = m_commandChain.top();
     
     current->setProcessing(true);
-    current->process();
+    {
+      TraceScope scope(this, "process", current->name());
+      current->process();
+    }
     current->setProcessing(false);
     
     if (current->isDestructable())
       resetCommandClass(current->resetCode());
   } else if (m_cmdData) {
     m_cmdData->setProcessing(true);
-    m_cmdData->process();
+    {
+      TraceScope scope(this, "process", m_cmdData->name());
+      m_cmdData->process();
+    }
     m_cmdData->setProcessing(false);
     
     if (m_cmdData->isDestructable())
@@ -324,7 +381,10 @@ void Socket::wakeup(WakeupEvent *event)
     }
     
     current->setProcessing(true);
-    current->wakeup(event);
+    {
+      TraceScope scope(this, "wakeup", current->name());
+      current->wakeup(event);
+    }
     current->setProcessing(false);
     
     if (current->isDestructable())
@@ -336,7 +396,10 @@ void Socket::wakeup(WakeupEvent *event)
     }
     
     m_cmdData->setProcessing(true);
-    m_cmdData->wakeup(event);
+    {
+      TraceScope scope(this, "wakeup", m_cmdData->name());
+      m_cmdData->wakeup(event);
+    }
     m_cmdData->setProcessing(false);
     
     if (m_cmdData->isDestructable())
@@ -344,24 +407,6 @@ void Socket::wakeup(WakeupEvent *event)
   }
 }
 
-filesize_t Socket::getTransferSpeed()
-{
-  time_t timeDelta = time(0) - m_speedLastTime;
-  
-  if (timeDelta == 0)
-    return 0;
-  
-  if (m_speedLastBytes > m_transferBytes)
-    m_speedLastBytes = 0;
-  
-  filesize_t speed = (m_transferBytes - m_speedLastBytes)/(time(0) - m_speedLastTime);
-  
-  m_speedLastBytes = m_transferBytes;
-  m_speedLastTime = time(0);
-  
-  return speed;
-}
-
 void Socket::protoAbort()
 {
   if (m_connectionRetry && !m_cmdData)
@@ -414,6 +459,18 @@ public:
     }
 };
 
+void Socket::protoChecksum(const KUrl&, const KUrl&, filesize_t, filesize_t)
+{
+  setReturnValue((int) ChecksumUnavailable);
+  
+  if (m_cmdData) {
+    nextCommandAsync();
+  } else {
+    emitEvent(Event::EventChecksum, QVariant((int) ChecksumUnavailable));
+    resetCommandClass();
+  }
+}
+
 void Socket::protoStat(const KUrl &path)
 {
   // Lookup the cache first and don't even try to list if cached
@@ -557,6 +614,8 @@ void Socket::protoScan(const KUrl &path)
   scan->currentDirectory = path.path();
   scan->currentTree = new DirectoryTree(DirectoryEntry());
   m_cmdData = scan;
+  
+  TraceScope scope(this, "process", m_cmdData->name());
   m_cmdData->process();
 }
 
@@ -564,6 +623,70 @@ void Socket::protoScan(const KUrl &path)
 // ***************************************** DELETE ******************************************
 // *******************************************************************************************
 
+class FtpCommandRemoveBatch : public Commands::Base {
+public:
+    enum State {
+      None,
+      RemovedFile
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandRemoveBatch, Socket, CmdNone)
+    
+    KUrl parentPath;
+    QStringList files;
+    QStringList::const_iterator currentFile;
+    
+    void removeCurrentFile()
+    {
+      KUrl childPath = parentPath;
+      childPath.addPath(*currentFile);
+      
+      socket()->setConfig(Settings::RemoveDirectory, 0);
+      socket()->protoRemove(childPath);
+    }
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          currentFile = files.constBegin();
+          currentState = RemovedFile;
+          
+          if (currentFile == files.constEnd())
+            socket()->resetCommandClass();
+          else
+            removeCurrentFile();
+          break;
+        }
+        case RemovedFile: {
+          if (++currentFile == files.constEnd())
+            socket()->resetCommandClass();
+          else
+            removeCurrentFile();
+          break;
+        }
+      }
+    }
+};
+
+void Socket::protoRemoveMultiple(const KUrl &parent, const QStringList &files)
+{
+  // Default implementation simply removes the files one by one
+  FtpCommandRemoveBatch *batch = new FtpCommandRemoveBatch(this);
+  batch->parentPath = parent;
+  batch->files = files;
+  
+  if (m_cmdData) {
+    addToCommandChain(batch);
+    nextCommand();
+  } else {
+    m_cmdData = batch;
+    
+    TraceScope scope(this, "process", m_cmdData->name());
+    m_cmdData->process();
+  }
+}
+
 class FtpCommandDelete : public Commands::Base {
 public:
     enum State {
@@ -571,6 +694,7 @@ public:
       VerifyDir,
       SimpleRemove,
       SentList,
+      RemovedFiles,
       ProcessList,
       DeletedDir,
       DeletedFile
@@ -578,11 +702,23 @@ public:
     
     ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandDelete, Socket, CmdDelete)
     
-    QList<DirectoryEntry> currentList;
+    QList<DirectoryEntry> directories;
     QList<DirectoryEntry>::const_iterator currentEntry;
     
     KUrl destinationPath;
     
+    void finish()
+    {
+      if (socket()->isChained())
+        socket()->resetCommandClass();
+      else {
+        // We are the top level command class, remove the destination dir
+        currentState = SimpleRemove;
+        socket()->setConfig(Settings::RemoveDirectory, 1);
+        socket()->protoRemove(destinationPath);
+      }
+    }
+    
     void process()
     {
       switch (currentState) {
@@ -613,7 +749,7 @@ public:
             } else {
               // A single file, a simple remove
               currentState = SimpleRemove;
-              socket()->setConfig("params.remove.directory", 0);
+              socket()->setConfig(Settings::RemoveDirectory, 0);
               socket()->protoRemove(destinationPath);
             }
           }          
@@ -626,21 +762,33 @@ public:
           break;
         }
         case SentList: {
-          currentList = socket()->getLastDirectoryListing().list();
-          currentEntry = currentList.constBegin();
+          QList<DirectoryEntry> list = socket()->getLastDirectoryListing().list();
+          QStringList files;
+          
+          QList<DirectoryEntry>::const_iterator listEnd = list.constEnd();
+          for (QList<DirectoryEntry>::const_iterator i = list.constBegin(); i != listEnd; i++) {
+            if ((*i).isDirectory())
+              directories.append(*i);
+            else
+              files.append((*i).filename());
+          }
+          
+          currentEntry = directories.constBegin();
+          currentState = RemovedFiles;
+          
+          if (!files.isEmpty()) {
+            // Remove all files in this directory at once, so the protocol is able
+            // to pipeline the requests
+            socket()->protoRemoveMultiple(destinationPath, files);
+            return;
+          }
+        }
+        case RemovedFiles: {
           currentState = ProcessList;
           
-          // Empty listing, we are done
-          if (currentEntry == currentList.constEnd()) {
-            if (socket()->isChained())
-              socket()->resetCommandClass();
-            else {
-              // We are the top level command class, remove the destination dir
-              currentState = SimpleRemove;
-              socket()->setConfig("params.remove.directory", 1);
-              socket()->protoRemove(destinationPath);
-            }
-            
+          // No subdirectories, we are done
+          if (currentEntry == directories.constEnd()) {
+            finish();
             return;
           }
         }
@@ -648,21 +796,14 @@ public:
           KUrl childPath = destinationPath;
           childPath.addPath((*currentEntry).filename());
           
-          if ((*currentEntry).isDirectory()) {
-            // A directory, chain another delete command
-            currentState = DeletedDir;
-            
-            // Chain manually, since we need to set some parameters
-            FtpCommandDelete *del = new FtpCommandDelete(socket());
-            del->destinationPath = childPath;
-            socket()->addToCommandChain(del);
-            socket()->nextCommand();
-          } else {
-            // A file entry - remove
-            currentState = DeletedFile;
-            socket()->setConfig("params.remove.directory", 0);
-            socket()->protoRemove(childPath);
-          }
+          // A directory, chain another delete command
+          currentState = DeletedDir;
+          
+          // Chain manually, since we need to set some parameters
+          FtpCommandDelete *del = new FtpCommandDelete(socket());
+          del->destinationPath = childPath;
+          socket()->addToCommandChain(del);
+          socket()->nextCommand();
           break;
         }
         case DeletedDir: {
@@ -671,23 +812,16 @@ public:
           childPath.addPath((*currentEntry).filename());
           
           currentState = DeletedFile;
-          socket()->setConfig("params.remove.directory", 1);
+          socket()->setConfig(Settings::RemoveDirectory, 1);
           socket()->protoRemove(childPath);
           break;
         }
         case DeletedFile: {
           currentState = ProcessList;
           
-          if (++currentEntry == currentList.constEnd()) {
-            if (socket()->isChained())
-              socket()->resetCommandClass();
-            else {
-              // We are the top level command class, remove the destination dir
-              currentState = SimpleRemove;
-              socket()->setConfig("params.remove.directory", 1);
-              socket()->protoRemove(destinationPath);
-            }
-          } else
+          if (++currentEntry == directories.constEnd())
+            finish();
+          else
             socket()->nextCommand();
           break;
         }
@@ -701,6 +835,8 @@ void Socket::protoDelete(const KUrl &path)
   FtpCommandDelete *del = new FtpCommandDelete(this);
   del->destinationPath = path;
   m_cmdData = del;
+  
+  TraceScope scope(this, "process", m_cmdData->name());
   m_cmdData->process();
 }
 
@@ -708,6 +844,80 @@ void Socket::protoDelete(const KUrl &path)
 // ***************************************** CHMOD *******************************************
 // *******************************************************************************************
 
+/**
+ * Converts the mode as passed to protoChmod (octal digits written as a decimal
+ * number, for example 755) to actual permission bits.
+ */
+static int modeToPermissions(int mode)
+{
+  return QString::number(mode).toInt(0, 8);
+}
+
+class FtpCommandChmodBatch : public Commands::Base {
+public:
+    enum State {
+      None,
+      ChmodedFile
+    };
+    
+    ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandChmodBatch, Socket, CmdNone)
+    
+    KUrl parentPath;
+    QStringList files;
+    QStringList::const_iterator currentFile;
+    int mode;
+    
+    void chmodCurrentFile()
+    {
+      KUrl childPath = parentPath;
+      childPath.addPath(*currentFile);
+      
+      socket()->protoChmodSingle(childPath, mode);
+    }
+    
+    void process()
+    {
+      switch (currentState) {
+        case None: {
+          currentFile = files.constBegin();
+          currentState = ChmodedFile;
+          
+          if (currentFile == files.constEnd())
+            socket()->resetCommandClass();
+          else
+            chmodCurrentFile();
+          break;
+        }
+        case ChmodedFile: {
+          if (++currentFile == files.constEnd())
+            socket()->resetCommandClass();
+          else
+            chmodCurrentFile();
+          break;
+        }
+      }
+    }
+};
+
+void Socket::protoChmodMultiple(const KUrl &parent, const QStringList &files, int mode)
+{
+  // Default implementation simply changes the mode of files one by one
+  FtpCommandChmodBatch *batch = new FtpCommandChmodBatch(this);
+  batch->parentPath = parent;
+  batch->files = files;
+  batch->mode = mode;
+  
+  if (m_cmdData) {
+    addToCommandChain(batch);
+    nextCommand();
+  } else {
+    m_cmdData = batch;
+    
+    TraceScope scope(this, "process", m_cmdData->name());
+    m_cmdData->process();
+  }
+}
+
 class FtpCommandRecursiveChmod : public Commands::Base {
 public:
     enum State {
@@ -715,6 +925,7 @@ public:
       VerifyDir,
       SimpleChmod,
       SentList,
+      ChmodedFiles,
       ProcessList,
       ChmodedDir,
       ChmodedFile
@@ -722,12 +933,29 @@ public:
     
     ENGINE_STANDARD_COMMAND_CONSTRUCTOR(FtpCommandRecursiveChmod, Socket, CmdChmod)
     
-    QList<DirectoryEntry> currentList;
+    QList<DirectoryEntry> directories;
     QList<DirectoryEntry>::const_iterator currentEntry;
     
     KUrl destinationPath;
     int mode;
     
+    bool hasMode(const DirectoryEntry &entry)
+    {
+      // Listings that don't carry permissions report them as zero
+      return entry.permissions() != 0 && (entry.permissions() & 07777) == modeToPermissions(mode);
+    }
+    
+    void finish()
+    {
+      if (socket()->isChained())
+        socket()->resetCommandClass();
+      else {
+        // We are the top level command class, chmod the destination dir
+        currentState = SimpleChmod;
+        socket()->protoChmodSingle(destinationPath, mode);
+      }
+    }
+    
     void process()
     {
       switch (currentState) {
@@ -767,20 +995,33 @@ public:
           break;
         }
         case SentList: {
-          currentList = socket()->getLastDirectoryListing().list();
-          currentEntry = currentList.constBegin();
+          QList<DirectoryEntry> list = socket()->getLastDirectoryListing().list();
+          QStringList files;
+          
+          QList<DirectoryEntry>::const_iterator listEnd = list.constEnd();
+          for (QList<DirectoryEntry>::const_iterator i = list.constBegin(); i != listEnd; i++) {
+            if ((*i).isDirectory())
+              directories.append(*i);
+            else if (!hasMode(*i))
+              files.append((*i).filename());
+          }
+          
+          currentEntry = directories.constBegin();
+          currentState = ChmodedFiles;
+          
+          if (!files.isEmpty()) {
+            // Change the mode of all files in this directory at once, so the
+            // protocol is able to batch the requests
+            socket()->protoChmodMultiple(destinationPath, files, mode);
+            return;
+          }
+        }
+        case ChmodedFiles: {
           currentState = ProcessList;
           
-          // Empty listing, we are done
-          if (currentEntry == currentList.constEnd()) {
-            if (socket()->isChained())
-              socket()->resetCommandClass();
-            else {
-              // We are the top level command class, chmod the destination dir
-              currentState = SimpleChmod;
-              socket()->protoChmodSingle(destinationPath, mode);
-            }
-            
+          // No subdirectories, we are done
+          if (currentEntry == directories.constEnd()) {
+            finish();
             return;
           }
         }
@@ -788,44 +1029,37 @@ public:
           KUrl childPath = destinationPath;
           childPath.addPath((*currentEntry).filename());
           
-          if ((*currentEntry).isDirectory()) {
-            // A directory, chain another recursive chmod command
-            currentState = ChmodedDir;
-            
-            // Chain manually, since we need to set some parameters
-            FtpCommandRecursiveChmod *cm = new FtpCommandRecursiveChmod(socket());
-            cm->destinationPath = childPath;
-            cm->mode = mode;
-            socket()->addToCommandChain(cm);
-            socket()->nextCommand();
-          } else {
-            // A file entry - remove
-            currentState = ChmodedFile;
-            socket()->protoChmodSingle(childPath, mode);
-          }
+          // A directory, chain another recursive chmod command
+          currentState = ChmodedDir;
+          
+          // Chain manually, since we need to set some parameters
+          FtpCommandRecursiveChmod *cm = new FtpCommandRecursiveChmod(socket());
+          cm->destinationPath = childPath;
+          cm->mode = mode;
+          socket()->addToCommandChain(cm);
+          socket()->nextCommand();
           break;
         }
         case ChmodedDir: {
-          // We have to chmod the directory
-          KUrl childPath = destinationPath;
-          childPath.addPath((*currentEntry).filename());
-          
           currentState = ChmodedFile;
-          socket()->protoChmodSingle(childPath, mode);
+          
+          // We have to chmod the directory unless it already has the right mode
+          if (hasMode(*currentEntry)) {
+            socket()->nextCommand();
+          } else {
+            KUrl childPath = destinationPath;
+            childPath.addPath((*currentEntry).filename());
+            
+            socket()->protoChmodSingle(childPath, mode);
+          }
           break;
         }
         case ChmodedFile: {
           currentState = ProcessList;
           
-          if (++currentEntry == currentList.constEnd()) {
-            if (socket()->isChained())
-              socket()->resetCommandClass();
-            else {
-              // We are the top level command class, chmod the destination dir
-              currentState = SimpleChmod;
-              socket()->protoChmodSingle(destinationPath, mode);
-            }
-          } else
+          if (++currentEntry == directories.constEnd())
+            finish();
+          else
             socket()->nextCommand();
           break;
         }
@@ -841,6 +1075,8 @@ void Socket::protoChmod(const KUrl &path, int mode, bool recursive)
     cm->destinationPath = path;
     cm->mode = mode;
     m_cmdData = cm;
+    
+    TraceScope scope(this, "process", m_cmdData->name());
     m_cmdData->process();
   } else {
     // No recursive, just chmod a single file
@@ -43,9 +43,14 @@
 #include <QPointer>
 #include <QDateTime>
 #include <QHostAddress>
+#include <QStringList>
 
 #include "settings.h"
 #include "commands.h"
+#include "speedlimiter.h"
+#include "speedmeter.h"
+#include "metrics.h"
+#include "tracer.h"
 
 namespace KFTPEngine {
 
@@ -111,6 +116,25 @@ public:
     template <typename T>
     T getConfig(const QString &key, const T &def = T()) const { return m_settings->getConfig<T>(key, def); }
     
+    /**
+     * @overload
+     * Set a registered config value without a string lookup.
+     */
+    void setConfig(Settings::Key key, const QVariant &value) { m_settings->setConfig(key, value); }
+    
+    /**
+     * @overload
+     * Get a registered config value as string without a string lookup.
+     */
+    QString getConfig(Settings::Key key) const { return m_settings->getConfig(key); }
+    
+    /**
+     * @overload
+     * Get a registered config value without a string lookup.
+     */
+    template <typename T>
+    T getConfig(Settings::Key key, const T &def = T()) const { return m_settings->getConfig<T>(key, def); }
+    
     /**
      * This method should trigger the connection process.
      *
@@ -156,6 +180,19 @@ public:
      */
     virtual void protoRemove(const KUrl &path) = 0;
     
+    /**
+     * This method should remove a batch of files that all reside in the same
+     * directory. Protocols that are able to pipeline requests should override
+     * it, the default implementation just calls @ref protoRemove for each
+     * file in turn. Any failure should reset the command class with Failed.
+     *
+     * @warning You should NOT use this method directly! Use @ref protoDelete
+     *          instead!
+     * @param parent The directory containing the files
+     * @param files A list of filenames to remove
+     */
+    virtual void protoRemoveMultiple(const KUrl &parent, const QStringList &files);
+    
     /**
      * This method should rename/move a remote file.
      *
@@ -174,6 +211,20 @@ public:
      */
     virtual void protoChmodSingle(const KUrl &path, int mode) = 0;
     
+    /**
+     * This method should change the mode of a batch of files that all reside
+     * in the same directory. Protocols that are able to pipeline or batch
+     * requests should override it, the default implementation just calls
+     * @ref protoChmodSingle for each file in turn.
+     *
+     * @warning You should NOT use this method directly! Use @ref protoChmod
+     *          instead!
+     * @param parent The directory containing the files
+     * @param files A list of filenames
+     * @param mode The new file mode
+     */
+    virtual void protoChmodMultiple(const KUrl &parent, const QStringList &files, int mode);
+    
     /**
      * This method should create a new remote directory.
      *
@@ -218,6 +269,20 @@ public:
      */
     virtual void protoSiteToSite(Socket*, const KUrl&, const KUrl&) {}
     
+    /**
+     * This method should compare a local file (or a part of it) against the
+     * checksum reported by the server. The ChecksumStatus result is set as
+     * the return value and is emitted as an EventChecksum event when the
+     * command is not chained. The default implementation reports that no
+     * checksum is available.
+     *
+     * @param remote The remote file
+     * @param local The local file
+     * @param offset Offset of the first byte to compare
+     * @param length Number of bytes to compare or 0 for the whole file
+     */
+    virtual void protoChecksum(const KUrl &remote, const KUrl &local, filesize_t offset = 0, filesize_t length = 0);
+    
     /**
      * Send a packet to keep the connection alive.
      */
@@ -333,17 +398,6 @@ public:
      */
     void emitEvent(Event::Type type, const QVariant &param1);
     
-    /**
-     * Emits an engine event containing a custom QVariant and blocks
-     * until a response is received.
-     *
-     * @warning See Thread::waitForWakeup warning before using this method!
-     * @param type Event type
-     * @param param1 The custom variant
-     * @return The WakeupEvent that responded to this call
-     */
-    WakeupEvent *emitEventAndWait(Event::Type type, const QVariant &param1 = QVariant());
-    
     /**
      * This method will set the socket's remote encoding which will be used when
      * converting filenames into UTF-8 and back.
@@ -393,7 +447,7 @@ public:
      *
      * @param url The url this socket is connected to
      */
-    void setCurrentUrl(const KUrl &url) { m_currentUrl = url; }
+    void setCurrentUrl(const KUrl &url) { m_currentUrl = url; m_metrics = 0; }
     
     /**
      * Get the url this socket is connected to.
@@ -403,11 +457,45 @@ public:
     KUrl getCurrentUrl() { return m_currentUrl; }
     
     /**
-     * Sets the command the socket is currently executing.
+     * Appends an item to the speed limiter for the current transfer. The
+     * item is grouped with other connections to the same site and its
+     * limits are taken from the site and transfer settings.
+     *
+     * @param item The speed limiter item, usually this socket
+     * @param type Limit type
+     */
+    void setupSpeedLimiter(SpeedLimiterItem *item, SpeedLimiter::Type type);
+    
+    /**
+     * Returns the metrics of the site this socket is connected to.
+     */
+    MetricsSite *metrics();
+    
+    /**
+     * Returns the identifier of this socket's track in traces.
+     */
+    int traceId() const { return m_traceId; }
+    
+    /**
+     * Adds a trace record for this socket. Callers should first check that
+     * tracing is enabled.
+     *
+     * @param phase Chrome trace event phase
+     * @param category Record category
+     * @param name Record name
+     * @param id Identifier that pairs asynchronous begin and end records
+     * @param detail Optional record detail
+     */
+    void trace(char phase, const char *category, const QString &name, quintptr id = 0,
+               const QString &detail = QString());
+    
+    /**
+     * Sets the command the socket is currently executing. The time until
+     * the socket becomes idle again is recorded in the site's metrics.
      *
      * @param type Command type
      */
-    void setCurrentCommand(Commands::Type type) { m_currentCommand = type; }
+    void setCurrentCommand(Commands::Type type);
     
     /**
      * Get the current socket command.
@@ -454,11 +542,12 @@ public:
     filesize_t getTransferBytes() { return m_transferBytes; }
     
     /**
-     * Get the current transfer speed.
+     * Get the meter measuring the speed of the current transfer. The meter
+     * should only be sampled by the thread that owns the transfer.
      *
-     * @return The current transfer speed.
+     * @return The speed meter
      */
-    filesize_t getTransferSpeed();
+    SpeedMeter *speedMeter() { return &m_speedMeter; }
     
     /**
      * Wakeup the last command processor with a specific wakeup event. This
@@ -472,6 +561,15 @@ public:
      */
     virtual void wakeup(WakeupEvent *event);
     
+    /**
+     * Resume a transfer that has been stopped because the speed limiter
+     * didn't allow any more bytes. This method is always called from the
+     * socket's own thread.
+     *
+     * By default this method does nothing.
+     */
+    virtual void throttleWakeup() {}
+    
     /**
      * Reset the current command class, possibly invoking the calling chained
      * command class or completing the operation.
@@ -485,7 +583,7 @@ public:
      *
      * @param cmd The command class to add
      */
-    void addToCommandChain(Commands::Base *cmd) { m_commandChain.append(cmd); }
+    void addToCommandChain(Commands::Base *cmd);
     
     /**
      * Execute the next command.
@@ -529,13 +627,13 @@ public:
      *
      * @param value Chained command return value
      */
-    void setReturnValue(const QVariant &value) { setConfig("__returnvalue", value); }
+    void setReturnValue(const QVariant &value) { setConfig(Settings::ReturnValue, value); }
     
     /**
      * Returns the return value that was set last.
      */
     template <typename T>
-    T returnValue() const { return getConfig<T>("__returnvalue"); }
+    T returnValue() const { return getConfig<T>(Settings::ReturnValue); }
 protected:
     /**
      * Call this method when a long wait period has started or ended. If the wait
@@ -579,8 +677,7 @@ protected:
     DirectoryEntry m_lastStatResponse;
     
     filesize_t m_transferBytes;
-    time_t m_speedLastTime;
-    filesize_t m_speedLastBytes;
+    SpeedMeter m_speedMeter;
     
     QTime m_timeoutCounter;
     QTime m_keepaliveCounter;
@@ -590,6 +687,9 @@ private:
     KUrl m_currentUrl;
     QString m_protocol;
     Commands::Type m_currentCommand;
+    qint64 m_commandStart;
+    MetricsSite *m_metrics;
+    int m_traceId;
     bool m_errorReporting;
     QPointer<ConnectionRetry> m_connectionRetry;
 };
@@ -34,16 +34,26 @@
  * files in the program, then also delete it here.
  */
 #include "speedlimiter.h"
+#include "speedmeter.h"
 #include "misc/config.h"
 
+#include <QVector>
+#include <QMutexLocker>
+
 #include <KGlobal>
 
 using namespace KFTPCore;
 
 namespace KFTPEngine {
 
-static const int tickDelay = 250;
-static int bucketSize = 1000 / tickDelay;
+/* Minimum time between two refills (in microseconds) */
+static const qint64 refillInterval = 10000;
+
+/* Tokens an item may accumulate, expressed as time at its rate (in microseconds) */
+static const qint64 bucketTime = 250000;
+
+/* Amount of data an item should be able to send after waking up */
+static const int wakeupChunk = 1024;
 
 class SpeedLimiterPrivate
 {
@@ -53,23 +63,118 @@ public:
 
 K_GLOBAL_STATIC(SpeedLimiterPrivate, speedLimiterPrivate)
 
+/**
+ * A group of items sharing a common limit.
+ */
+class SpeedLimiterGroup
+{
+public:
+    SpeedLimiterGroup()
+      : limit(0),
+        weight(1)
+    {
+    }
+    
+    int limit;
+    int weight;
+    QList<SpeedLimiterItem*> items;
+};
+
+/**
+ * A single consumer of tokens during one refill.
+ */
+struct SpeedLimiterShare
+{
+    double weight;
+    double capacity;
+    double assigned;
+};
+
+/**
+ * Returns the number of tokens a rate provides in the given time or -1 when
+ * the rate is not limited.
+ */
+static double rateTokens(int rate, qint64 usec)
+{
+  if (rate <= 0)
+    return -1;
+  
+  return (double) rate * usec / 1000000;
+}
+
+/**
+ * Returns the smaller of two token amounts, where -1 means unlimited.
+ */
+static double minTokens(double a, double b)
+{
+  if (a < 0)
+    return b;
+  else if (b < 0)
+    return a;
+  
+  return qMin(a, b);
+}
+
+/**
+ * Splits tokens between shares proportionally to their weights, without
+ * assigning more than a share's capacity (-1 means no capacity limit). Tokens
+ * that saturated shares can't take are redistributed to the others.
+ *
+ * @param tokens Number of tokens to split
+ * @param shares Shares to split the tokens between
+ * @return Number of tokens left over
+ */
+static double distributeTokens(double tokens, QVector<SpeedLimiterShare> &shares)
+{
+  // Every pass either hands out all tokens or saturates at least one share
+  for (int pass = 0; pass <= shares.count() && tokens > 0; pass++) {
+    double totalWeight = 0;
+    
+    for (int i = 0; i < shares.count(); i++) {
+      if (shares[i].capacity < 0 || shares[i].assigned < shares[i].capacity)
+        totalWeight += shares[i].weight;
+    }
+    
+    if (totalWeight <= 0)
+      break;
+    
+    double given = 0;
+    
+    for (int i = 0; i < shares.count(); i++) {
+      SpeedLimiterShare &share = shares[i];
+      if (share.capacity >= 0 && share.assigned >= share.capacity)
+        continue;
+      
+      double portion = tokens * share.weight / totalWeight;
+      if (share.capacity >= 0)
+        portion = qMin(portion, share.capacity - share.assigned);
+      
+      share.assigned += portion;
+      given += portion;
+    }
+    
+    tokens -= given;
+  }
+  
+  return qMax(0.0, tokens);
+}
+
 SpeedLimiter *SpeedLimiter::self()
 {
   return &speedLimiterPrivate->instance;
 }
 
 SpeedLimiter::SpeedLimiter()
-  : m_timer(new QTimer(this))
+  : m_mutex(QMutex::Recursive)
 {
-  // Reset limits and token debts
+  // Reset limits
   m_limits[0] = 0;
   m_limits[1] = 0;
   
-  m_tokenDebt[0] = 0;
-  m_tokenDebt[1] = 0;
-  
-  connect(m_timer, SIGNAL(timeout()), this, SLOT(synchronize()));
-  connect(this, SIGNAL(activateTimer(int)), m_timer, SLOT(start(int)));
+  m_lastRefill[0] = SpeedMeter::monotonicTime();
+  m_lastRefill[1] = m_lastRefill[0];
+  m_refillStamp[0] = (int) m_lastRefill[0];
+  m_refillStamp[1] = (int) m_lastRefill[0];
   
   // Subscribe to config updates and update the limits
   connect(Config::self(), SIGNAL(configChanged()), this, SLOT(updateLimits()));
@@ -78,6 +183,8 @@ SpeedLimiter::SpeedLimiter()
 
 SpeedLimiter::~SpeedLimiter()
 {
+  qDeleteAll(m_groups[0]);
+  qDeleteAll(m_groups[1]);
 }
 
 void SpeedLimiter::updateLimits()
@@ -88,35 +195,52 @@ void SpeedLimiter::updateLimits()
 
 void SpeedLimiter::setLimit(Type type, int limit)
 {
+  QMutexLocker locker(&m_mutex);
   m_limits[type] = limit;
 }
 
-void SpeedLimiter::append(SpeedLimiterItem *item, Type type)
+void SpeedLimiter::setGroupLimit(const QString &name, Type type, int limit, int weight)
 {
-  m_objects[type].append(item);
+  QMutexLocker locker(&m_mutex);
   
-  int limit = m_limits[type];
-  if (limit > 0) {
-    int tokens = limit * tickDelay / 1000;
-    tokens /= m_objects[type].count();
-    
-    if (m_tokenDebt[type] > 0) {
-      if (tokens >= m_tokenDebt[type]) {
-        tokens -= m_tokenDebt[type];
-        m_tokenDebt[type] = 0;
-      } else {
-        tokens = 0;
-      }
-    }
-    
-    item->m_availableBytes = tokens;
-  } else {
-    item->m_availableBytes = -1;
+  SpeedLimiterGroup *g = group(name, type);
+  g->limit = limit;
+  g->weight = qMax(1, weight);
+}
+
+SpeedLimiterGroup *SpeedLimiter::group(const QString &name, Type type)
+{
+  SpeedLimiterGroup *g = m_groups[type].value(name);
+  
+  if (!g) {
+    g = new SpeedLimiterGroup();
+    m_groups[type].insert(name, g);
   }
   
-  // Fire the timer if not running
-  if (!m_timer->isActive())
-    emit activateTimer(tickDelay);
+  return g;
+}
+
+bool SpeedLimiter::isLimited(SpeedLimiterItem *item, Type type) const
+{
+  return m_limits[type] > 0 || item->m_group->limit > 0 || item->m_limit > 0;
+}
+
+void SpeedLimiter::append(SpeedLimiterItem *item, Type type, const QString &name)
+{
+  QMutexLocker locker(&m_mutex);
+  
+  // An item can only be managed once
+  remove(item);
+  
+  SpeedLimiterGroup *g = group(name, type);
+  g->items.append(item);
+  item->m_group = g;
+  item->m_type = type;
+  item->m_credit = 0;
+  item->m_rate = 0;
+  
+  // New items start with an empty bucket and get their share on the next refill
+  item->m_availableBytes = isLimited(item, type) ? 0 : -1;
 }
 
 void SpeedLimiter::remove(SpeedLimiterItem *item)
@@ -127,110 +251,185 @@ void SpeedLimiter::remove(SpeedLimiterItem *item)
 
 void SpeedLimiter::remove(SpeedLimiterItem *item, Type type)
 {
-  if (m_objects[type].contains(item)) {
-    int tokens = m_limits[type] * tickDelay / 1000;
-    tokens /= m_objects[type].count();
+  QMutexLocker locker(&m_mutex);
+  SpeedLimiterGroup *g = item->m_group;
+  
+  if (g && item->m_type == type) {
+    g->items.removeAll(item);
+    item->m_group = 0;
     
-    if (item->m_availableBytes < tokens)
-      m_tokenDebt[type] += tokens - item->m_availableBytes;
+    if (g->items.isEmpty()) {
+      m_groups[type].remove(m_groups[type].key(g));
+      delete g;
+    }
     
-    m_objects[type].removeAll(item);
+    item->m_availableBytes = -1;
   }
+}
+
+int SpeedLimiter::wakeupDelay(SpeedLimiterItem *item)
+{
+  QMutexLocker locker(&m_mutex);
+  
+  // Wait until a reasonable chunk can be sent at the item's current rate
+  int delay = bucketTime / 1000;
+  if (item->m_rate > 0)
+    delay = (int) (wakeupChunk * 1000 / item->m_rate);
   
-  item->m_availableBytes = -1;
+  return qBound((int) (refillInterval / 1000), delay, (int) (bucketTime / 1000));
 }
 
-void SpeedLimiter::synchronize()
+void SpeedLimiter::refill(Type type)
 {
-  QList<SpeedLimiterItem> pendingWakeup;
+  qint64 now = SpeedMeter::monotonicTime();
   
-  for (int i = 0; i < 2; i++) {
-    m_tokenDebt[i] = 0;
+  // Most calls happen well within one interval, check that without the lock
+  int stamp = m_refillStamp[type];
+  if ((quint32) now - (quint32) stamp < (quint32) refillInterval)
+    return;
+  
+  // Only one caller per interval gets to redistribute the tokens
+  if (!m_refillStamp[type].testAndSetOrdered(stamp, (int) now))
+    return;
+  
+  QMutexLocker locker(&m_mutex);
+  
+  qint64 elapsed = now - m_lastRefill[type];
+  if (elapsed < refillInterval)
+    return;
+  
+  m_lastRefill[type] = now;
+  
+  // Tokens not requested for a long time are lost, the buckets are full anyway
+  elapsed = qMin(elapsed, bucketTime);
+  
+  if (m_groups[type].isEmpty())
+    return;
+  
+  double tokens = rateTokens(m_limits[type], elapsed);
+  QList<SpeedLimiterGroup*> groups = m_groups[type].values();
+  QVector<QVector<SpeedLimiterShare> > itemShares(groups.count());
+  QVector<SpeedLimiterShare> groupShares(groups.count());
+  
+  // Determine how many tokens each item can take, which is bounded by its
+  // own limit and by the room left in its bucket
+  for (int j = 0; j < groups.count(); j++) {
+    SpeedLimiterGroup *g = groups[j];
+    double groupTokens = rateTokens(g->limit, elapsed);
+    double demand = 0;
+    
+    itemShares[j].resize(g->items.count());
     
-    int limit = m_limits[i];
-    if (!limit) {
-      // There is no limit, reset all items
-      foreach (SpeedLimiterItem *item, m_objects[i]) {
-        item->m_availableBytes = -1;
+    for (int k = 0; k < g->items.count(); k++) {
+      SpeedLimiterItem *item = g->items[k];
+      SpeedLimiterShare &share = itemShares[j][k];
+      
+      double itemTokens = rateTokens(item->m_limit, elapsed);
+      int rate = item->m_limit;
+      
+      if (rate <= 0 || (g->limit > 0 && g->limit < rate))
+        rate = g->limit;
+      if (rate <= 0 || (m_limits[type] > 0 && m_limits[type] < rate))
+        rate = m_limits[type];
+      
+      share.weight = item->m_weight;
+      share.assigned = 0;
+      
+      if (rate <= 0) {
+        share.capacity = -1;
+      } else {
+        double room = rateTokens(rate, bucketTime) - qMax(0, (int) item->m_availableBytes) - item->m_credit;
+        share.capacity = minTokens(itemTokens, qMax(0.0, room));
       }
       
-      continue;
+      demand = (demand < 0 || share.capacity < 0) ? -1 : demand + share.capacity;
     }
     
-    // If there are no objects, just skip it
-    if (m_objects[i].isEmpty())
-      continue;
-    
-    int tokens = limit * tickDelay / 1000;
-    if (!tokens)
-      tokens = 1;
-    
-    int maxTokens = tokens * bucketSize;
-    
-    // Get amount of tokens for each object
-    int tokensPerObject = tokens / m_objects[i].count();
-    if (!tokensPerObject)
-      tokensPerObject = 1;
-    
-    tokens = 0;
+    groupShares[j].weight = g->weight;
+    groupShares[j].capacity = minTokens(groupTokens, demand);
+    groupShares[j].assigned = 0;
+  }
+  
+  // Split the global tokens between groups, unless there is no global limit
+  // in which case each group is only bounded by its own limit
+  if (tokens >= 0) {
+    distributeTokens(tokens, groupShares);
+  } else {
+    for (int j = 0; j < groups.count(); j++)
+      groupShares[j].assigned = groupShares[j].capacity;
+  }
+  
+  // Split each group's tokens between its items
+  for (int j = 0; j < groups.count(); j++) {
+    double groupTokens = groupShares[j].assigned;
     
-    QList<SpeedLimiterItem*> unsaturatedObjects;
+    if (groupTokens >= 0)
+      distributeTokens(groupTokens, itemShares[j]);
     
-    foreach (SpeedLimiterItem *item, m_objects[i]) {
-      if (item->m_availableBytes == -1) {
-        item->m_availableBytes = tokensPerObject;
-        unsaturatedObjects.append(item);
-      } else {
-        item->m_availableBytes += tokensPerObject;
-        
-        if (item->m_availableBytes > maxTokens) {
-          tokens += item->m_availableBytes - maxTokens;
-          item->m_availableBytes = maxTokens;
-        } else {
-          unsaturatedObjects.append(item);
-        }
+    for (int k = 0; k < groups[j]->items.count(); k++) {
+      SpeedLimiterItem *item = groups[j]->items[k];
+      const SpeedLimiterShare &share = itemShares[j][k];
+      
+      if (groupTokens < 0 && share.capacity < 0) {
+        // Nothing limits this item
+        item->m_availableBytes.fetchAndStoreOrdered(-1);
+        item->m_credit = 0;
+        item->m_rate = 0;
+        continue;
       }
-    }
-    
-    // Assign any left-overs to unsaturated sources
-    while (tokens && !unsaturatedObjects.isEmpty()) {
-      tokensPerObject = tokens / unsaturatedObjects.count();
-      if (!tokensPerObject)
-        break;
       
-      tokens = 0;
+      double assigned = groupTokens < 0 ? share.capacity : share.assigned;
+      item->m_rate = assigned * 1000000 / elapsed;
       
-      foreach (SpeedLimiterItem *item, unsaturatedObjects) {
-        item->m_availableBytes += tokensPerObject;
-        
-        if (item->m_availableBytes > maxTokens) {
-          tokens += item->m_availableBytes - maxTokens;
-          item->m_availableBytes = maxTokens;
-          unsaturatedObjects.removeAll(item);
-        }
-      }
+      // Whole tokens are handed out, the fraction is kept for the next refill
+      item->m_credit += assigned;
+      int whole = (int) item->m_credit;
+      item->m_credit -= whole;
+      
+      // The item may be consuming tokens concurrently
+      int available;
+      do {
+        available = item->m_availableBytes;
+      } while (!item->m_availableBytes.testAndSetOrdered(available, qMax(0, available) + whole));
+      
+      // Items that have stopped transferring must be resumed
+      if (available == 0 && whole > 0)
+        item->speedLimiterWakeup();
     }
   }
-  
-  if (m_objects[0].isEmpty() && m_objects[1].isEmpty())
-    m_timer->stop();
 }
 
 SpeedLimiterItem::SpeedLimiterItem()
-  : m_availableBytes(-1)
+  : m_availableBytes(-1),
+    m_limit(0),
+    m_weight(1),
+    m_credit(0),
+    m_rate(0),
+    m_group(0),
+    m_type(-1)
 {
 }
 
+int SpeedLimiterItem::allowedBytes()
+{
+  // The group and type are only changed by the thread owning this item
+  if (m_group)
+    SpeedLimiter::self()->refill(static_cast<SpeedLimiter::Type>(m_type));
+  
+  return m_availableBytes;
+}
+
 void SpeedLimiterItem::updateUsage(int bytes)
 {
-  // Ignore if there are no limits
-  if (m_availableBytes == -1)
-    return;
+  int available;
   
-  if (bytes > m_availableBytes)
-    m_availableBytes = 0;
-  else
-    m_availableBytes -= bytes;
+  do {
+    available = m_availableBytes;
+    
+    // Ignore if there are no limits
+    if (available == -1)
+      return;
+  } while (!m_availableBytes.testAndSetOrdered(available, qMax(0, available - bytes)));
 }
 
 }
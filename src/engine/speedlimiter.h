@@ -38,22 +38,39 @@
 
 #include <QObject>
 #include <QList>
-#include <QTimer>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInt>
 
 namespace KFTPEngine {
 
 class SpeedLimiterPrivate;
+class SpeedLimiterGroup;
 class SpeedLimiterItem;
 
 /**
  * This class is used by Socket implementations to enforce speed limits for
- * uploads or downloads. It implements a variant of Token Bucket algorithm.
+ * uploads or downloads. It implements a hierarchical variant of Token Bucket
+ * algorithm. The global limit is shared between groups of items (usually one
+ * group per site) and each group's share is further split between its items
+ * (usually one item per transfer).
+ *
+ * Every level can have its own limit and tokens are split between siblings
+ * according to their weights. Tokens that an item or a group can't use are
+ * redistributed to the siblings that can.
+ *
+ * There is no refill timer. Tokens are refilled on demand, from whichever
+ * thread asks for them, based on the time elapsed on a monotonic clock since
+ * the last refill. Shares are computed with fractional precision and the
+ * remainders are carried over, so even low limits are split fairly. All
+ * methods may be called from any thread.
  *
  * @author Jernej Kos <kostko@unimatrix-one.org>
  */
 class SpeedLimiter : public QObject {
 Q_OBJECT
 friend class SpeedLimiterPrivate;
+friend class SpeedLimiterItem;
 public:
     /**
      * Possible limit types.
@@ -69,20 +86,33 @@ public:
     static SpeedLimiter *self();
     
     /**
-     * Set a limit rate.
+     * Set a global limit rate.
      *
      * @param type Limit type
-     * @param limit Rate
+     * @param limit Rate in bytes per second (0 means no limit)
      */
     void setLimit(Type type, int limit);
     
     /**
-     * Appends an item to be managed by the speed limiter.
+     * Set the limit rate and weight of a group. The group is created if it
+     * doesn't exist yet and is removed as soon as its last item is removed.
+     *
+     * @param group Group name
+     * @param type Limit type
+     * @param limit Rate in bytes per second (0 means no limit)
+     * @param weight Share of the global limit relative to other groups
+     */
+    void setGroupLimit(const QString &group, Type type, int limit, int weight = 1);
+    
+    /**
+     * Appends an item to be managed by the speed limiter. The item's own
+     * limit and weight should be set before calling this method.
      *
      * @param item Item instance
      * @param type Limit type
+     * @param group Name of the group this item belongs to
      */
-    void append(SpeedLimiterItem *item, Type type);
+    void append(SpeedLimiterItem *item, Type type, const QString &group = QString());
     
     /**
      * Removes an item from the speed limiter.
@@ -98,6 +128,14 @@ public:
      * @param type Limit type
      */
     void remove(SpeedLimiterItem *item, Type type);
+    
+    /**
+     * Returns the number of milliseconds an item that has run out of tokens
+     * should wait before trying again.
+     *
+     * @param item Item instance
+     */
+    int wakeupDelay(SpeedLimiterItem *item);
 protected:
     /**
      * Class constructor.
@@ -108,18 +146,45 @@ protected:
      * Class destructor.
      */
     ~SpeedLimiter();
+    
+    /**
+     * Returns the group with the specified name, creating it if needed. The
+     * caller must hold the lock.
+     *
+     * @param group Group name
+     * @param type Limit type
+     */
+    SpeedLimiterGroup *group(const QString &group, Type type);
+    
+    /**
+     * Returns true if any level above the item is limited. The caller must
+     * hold the lock.
+     *
+     * @param item Item instance
+     * @param type Limit type
+     */
+    bool isLimited(SpeedLimiterItem *item, Type type) const;
+    
+    /**
+     * Assigns the tokens accumulated since the last refill to items of the
+     * specified type. Nothing is done when the last refill is too recent,
+     * which is checked without taking the lock. Only the caller that claims
+     * an interval does the redistribution.
+     *
+     * @param type Limit type
+     */
+    void refill(Type type);
 private:
-    QTimer *m_timer;
+    QMutex m_mutex;
     int m_limits[2];
+    qint64 m_lastRefill[2];
     
-    QList<SpeedLimiterItem*> m_objects[2];
+    /* Low 32 bits of the last refill time, used to claim a refill without locking */
+    QAtomicInt m_refillStamp[2];
     
-    int m_tokenDebt[2];
+    QHash<QString, SpeedLimiterGroup*> m_groups[2];
 private slots:
     void updateLimits();
-    void synchronize();
-signals:
-    void activateTimer(int msec);
 };
 
 /**
@@ -137,16 +202,56 @@ public:
     SpeedLimiterItem();
     
     /**
-     * Returns the number of bytes allowed for consumption.
+     * Class destructor.
+     */
+    virtual ~SpeedLimiterItem() {}
+    
+    /**
+     * Returns the number of bytes allowed for consumption or -1 when there
+     * is no limit. Tokens that became available since the last call are
+     * assigned first.
+     */
+    int allowedBytes();
+    
+    /**
+     * Set this item's own limit rate. The limit only takes effect when the
+     * item is appended to the speed limiter.
+     *
+     * @param limit Rate in bytes per second (0 means no limit)
+     */
+    void setLimit(int limit) { m_limit = limit; }
+    
+    /**
+     * Set this item's share of its group's limit relative to other items in
+     * the same group.
+     *
+     * @param weight Item weight
      */
-    int allowedBytes() const { return m_availableBytes; }
+    void setWeight(int weight) { m_weight = qMax(1, weight); }
 protected:
     /**
      * Updates object's byte usage.
      */
     void updateUsage(int bytes);
+    
+    /**
+     * This method is called by the speed limiter when the item has run out
+     * of tokens and new ones have just been assigned. It may be called from
+     * any thread while the speed limiter is locked, so implementations should
+     * only notify the thread owning the item.
+     */
+    virtual void speedLimiterWakeup() {}
 private:
-    int m_availableBytes;
+    QAtomicInt m_availableBytes;
+    int m_limit;
+    int m_weight;
+    
+    /* Fractional tokens and the last assigned rate, guarded by the limiter */
+    double m_credit;
+    double m_rate;
+    
+    SpeedLimiterGroup *m_group;
+    int m_type;
 };
 
 }
@@ -0,0 +1,111 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "speedmeter.h"
+
+#include <math.h>
+#include <time.h>
+
+namespace KFTPEngine {
+
+/* Time constant of the moving average (in seconds) */
+static const double averageWindow = 2.0;
+
+SpeedMeter::SpeedMeter()
+  : m_pending(0),
+    m_reset(0),
+    m_lastSample(0),
+    m_total(0),
+    m_rate(0),
+    m_peak(0)
+{
+}
+
+qint64 SpeedMeter::monotonicTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  
+  return (qint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void SpeedMeter::reset()
+{
+  // Bytes of the previous transfer are dropped, the sampler resets the rest
+  m_pending.fetchAndStoreOrdered(0);
+  m_reset.fetchAndStoreOrdered(1);
+}
+
+void SpeedMeter::sample()
+{
+  qint64 now = monotonicTime();
+  
+  if (m_reset.testAndSetOrdered(1, 0)) {
+    m_lastSample = now;
+    m_total = 0;
+    m_rate = 0;
+    m_peak = 0;
+  }
+  
+  int bytes = m_pending.fetchAndStoreOrdered(0);
+  m_total += bytes;
+  
+  if (!m_lastSample) {
+    // Nothing to compare with on the first sample
+    m_lastSample = now;
+    return;
+  }
+  
+  double elapsed = (now - m_lastSample) / 1000000.0;
+  if (elapsed <= 0)
+    return;
+  
+  m_lastSample = now;
+  double current = bytes / elapsed;
+  
+  if (m_rate == 0) {
+    // Start with the first measurement so short transfers show their speed
+    m_rate = current;
+  } else {
+    // Older samples decay independently of how often we are sampled
+    double alpha = 1.0 - exp(-elapsed / averageWindow);
+    m_rate += alpha * (current - m_rate);
+  }
+  
+  m_peak = qMax(m_peak, m_rate);
+}
+
+}
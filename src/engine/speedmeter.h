@@ -0,0 +1,113 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef KFTPENGINESPEEDMETER_H
+#define KFTPENGINESPEEDMETER_H
+
+#include <QAtomicInt>
+
+#include "directorylisting.h"
+
+namespace KFTPEngine {
+
+/**
+ * This class measures the transfer speed of a socket. Bytes are counted by
+ * the thread that moves the data without any locking, while a single reader
+ * (usually the GUI thread) periodically samples the counter and maintains
+ * an exponentially weighted moving average of the speed together with the
+ * peak speed.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class SpeedMeter {
+public:
+    /**
+     * Class constructor.
+     */
+    SpeedMeter();
+    
+    /**
+     * Counts transferred bytes. This method may be called from any thread.
+     *
+     * @param bytes Number of bytes
+     */
+    void add(int bytes) { m_pending.fetchAndAddOrdered(bytes); }
+    
+    /**
+     * Requests the meter to be reset on the next sample, as a new transfer
+     * is starting. This method may be called from any thread.
+     */
+    void reset();
+    
+    /**
+     * Takes a new sample and updates the average speed. Only one thread may
+     * sample a meter.
+     */
+    void sample();
+    
+    /**
+     * Returns the total number of bytes counted up to the last sample.
+     */
+    filesize_t total() const { return m_total; }
+    
+    /**
+     * Returns the average speed at the last sample in bytes per second.
+     */
+    filesize_t rate() const { return (filesize_t) m_rate; }
+    
+    /**
+     * Returns the highest average speed since the meter was reset.
+     */
+    filesize_t peak() const { return (filesize_t) m_peak; }
+    
+    /**
+     * Returns the current time of a monotonic clock in microseconds.
+     */
+    static qint64 monotonicTime();
+private:
+    QAtomicInt m_pending;
+    QAtomicInt m_reset;
+    
+    /* Sampler state */
+    qint64 m_lastSample;
+    filesize_t m_total;
+    double m_rate;
+    double m_peak;
+};
+
+}
+
+#endif
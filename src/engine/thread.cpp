@@ -37,8 +37,9 @@
 #include "ftpsocket.h"
 #include "sftpsocket.h"
 #include "settings.h"
+#include "iothreadpool.h"
+#include "misc/config.h"
 
-#include <QAbstractEventDispatcher>
 #include <QCoreApplication>
 
 namespace KFTPEngine {
@@ -51,14 +52,54 @@ CommandQueue::Event::Event(Commands::Type type)
 
 CommandQueue::CommandQueue(Thread *thread)
   : QObject(),
-    m_thread(thread)
+    m_thread(thread),
+    m_shutdown(false)
 {
 }
 
+CommandQueue::~CommandQueue()
+{
+  if (m_shutdown)
+    m_thread->deleteLater();
+}
+
 void CommandQueue::customEvent(QEvent *event)
 {
   Event *e = static_cast<Event*>(event);
+  
+  // Commands posted while the thread was shutting down have nothing to run on
+  if (m_shutdown)
+    return;
+  
+  switch (e->command()) {
+    case Commands::CmdStartup: {
+      m_thread->initialize();
+      m_thread->m_startupSem.release();
+      return;
+    }
+    case Commands::CmdShutdown: {
+      m_thread->cleanup();
+      IoThreadPool::self()->release(m_thread->m_ioThread);
+      
+      // Schedule our deletion, the thread goes away together with us
+      m_shutdown = true;
+      deleteLater();
+      return;
+    }
+    default: break;
+  }
+  
   Socket *socket = m_thread->socket();
+  if (!socket)
+    return;
+  
+  // Resuming a throttled transfer or executing a deferred command doesn't
+  // affect the current command
+  switch (e->command()) {
+    case Commands::CmdThrottleWakeup: socket->throttleWakeup(); return;
+    case Commands::CmdNextCommand: socket->nextCommand(); return;
+    default: break;
+  }
   
   if (!socket->isBusy()) {
     socket->setCurrentCommand(e->command());
@@ -123,6 +164,10 @@ void CommandQueue::customEvent(QEvent *event)
                                 e->parameter(2).value<KUrl>());
         break;
       }
+      case Commands::CmdChecksum: {
+        socket->protoChecksum(e->parameter(0).value<KUrl>(), e->parameter(1).value<KUrl>());
+        break;
+      }
       default: break;
     }
   }
@@ -144,15 +189,21 @@ Thread::Thread()
  : QThread(),
    m_eventHandler(new EventHandler(this)),
    m_socket(0),
-   m_exit(false),
-   m_commandsDeferred(0),
-   m_immediateWakeup(false)
+   m_settings(0),
+   m_commandQueue(0),
+   m_ioThread(0)
 {
-  m_startupSem.release(1);
-  m_startupSem.acquire();
-  
-  // Auto start the thread
-  start();
+  if (KFTPCore::Config::engineThreadPool()) {
+    // Run the connection in one of the shared I/O threads
+    m_ioThread = IoThreadPool::self()->acquire();
+    m_commandQueue = new CommandQueue(this);
+    m_commandQueue->moveToThread(m_ioThread);
+    
+    notifyCommandQueue(new CommandQueue::Event(Commands::CmdStartup));
+  } else {
+    // Auto start the thread
+    start();
+  }
   
   m_startupSem.acquire();
 }
@@ -164,9 +215,16 @@ Thread::~Thread()
 
 void Thread::shutdown()
 {
-  m_commandsDeferred = 0;
-  m_exit = true;
-  QAbstractEventDispatcher::instance(this)->interrupt();
+  if (m_ioThread) {
+    // Cleanup is done by the I/O thread, no further commands are accepted
+    CommandQueue *commandQueue = m_commandQueue.fetchAndStoreOrdered(0);
+    
+    if (commandQueue)
+      QCoreApplication::postEvent(commandQueue, new CommandQueue::Event(Commands::CmdShutdown));
+    return;
+  }
+  
+  exit();
 
   // Start a timer to prevent the thread from hanging
   QTimer::singleShot(5000, this, SLOT(shutdownWithTerminate()));
@@ -180,41 +238,47 @@ void Thread::shutdownWithTerminate()
 
 void Thread::run()
 {
-  m_commandQueue = new CommandQueue(this);
-  m_settings = new Settings();
-  setCurrentProtocol("ftp");
+  CommandQueue *commandQueue = new CommandQueue(this);
+  initialize();
+  
+  m_commandQueue = commandQueue;
   m_startupSem.release();
   
   // Enter the event loop
-  QEventLoop eventLoop;
-  while (!m_exit) {
-    if (m_commandsDeferred)
-      eventLoop.processEvents(QEventLoop::ProcessEventsFlag(QEventLoop::DeferredDeletion));
-    else
-      eventLoop.processEvents(QEventLoop::WaitForMoreEvents | QEventLoop::ProcessEventsFlag(QEventLoop::DeferredDeletion));
-    
-    if (m_commandsDeferred) {
-      m_socket->nextCommand();
-      m_commandsDeferred--;
-    }
-  }
+  exec();
   
   // Cleanup before exiting
+  m_commandQueue.fetchAndStoreOrdered(0);
+  delete commandQueue;
+  cleanup();
+
+  // Schedule our deletion
+  deleteLater();
+}
+
+void Thread::initialize()
+{
+  m_settings = new Settings();
+  setCurrentProtocol("ftp");
+}
+
+void Thread::cleanup()
+{
   delete m_settings;
-  delete m_commandQueue;
+  m_settings = 0;
   
   foreach (Socket *socket, m_sockets) {
     delete socket;
   }
-
-  // Schedule our deletion
-  deleteLater();
+  
+  m_sockets.clear();
+  m_socket = 0;
 }
 
 void Thread::deferCommandExec()
 {
-  m_commandsDeferred++;
-  QAbstractEventDispatcher::instance(this)->interrupt();
+  // Processed after the events that are already pending
+  notifyCommandQueue(new CommandQueue::Event(Commands::CmdNextCommand));
 }
 
 void Thread::setCurrentProtocol(const QString &protocol)
@@ -243,55 +307,42 @@ void Thread::setCurrentProtocol(const KUrl &url)
 
 void Thread::notifyCommandQueue(CommandQueue::Event *event, int priority)
 {
-  if (m_commandQueue)
-    QCoreApplication::postEvent(m_commandQueue, event, priority);
+  CommandQueue *commandQueue = m_commandQueue;
+  
+  if (commandQueue)
+    QCoreApplication::postEvent(commandQueue, event, priority);
+  else
+    delete event;
 }
 
 void Thread::wakeup(WakeupEvent *e)
 {
-  if (m_immediateWakeup) {
-    m_imWakeupEvent = e;
-    m_immediateWakeup = false;
-    m_imWakeupCond.wakeOne();
-  } else {
-    CommandQueue::Event *event = new CommandQueue::Event(Commands::CmdWakeup);
-    event->addParameter(QVariant::fromValue(e));
-    
-    notifyCommandQueue(event);
-  }
+  CommandQueue::Event *event = new CommandQueue::Event(Commands::CmdWakeup);
+  event->addParameter(QVariant::fromValue(e));
+  
+  notifyCommandQueue(event);
+}
+
+void Thread::throttleWakeup()
+{
+  notifyCommandQueue(new CommandQueue::Event(Commands::CmdThrottleWakeup));
 }
 
 void Thread::abort()
 {
-  if (m_immediateWakeup) {
-    m_imWakeupEvent = 0;
-    m_immediateWakeup = false;
-    m_imWakeupCond.wakeOne();
-  }
-  
   notifyCommandQueue(new CommandQueue::Event(Commands::CmdAbort), Qt::HighEventPriority * 100);
 }
 
 void Thread::emitEvent(Event::Type type, QList<QVariant> params)
 {
   if (m_eventHandler)
-    QCoreApplication::postEvent(m_eventHandler, new Event(type, params));
+    m_eventHandler->post(type, params);
 }
 
-WakeupEvent *Thread::waitForWakeup()
+void Thread::emitEvent(Event::Type type, const QString &text, const QString &detail)
 {
-  WakeupEvent *event;
-  
-  m_imWakeupMutex.lock();
-  m_immediateWakeup = true;
-  m_imWakeupCond.wait(&m_imWakeupMutex);
-  
-  event = m_imWakeupEvent;
-  m_imWakeupEvent = 0;
-  
-  m_imWakeupMutex.unlock();
-  
-  return event;
+  if (m_eventHandler)
+    m_eventHandler->post(type, text, detail);
 }
 
 void Thread::connect(const KUrl &url)
@@ -394,4 +445,13 @@ void Thread::siteToSite(Thread *thread, const KUrl &source, const KUrl &destinat
   notifyCommandQueue(event);
 }
 
+void Thread::checksum(const KUrl &remote, const KUrl &local)
+{
+  CommandQueue::Event *event = new CommandQueue::Event(Commands::CmdChecksum);
+  event->addParameter(remote);
+  event->addParameter(local);
+  
+  notifyCommandQueue(event);
+}
+
 }
@@ -38,10 +38,9 @@
 
 #include <QThread>
 #include <QSemaphore>
-#include <QWaitCondition>
-#include <QMutex>
 #include <QList>
 #include <QHash>
+#include <QAtomicPointer>
 
 #include "event.h"
 #include "directorylisting.h"
@@ -51,6 +50,7 @@
 namespace KFTPEngine {
 
 class Settings;
+class IoThread;
 
 /**
  * The command queue handles any incoming requests for execution of
@@ -96,6 +96,12 @@ public:
      * Class constructor.
      */
     CommandQueue(Thread *thread);
+    
+    /**
+     * Class destructor. A thread that has been shut down is only deleted
+     * together with its command queue.
+     */
+    ~CommandQueue();
 protected:
     /**
      * This method gets called when an event is delivered to
@@ -104,6 +110,7 @@ protected:
     void customEvent(QEvent *event);
 private:
     Thread *m_thread;
+    bool m_shutdown;
 };
 
 /**
@@ -111,6 +118,10 @@ private:
  * the underlying socket implementation and also as an abstraction layer
  * to support multiple protocols.
  *
+ * When the engine thread pool is enabled, no thread is started for the
+ * connection. Its command queue and sockets are assigned to one of the
+ * shared I/O threads instead (see IoThreadPool).
+ *
  * @author Jernej Kos <kostko@unimatrix-one.org>
  */
 class Thread : public QThread
@@ -156,6 +167,13 @@ public:
      * @param e The wakeup event to pass on
      */
     void wakeup(WakeupEvent *e);
+    
+    /**
+     * Schedules a throttled transfer to be resumed in this thread. This is
+     * used by the speed limiter after new tokens have been assigned to a
+     * socket that has run out of them.
+     */
+    void throttleWakeup();
 
     /**
      * Requests the thread to shutdown.
@@ -175,29 +193,35 @@ public:
     void mkdir(const KUrl &url);
     void raw(const QString &raw);
     void siteToSite(Thread *thread, const KUrl &source, const KUrl &destination);
+    void checksum(const KUrl &remote, const KUrl &local);
 protected:
     /**
-     * Thread entry point.
+     * Thread entry point. Only used when the connection has a dedicated
+     * thread.
      */
     void run();
     
+    /**
+     * Creates the settings and the default socket. This method is called
+     * from the thread that will run the connection.
+     */
+    void initialize();
+    
+    /**
+     * Destroys the settings and all sockets. This method is called from
+     * the thread that has been running the connection.
+     */
+    void cleanup();
+    
     /**
      * Emits an event to the outside world.
      */
     void emitEvent(Event::Type type, QList<QVariant> params);
     
     /**
-     * Blocks the execution of this thread until a wakeup event is received. This
-     * method should only be used for things like peer certificate verification
-     * where user input is requested in place and methods cannot be deferred. Other
-     * than that this method should NOT be used.
-     *
-     * @warning Such an event MUST be replied to by the main thread. Failure to
-     *          do so will permanently lock this thread!
-     *
-     * @return A valid WakeupEvent instance or NULL if an abort ocurred
+     * Emits a text event to the outside world.
      */
-    WakeupEvent *waitForWakeup();
+    void emitEvent(Event::Type type, const QString &text, const QString &detail);
     
     /**
      * Sets the protocol implementation to be used by the current thread. It
@@ -242,15 +266,9 @@ protected:
     Settings *m_settings;
     
     QHash<QString, Socket*> m_sockets;
-    CommandQueue *m_commandQueue;
+    QAtomicPointer<CommandQueue> m_commandQueue;
     QSemaphore m_startupSem;
-    bool m_exit;
-    int m_commandsDeferred;
-    
-    QMutex m_imWakeupMutex;
-    QWaitCondition m_imWakeupCond;
-    WakeupEvent *m_imWakeupEvent;
-    bool m_immediateWakeup;
+    IoThread *m_ioThread;
 };
 
 }
@@ -0,0 +1,219 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "tracer.h"
+#include "socket.h"
+#include "speedmeter.h"
+
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QFile>
+
+#include <KGlobal>
+
+namespace KFTPEngine {
+
+QAtomicInt Tracer::m_enabled = 0;
+QAtomicInt Tracer::m_socketIds = 0;
+
+/**
+ * Escapes a string for use in a JSON document.
+ */
+static QString jsonEscape(const QString &text)
+{
+  QString result;
+  result.reserve(text.length() + 2);
+  
+  for (int i = 0; i < text.length(); i++) {
+    QChar c = text.at(i);
+    
+    switch (c.unicode()) {
+      case '"': result += "\\\""; break;
+      case '\\': result += "\\\\"; break;
+      case '\n': result += "\\n"; break;
+      case '\r': result += "\\r"; break;
+      case '\t': result += "\\t"; break;
+      default: {
+        if (c.unicode() < 0x20)
+          result += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+        else
+          result += c;
+        break;
+      }
+    }
+  }
+  
+  return result;
+}
+
+class TracerPrivate
+{
+public:
+    Tracer instance;
+};
+
+K_GLOBAL_STATIC(TracerPrivate, tracerPrivate)
+
+Tracer *Tracer::self()
+{
+  return &tracerPrivate->instance;
+}
+
+Tracer::Tracer()
+  : m_dropped(0)
+{
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+  m_enabled = enabled ? 1 : 0;
+}
+
+void Tracer::clear()
+{
+  QMutexLocker locker(&m_mutex);
+  m_records.clear();
+  m_tracks.clear();
+  m_dropped = 0;
+}
+
+int Tracer::count()
+{
+  QMutexLocker locker(&m_mutex);
+  return m_records.count();
+}
+
+void Tracer::record(Socket *socket, char phase, const char *category, const QString &name,
+                    quintptr id, const QString &detail)
+{
+  Record record;
+  record.timestamp = SpeedMeter::monotonicTime();
+  record.track = socket->traceId();
+  record.phase = phase;
+  record.category = category;
+  record.name = name;
+  record.id = id;
+  record.detail = detail;
+  
+  QMutexLocker locker(&m_mutex);
+  
+  if (m_records.count() >= MaxRecords) {
+    m_dropped++;
+    return;
+  }
+  
+  // Name the socket's track when it is first seen
+  if (!m_tracks.contains(record.track)) {
+    KUrl url = socket->getCurrentUrl();
+    
+    Record meta;
+    meta.timestamp = record.timestamp;
+    meta.track = record.track;
+    meta.phase = 'M';
+    meta.category = "";
+    meta.name = "thread_name";
+    meta.id = 0;
+    
+    if (url.host().isEmpty())
+      meta.detail = QString("%1 #%2").arg(socket->protocolName()).arg(record.track);
+    else
+      meta.detail = QString("%1:%2 #%3").arg(url.host()).arg(url.port()).arg(record.track);
+    
+    m_tracks.insert(record.track);
+    m_records.append(meta);
+  }
+  
+  m_records.append(record);
+}
+
+void Tracer::write(QTextStream &stream)
+{
+  QMutexLocker locker(&m_mutex);
+  
+  stream << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << m_dropped << "},\"traceEvents\":[\n";
+  
+  for (int i = 0; i < m_records.count(); i++) {
+    const Record &record = m_records.at(i);
+    
+    stream << "{\"name\":\"" << jsonEscape(record.name) << "\","
+           << "\"cat\":\"" << record.category << "\","
+           << "\"ph\":\"" << record.phase << "\","
+           << "\"ts\":" << record.timestamp << ","
+           << "\"pid\":1,\"tid\":" << record.track;
+    
+    if (record.phase == 'b' || record.phase == 'e')
+      stream << ",\"id\":\"0x" << QString::number((qulonglong) record.id, 16) << "\"";
+    else if (record.phase == 'i')
+      stream << ",\"s\":\"t\"";
+    
+    if (record.phase == 'M')
+      stream << ",\"args\":{\"name\":\"" << jsonEscape(record.detail) << "\"}";
+    else if (!record.detail.isEmpty())
+      stream << ",\"args\":{\"detail\":\"" << jsonEscape(record.detail) << "\"}";
+    
+    stream << (i < m_records.count() - 1 ? "},\n" : "}\n");
+  }
+  
+  stream << "]}\n";
+  stream.flush();
+}
+
+bool Tracer::exportToFile(const QString &filename)
+{
+  QFile file(filename);
+  
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    return false;
+  
+  QTextStream stream(&file);
+  stream.setCodec("UTF-8");
+  write(stream);
+  file.close();
+  
+  return true;
+}
+
+void TraceScope::begin()
+{
+  m_socket->trace('B', m_category, m_name);
+}
+
+void TraceScope::end()
+{
+  m_socket->trace('E', m_category, m_name);
+}
+
+}
@@ -0,0 +1,202 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef KFTPENGINETRACER_H
+#define KFTPENGINETRACER_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QVector>
+#include <QSet>
+#include <QString>
+
+class QTextStream;
+
+namespace KFTPEngine {
+
+class Socket;
+class TracerPrivate;
+
+/**
+ * This class records a timeline of command execution in all sockets. It
+ * captures top-level commands, chained command classes, command class
+ * processing, state transitions, control connection traffic and command
+ * resets, so the per-file overhead of the command state machines can be
+ * examined.
+ *
+ * Tracing is disabled by default. Callers should check isEnabled() before
+ * preparing trace data, so a disabled tracer costs one atomic read. The
+ * recorded timeline is exported in the Chrome trace event format, where
+ * every socket is shown as a separate track.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class Tracer {
+friend class TracerPrivate;
+public:
+    /**
+     * Maximum number of records kept, further records are dropped.
+     */
+    enum { MaxRecords = 250000 };
+    
+    /**
+     * Returns the global tracer instance.
+     */
+    static Tracer *self();
+    
+    /**
+     * Returns true if tracing is enabled.
+     */
+    static bool isEnabled() { return m_enabled != 0; }
+    
+    /**
+     * Returns a new unique socket identifier, used as the socket's track.
+     */
+    static int nextSocketId() { return m_socketIds.fetchAndAddRelaxed(1) + 1; }
+    
+    /**
+     * Enables or disables tracing. Records are kept when tracing is disabled
+     * so they can be exported afterwards.
+     *
+     * @param enabled True to enable tracing
+     */
+    void setEnabled(bool enabled);
+    
+    /**
+     * Removes all records.
+     */
+    void clear();
+    
+    /**
+     * Returns the number of records.
+     */
+    int count();
+    
+    /**
+     * Adds a new record. Timestamps are taken from the monotonic clock.
+     *
+     * @param socket Socket the record belongs to
+     * @param phase Chrome trace event phase (B, E, b, e or i)
+     * @param category Record category
+     * @param name Record name
+     * @param id Identifier that pairs asynchronous begin and end records
+     * @param detail Optional detail shown in the record's arguments
+     */
+    void record(Socket *socket, char phase, const char *category, const QString &name,
+                quintptr id = 0, const QString &detail = QString());
+    
+    /**
+     * Writes all records as a Chrome trace event JSON document.
+     *
+     * @param stream Destination stream
+     */
+    void write(QTextStream &stream);
+    
+    /**
+     * Writes all records to a file.
+     *
+     * @param filename Destination file
+     * @return True if the file has been written
+     */
+    bool exportToFile(const QString &filename);
+protected:
+    /**
+     * Class constructor.
+     */
+    Tracer();
+private:
+    class Record {
+    public:
+        qint64 timestamp;
+        int track;
+        char phase;
+        const char *category;
+        QString name;
+        quintptr id;
+        QString detail;
+    };
+    
+    static QAtomicInt m_enabled;
+    static QAtomicInt m_socketIds;
+    
+    QMutex m_mutex;
+    QVector<Record> m_records;
+    QSet<int> m_tracks;
+    int m_dropped;
+};
+
+/**
+ * Records a synchronous span for the lifetime of the object. Nothing is
+ * recorded when tracing is disabled at construction time.
+ *
+ * @author Jernej Kos <kostko@unimatrix-one.org>
+ */
+class TraceScope {
+public:
+    /**
+     * Class constructor.
+     *
+     * @param socket Socket the span belongs to
+     * @param category Span category
+     * @param name Span name, must remain valid until destruction
+     */
+    TraceScope(Socket *socket, const char *category, const char *name)
+      : m_socket(Tracer::isEnabled() ? socket : 0), m_category(category), m_name(name)
+    {
+      if (m_socket)
+        begin();
+    }
+    
+    /**
+     * Class destructor.
+     */
+    ~TraceScope()
+    {
+      if (m_socket)
+        end();
+    }
+private:
+    Socket *m_socket;
+    const char *m_category;
+    const char *m_name;
+    
+    void begin();
+    void end();
+};
+
+}
+
+#endif
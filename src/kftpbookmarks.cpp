@@ -959,6 +959,10 @@ void Manager::setupClient(Site *site, KFTPEngine::Thread *client, KFTPEngine::Th
     
     settings->setConfig("encoding", site->getProperty("encoding"));
     
+    settings->setConfig("speed.site_download", site->getIntProperty("speedLimitDown") * 1024);
+    settings->setConfig("speed.site_upload", site->getIntProperty("speedLimitUp") * 1024);
+    settings->setConfig("speed.site_weight", qMax(1, site->getIntProperty("speedWeight")));
+    
     if (site->protocol() == Site::ProtoFtp) {
       settings->setConfig("feat.pasv", site->getIntProperty("disablePASV") != 1);
       settings->setConfig("feat.epsv", site->getIntProperty("disableEPSV") != 1);
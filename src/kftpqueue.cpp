@@ -39,7 +39,9 @@
 #include "kftpbookmarks.h"
 #include "widgets/systemtray.h"
 #include "kftpqueueprocessor.h"
+#include "kftpqueuejournal.h"
 #include "kftpsession.h"
+#include "statistics.h"
 
 #include "misc/config.h"
 #include "misc/filter.h"
@@ -138,6 +140,8 @@ Manager::Manager()
   m_lastQID = 1;
   m_curDownSpeed = 0;
   m_curUpSpeed = 0;
+  m_queueEta = -1;
+  m_queueEtaValid = false;
 
   m_emitUpdate = true;
 
@@ -149,6 +153,13 @@ Manager::Manager()
 
   // Create the queue converter object
   m_converter = new KFTPQueueConverter(this);
+  
+  // Create the queue journal object
+  m_journal = new KFTPQueueJournal(this);
+  
+  // Statistics are flushed periodically instead of on every change
+  m_statisticsTimer.setSingleShot(true);
+  connect(&m_statisticsTimer, SIGNAL(timeout()), this, SLOT(slotStatisticsFlush()));
 }
 
 Manager::~Manager()
@@ -175,15 +186,87 @@ void Manager::stopAllTransfers()
 
 Transfer *Manager::findTransfer(long id)
 {
-  // First try the cache
-  QueueObject *object = m_queueObjectCache[id];
+  return static_cast<Transfer*>(m_queueObjects.value(id));
+}
+
+void Manager::registerObject(QueueObject *object, long id)
+{
+  if (m_queueObjectIds.contains(object)) {
+    // Object is being renumbered, drop the old mapping
+    long oldId = m_queueObjectIds.value(object);
+    
+    if (m_queueObjects.value(oldId) == object)
+      m_queueObjects.remove(oldId);
+  } else {
+    connect(object, SIGNAL(destroyed(QObject*)), this, SLOT(slotObjectDestroyed(QObject*)));
+  }
   
-  if (!object) {
-    object = m_topLevel->findChildObject(id);
-    m_queueObjectCache.insert(id, object);
+  m_queueObjects.insert(id, object);
+  m_queueObjectIds.insert(object, id);
+}
+
+void Manager::slotObjectDestroyed(QObject *object)
+{
+  // Only the pointer may be used here as the object is already destroyed
+  long id = m_queueObjectIds.take(object);
+  
+  if (static_cast<QObject*>(m_queueObjects.value(id)) == object)
+    m_queueObjects.remove(id);
+  
+  // Drop any speed the transfer still contributes
+  if (m_transferSpeeds.contains(object)) {
+    TransferSpeed previous = m_transferSpeeds.take(object);
+    addTransferSpeed(previous.type, -previous.speed);
+  }
+}
+
+void Manager::addTransferSpeed(TransferType type, filesize_t speed)
+{
+  switch (type) {
+    case Download: m_curDownSpeed += speed; break;
+    case Upload: m_curUpSpeed += speed; break;
+    case FXP: {
+      m_curDownSpeed += speed;
+      m_curUpSpeed += speed;
+      break;
+    }
   }
+}
+
+void Manager::updateTransferSpeed(Transfer *transfer, filesize_t speed)
+{
+  // Only registered transfers are tracked, as we need to know when they are destroyed
+  if (!m_queueObjectIds.contains(transfer))
+    return;
+  
+  if (m_transferSpeeds.contains(transfer)) {
+    TransferSpeed previous = m_transferSpeeds.take(transfer);
+    addTransferSpeed(previous.type, -previous.speed);
+  }
+  
+  if (speed != 0) {
+    TransferSpeed current;
+    current.type = transfer->getTransferType();
+    current.speed = speed;
+    
+    m_transferSpeeds.insert(transfer, current);
+    addTransferSpeed(current.type, speed);
+  }
+}
+
+QList<Transfer*> Manager::getActiveTransfers() const
+{
+  QList<Transfer*> transfers;
   
-  return static_cast<Transfer*>(object);
+  foreach (QObject *transfer, m_transferSpeeds.keys())
+    transfers.append(static_cast<Transfer*>(transfer));
+  
+  return transfers;
+}
+
+void Manager::scheduleRemoval(Transfer *transfer)
+{
+  m_pendingRemovals.append(transfer);
 }
 
 Site *Manager::findSite(KUrl url, bool noCreate)
@@ -306,17 +389,24 @@ Transfer *Manager::spawnTransfer(KUrl sourceUrl, KUrl destinationUrl, filesize_t
   return transfer;
 }
 
+TransferDir *Manager::spawnSynchronization(const KUrl &sourceUrl, const KUrl &destinationUrl, int flags)
+{
+  TransferDir *transfer = static_cast<TransferDir*>(spawnTransfer(sourceUrl, destinationUrl, 0, true, true, true, 0, true));
+  
+  transfer->setSyncFlags(flags | TransferDir::SyncEnabled);
+  m_journal->recordAttributes(transfer);
+  transfer->scan();
+  
+  return transfer;
+}
+
 void Manager::removeTransfer(Transfer *transfer, bool abortSession)
 {
   if (!transfer)
     return;
     
   transfer->abort();
-  long id = transfer->getId();
   long sid = transfer->parentObject()->getId();
-  
-  // Remove transfer from cache
-  m_queueObjectCache.remove(id);
 
   // Should the site be removed as well ?
   QueueObject *site = 0;
@@ -394,32 +484,31 @@ void Manager::clearFailedTransferList()
 
 void Manager::doEmitUpdate()
 {
-  m_curDownSpeed = 0;
-  m_curUpSpeed = 0;
-
-  topLevelObject()->removeMarkedTransfers();
+  // Remove transfers that have been marked for deletion since the last update
+  QList<QPointer<Transfer> > removals = m_pendingRemovals;
+  m_pendingRemovals.clear();
   
-  // Get download/upload speeds
-  foreach (QueueObject *i, topLevelObject()->getChildrenList()) {
-    foreach (QueueObject *t, i->getChildrenList()) {
-      KFTPQueue::Transfer *tmp = static_cast<Transfer*>(t);
-      
-      switch (tmp->getTransferType()) {
-        case Download: m_curDownSpeed += tmp->getSpeed(); break;
-        case Upload: m_curUpSpeed += tmp->getSpeed(); break;
-        case FXP: {
-          m_curDownSpeed += tmp->getSpeed();
-          m_curUpSpeed += tmp->getSpeed();
-          break;
-        }
-      }
-    }
+  foreach (QPointer<Transfer> transfer, removals) {
+    if (transfer && transfer->isDeleteMarked())
+      removeTransfer(transfer);
   }
 
   // Emit global update to all GUI objects
   emit queueUpdate();
 }
 
+void Manager::scheduleStatisticsFlush()
+{
+  if (!m_statisticsTimer.isActive())
+    m_statisticsTimer.start(250);
+}
+
+void Manager::slotStatisticsFlush()
+{
+  m_topLevel->flushStatistics();
+  m_queueEtaValid = false;
+}
+
 void Manager::start()
 {
   if (m_processingQueue)
@@ -468,7 +557,59 @@ void Manager::clearQueue()
 
 int Manager::getTransferPercentage()
 {
-  return 0;
+  filesize_t size = topLevelObject()->getSize();
+  if (size == 0)
+    return 0;
+  
+  return (int) qMin((filesize_t) 100, topLevelObject()->getCompleted() * 100 / size);
+}
+
+int Manager::getQueueEta()
+{
+  if (!m_queueEtaValid) {
+    m_queueEta = computeQueueEta();
+    m_queueEtaValid = true;
+  }
+  
+  return m_queueEta;
+}
+
+int Manager::computeQueueEta()
+{
+  double total = 0.0;
+  double longest = 0.0;
+  int sites = 0;
+  
+  foreach (QueueObject *i, topLevelObject()->getChildrenList()) {
+    filesize_t remaining = i->getSize() > i->getCompleted() ? i->getSize() - i->getCompleted() : 0;
+    if (remaining == 0)
+      continue;
+    
+    double eta = 0.0;
+    
+    if (i->getSpeed() > 0) {
+      eta = (double) remaining / i->getSpeed();
+    } else {
+      foreach (QueueObject *t, i->getChildrenList()) {
+        double estimate = Statistics::self()->estimate(static_cast<Transfer*>(t));
+        
+        // Without any history for the site there is nothing to predict from
+        if (estimate < 0)
+          return -1;
+        
+        eta += estimate;
+      }
+    }
+    
+    total += eta;
+    longest = qMax(longest, eta);
+    sites++;
+  }
+  
+  if (sites == 0)
+    return -1;
+  
+  return (int) qMax(longest, total / qMin(sites, KFTPCore::Config::queueMaxSites()));
 }
 
 int Manager::getNumRunning(bool onlyDirs)
@@ -555,8 +696,12 @@ KFTPEngine::FileExistsWakeupEvent *Manager::fileExistsAction(TransferFile *trans
       }
     }
     
-    // Now that we have all data, get the action and do it
-    action = fa->getActionForSituation(srcSize, srcTime, dstSize, dstTime);
+    // Transfers that were interrupted after a journaled checkpoint simply continue
+    // where they left off, otherwise consult the configured actions
+    if (transfer->getCheckpoint() > 0 && dstSize >= transfer->getCheckpoint() && dstSize < srcSize)
+      action = FE_RESUME_ACT;
+    else
+      action = fa->getActionForSituation(srcSize, srcTime, dstSize, dstTime);
   }
   
   switch (action) {
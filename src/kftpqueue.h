@@ -38,8 +38,10 @@
 
 #include <QString>
 #include <QList>
-#include <QCache>
+#include <QHash>
 #include <QMap>
+#include <QTimer>
+#include <QPointer>
 
 #include <KUrl>
 
@@ -62,6 +64,7 @@ namespace KFTPSession {
 }
 
 class KFTPQueueConverter;
+class KFTPQueueJournal;
 
 class K3Process;
 
@@ -182,6 +185,7 @@ Q_OBJECT
 friend class KFTPSession::Session;
 friend class KFTPSession::Connection;
 friend class ::KFTPQueueConverter;
+friend class ::KFTPQueueJournal;
 friend class ::DirectoryScanner;
 friend class FailedTransfer;
 friend class QueueObject;
@@ -243,6 +247,16 @@ public:
      */
     Transfer *findTransfer(long id);
     
+    /**
+     * Registers a queue object under the given id, replacing any previous
+     * registration of the same object. Objects are unregistered automaticly
+     * when destroyed. This is called by QueueObject::setId.
+     *
+     * @param object The queue object
+     * @param id The object's new id
+     */
+    void registerObject(QueueObject *object, long id);
+    
     /**
      * Finds a site by its URL.
      *
@@ -280,6 +294,14 @@ public:
      */
     KFTPQueueConverter *getConverter() const { return m_converter; }
     
+    /**
+     * Return the queue journal, which takes care of saving and restoring
+     * the queue.
+     *
+     * @return the KFTPQueueJournal object
+     */
+    KFTPQueueJournal *getJournal() const { return m_journal; }
+    
     /**
      * Opens the file with the registred application for it's MIME type and waits
      * for the process to exit (then it will reupload the file if it has changed).
@@ -300,6 +322,30 @@ public:
      * variable set.
      */
     void doEmitUpdate();
+    
+    /**
+     * Schedules removal of a transfer that has been marked for deletion. The
+     * transfer will be removed on the next doEmitUpdate call.
+     *
+     * @param transfer The transfer to remove
+     */
+    void scheduleRemoval(Transfer *transfer);
+    
+    /**
+     * Updates the global download and upload speed with a new speed of a
+     * single transfer. This is called by QueueObject::setSpeed.
+     *
+     * @param transfer The transfer which speed has changed
+     * @param speed The transfer's new speed
+     */
+    void updateTransferSpeed(Transfer *transfer, filesize_t speed);
+    
+    /**
+     * Schedules a flush of queue object statistics. Statistics of objects that
+     * have been marked dirty are recomputed and a single change notification
+     * is emitted for each of them, at most four times per second.
+     */
+    void scheduleStatisticsFlush();
 
     /**
      * Get the current download speed.
@@ -315,6 +361,20 @@ public:
      */
     filesize_t getUploadSpeed() const { return m_curUpSpeed; }
     
+    /**
+     * Get the transfers that are currently transferring data.
+     *
+     * @return A list of active transfers
+     */
+    QList<Transfer*> getActiveTransfers() const;
+    
+    /**
+     * Get the number of objects currently in the queue.
+     *
+     * @return The number of queue objects
+     */
+    int getObjectCount() const { return m_queueObjects.count(); }
+    
     /**
      * Get the percentage of the queue's completion.
      *
@@ -322,6 +382,17 @@ public:
      */
     int getTransferPercentage();
     
+    /**
+     * Estimate the time needed to process the rest of the queue. Sites that
+     * are transferring use their current speed, others are predicted from
+     * the site's statistics. Sites are assumed to run in parallel up to the
+     * configured maximum number of concurrent sites. The estimate is only
+     * recomputed once per statistics flush.
+     *
+     * @return Estimated number of seconds or -1 when no estimate is possible
+     */
+    int getQueueEta();
+    
     /**
      * Get the number of currently running transfers.
      *
@@ -406,6 +477,17 @@ public:
      */
     KFTPQueue::Transfer *spawnTransfer(KUrl sourceUrl, KUrl destinationUrl, filesize_t size, bool dir,
                                        bool ignoreSkip = false, bool insertToQueue = true, QObject *parent = 0L, bool noScan = false);
+    
+    /**
+     * Spawn a new directory synchronization. Only entries that are missing
+     * or differ on the destination will be transferred.
+     *
+     * @param sourceUrl Source directory URL
+     * @param destinationUrl Destination directory URL
+     * @param flags Additional TransferDir::SyncFlags (like SyncDelete or SyncChecksum)
+     * @return A valid KFTPQueue::TransferDir instance
+     */
+    KFTPQueue::TransferDir *spawnSynchronization(const KUrl &sourceUrl, const KUrl &destinationUrl, int flags = 0);
 protected:
     /**
      * Class constructor.
@@ -431,12 +513,30 @@ protected:
     void processUserDialogRequest();
 private:
     QueueObject *m_topLevel;
-    QCache<long, QueueObject> m_queueObjectCache;
+    QHash<long, QueueObject*> m_queueObjects;
+    QHash<QObject*, long> m_queueObjectIds;
+    QList<QPointer<Transfer> > m_pendingRemovals;
+    
+    /* Speed contributions of transfers that are currently transferring */
+    struct TransferSpeed {
+      TransferType type;
+      filesize_t speed;
+    };
+    QHash<QObject*, TransferSpeed> m_transferSpeeds;
+    
+    void addTransferSpeed(TransferType type, filesize_t speed);
+    
+    /* Queue estimate cached until the next statistics flush */
+    int m_queueEta;
+    bool m_queueEtaValid;
+    
+    int computeQueueEta();
     
     QMap<pid_t, OpenedFile> m_editProcessList;
     QList<KFTPQueue::FailedTransfer*> m_failedTransfers;
     KFTPQueueProcessor *m_queueProc;
     KFTPQueueConverter *m_converter;
+    KFTPQueueJournal *m_journal;
     
     long m_lastQID;
     bool m_emitUpdate;
@@ -448,7 +548,11 @@ private:
     bool m_feDialogOpen;
     FEAction m_defaultFeAction;
     QList<UserDialogRequest*> m_userDialogRequests;
+    
+    QTimer m_statisticsTimer;
 private slots:
+    void slotObjectDestroyed(QObject *object);
+    void slotStatisticsFlush();
     void slotQueueProcessingComplete();
     void slotQueueProcessingAborted();
     
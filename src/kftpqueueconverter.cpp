@@ -35,97 +35,248 @@
 
 #include "kftpqueueconverter.h"
 #include "kftpqueue.h"
+#include "queuegroup.h"
+#include "kftptransferdir.h"
 
 #include <QList>
-#include <QTextStream>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 
 #include <kfilterdev.h>
+#include <ksavefile.h>
 
 KFTPQueueConverter::KFTPQueueConverter(QObject *parent)
  : QObject(parent)
 {
 }
 
-void KFTPQueueConverter::importQueue(const QString &filename)
+void KFTPQueueConverter::importQueue(const QString &filename, QHash<long, QPointer<KFTPQueue::Transfer> > *idMap)
 {
-  m_xml = QDomDocument("KFTPGrabberQueue");
   KFTPQueue::Manager::self()->clearQueue();
   
   // Load from file
   QIODevice *file = KFilterDev::deviceForFile(filename);
-  m_xml.setContent(file);
-  file->close();
-  delete file;
+  if (!file->open(QIODevice::ReadOnly)) {
+    qDebug("WARNING: Unable to open xml for reading!");
+    delete file;
+    return;
+  }
+  
+  // Parse XML and create KFTPQueueTransfers as items are read
+  QXmlStreamReader xml(file);
   
-  // Parse XML and create KFTPQueueTransfers
-  QDomNode n = m_xml.documentElement().firstChild();
-  while (!n.isNull()) {
-    importNode(n);
+  while (!xml.atEnd()) {
+    xml.readNext();
     
-    n = n.nextSibling();
+    if (xml.isStartElement() && xml.name() == "queue" && idMap) {
+      // Make sure new objects don't take any of the saved ids
+      long lastId = xml.attributes().value("lastid").toString().toLong();
+      KFTPQueue::Manager::self()->m_lastQID = qMax(KFTPQueue::Manager::self()->m_lastQID, lastId);
+    } else if (xml.isStartElement() && xml.name() == "item") {
+      importItem(xml, idMap);
+    }
   }
   
+  if (xml.hasError())
+    qDebug("WARNING: Queue file is malformed, only part of it has been loaded!");
+  
+  file->close();
+  delete file;
+  
   KFTPQueue::Manager::self()->doEmitUpdate();
 }
 
-void KFTPQueueConverter::exportQueue(const QString &filename)
+bool KFTPQueueConverter::exportQueue(const QString &filename)
 {
-  m_xml = QDomDocument("KFTPGrabberQueue");
-  m_xml.setContent(QString("<queue></queue>"));
+  // Write to a temporary file, so a crash or an error never destroys the old queue
+  KSaveFile saveFile(filename);
+  QIODevice *file = saveFile.open() ? KFilterDev::device(&saveFile, "application/x-gzip", false) : 0;
+  
+  if (!file || !file->open(QIODevice::WriteOnly)) {
+    qDebug("WARNING: Unable to open xml for writing!");
+    delete file;
+    saveFile.abort();
+    return false;
+  }
+  
+  QXmlStreamWriter xml(file);
+  xml.setAutoFormatting(true);
+  xml.writeStartDocument();
+  xml.writeDTD("<!DOCTYPE KFTPGrabberQueue>");
+  xml.writeStartElement("queue");
+  xml.writeAttribute("lastid", QString::number(KFTPQueue::Manager::self()->m_lastQID));
   
   // Go trough all KFTPQueueTransfers and generate XML
-  QList<KFTPQueue::QueueObject*> sites = KFTPQueue::Manager::self()->topLevelObject()->getChildrenList();
+  KFTPQueue::QueueObject *topLevel = KFTPQueue::Manager::self()->topLevelObject();
   
-  foreach (KFTPQueue::QueueObject *i, sites) {
-    foreach (KFTPQueue::QueueObject *t, i->getChildrenList())
-      generateXML(static_cast<KFTPQueue::Transfer*>(t), m_xml.documentElement());
+  for (int i = 0; i < topLevel->childCount(); i++) {
+    KFTPQueue::QueueObject *site = topLevel->getChildAt(i);
+    
+    for (int j = 0; j < site->childCount(); j++)
+      generateXML(static_cast<KFTPQueue::Transfer*>(site->getChildAt(j)), xml);
   }
   
-  // Save to file
-  QIODevice *file = KFilterDev::deviceForFile(filename, "application/x-gzip");
-  if (!file->open(QIODevice::WriteOnly)) {
-    qDebug("WARNING: Unable to open xml for writing!");
-    return;
-  }
+  xml.writeEndElement();
+  xml.writeEndDocument();
   
-  QTextStream fileStream(file);
-  m_xml.save(fileStream, 2);
   file->close();
-  
   delete file;
+  
+  if (xml.hasError() || !saveFile.finalize()) {
+    qDebug("WARNING: Unable to write xml!");
+    saveFile.abort();
+    return false;
+  }
+  
+  return true;
 }
 
-void KFTPQueueConverter::generateXML(KFTPQueue::Transfer *transfer, QDomNode parent)
+void KFTPQueueConverter::generateXML(KFTPQueue::Transfer *transfer, QXmlStreamWriter &xml)
 {
   // Create the item
-  QDomElement item = m_xml.createElement("item");
-  parent.appendChild(item);
-
+  xml.writeStartElement("item");
+  
   // Create text nodes
-  createTextNode("source", transfer->getSourceUrl().url(), item);
-  createTextNode("dest", transfer->getDestUrl().url(), item);
-  createTextNode("size", QString::number(transfer->getSize()), item);
-  createTextNode("type", transfer->isDir() ? "directory" : "file", item);
+  xml.writeTextElement("id", QString::number(transfer->getId()));
+  xml.writeTextElement("source", transfer->getSourceUrl().url());
+  xml.writeTextElement("dest", transfer->getDestUrl().url());
+  xml.writeTextElement("size", QString::number(transfer->getSize()));
+  xml.writeTextElement("type", transfer->isDir() ? "directory" : "file");
+  
+  if (transfer->isDir() && transfer->group()->getPolicy() != KFTPQueue::QueueGroup::Default)
+    xml.writeTextElement("policy", QString::number(transfer->group()->getPolicy()));
+  
+  if (transfer->isDir() && static_cast<KFTPQueue::TransferDir*>(transfer)->syncFlags() != KFTPQueue::TransferDir::SyncNone)
+    xml.writeTextElement("sync", QString::number(static_cast<KFTPQueue::TransferDir*>(transfer)->syncFlags()));
+  
+  if (transfer->getSpeedLimit() > 0)
+    xml.writeTextElement("speedlimit", QString::number(transfer->getSpeedLimit()));
+  
+  if (transfer->getSpeedPriority() != KFTPQueue::Transfer::PriorityDefault)
+    xml.writeTextElement("priority", QString::number(transfer->getSpeedPriority()));
+  
+  if (!transfer->isDir() && static_cast<KFTPQueue::TransferFile*>(transfer)->getCheckpoint() > 0)
+    xml.writeTextElement("checkpoint", QString::number(static_cast<KFTPQueue::TransferFile*>(transfer)->getCheckpoint()));
   
   if (transfer->isDir() && transfer->hasChildren()) {
     // Transfer has children, add them as well
-    QDomElement tag = m_xml.createElement("children");
-    item.appendChild(tag);
+    xml.writeStartElement("children");
+    
+    for (int i = 0; i < transfer->childCount(); i++)
+      generateXML(static_cast<KFTPQueue::Transfer*>(transfer->getChildAt(i)), xml);
+    
+    xml.writeEndElement();
+  }
+  
+  xml.writeEndElement();
+}
+
+void KFTPQueueConverter::importItem(QXmlStreamReader &xml, QHash<long, QPointer<KFTPQueue::Transfer> > *idMap, QObject *parent)
+{
+  KUrl srcUrl;
+  KUrl dstUrl;
+  filesize_t size = 0;
+  filesize_t checkpoint = 0;
+  int policy = KFTPQueue::QueueGroup::Default;
+  int syncFlags = KFTPQueue::TransferDir::SyncNone;
+  int speedLimit = 0;
+  int priority = KFTPQueue::Transfer::PriorityDefault;
+  bool dir = false;
+  long id = 0;
+  
+  KFTPQueue::Transfer *transfer = 0L;
+  
+  // Read item properties until the closing tag, the transfer is created as soon
+  // as its children are about to be read
+  while (!xml.atEnd()) {
+    xml.readNext();
+    
+    if (xml.isEndElement())
+      break;
     
-    foreach (KFTPQueue::QueueObject *i, transfer->getChildrenList()) {
-      generateXML(static_cast<KFTPQueue::Transfer*>(i), tag);
+    if (!xml.isStartElement())
+      continue;
+    
+    if (xml.name() == "id") {
+      id = xml.readElementText().trimmed().toLong();
+    } else if (xml.name() == "source") {
+      srcUrl = KUrl(xml.readElementText().trimmed());
+    } else if (xml.name() == "dest") {
+      dstUrl = KUrl(xml.readElementText().trimmed());
+    } else if (xml.name() == "size") {
+      size = xml.readElementText().trimmed().toULongLong();
+    } else if (xml.name() == "type") {
+      dir = xml.readElementText().trimmed() == "directory";
+    } else if (xml.name() == "policy") {
+      policy = qBound((int) KFTPQueue::QueueGroup::Default, xml.readElementText().trimmed().toInt(), (int) KFTPQueue::QueueGroup::RoundRobin);
+    } else if (xml.name() == "sync") {
+      syncFlags = xml.readElementText().trimmed().toInt();
+    } else if (xml.name() == "speedlimit") {
+      speedLimit = qMax(0, xml.readElementText().trimmed().toInt());
+    } else if (xml.name() == "priority") {
+      priority = xml.readElementText().trimmed().toInt();
+    } else if (xml.name() == "checkpoint") {
+      checkpoint = xml.readElementText().trimmed().toULongLong();
+    } else if (xml.name() == "children" && dir && !transfer) {
+      transfer = createTransfer(srcUrl, dstUrl, size, dir, parent, idMap ? id : 0);
+      
+      // Import all child nodes
+      while (!xml.atEnd()) {
+        xml.readNext();
+        
+        if (xml.isEndElement())
+          break;
+        
+        if (xml.isStartElement()) {
+          if (xml.name() == "item")
+            importItem(xml, idMap, transfer);
+          else
+            skipElement(xml);
+        }
+      }
+    } else {
+      skipElement(xml);
     }
   }
+  
+  if (!transfer)
+    transfer = createTransfer(srcUrl, dstUrl, size, dir, parent, idMap ? id : 0);
+  
+  transfer->setSpeedLimit(speedLimit);
+  
+  switch (priority) {
+    case KFTPQueue::Transfer::PriorityLow:
+    case KFTPQueue::Transfer::PriorityNormal:
+    case KFTPQueue::Transfer::PriorityHigh: transfer->setSpeedPriority(static_cast<KFTPQueue::Transfer::SpeedPriority>(priority)); break;
+    default: break;
+  }
+  
+  if (dir) {
+    transfer->group()->setPolicy(static_cast<KFTPQueue::QueueGroup::Policy>(policy));
+    static_cast<KFTPQueue::TransferDir*>(transfer)->setSyncFlags(syncFlags);
+  } else
+    static_cast<KFTPQueue::TransferFile*>(transfer)->setCheckpoint(checkpoint);
+  
+  if (idMap && id)
+    idMap->insert(id, transfer);
 }
 
-void KFTPQueueConverter::importNode(QDomNode node, QObject *parent)
+void KFTPQueueConverter::skipElement(QXmlStreamReader &xml)
 {
-  // Get node data
-  KUrl srcUrl = KUrl(getTextNode("source", node));
-  KUrl dstUrl = KUrl(getTextNode("dest", node));
-  filesize_t size = getTextNode("size", node).toULongLong();
-  bool dir = getTextNode("type", node) == "directory";
+  int depth = 1;
   
+  while (depth > 0 && !xml.atEnd()) {
+    xml.readNext();
+    
+    if (xml.isStartElement())
+      depth++;
+    else if (xml.isEndElement())
+      depth--;
+  }
+}
+
+KFTPQueue::Transfer *KFTPQueueConverter::createTransfer(const KUrl &srcUrl, const KUrl &dstUrl, filesize_t size, bool dir, QObject *parent, long id)
+{
   KFTPQueue::TransferType transType = KFTPQueue::Download;
   
   if (srcUrl.isLocalFile() && !dstUrl.isLocalFile()) {
@@ -151,53 +302,25 @@ void KFTPQueueConverter::importNode(QDomNode node, QObject *parent)
   transfer->addSize(dir ? 0 : size);
   transfer->setTransferType(transType);
   
-  if (parent == KFTPQueue::Manager::self()->topLevelObject()) {
-    KFTPQueue::Manager::self()->insertTransfer(transfer);
-  } else {
-    transfer->setId(KFTPQueue::Manager::self()->m_lastQID++);
-    emit KFTPQueue::Manager::self()->objectAdded(transfer);
-    transfer->readyObject();
-  }
-  
-  QDomNodeList tagNodes = node.toElement().elementsByTagName("children");
-  if (dir && tagNodes.length() > 0) {
-    // Import all child nodes
-    QDomNode n = node.firstChild();
-    while (!n.isNull()) {
-      if (n.toElement().tagName() == "children") {
-        n = n.firstChild();
-        break;
-      }
-      
-      n = n.nextSibling();
-    }
-    
-    while (!n.isNull()) {
-      importNode(n, transfer);
-      
-      n = n.nextSibling();
-    }
-  }
-}
-
-void KFTPQueueConverter::createTextNode(const QString &name, const QString &value, QDomNode parent)
-{
-  QDomElement tag = m_xml.createElement(name);
-  parent.appendChild(tag);
+  KFTPQueue::Manager *manager = KFTPQueue::Manager::self();
   
-  QDomText textNode = m_xml.createTextNode(value);
-  tag.appendChild(textNode);
-}
-
-QString KFTPQueueConverter::getTextNode(const QString &name, QDomNode parent)
-{
-  QDomNodeList tagNodes = parent.toElement().elementsByTagName(name);
+  // Saved ids are kept unless some other object already uses them
+  if (id > 0 && manager->findTransfer(id))
+    id = 0;
   
-  if (tagNodes.length() > 0) {
-    return tagNodes.item(0).toElement().text().trimmed();
+  if (parent == manager->topLevelObject()) {
+    manager->insertTransfer(transfer);
+    
+    if (id > 0 && id != transfer->getId())
+      transfer->setId(id);
   } else {
-    return QString::null;
+    transfer->setId(id > 0 ? id : manager->m_lastQID++);
+    emit manager->objectAdded(transfer);
+    transfer->readyObject();
   }
+  
+  manager->m_lastQID = qMax(manager->m_lastQID, transfer->getId() + 1);
+  return transfer;
 }
 
 #include "kftpqueueconverter.moc"
@@ -37,14 +37,22 @@
 #define KFTPQUEUECONVERTER_H
 
 #include <qobject.h>
-#include <qdom.h>
+#include <QHash>
+#include <QPointer>
+
+#include "engine/directorylisting.h"
+
+class KUrl;
+class QXmlStreamReader;
+class QXmlStreamWriter;
 
 namespace KFTPQueue {
   class Transfer;
 }
 
 /**
-This class provides queue export/import to XML files.
+This class provides queue export/import to XML files. Files are read and
+written as streams, so memory usage doesn't depend on the queue size.
 
 @author Jernej Kos
 */
@@ -59,24 +67,38 @@ public:
      * new KFTPQueueTransfers.
      *
      * @param filename XML file that contains the queue
+     * @param idMap Optional map that receives the new transfers by their exported ids,
+     *              when given the transfers also keep their exported ids
      */
-    void importQueue(const QString &filename);
+    void importQueue(const QString &filename, QHash<long, QPointer<KFTPQueue::Transfer> > *idMap = 0);
     
     /**
      * Export queue to XML file. It will take all current KFTPQueueTransfers
      * and convert their properties to XML format.
      *
      * @param filename File where queue will be exported
+     * @return True if the file has been written, it is left untouched otherwise
      */
-    void exportQueue(const QString &filename);
-private:
-    QDomDocument m_xml;
+    bool exportQueue(const QString &filename);
     
-    void generateXML(KFTPQueue::Transfer *transfer, QDomNode parent);
-    void createTextNode(const QString &name, const QString &value, QDomNode parent);
+    /**
+     * Creates a new transfer and adds it to the queue. Toplevel transfers are
+     * inserted under their site, others are appended to the given parent.
+     *
+     * @param srcUrl Source URL
+     * @param dstUrl Destination URL
+     * @param size Filesize
+     * @param dir True if this transfer represents a directory
+     * @param parent Parent transfer or 0 for toplevel transfers
+     * @param id Id the transfer should keep if it isn't taken yet, 0 for a new one
+     * @return The newly created transfer
+     */
+    KFTPQueue::Transfer *createTransfer(const KUrl &srcUrl, const KUrl &dstUrl, filesize_t size, bool dir, QObject *parent, long id = 0);
+private:
+    void generateXML(KFTPQueue::Transfer *transfer, QXmlStreamWriter &xml);
     
-    void importNode(QDomNode node, QObject *parent = 0);
-    QString getTextNode(const QString &name, QDomNode parent);
+    void importItem(QXmlStreamReader &xml, QHash<long, QPointer<KFTPQueue::Transfer> > *idMap, QObject *parent = 0);
+    void skipElement(QXmlStreamReader &xml);
 };
 
 #endif
@@ -0,0 +1,469 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "kftpqueuejournal.h"
+#include "kftpqueue.h"
+#include "queuegroup.h"
+
+#include "misc/config.h"
+
+/* Journal file header */
+static const quint32 JournalMagic = 0x4B46514A;
+static const quint32 JournalVersion = 1;
+
+/* Minimum number of records before the journal is compacted */
+static const int JournalMinRecords = 4096;
+
+KFTPQueueJournal::KFTPQueueJournal(KFTPQueue::Manager *manager)
+ : QObject(manager),
+   m_manager(manager),
+   m_records(0),
+   m_replaying(false),
+   m_renumbered(false)
+{
+  m_stream.setVersion(QDataStream::Qt_4_0);
+  
+  connect(manager, SIGNAL(objectAdded(KFTPQueue::QueueObject*)), this, SLOT(slotObjectAdded(KFTPQueue::QueueObject*)));
+  connect(manager, SIGNAL(objectRemoved(KFTPQueue::QueueObject*)), this, SLOT(slotObjectRemoved(KFTPQueue::QueueObject*)));
+  connect(manager, SIGNAL(objectBeforeRemoval(KFTPQueue::QueueObject*)), this, SLOT(slotObjectBeforeRemoval(KFTPQueue::QueueObject*)));
+  connect(manager, SIGNAL(failedTransferAdded(KFTPQueue::FailedTransfer*)), this, SLOT(slotFailedTransferAdded(KFTPQueue::FailedTransfer*)));
+  connect(manager, SIGNAL(failedTransferBeforeRemoval(KFTPQueue::FailedTransfer*)), this, SLOT(slotFailedTransferBeforeRemoval(KFTPQueue::FailedTransfer*)));
+  
+  // Records are written in batches, so a large scan doesn't cause a write per transfer
+  m_flushTimer.setSingleShot(true);
+  connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(slotFlush()));
+  
+  m_checkpointTimer.setInterval(10000);
+  connect(&m_checkpointTimer, SIGNAL(timeout()), this, SLOT(slotCheckpoint()));
+  
+  m_compactTimer.setSingleShot(true);
+  connect(&m_compactTimer, SIGNAL(timeout()), this, SLOT(slotCompact()));
+}
+
+KFTPQueueJournal::~KFTPQueueJournal()
+{
+  // The manager is being destroyed, so just make sure everything hits the disk
+  if (m_file.isOpen())
+    m_file.flush();
+}
+
+void KFTPQueueJournal::restore(const QString &filename)
+{
+  m_snapshotFile = filename;
+  
+  // Load the snapshot first, remembering which transfer got which saved id
+  QHash<long, QPointer<KFTPQueue::Transfer> > idMap;
+  
+  m_replaying = true;
+  m_manager->getConverter()->importQueue(filename, &idMap);
+  
+  if (!KFTPCore::Config::queueJournal()) {
+    m_replaying = false;
+    return;
+  }
+  
+  // Apply changes made after the snapshot has been written
+  m_renumbered = false;
+  int records = replay(idMap);
+  m_replaying = false;
+  
+  QHash<long, QPointer<KFTPQueue::Transfer> >::const_iterator idEnd = idMap.constEnd();
+  for (QHash<long, QPointer<KFTPQueue::Transfer> >::const_iterator i = idMap.constBegin(); i != idEnd && !m_renumbered; i++) {
+    if (*i && (*i)->getId() != i.key())
+      m_renumbered = true;
+  }
+  
+  // Transfers keep their saved ids, so new records can simply be appended
+  // unless the journal ended in a broken record or some id was taken
+  if (records < 0 || m_renumbered) {
+    compact();
+  } else {
+    open(false);
+    m_records = records;
+  }
+  
+  m_checkpointTimer.start();
+}
+
+void KFTPQueueJournal::close()
+{
+  m_checkpointTimer.stop();
+  m_flushTimer.stop();
+  m_compactTimer.stop();
+  
+  if (m_snapshotFile.isEmpty())
+    return;
+  
+  bool saved = m_manager->getConverter()->exportQueue(m_snapshotFile);
+  
+  if (m_file.isOpen()) {
+    m_file.close();
+    
+    if (saved)
+      m_file.remove();
+  }
+}
+
+void KFTPQueueJournal::scheduleCompaction()
+{
+  if (m_file.isOpen())
+    m_compactTimer.start(0);
+}
+
+bool KFTPQueueJournal::isRecording() const
+{
+  return m_file.isOpen() && !m_replaying;
+}
+
+void KFTPQueueJournal::open(bool truncate)
+{
+  if (m_file.isOpen())
+    m_file.close();
+  
+  m_file.setFileName(m_snapshotFile + ".journal");
+  
+  if (!m_file.open(truncate ? QIODevice::WriteOnly | QIODevice::Truncate : QIODevice::WriteOnly | QIODevice::Append)) {
+    qDebug("WARNING: Unable to open queue journal for writing!");
+    return;
+  }
+  
+  m_stream.setDevice(&m_file);
+  m_records = 0;
+  
+  if (truncate || m_file.size() == 0)
+    m_stream << JournalMagic << JournalVersion;
+}
+
+void KFTPQueueJournal::beginRecord(RecordType type, long id)
+{
+  m_stream << (quint8) type << (qint64) id;
+}
+
+void KFTPQueueJournal::endRecord()
+{
+  m_records++;
+  
+  if (!m_flushTimer.isActive())
+    m_flushTimer.start(500);
+  
+  // Compact once replaying the journal would be slower than loading a new snapshot
+  if (m_records > qMax(JournalMinRecords, 2 * m_manager->getObjectCount()))
+    scheduleCompaction();
+}
+
+void KFTPQueueJournal::recordAttributes(KFTPQueue::Transfer *transfer)
+{
+  if (!isRecording())
+    return;
+  
+  qint32 policy = 0, syncFlags = 0;
+  if (transfer->isDir()) {
+    policy = transfer->group()->getPolicy();
+    syncFlags = static_cast<KFTPQueue::TransferDir*>(transfer)->syncFlags();
+  }
+  
+  beginRecord(RecordAttributes, transfer->getId());
+  m_stream << transfer->getSourceUrl().url() << transfer->getDestUrl().url() << (qint32) transfer->getTransferType();
+  m_stream << (qint32) transfer->getSpeedLimit() << (qint32) transfer->getSpeedPriority() << policy << syncFlags;
+  endRecord();
+}
+
+void KFTPQueueJournal::recordFailed(KFTPQueue::FailedTransfer *transfer)
+{
+  KFTPQueue::TransferFile *file = transfer->getTransfer();
+  if (!file)
+    return;
+  
+  beginRecord(RecordFailed, file->getId());
+  m_stream << file->getSourceUrl().url() << file->getDestUrl().url() << (quint64) file->getSize() << transfer->getError();
+  endRecord();
+}
+
+int KFTPQueueJournal::replay(QHash<long, QPointer<KFTPQueue::Transfer> > &idMap)
+{
+  QFile file(m_snapshotFile + ".journal");
+  if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+    return 0;
+  
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_0);
+  
+  quint32 magic, version;
+  stream >> magic >> version;
+  
+  if (stream.status() != QDataStream::Ok || magic != JournalMagic || version != JournalVersion) {
+    qDebug("WARNING: Queue journal is not valid, ignoring it!");
+    return -1;
+  }
+  
+  KFTPQueueConverter *converter = m_manager->getConverter();
+  QHash<long, QPointer<KFTPQueue::FailedTransfer> > failedMap;
+  int records = 0;
+  
+  while (!stream.atEnd()) {
+    quint8 type;
+    qint64 id;
+    stream >> type >> id;
+    
+    switch (type) {
+      case RecordAdd: {
+        qint64 parentId;
+        bool dir;
+        QString srcUrl, dstUrl;
+        quint64 size;
+        stream >> parentId >> dir >> srcUrl >> dstUrl >> size;
+        
+        if (stream.status() != QDataStream::Ok)
+          break;
+        
+        // Children of transfers that are no longer there are dropped as well
+        KFTPQueue::Transfer *parent = 0;
+        if (parentId && !(parent = idMap.value(parentId)))
+          break;
+        
+        idMap.insert(id, converter->createTransfer(KUrl(srcUrl), KUrl(dstUrl), size, dir, parent, id));
+        break;
+      }
+      case RecordRemove: {
+        KFTPQueue::Transfer *transfer = idMap.take(id);
+        if (transfer)
+          m_manager->removeTransfer(transfer, false);
+        break;
+      }
+      case RecordMove: {
+        qint32 position;
+        stream >> position;
+        
+        KFTPQueue::Transfer *transfer = idMap.value(id);
+        if (stream.status() == QDataStream::Ok && transfer && transfer->hasParentObject())
+          transfer->parentObject()->moveChildTo(transfer, position);
+        break;
+      }
+      case RecordAttributes: {
+        QString srcUrl, dstUrl;
+        qint32 type, speedLimit, priority, policy, syncFlags;
+        stream >> srcUrl >> dstUrl >> type >> speedLimit >> priority >> policy >> syncFlags;
+        
+        KFTPQueue::Transfer *transfer = idMap.value(id);
+        if (stream.status() != QDataStream::Ok || !transfer)
+          break;
+        
+        transfer->setSourceUrl(KUrl(srcUrl));
+        transfer->setDestUrl(KUrl(dstUrl));
+        transfer->setTransferType(static_cast<KFTPQueue::TransferType>(type));
+        transfer->setSpeedLimit(speedLimit);
+        transfer->setSpeedPriority(static_cast<KFTPQueue::Transfer::SpeedPriority>(priority));
+        
+        if (transfer->isDir()) {
+          transfer->group()->setPolicy(static_cast<KFTPQueue::QueueGroup::Policy>(policy));
+          static_cast<KFTPQueue::TransferDir*>(transfer)->setSyncFlags(syncFlags);
+        }
+        
+        // Changed URLs might belong to another site
+        if (!transfer->hasParentTransfer())
+          m_manager->revalidateTransfer(transfer);
+        break;
+      }
+      case RecordCheckpoint: {
+        quint64 offset;
+        stream >> offset;
+        
+        KFTPQueue::Transfer *transfer = idMap.value(id);
+        if (stream.status() == QDataStream::Ok && transfer && !transfer->isDir())
+          static_cast<KFTPQueue::TransferFile*>(transfer)->setCheckpoint(offset);
+        break;
+      }
+      case RecordFailed: {
+        QString srcUrl, dstUrl, error;
+        quint64 size;
+        stream >> srcUrl >> dstUrl >> size >> error;
+        
+        if (stream.status() != QDataStream::Ok)
+          break;
+        
+        KFTPQueue::Transfer *transfer = converter->createTransfer(KUrl(srcUrl), KUrl(dstUrl), size, false, 0, id);
+        if (transfer->getId() != id)
+          m_renumbered = true;
+        
+        KFTPQueue::FailedTransfer::fail(static_cast<KFTPQueue::TransferFile*>(transfer), error, false);
+        failedMap.insert(id, m_manager->failedTransfers()->last());
+        break;
+      }
+      case RecordFailedRemoved: {
+        KFTPQueue::FailedTransfer *transfer = failedMap.take(id);
+        if (transfer)
+          m_manager->removeFailedTransfer(transfer);
+        break;
+      }
+      default: {
+        qDebug("WARNING: Unknown queue journal record, ignoring the rest of the journal!");
+        stream.setStatus(QDataStream::ReadCorruptData);
+        break;
+      }
+    }
+    
+    // A record cut short by a crash ends the journal
+    if (stream.status() != QDataStream::Ok) {
+      records = -1;
+      break;
+    }
+    
+    records++;
+  }
+  
+  m_manager->doEmitUpdate();
+  return records;
+}
+
+bool KFTPQueueJournal::compact()
+{
+  m_compactTimer.stop();
+  m_flushTimer.stop();
+  
+  // Keep journaling on top of the old snapshot when the new one can't be written
+  if (!m_manager->getConverter()->exportQueue(m_snapshotFile)) {
+    if (m_file.isOpen())
+      m_file.flush();
+    else
+      open(false);
+    
+    return false;
+  }
+  
+  // The new snapshot contains the complete queue, so the journal can be started anew
+  open(true);
+  
+  if (!m_file.isOpen())
+    return false;
+  
+  // Failed transfers are not part of the snapshot
+  foreach (KFTPQueue::FailedTransfer *transfer, *m_manager->failedTransfers())
+    recordFailed(transfer);
+  
+  m_file.flush();
+  return true;
+}
+
+void KFTPQueueJournal::slotObjectAdded(KFTPQueue::QueueObject *object)
+{
+  if (!object->isTransfer() || !isRecording())
+    return;
+  
+  // Moves are signaled as a removal immediately followed by an addition
+  if (object == m_moving) {
+    m_moving = 0;
+    
+    beginRecord(RecordMove, object->getId());
+    m_stream << (qint32) object->index();
+    endRecord();
+    return;
+  }
+  
+  KFTPQueue::Transfer *transfer = static_cast<KFTPQueue::Transfer*>(object);
+  KFTPQueue::QueueObject *parent = transfer->parentObject();
+  
+  beginRecord(RecordAdd, transfer->getId());
+  m_stream << (qint64) (parent->isTransfer() ? parent->getId() : 0) << transfer->isDir();
+  m_stream << transfer->getSourceUrl().url() << transfer->getDestUrl().url();
+  m_stream << (quint64) (transfer->isDir() ? 0 : transfer->getSize());
+  endRecord();
+}
+
+void KFTPQueueJournal::slotObjectRemoved(KFTPQueue::QueueObject *object)
+{
+  // Transfers themselves are only removed when moved, proper removals are
+  // signaled by objectBeforeRemoval
+  if (object->isTransfer())
+    m_moving = object;
+}
+
+void KFTPQueueJournal::slotObjectBeforeRemoval(KFTPQueue::QueueObject *object)
+{
+  if (!object->isTransfer() || !isRecording())
+    return;
+  
+  beginRecord(RecordRemove, object->getId());
+  endRecord();
+}
+
+void KFTPQueueJournal::slotFailedTransferAdded(KFTPQueue::FailedTransfer *transfer)
+{
+  if (isRecording())
+    recordFailed(transfer);
+}
+
+void KFTPQueueJournal::slotFailedTransferBeforeRemoval(KFTPQueue::FailedTransfer *transfer)
+{
+  if (!isRecording() || !transfer->getTransfer())
+    return;
+  
+  beginRecord(RecordFailedRemoved, transfer->getTransfer()->getId());
+  endRecord();
+}
+
+void KFTPQueueJournal::slotFlush()
+{
+  if (m_file.isOpen())
+    m_file.flush();
+}
+
+void KFTPQueueJournal::slotCheckpoint()
+{
+  foreach (KFTPQueue::Transfer *transfer, m_manager->getActiveTransfers()) {
+    if (transfer->isDir())
+      continue;
+    
+    KFTPQueue::TransferFile *file = static_cast<KFTPQueue::TransferFile*>(transfer);
+    if (file->getCompleted() <= file->getCheckpoint())
+      continue;
+    
+    file->setCheckpoint(file->getCompleted());
+    
+    if (isRecording()) {
+      beginRecord(RecordCheckpoint, file->getId());
+      m_stream << (quint64) file->getCheckpoint();
+      endRecord();
+    }
+  }
+}
+
+void KFTPQueueJournal::slotCompact()
+{
+  if (isRecording())
+    compact();
+}
+
+#include "kftpqueuejournal.moc"
@@ -0,0 +1,156 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2007 by the KFTPGrabber developers
+ * Copyright (C) 2003-2007 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef KFTPQUEUEJOURNAL_H
+#define KFTPQUEUEJOURNAL_H
+
+#include <QObject>
+#include <QFile>
+#include <QDataStream>
+#include <QHash>
+#include <QPointer>
+#include <QTimer>
+
+namespace KFTPQueue {
+  class Manager;
+  class QueueObject;
+  class Transfer;
+  class FailedTransfer;
+}
+
+/**
+ * This class keeps an append-only journal of queue changes next to the
+ * queue snapshot written by KFTPQueueConverter. Every addition, removal,
+ * move, attribute change and failure is appended as a small binary record and running
+ * transfers periodically record how far they got. On startup the snapshot
+ * is loaded and the journal replayed, so a crash loses at most the last
+ * few hundred milliseconds of changes. Once the journal grows large compared
+ * to the queue it is compacted into a fresh snapshot.
+ *
+ * @author Jernej Kos
+ */
+class KFTPQueueJournal : public QObject
+{
+Q_OBJECT
+public:
+    /**
+     * Class constructor.
+     *
+     * @param manager The queue manager whose changes should be journaled
+     */
+    KFTPQueueJournal(KFTPQueue::Manager *manager);
+    
+    /**
+     * Class destructor.
+     */
+    ~KFTPQueueJournal();
+    
+    /**
+     * Loads the queue snapshot, replays any journaled changes on top of
+     * it and starts journaling. When journaling is disabled only the
+     * snapshot is loaded.
+     *
+     * @param filename The queue snapshot file
+     */
+    void restore(const QString &filename);
+    
+    /**
+     * Writes a fresh snapshot of the queue and discards the journal. This
+     * should be called on shutdown. The journal is kept when the snapshot
+     * can't be written.
+     */
+    void close();
+    
+    /**
+     * Requests a compaction of the journal.
+     */
+    void scheduleCompaction();
+    
+    /**
+     * Journals the editable attributes of a transfer (its URLs, transfer
+     * type, speed settings and, for directories, the scheduling policy and
+     * synchronization flags). Call this after changing any of them.
+     *
+     * @param transfer The transfer that has been changed
+     */
+    void recordAttributes(KFTPQueue::Transfer *transfer);
+private:
+    enum RecordType {
+      RecordAdd = 1,
+      RecordRemove,
+      RecordMove,
+      RecordCheckpoint,
+      RecordFailed,
+      RecordFailedRemoved,
+      RecordAttributes
+    };
+    
+    KFTPQueue::Manager *m_manager;
+    QString m_snapshotFile;
+    
+    QFile m_file;
+    QDataStream m_stream;
+    int m_records;
+    bool m_replaying;
+    bool m_renumbered;
+    
+    QPointer<KFTPQueue::QueueObject> m_moving;
+    
+    QTimer m_flushTimer;
+    QTimer m_checkpointTimer;
+    QTimer m_compactTimer;
+    
+    bool isRecording() const;
+    void open(bool truncate);
+    void beginRecord(RecordType type, long id);
+    void endRecord();
+    void recordFailed(KFTPQueue::FailedTransfer *transfer);
+    
+    int replay(QHash<long, QPointer<KFTPQueue::Transfer> > &idMap);
+    bool compact();
+private slots:
+    void slotObjectAdded(KFTPQueue::QueueObject *object);
+    void slotObjectRemoved(KFTPQueue::QueueObject *object);
+    void slotObjectBeforeRemoval(KFTPQueue::QueueObject *object);
+    void slotFailedTransferAdded(KFTPQueue::FailedTransfer *transfer);
+    void slotFailedTransferBeforeRemoval(KFTPQueue::FailedTransfer *transfer);
+    
+    void slotFlush();
+    void slotCheckpoint();
+    void slotCompact();
+};
+
+#endif
@@ -36,7 +36,11 @@
 #include "kftpqueueprocessor.h"
 #include "kftpqueue.h"
 #include "kftpsession.h"
-//Added by qt3to4:
+#include "queuegroup.h"
+#include "misc/config.h"
+
+QList<QPointer<KFTPQueue::QueueGroup> > KFTPQueueProcessor::m_readyGroups;
+int KFTPQueueProcessor::m_acquiredConnections = 0;
 
 KFTPQueueProcessor::KFTPQueueProcessor(QObject *parent)
  : QObject(parent)
@@ -49,87 +53,150 @@ bool KFTPQueueProcessor::isRunning()
   return m_running;
 }
 
-void KFTPQueueProcessor::processActiveSite()
+void KFTPQueueProcessor::connectionAcquired()
 {
-  if (!m_activeSite)
-    return;
+  m_acquiredConnections++;
+}
 
-  // Start the transfer
-  m_activeSite->delayedExecute();
+void KFTPQueueProcessor::connectionReleased()
+{
+  m_acquiredConnections--;
 }
 
-bool KFTPQueueProcessor::nextSite()
+bool KFTPQueueProcessor::isConnectionAvailable()
 {
-  // Select the first server (should be next) if there is none, we are done :)
-  //KFTPQueueTransfers *transfers = FTPQueueManager->getQueueTransferList();
-  QList<KFTPQueue::QueueObject*> sites = KFTPQueue::Manager::self()->topLevelObject()->getChildrenList();
+  int max = KFTPCore::Config::queueMaxConnections();
   
-  if (sites.count() > 0 && m_running) {
-    if (m_activeSite && m_activeSite->getId() == sites.at(0)->getId()) {
-      // Because this function can be called from slotSiteComplete and signal gets
-      // emitted *before* site is removed we should use the second site on the list
-      m_activeSite = static_cast<KFTPQueue::Site*>(sites.at(1));
-    } else {
-      m_activeSite = static_cast<KFTPQueue::Site*>(sites.at(0));
-    }
-  } else {
-    m_activeSite = 0L;
+  return max == 0 || getNumAcquiredConnections() < max;
+}
+
+void KFTPQueueProcessor::enqueueGroup(KFTPQueue::QueueGroup *group)
+{
+  if (!m_readyGroups.contains(group))
+    m_readyGroups.append(group);
+}
+
+void KFTPQueueProcessor::dispatchReadyGroups()
+{
+  // Every group waiting at this point gets at most one turn, groups that are
+  // still unable to proceed enqueue themselves again
+  int waiting = m_readyGroups.count();
+  
+  while (waiting-- > 0 && !m_readyGroups.isEmpty() && isConnectionAvailable()) {
+    QPointer<KFTPQueue::QueueGroup> group = m_readyGroups.takeFirst();
+    
+    if (group)
+      group->dispatch();
+  }
+}
+
+KFTPQueue::Site *KFTPQueueProcessor::nextSite(QObject *ignore)
+{
+  // Select the first site that is neither active nor aborted, the ignored site is
+  // one that is currently being destroyed but may still be on the list
+  foreach (KFTPQueue::QueueObject *object, KFTPQueue::Manager::self()->topLevelObject()->getChildrenList()) {
+    KFTPQueue::Site *site = static_cast<KFTPQueue::Site*>(object);
+    
+    if (static_cast<QObject*>(site) == ignore || m_activeSites.contains(site) || m_abortedSites.contains(site->getId()))
+      continue;
+    
+    if (site->isRunning() || !site->hasChildren())
+      continue;
+    
+    return site;
   }
   
-  if (m_activeSite) {
+  return 0;
+}
+
+void KFTPQueueProcessor::startSites(QObject *ignore)
+{
+  // Forget about sites that have been destroyed
+  m_activeSites.removeAll(QPointer<KFTPQueue::Site>());
+  
+  while (m_running && m_activeSites.count() < KFTPCore::Config::queueMaxSites()) {
+    // Each site needs at least one connection to make any progress
+    if (!m_activeSites.isEmpty() && !isConnectionAvailable())
+      break;
+    
+    KFTPQueue::Site *site = nextSite(ignore);
+    if (!site)
+      break;
+    
     // Connect the signals
-    connect(m_activeSite, SIGNAL(destroyed(QObject*)), this, SLOT(slotSiteComplete()));
-    connect(m_activeSite, SIGNAL(siteAborted()), this, SLOT(slotSiteAborted()));
+    connect(site, SIGNAL(destroyed(QObject*)), this, SLOT(slotSiteComplete(QObject*)));
+    connect(site, SIGNAL(siteAborted()), this, SLOT(slotSiteAborted()));
     
-    return true;
-  } else {
-    // We are done, so we emit the proper signal
-    m_running = false;
+    m_activeSites.append(site);
     
-    emit queueComplete();
-    return false;
+    // Start the transfer
+    site->delayedExecute();
   }
   
-  return false;
+  if (m_activeSites.isEmpty())
+    finishProcessing();
+}
+
+void KFTPQueueProcessor::finishProcessing()
+{
+  if (!m_running)
+    return;
+  
+  // We are done, so we emit the proper signal
+  m_running = false;
+  
+  if (m_abortedSites.isEmpty()) {
+    emit queueComplete();
+  } else {
+    m_abortedSites.clear();
+    emit queueAborted();
+  }
 }
 
 void KFTPQueueProcessor::startProcessing()
 {
   m_running = true;
+  m_abortedSites.clear();
   
-  // Select the site and process it
-  if (nextSite())
-    processActiveSite();
+  // Select the sites and process them
+  startSites();
 }
 
 void KFTPQueueProcessor::stopProcessing()
 {
   // Stop the queue processing
   m_running = false;
+  m_abortedSites.clear();
   
-  // Abort current transfer
-  if (m_activeSite) {
-    // Disconnect signals
-    m_activeSite->QObject::disconnect(this);
-    m_activeSite->abort();
+  // Abort current transfers
+  foreach (QPointer<KFTPQueue::Site> site, m_activeSites) {
+    if (site) {
+      // Disconnect signals
+      site->QObject::disconnect(this);
+      site->abort();
+    }
   }
   
-  m_activeSite = 0L;
+  m_activeSites.clear();
   emit queueAborted();
 }
 
-void KFTPQueueProcessor::slotSiteComplete()
+void KFTPQueueProcessor::slotSiteComplete(QObject *site)
 {
-  // Transfer is complete, move to the next
-  if (nextSite())
-    processActiveSite();
+  // Site is complete, replace it with the next one
+  startSites(site);
 }
 
 void KFTPQueueProcessor::slotSiteAborted()
 {
-  // Transfer has aborted, we should stop
-  stopProcessing();
+  KFTPQueue::Site *site = static_cast<KFTPQueue::Site*>(QObject::sender());
+  
+  // Only this site has been aborted, others should continue
+  site->QObject::disconnect(this);
+  m_activeSites.removeAll(site);
+  m_abortedSites.append(site->getId());
+  
+  startSites();
 }
 
 #include "kftpqueueprocessor.moc"
-
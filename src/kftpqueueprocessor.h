@@ -40,14 +40,20 @@
 #include <qthread.h>
 #include <qapplication.h>
 #include <qpointer.h>
+#include <QList>
 
 namespace KFTPQueue {
   class Site;
+  class QueueGroup;
 }
 
 /**
-@author Jernej Kos
-*/
+ * The queue processor executes queued sites. Up to queueMaxSites sites are
+ * processed concurrently, while per-site connection limits are still enforced
+ * by the sessions themselves.
+ *
+ * @author Jernej Kos
+ */
 class KFTPQueueProcessor : public QObject
 {
 friend class KFTPQueueManager;
@@ -59,14 +65,59 @@ public:
     void stopProcessing();
     
     bool isRunning();
+    
+    /**
+     * Returns the number of connections currently acquired by transfers in
+     * all sessions.
+     */
+    static int getNumAcquiredConnections() { return m_acquiredConnections; }
+    
+    /**
+     * Records that a transfer has acquired a connection.
+     */
+    static void connectionAcquired();
+    
+    /**
+     * Records that a connection is no longer held by a transfer.
+     */
+    static void connectionReleased();
+    
+    /**
+     * Can queued transfers acquire another connection without exceeding the
+     * global connection limit ?
+     *
+     * @return True if another connection may be acquired
+     */
+    static bool isConnectionAvailable();
+    
+    /**
+     * Adds a queue group to the global ready list. Groups waiting here are
+     * blocked by the global connection limit and are dispatched in order as
+     * soon as any connection is released. A group that is already waiting
+     * is not added again.
+     *
+     * @param group The group waiting for a free connection
+     */
+    static void enqueueGroup(KFTPQueue::QueueGroup *group);
+    
+    /**
+     * Hands connections freed under the global limit to the groups waiting
+     * in the global ready list.
+     */
+    static void dispatchReadyGroups();
 private:
-    QPointer<KFTPQueue::Site> m_activeSite;
+    static QList<QPointer<KFTPQueue::QueueGroup> > m_readyGroups;
+    static int m_acquiredConnections;
+    
+    QList<QPointer<KFTPQueue::Site> > m_activeSites;
+    QList<long> m_abortedSites;
     bool m_running;
     
-    void processActiveSite();
-    bool nextSite();
+    void startSites(QObject *ignore = 0);
+    KFTPQueue::Site *nextSite(QObject *ignore);
+    void finishProcessing();
 private slots:
-    void slotSiteComplete();
+    void slotSiteComplete(QObject *site);
     void slotSiteAborted();
 signals:
     void queueComplete();
@@ -39,6 +39,8 @@
 #include "browser/view.h"
 
 #include "kftpbookmarks.h"
+#include "queuegroup.h"
+#include "kftpqueueprocessor.h"
 #include "widgets/systemtray.h"
 #include "widgets/sslerrorsdialog.h"
 #include "widgets/fingerprintverifydialog.h"
@@ -68,7 +70,8 @@ Connection::Connection(Session *session, bool primary)
     m_primary(primary),
     m_busy(false),
     m_aborting(false),
-    m_scanning(false)
+    m_scanning(false),
+    m_counted(false)
 {
   // Create the actual connection client
   m_client = new KFTPEngine::Thread();
@@ -87,6 +90,7 @@ Connection::Connection(Session *session, bool primary)
 
 Connection::~Connection()
 {
+  slotTransferDestroyed();
   m_client->shutdown();
 }
 
@@ -103,8 +107,14 @@ void Connection::acquire(KFTPQueue::Transfer *transfer)
   m_transfer = transfer;
   m_busy = true;
 
-  connect(transfer, SIGNAL(transferComplete(long)), this, SLOT(slotTransferCompleted()));
-  connect(transfer, SIGNAL(transferAbort(long)), this, SLOT(slotTransferCompleted()));
+  if (transfer) {
+    connect(transfer, SIGNAL(transferComplete(long)), this, SLOT(slotTransferCompleted()));
+    connect(transfer, SIGNAL(transferAbort(long)), this, SLOT(slotTransferCompleted()));
+    connect(transfer, SIGNAL(destroyed()), this, SLOT(slotTransferDestroyed()));
+    
+    m_counted = true;
+    KFTPQueueProcessor::connectionAcquired();
+  }
 
   emit connectionAcquired();
 }
@@ -117,9 +127,14 @@ void Connection::release()
 
   m_transfer = 0L;
   m_busy = false;
+  slotTransferDestroyed();
 
   emit connectionRemoved();
   emit static_cast<Session*>(parent())->freeConnectionAvailable();
+  
+  // With a global connection limit, groups waiting for any slot may proceed as well
+  if (KFTPCore::Config::queueMaxConnections() > 0)
+    KFTPQueueProcessor::dispatchReadyGroups();
 }
 
 void Connection::abort()
@@ -180,8 +195,15 @@ void Connection::addScannedDirectory(KFTPEngine::DirectoryTree *tree, KFTPQueue:
     // Check if we should skip this entry
     const ActionChain *actionChain = Filters::self()->process(sourceUrlBase, 0, true);
      
-    if (actionChain && actionChain->getAction(Action::Skip))
+    if (actionChain && actionChain->getAction(Action::Skip)) {
+      // Skipped entries must not look extraneous on the destination
+      KFTPQueue::TransferDir::unindex(parent, sourceUrlBase, true);
       continue;
+    }
+    
+    // Directories that already exist on the destination are only kept when
+    // something inside them needs to be synchronized
+    bool synchronized = KFTPQueue::TransferDir::isSynchronized(parent, sourceUrlBase, (*i)->info());
     
     // Add directory transfer
     KFTPQueue::TransferDir *transfer = new KFTPQueue::TransferDir(parent);
@@ -196,7 +218,7 @@ void Connection::addScannedDirectory(KFTPEngine::DirectoryTree *tree, KFTPQueue:
     QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
     addScannedDirectory(*i, transfer);
     
-    if (KFTPCore::Config::skipEmptyDirs() && !transfer->hasChildren())
+    if ((KFTPCore::Config::skipEmptyDirs() || synchronized) && !transfer->hasChildren())
       KFTPQueue::Manager::self()->removeTransfer(transfer, false);
   }
   
@@ -215,7 +237,13 @@ void Connection::addScannedDirectory(KFTPEngine::DirectoryTree *tree, KFTPQueue:
     // Check if we should skip this entry
     const ActionChain *actionChain = Filters::self()->process(sourceUrlBase, (*i).size(), false);
      
-    if (actionChain && actionChain->getAction(Action::Skip))
+    if (actionChain && actionChain->getAction(Action::Skip)) {
+      KFTPQueue::TransferDir::unindex(parent, sourceUrlBase, false);
+      continue;
+    }
+    
+    // Skip files that are up to date on the destination
+    if (KFTPQueue::TransferDir::isSynchronized(parent, sourceUrlBase, *i))
       continue;
     
     // Add file transfer
@@ -293,6 +321,15 @@ void Connection::slotTransferCompleted()
   release();
 }
 
+void Connection::slotTransferDestroyed()
+{
+  // Only connections held by a live transfer count against the global limit
+  if (m_counted) {
+    m_counted = false;
+    KFTPQueueProcessor::connectionReleased();
+  }
+}
+
 void Connection::reconnect()
 {
   if (!m_client->socket()->isConnected()) {
@@ -315,6 +352,9 @@ Session::Session(Side side)
 {
   // Register this session
   Manager::self()->registerSession(this);
+  
+  // Free connections are handed to waiting queue groups immediately
+  connect(this, SIGNAL(freeConnectionAvailable()), this, SLOT(dispatchReadyQueue()));
 }
 
 Session::~Session()
@@ -398,10 +438,10 @@ void Session::slotClientEngineEvent(KFTPEngine::Event *event)
       m_fileView->goHome();
       break;
     }
-    case Event::EventCommand: m_log->append(event->getParameter(0).toString(), LogView::FtpCommand);  break;
-    case Event::EventMultiline: m_log->append(event->getParameter(0).toString(), LogView::FtpMultiline); break;
-    case Event::EventResponse: m_log->append(event->getParameter(0).toString(), LogView::FtpResponse); break;
-    case Event::EventMessage: m_log->append(event->getParameter(0).toString(), LogView::FtpStatus); break;
+    case Event::EventCommand: m_log->append(event->text(), LogView::FtpCommand);  break;
+    case Event::EventMultiline: m_log->append(event->text(), LogView::FtpMultiline); break;
+    case Event::EventResponse: m_log->append(event->text(), LogView::FtpResponse); break;
+    case Event::EventMessage: m_log->append(event->text(), LogView::FtpStatus); break;
     case Event::EventError: {
       // ***************************************************************************
       // ****************************** EventError *********************************
@@ -490,6 +530,26 @@ void Session::scanDirectory(KFTPQueue::Transfer *parent, Connection *connection)
   }
 }
 
+void Session::enqueueGroup(KFTPQueue::QueueGroup *group)
+{
+  if (!m_readyQueue.contains(group))
+    m_readyQueue.append(group);
+}
+
+void Session::dispatchReadyQueue()
+{
+  // Every group waiting at this point gets at most one turn, groups that are
+  // still unable to proceed enqueue themselves again
+  int waiting = m_readyQueue.count();
+  
+  while (waiting-- > 0 && !m_readyQueue.isEmpty() && isFreeConnection()) {
+    QPointer<KFTPQueue::QueueGroup> group = m_readyQueue.takeFirst();
+    
+    if (group)
+      group->dispatch();
+  }
+}
+
 void Session::abort()
 {
   if (m_aborting)
@@ -60,6 +60,10 @@ namespace KFTPBookmarks {
   class Site;
 }
 
+namespace KFTPQueue {
+  class QueueGroup;
+}
+
 namespace KFTPSession {
 
 class Session;
@@ -125,7 +129,8 @@ public:
      * locked no other transfer may use it. The connection will be automaticly
      * unlocked when the transfer completes.
      *
-     * @param transfer The transfer which is locking this connection.
+     * @param transfer The transfer which is locking this connection or 0 when
+     *                 it is locked for some other remote operation
      */
     void acquire(KFTPQueue::Transfer *transfer);
 
@@ -181,11 +186,13 @@ private:
     bool m_busy;
     bool m_aborting;
     bool m_scanning;
+    bool m_counted;
 
     QPointer<KFTPQueue::Transfer> m_transfer;
     KFTPEngine::Thread *m_client;
 private slots:
     void slotTransferCompleted();
+    void slotTransferDestroyed();
     
     void slotEngineEvent(KFTPEngine::Event *event);
 signals:
@@ -238,6 +245,7 @@ Q_OBJECT
 friend class KFTPWidgets::Browser::Actions;
 friend class Manager;
 friend class Connection;
+friend class RemoveJob;
 public:
     /**
      * Class constructor.
@@ -386,6 +394,20 @@ public:
      * Returns the URL of the primary connection.
      */
     KUrl getUrl() { return getClient()->socket()->getCurrentUrl(); }
+    
+    /**
+     * Adds a queue group to this session's ready queue. Waiting groups are
+     * dispatched in order as soon as a connection becomes free. A group
+     * that is already waiting is not added again.
+     *
+     * @param group The group waiting for a free connection
+     */
+    void enqueueGroup(KFTPQueue::QueueGroup *group);
+public slots:
+    /**
+     * Hands free connections to the groups waiting in the ready queue.
+     */
+    void dispatchReadyQueue();
 private:
     Side m_side;
     bool m_remote;
@@ -402,6 +424,9 @@ private:
 
     // Connection list
     QList<Connection*> m_connections;
+    
+    // Queue groups waiting for a free connection
+    QList<QPointer<KFTPQueue::QueueGroup> > m_readyQueue;
 
     int getMaxThreadCount();
 private slots:
@@ -539,7 +564,7 @@ public:
      * @return The session list.
      */
     SessionList *getSessionList() { return &m_sessionList; }
-
+    
     /**
      * Emits the update signal.
      */
@@ -95,10 +95,10 @@ TransferFile *FailedTransfer::restore()
   return m_transfer;
 }
 
-void FailedTransfer::fail(TransferFile *transfer, const QString &error)
+void FailedTransfer::fail(TransferFile *transfer, const QString &error, bool retry)
 {
   // Should the transfer be retried
-  if (KFTPCore::Config::failedAutoRetry() && transfer->m_retryCount < KFTPCore::Config::failedAutoRetryCount()) {
+  if (retry && KFTPCore::Config::failedAutoRetry() && transfer->m_retryCount < KFTPCore::Config::failedAutoRetryCount()) {
     // Semi-reset the current transfer
     transfer->addCompleted(-transfer->m_completed);
     
@@ -146,7 +146,9 @@ Transfer::Transfer(QObject *parent, Type type)
    m_dstSession(0),
    m_srcConnection(0),
    m_dstConnection(0),
-   m_retryCount(0)
+   m_retryCount(0),
+   m_speedLimit(0),
+   m_speedPriority(PriorityDefault)
 {
 }
 
@@ -255,7 +257,7 @@ void Transfer::slotConnectionConnected()
     return;
   
   // Everything is ready for immediate execution
-  delayedExecute();
+  delayedExecute(0);
 }
 
 void Transfer::faceDestruction(bool abortSession)
@@ -284,6 +286,26 @@ Transfer *Transfer::parentTransfer()
   return static_cast<Transfer*>(parent());
 }
 
+int Transfer::effectiveSpeedLimit()
+{
+  for (Transfer *transfer = this; transfer; transfer = transfer->parentTransfer()) {
+    if (transfer->m_speedLimit > 0)
+      return transfer->m_speedLimit;
+  }
+  
+  return 0;
+}
+
+Transfer::SpeedPriority Transfer::effectiveSpeedPriority()
+{
+  for (Transfer *transfer = this; transfer; transfer = transfer->parentTransfer()) {
+    if (transfer->m_speedPriority != PriorityDefault)
+      return transfer->m_speedPriority;
+  }
+  
+  return Manager::self()->isProcessing() ? PriorityNormal : PriorityHigh;
+}
+
 void Transfer::resetTransfer()
 {
   // Disconnect signals
@@ -313,6 +335,15 @@ void Transfer::resetTransfer()
   setSpeed(0);
 }
 
+void Transfer::markForDeletion()
+{
+  if (m_deleteMe)
+    return;
+  
+  m_deleteMe = true;
+  KFTPQueue::Manager::self()->scheduleRemoval(this);
+}
+
 bool Transfer::canMove()
 {
   return !isRunning();
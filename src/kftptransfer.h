@@ -108,8 +108,9 @@ public:
      *
      * @param transfer Pointer to the transfer object that failed.
      * @param error The error that ocurred.
+     * @param retry Should the transfer be retried when auto retry is enabled
      */
-    static void fail(TransferFile *transfer, const QString &error);
+    static void fail(TransferFile *transfer, const QString &error, bool retry = true);
 private:
     QPointer<TransferFile> m_transfer;
     QString m_error;
@@ -131,6 +132,17 @@ friend class KFTPSession::Session;
 friend class KFTPSession::Connection;
 Q_OBJECT
 public:
+    /**
+     * Bandwidth priorities, the values are used as weights when the speed
+     * limit is shared between transfers of the same site.
+     */
+    enum SpeedPriority {
+      PriorityDefault = 0,
+      PriorityLow = 1,
+      PriorityNormal = 2,
+      PriorityHigh = 4
+    };
+    
     Transfer(QObject *parent, Type type);
     ~Transfer();
     
@@ -224,6 +236,49 @@ public:
      */
     void setOpenAfterTransfer(bool value) { m_openAfterTransfer = value; }
     
+    /**
+     * Set this transfer's own speed limit. Directories apply the limit to
+     * every transfer they contain.
+     *
+     * @param limit Rate in bytes per second (0 means inherit from the parent)
+     */
+    void setSpeedLimit(int limit) { m_speedLimit = limit; }
+    
+    /**
+     * Returns this transfer's own speed limit.
+     */
+    int getSpeedLimit() const { return m_speedLimit; }
+    
+    /**
+     * Set this transfer's bandwidth priority.
+     *
+     * @param priority The priority (PriorityDefault means inherit from the parent)
+     */
+    void setSpeedPriority(SpeedPriority priority) { m_speedPriority = priority; }
+    
+    /**
+     * Returns this transfer's own bandwidth priority.
+     */
+    SpeedPriority getSpeedPriority() const { return m_speedPriority; }
+    
+    /**
+     * Returns the speed limit that applies to this transfer, which is the
+     * limit of the nearest transfer up the tree that has one.
+     *
+     * @return Rate in bytes per second or 0 when not limited
+     */
+    int effectiveSpeedLimit();
+    
+    /**
+     * Returns the bandwidth priority that applies to this transfer. When
+     * neither this transfer nor its parents have one set, transfers started
+     * while the queue is not being processed are considered interactive and
+     * get high priority.
+     *
+     * @return The priority
+     */
+    SpeedPriority effectiveSpeedPriority();
+    
     /**
      * Is this transfer marked for deletion ?
      *
@@ -231,6 +286,12 @@ public:
      */
     bool isDeleteMarked() const { return m_deleteMe; }
     
+    /**
+     * Marks this transfer for deletion. The transfer will be removed from
+     * the queue on the next queue update.
+     */
+    void markForDeletion();
+    
     /**
      * Get the transfer's parent transfer.
      *
@@ -297,6 +358,10 @@ protected:
     
     int m_retryCount;
     
+    /* Bandwidth settings */
+    int m_speedLimit;
+    SpeedPriority m_speedPriority;
+    
     void showTransCompleteBalloon();
     void resetTransfer();
     
@@ -37,11 +37,18 @@
 #include "kftpqueue.h"
 #include "kftpsession.h"
 #include "queuegroup.h"
+#include "removejob.h"
+
+#include "misc/filter.h"
+
+#include <QDir>
 
 #include <kstandarddirs.h>
+#include <kio/job.h>
 
 using namespace KFTPEngine;
 using namespace KFTPSession;
+using namespace KFTPCore::Filter;
 
 namespace KFTPQueue {
 
@@ -50,7 +57,10 @@ TransferDir::TransferDir(QObject *parent)
     m_scanned(false),
     m_group(new QueueGroup(this)),
     m_srcScanner(0),
-    m_executionMode(Default)
+    m_executionMode(Default),
+    m_syncFlags(SyncNone),
+    m_syncState(SyncIdle),
+    m_syncIndexed(false)
 {
   // Connect to some group signals
   connect(m_group, SIGNAL(interrupted()), this, SLOT(slotGroupInterrupted()));
@@ -77,6 +87,13 @@ void TransferDir::execute()
     }
     case ScanOnly:
     case ScanWithExecute: {
+      // When synchronizing, the destination has to be indexed first so the
+      // source scan is able to skip entries that are up to date
+      if ((m_syncFlags & SyncEnabled) && !m_syncIndexed) {
+        indexDestination();
+        return;
+      }
+      
       // We should initiate a scan
       if (m_srcSession) {
         m_srcSession->scanDirectory(this, m_srcConnection);
@@ -85,6 +102,8 @@ void TransferDir::execute()
         connect(m_srcSession, SIGNAL(dirScanDone()), this, SLOT(slotDirScanDone()));
       } else {
         m_srcScanner = new DirectoryScanner(this);
+        m_scanned = true;
+        
         connect(m_srcScanner, SIGNAL(completed()), this, SLOT(slotDirScanDone()));
       }
       
@@ -118,7 +137,7 @@ void TransferDir::execute()
       
       // Reset and start the group
       m_group->reset();
-      m_group->executeNextTransfer();
+      m_group->dispatch();
       break;
     }
   }
@@ -135,6 +154,22 @@ void TransferDir::scan()
 
 void TransferDir::abort()
 {
+  if (m_syncState != SyncIdle) {
+    // Synchronization in progress, stop listening for destination events
+    if (m_dstConnection)
+      m_dstConnection->getClient()->eventHandler()->QObject::disconnect(this, SLOT(slotSyncEngineEvent(KFTPEngine::Event*)));
+    
+    if (m_syncRemoveJob)
+      m_syncRemoveJob->abort();
+    
+    m_syncState = SyncIdle;
+    m_syncIndex.clear();
+    m_syncKept.clear();
+    m_syncRemovals.clear();
+    m_syncDirRemovals.clear();
+    unlock();
+  }
+  
   if (isLocked()) {
     // The transfer is locked because a scan is in progress
     if (m_srcSession) {
@@ -168,7 +203,7 @@ void TransferDir::slotGroupDone()
 {
   // There are no more transfers, so we are finished
   showTransCompleteBalloon();
-  m_deleteMe = true;
+  markForDeletion();
   resetTransfer();
   
   emit transferComplete(m_id);
@@ -188,10 +223,272 @@ void TransferDir::slotDirScanDone()
   else
     disconnect(m_srcScanner, SIGNAL(completed()), this, SLOT(slotDirScanDone()));
   
+  // A later scan has to index the destination again
+  m_syncIndexed = false;
+  
+  // Remove entries that are no longer present on the source, the transfer
+  // will be reexecuted once they are gone
+  if ((m_syncFlags & SyncDelete) && removeExtraneous())
+    return;
+  
+  m_syncIndex.clear();
+  m_syncKept.clear();
+  
   // Reexecute the transfer
   delayedExecute();
 }
 
+TransferDir *TransferDir::synchronizationRoot(QueueObject *object)
+{
+  for (QueueObject *i = object; i && i->getType() == QueueObject::Directory; i = i->parentObject()) {
+    TransferDir *dir = static_cast<TransferDir*>(i);
+    
+    if (dir->m_syncFlags & SyncEnabled)
+      return dir;
+  }
+  
+  return 0;
+}
+
+bool TransferDir::isSynchronized(Transfer *parent, const KUrl &sourceUrl, const DirectoryEntry &entry)
+{
+  // Find the synchronizing transfer this entry belongs to
+  TransferDir *root = synchronizationRoot(parent);
+  if (!root)
+    return false;
+  
+  QHash<QString, DirectoryEntry>::iterator i = root->m_syncIndex.find(root->syncPath(sourceUrl));
+  if (i == root->m_syncIndex.end())
+    return false;
+  
+  DirectoryEntry destination = *i;
+  root->m_syncIndex.erase(i);
+  
+  if (entry.isDirectory() || destination.isDirectory())
+    return entry.isDirectory() && destination.isDirectory();
+  
+  if (entry.size() != destination.size())
+    return false;
+  
+  // Files of equal size are queued, the engine compares their checksums
+  if (root->m_syncFlags & SyncChecksum)
+    return false;
+  
+  // Modification times are only compared when both sides provide them
+  if (entry.time() && destination.time() && destination.time() < entry.time())
+    return false;
+  
+  return true;
+}
+
+void TransferDir::unindex(Transfer *parent, const KUrl &sourceUrl, bool directory)
+{
+  TransferDir *root = synchronizationRoot(parent);
+  if (!root)
+    return;
+  
+  QString relativePath = root->syncPath(sourceUrl);
+  root->m_syncIndex.remove(relativePath);
+  
+  if (directory)
+    root->m_syncKept.insert(relativePath);
+}
+
+QString TransferDir::syncPath(const KUrl &sourceUrl) const
+{
+  QString rootPath = getSourceUrl().path(KUrl::AddTrailingSlash);
+  return sourceUrl.path(KUrl::RemoveTrailingSlash).mid(rootPath.length());
+}
+
+bool TransferDir::isSyncKept(const QString &path) const
+{
+  if (m_syncKept.isEmpty())
+    return false;
+  
+  for (int pos = path.lastIndexOf('/'); pos > 0; pos = path.lastIndexOf('/', pos - 1)) {
+    if (m_syncKept.contains(path.left(pos)))
+      return true;
+  }
+  
+  return false;
+}
+
+void TransferDir::indexDestination()
+{
+  m_syncIndex.clear();
+  m_syncKept.clear();
+  lock();
+  
+  if (m_destUrl.isLocalFile()) {
+    indexLocalDirectory(m_destUrl.path(KUrl::RemoveTrailingSlash), QString());
+    
+    m_syncIndexed = true;
+    unlock();
+    execute();
+  } else {
+    // Do a recursive scan of the destination, the engine will use any cached
+    // directory listings it already has
+    m_syncState = SyncIndexing;
+    connect(m_dstConnection->getClient()->eventHandler(), SIGNAL(engineEvent(KFTPEngine::Event*)), this, SLOT(slotSyncEngineEvent(KFTPEngine::Event*)));
+    m_dstConnection->getClient()->scan(m_destUrl);
+  }
+}
+
+void TransferDir::indexTree(DirectoryTree *tree, const QString &prefix)
+{
+  DirectoryTree::DirIterator dirEnd = tree->directories()->constEnd();
+  for (DirectoryTree::DirIterator i = tree->directories()->constBegin(); i != dirEnd; i++) {
+    QString path = prefix + (*i)->info().filename();
+    
+    m_syncIndex.insert(path, (*i)->info());
+    indexTree(*i, path + "/");
+  }
+  
+  DirectoryTree::FileIterator fileEnd = tree->files()->constEnd();
+  for (DirectoryTree::FileIterator i = tree->files()->constBegin(); i != fileEnd; i++)
+    m_syncIndex.insert(prefix + (*i).filename(), *i);
+}
+
+void TransferDir::indexLocalDirectory(const QString &path, const QString &prefix)
+{
+  QDir fs(path);
+  fs.setFilter(QDir::Readable | QDir::Hidden | QDir::TypeMask);
+  
+  foreach (QFileInfo file, fs.entryInfoList()) {
+    if (file.fileName() == "." || file.fileName() == "..")
+      continue;
+    
+    DirectoryEntry entry;
+    entry.setFilename(file.fileName());
+    entry.setType(file.isDir() ? 'd' : 'f');
+    entry.setSize(file.size());
+    entry.setTime(file.lastModified().toTime_t());
+    
+    m_syncIndex.insert(prefix + entry.filename(), entry);
+    
+    if (file.isDir() && !file.isSymLink())
+      indexLocalDirectory(file.absoluteFilePath(), prefix + entry.filename() + "/");
+  }
+}
+
+bool TransferDir::removeExtraneous()
+{
+  m_syncRemovals.clear();
+  
+  QHash<QString, DirectoryEntry>::const_iterator indexEnd = m_syncIndex.constEnd();
+  for (QHash<QString, DirectoryEntry>::const_iterator i = m_syncIndex.constBegin(); i != indexEnd; i++) {
+    // Skip entries whose parent directory is going to be removed anyway
+    QString parentPath = i.key().section('/', 0, -2);
+    if (!parentPath.isEmpty() && m_syncIndex.contains(parentPath))
+      continue;
+    
+    // Entries below directories that were skipped on the source are kept
+    if (isSyncKept(i.key()))
+      continue;
+    
+    KUrl url = m_destUrl;
+    url.addPath(i.key());
+    
+    // Entries the user doesn't want to transfer are not removed either
+    const ActionChain *actionChain = Filters::self()->process(url, (*i).size(), (*i).isDirectory());
+    if (actionChain && actionChain->getAction(Action::Skip))
+      continue;
+    
+    if ((*i).isDirectory() && !m_destUrl.isLocalFile())
+      m_syncDirRemovals.append(url);
+    else
+      m_syncRemovals.append(url);
+  }
+  
+  m_syncIndex.clear();
+  m_syncKept.clear();
+  
+  if (m_syncRemovals.isEmpty() && m_syncDirRemovals.isEmpty())
+    return false;
+  
+  if (m_destUrl.isLocalFile()) {
+    KIO::del(m_syncRemovals, KIO::HideProgressInfo);
+    m_syncRemovals.clear();
+    return false;
+  }
+  
+  // Remote files are removed one by one via the destination connection, the
+  // directory trees afterwards using every connection of the destination session
+  lock();
+  m_syncState = SyncDeleting;
+  connect(m_dstConnection->getClient()->eventHandler(), SIGNAL(engineEvent(KFTPEngine::Event*)), this, SLOT(slotSyncEngineEvent(KFTPEngine::Event*)));
+  removeNextExtraneous();
+  
+  return true;
+}
+
+void TransferDir::removeNextExtraneous()
+{
+  if (!m_syncRemovals.isEmpty()) {
+    m_dstConnection->getClient()->remove(m_syncRemovals.takeFirst());
+    return;
+  }
+  
+  m_dstConnection->getClient()->eventHandler()->QObject::disconnect(this, SLOT(slotSyncEngineEvent(KFTPEngine::Event*)));
+  
+  if (!m_syncDirRemovals.isEmpty()) {
+    m_syncState = SyncDeletingTrees;
+    m_syncRemoveJob = new RemoveJob(m_dstSession, m_dstConnection);
+    
+    foreach (const KUrl &url, m_syncDirRemovals)
+      m_syncRemoveJob->addDirectory(url);
+    m_syncDirRemovals.clear();
+    
+    connect(m_syncRemoveJob, SIGNAL(finished(bool)), this, SLOT(slotSyncTreesRemoved()));
+    m_syncRemoveJob->start();
+    return;
+  }
+  
+  m_syncState = SyncIdle;
+  unlock();
+  
+  // Reexecute the transfer
+  delayedExecute();
+}
+
+void TransferDir::slotSyncTreesRemoved()
+{
+  m_syncRemoveJob = 0;
+  m_syncState = SyncIdle;
+  unlock();
+  
+  // Reexecute the transfer
+  delayedExecute();
+}
+
+void TransferDir::slotSyncEngineEvent(KFTPEngine::Event *event)
+{
+  switch (m_syncState) {
+    case SyncIndexing: {
+      if (event->type() == Event::EventScanComplete) {
+        DirectoryTree *tree = event->getParameter(0).value<DirectoryTree*>();
+        indexTree(tree, QString());
+        delete tree;
+      } else if (event->type() == Event::EventReady) {
+        // The scan is done (a failed scan simply leaves the index empty)
+        m_dstConnection->getClient()->eventHandler()->QObject::disconnect(this, SLOT(slotSyncEngineEvent(KFTPEngine::Event*)));
+        m_syncState = SyncIdle;
+        m_syncIndexed = true;
+        unlock();
+        
+        delayedExecute();
+      }
+      break;
+    }
+    case SyncDeleting: {
+      if (event->type() == Event::EventReady)
+        removeNextExtraneous();
+      break;
+    }
+    default: break;
+  }
+}
+
 }
 
 #include "kftptransferdir.moc"
@@ -37,9 +37,22 @@
 #define KFTPQUEUEKFTPTRANSFERDIR_H
 
 #include "kftptransfer.h"
+#include "engine/directorylisting.h"
+
+#include <QHash>
+#include <QSet>
+#include <QPointer>
 
 class DirectoryScanner;
 
+namespace KFTPEngine {
+  class Event;
+}
+
+namespace KFTPSession {
+  class RemoveJob;
+}
+
 namespace KFTPQueue {
 
 /**
@@ -69,6 +82,22 @@ public:
       ScanWithExecute
     };
     
+    /**
+     * Synchronization flags (may be or-ed together).
+     *
+     * The following flags are supported:
+     *   SyncEnabled - only transfer files that are missing or differ on the destination
+     *   SyncDelete - remove destination entries that don't exist on the source
+     *   SyncChecksum - files of equal size are compared by checksum instead of
+     *                  modification time
+     */
+    enum SyncFlags {
+      SyncNone = 0,
+      SyncEnabled = 1,
+      SyncDelete = 2,
+      SyncChecksum = 4
+    };
+    
     /**
      * Class constructor.
      *
@@ -88,21 +117,101 @@ public:
      */
     void abort();
     
+    /**
+     * @overload
+     * Reimplemented from KFTPQueue::QueueObject.
+     */
+    QueueGroup *group() const { return m_group; }
+    
     /**
      * Initiates a directory scan. This method will do nothing if there are
      * existing children or the scan has already been initiated.
      */
     void scan();
+    
+    /**
+     * Sets the synchronization flags. When synchronization is enabled the
+     * destination is indexed before the source scan and only entries that
+     * are missing or differ (by size or modification time) are added to
+     * the queue. With SyncChecksum, files of equal size are queued as well
+     * and skipped by the engine when their checksums match. This must be
+     * set before the scan is initiated.
+     *
+     * @param flags An or-ed combination of SyncFlags
+     */
+    void setSyncFlags(int flags) { m_syncFlags = flags; }
+    
+    /**
+     * Returns the synchronization flags.
+     */
+    int syncFlags() const { return m_syncFlags; }
+    
+    /**
+     * Returns the synchronizing directory transfer an object belongs to.
+     *
+     * @param object The queue object to start looking at
+     * @return The closest synchronizing TransferDir or 0 if there is none
+     */
+    static TransferDir *synchronizationRoot(QueueObject *object);
+    
+    /**
+     * Checks an entry found while scanning the source against the destination
+     * index of the synchronizing transfer @p parent belongs to. Checked entries
+     * are no longer considered for removal.
+     *
+     * @param parent The transfer the scanned entry belongs to
+     * @param sourceUrl The entry's source URL
+     * @param entry The scanned entry
+     * @return True if the destination already contains an up-to-date entry
+     */
+    static bool isSynchronized(Transfer *parent, const KUrl &sourceUrl, const KFTPEngine::DirectoryEntry &entry);
+    
+    /**
+     * Withdraws a source entry that is not going to be transferred from the
+     * destination index, so the destination entry is never removed. For a
+     * directory everything below it is kept as well.
+     *
+     * @param parent The transfer the skipped entry belongs to
+     * @param sourceUrl The entry's source URL
+     * @param directory True if the skipped entry is a directory
+     */
+    static void unindex(Transfer *parent, const KUrl &sourceUrl, bool directory);
 private:
+    enum SyncState {
+      SyncIdle,
+      SyncIndexing,
+      SyncDeleting,
+      SyncDeletingTrees
+    };
+    
     bool m_scanned;
     QueueGroup *m_group;
     DirectoryScanner *m_srcScanner;
     ExecutionMode m_executionMode;
+    
+    int m_syncFlags;
+    SyncState m_syncState;
+    bool m_syncIndexed;
+    QHash<QString, KFTPEngine::DirectoryEntry> m_syncIndex;
+    QSet<QString> m_syncKept;
+    KUrl::List m_syncRemovals;
+    KUrl::List m_syncDirRemovals;
+    QPointer<KFTPSession::RemoveJob> m_syncRemoveJob;
+    
+    void indexDestination();
+    void indexTree(KFTPEngine::DirectoryTree *tree, const QString &prefix);
+    void indexLocalDirectory(const QString &path, const QString &prefix);
+    QString syncPath(const KUrl &sourceUrl) const;
+    bool isSyncKept(const QString &path) const;
+    bool removeExtraneous();
+    void removeNextExtraneous();
 private slots:
     void slotGroupDone();
     void slotGroupInterrupted();
     
     void slotDirScanDone();
+    void slotSyncEngineEvent(KFTPEngine::Event *event);
+    void slotSyncTreesRemoved();
 };
 
 }
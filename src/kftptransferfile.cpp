@@ -34,11 +34,13 @@
  */
 
 #include "kftptransferfile.h"
+#include "kftptransferdir.h"
 #include "widgets/systemtray.h"
 #include "kftpsession.h"
 #include "statistics.h"
 
 #include "engine/thread.h"
+#include "engine/settings.h"
 
 #include "misc/config.h"
 
@@ -53,10 +55,14 @@
 using namespace KFTPEngine;
 using namespace KFTPSession;
 
+/* Interval between transfer progress updates (in milliseconds) */
+static const int updateInterval = 250;
+
 namespace KFTPQueue {
 
 TransferFile::TransferFile(QObject *parent)
   : Transfer(parent, Transfer::File),
+    m_checkpoint(0),
     m_updateTimer(0),
     m_dfTimer(0)
 {
@@ -95,12 +101,22 @@ void TransferFile::execute()
     return;
   
   if ((m_dstConnection && !m_dstConnection->isConnected()) || (m_srcConnection && !m_srcConnection->isConnected())) {
+    // Measure how long it takes to establish the connection
+    if (m_status != Connecting)
+      m_connectTime.start();
+    
     m_status = Connecting;
     return;
   }
   
+  if (m_connectTime.isValid()) {
+    Statistics::self()->getSite(this)->addConnectTime(m_connectTime.elapsed());
+    m_connectTime = QTime();
+  }
+  
   // We are running now
   m_status = Running;
+  m_elapsedTime.start();
   
   m_completed = 0;
   m_resumed = 0;
@@ -109,7 +125,7 @@ void TransferFile::execute()
   if (!m_updateTimer) {
     m_updateTimer = new QTimer(this);
     connect(m_updateTimer, SIGNAL(timeout()), this, SLOT(slotTimerUpdate()));
-    m_updateTimer->start(1000);
+    m_updateTimer->start(updateInterval);
   }
   
   // Should we check for free space ?
@@ -121,6 +137,18 @@ void TransferFile::execute()
   
   emit transferStart(m_id);
   
+  // Apply bandwidth settings for this transfer
+  KFTPEngine::Settings *settings = remoteConnection()->getClient()->settings();
+  settings->setConfig("speed.transfer_limit", effectiveSpeedLimit());
+  settings->setConfig("speed.transfer_weight", (int) effectiveSpeedPriority());
+  
+  // Synchronizations may ask for existing files to be compared by checksum
+  TransferDir *syncRoot = TransferDir::synchronizationRoot(parentObject());
+  settings->setConfig("transfer.checksum_skip", syncRoot && (syncRoot->syncFlags() & TransferDir::SyncChecksum));
+  
+  // Don't report bytes of the socket's previous transfer
+  remoteConnection()->getClient()->socket()->speedMeter()->reset();
+  
   switch(m_transferType) {
     case Download: {
       m_srcConnection->getClient()->get(m_sourceUrl, m_destUrl);
@@ -131,8 +159,6 @@ void TransferFile::execute()
       break;
     }
     case FXP: {
-      // Start the timer to extrapolate transfer rate
-      m_elapsedTime.start();
       m_srcConnection->getClient()->siteToSite(m_dstConnection->getClient(), m_sourceUrl, m_destUrl);
       break;
     }
@@ -173,14 +199,30 @@ void TransferFile::slotEngineEvent(KFTPEngine::Event *event)
       // ***************************************************************************
       // ************************ EventTransferComplete ****************************
       // ***************************************************************************
-      // Calculate transfer rate for last transfer, and save to site's statistics
-      if (getTransferType() == FXP) {
-        if (m_elapsedTime.elapsed() > 10000) {
-          double speed = (m_size - m_resumed) / (double) m_elapsedTime.elapsed();
-          Statistics::self()->getSite(m_sourceUrl)->setLastFxpSpeed(speed * 1024);
+      // Save the transfer to site's statistics, together with the number of
+      // connections that were transferring at the same time
+      Session *session = getTransferType() == Upload ? m_dstSession : m_srcSession;
+      int threads = 0;
+      
+      if (session) {
+        foreach (Connection *connection, *session->getConnectionList()) {
+          if (connection->getTransfer())
+            threads++;
         }
       }
       
+      // Bytes are taken from the socket's meter, except for FXP where no data
+      // passes trough our sockets
+      filesize_t bytes = m_size - m_resumed;
+      
+      if (getTransferType() != FXP) {
+        SpeedMeter *meter = remoteConnection()->getClient()->socket()->speedMeter();
+        meter->sample();
+        bytes = meter->total();
+      }
+      
+      Statistics::self()->getSite(this)->addTransfer(getTransferType(), bytes, m_elapsedTime.elapsed(), threads);
+      
       // Update the completed size if the transfer was faster than the update timer
       addCompleted(m_size - m_completed);
   
@@ -196,7 +238,7 @@ void TransferFile::slotEngineEvent(KFTPEngine::Event *event)
         showTransCompleteBalloon();
       }
       
-      m_deleteMe = true;
+      markForDeletion();
       addActualSize(-m_size);
       
       resetTransfer();
@@ -213,6 +255,21 @@ void TransferFile::slotEngineEvent(KFTPEngine::Event *event)
       addCompleted(m_resumed);
       break;
     }
+    case Event::EventChecksum: {
+      // ***************************************************************************
+      // **************************** EventChecksum ********************************
+      // ***************************************************************************
+      ChecksumStatus status = static_cast<ChecksumStatus>(event->getParameter(0).toInt());
+      
+      if (status == ChecksumVerifying) {
+        // Data has been transferred, the engine is now comparing checksums
+        addCompleted(m_size - m_completed);
+        m_status = Verifying;
+        
+        emit objectUpdated();
+      }
+      break;
+    }
     case Event::EventError: {
       // ***************************************************************************
       // ****************************** EventError *********************************
@@ -244,6 +301,10 @@ void TransferFile::slotEngineEvent(KFTPEngine::Event *event)
           FailedTransfer::fail(this, i18n("Transfer failed for some reason."));
           break;
         }
+        case VerifyFailed: {
+          FailedTransfer::fail(this, i18n("Checksum verification failed, the transferred file differs from the original."));
+          break;
+        }
         default: break;
       }
       
@@ -282,21 +343,23 @@ void TransferFile::slotTimerUpdate()
   if (m_status == Running) {
     // Get speed from connection, or use FXP extrapolation.
     if (getTransferType() == FXP) {
-      double lastFxpSpeed = Statistics::self()->getSite(m_sourceUrl)->lastFxpSpeed();
+      StatisticsSite *site = Statistics::self()->findSite(this);
+      double fxpSpeed = site ? site->throughput(FXP) : 0.0;
       
-      if (lastFxpSpeed != 0.0) {
-        setSpeed(lastFxpSpeed);
+      if (fxpSpeed != 0.0) {
+        setSpeed(fxpSpeed);
         
         if (m_completed < m_size)
-          addCompleted(getSpeed());
+          addCompleted(getSpeed() * updateInterval / 1000);
       }
     } else {
-      Socket *socket = remoteConnection()->getClient()->socket();
+      SpeedMeter *meter = remoteConnection()->getClient()->socket()->speedMeter();
+      meter->sample();
       
-      if (socket->getTransferBytes() > m_completed - m_resumed)
-        addCompleted(socket->getTransferBytes() - (m_completed - m_resumed));
+      if (meter->total() > m_completed - m_resumed)
+        addCompleted(meter->total() - (m_completed - m_resumed));
 
-      setSpeed(socket->getTransferSpeed());
+      setSpeed(meter->rate());
     }
   }
 
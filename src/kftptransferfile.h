@@ -97,13 +97,31 @@ public:
      * @return True if the sessions are ready for immediate use
      */
     bool assignSessions(KFTPSession::Session *source = 0, KFTPSession::Session *destination = 0);
+    
+    /**
+     * Sets the last journaled offset of this transfer. When the transfer is
+     * restarted and the destination already contains at least this many bytes
+     * it is resumed instead of asking the user what to do.
+     *
+     * @param offset Number of bytes known to be transferred
+     */
+    void setCheckpoint(filesize_t offset) { m_checkpoint = offset; }
+    
+    /**
+     * Returns the last journaled offset of this transfer.
+     */
+    filesize_t getCheckpoint() const { return m_checkpoint; }
 private:
+    /* Last journaled offset */
+    filesize_t m_checkpoint;
+    
     /* Update timers */
     QTimer *m_updateTimer;
     QTimer *m_dfTimer;
 
-    /* FXP */
+    /* Statistics */
     QTime m_elapsedTime;
+    QTime m_connectTime;
     
     /**
      * @overload
@@ -72,6 +72,7 @@
 #include "widgets/logview.h"
 #include "widgets/queueview/queueview.h"
 #include "widgets/queueview/threadview.h"
+#include "widgets/queueview/metricsview.h"
 //#include "widgets/quickconnect.h"
 //#include "kftpserverlineedit.h"
 //#include "browser/view.h"
@@ -88,6 +89,8 @@
 #include "kftpqueue.h"
 #include "kftpsession.h"
 #include "kftpqueueconverter.h"
+#include "kftpqueuejournal.h"
+#include "statistics.h"
 #include "misc/pluginmanager.h"
 #include "engine/thread.h"
 
@@ -209,8 +212,9 @@ void MainWindow::slotLoader()
   // Load bookmarks and custom site commands
   KFTPBookmarks::Manager::self()->load(KStandardDirs::locateLocal("appdata", "bookmarks.xml"));
 
-  // Load the saved queue
-  KFTPQueue::Manager::self()->getConverter()->importQueue(KStandardDirs::locateLocal("appdata", "queue"));
+  // Load the saved queue and any changes journaled since
+  KFTPQueue::Statistics::self()->load(KStandardDirs::locateLocal("appdata", "statistics"));
+  KFTPQueue::Manager::self()->getJournal()->restore(KStandardDirs::locateLocal("appdata", "queue"));
 
   // Update the bookmark menu
   initBookmarkMenu();
@@ -232,7 +236,8 @@ void MainWindow::appShutdown()
   KFTPCore::Filter::Filters::self()->close();
 
   // Save current queue
-  KFTPQueue::Manager::self()->getConverter()->exportQueue(KStandardDirs::locateLocal("appdata", "queue"));
+  KFTPQueue::Manager::self()->getJournal()->close();
+  KFTPQueue::Statistics::self()->save();
 }
 
 bool MainWindow::queryClose()
@@ -360,6 +365,7 @@ void MainWindow::initStatusBar()
 
   statusBar()->insertItem(i18nc("Download traffic rate", "Down: %1/s", KIO::convertSize(KFTPQueue::Manager::self()->getDownloadSpeed())), 2);
   statusBar()->insertItem(i18nc("Upload traffic rate", "Up: %1/s", KIO::convertSize(KFTPQueue::Manager::self()->getUploadSpeed())), 3);
+  statusBar()->insertItem(QString(), 4);
 }
 
 void MainWindow::initMainView()
@@ -426,6 +432,13 @@ void MainWindow::initMainView()
   
   addDockWidget(Qt::BottomDockWidgetArea, graphDock);
   tabifyDockWidget(logDock, graphDock);
+  
+  QDockWidget *statsDock = new QDockWidget(i18n("Statistics"));
+  statsDock->setObjectName("statistics");
+  statsDock->setWidget(new KFTPWidgets::MetricsView(statsDock));
+  
+  addDockWidget(Qt::BottomDockWidgetArea, statsDock);
+  tabifyDockWidget(graphDock, statsDock);
 }
 
 void MainWindow::slotUpdateStatusBar()
@@ -433,6 +446,12 @@ void MainWindow::slotUpdateStatusBar()
   // Status bar
   statusBar()->changeItem(i18nc("Download traffic rate", "Down: %1/s", KIO::convertSize(KFTPQueue::Manager::self()->getDownloadSpeed())), 2);
   statusBar()->changeItem(i18nc("Upload traffic rate", "Up: %1/s", KIO::convertSize(KFTPQueue::Manager::self()->getUploadSpeed())), 3);
+  
+  int eta = KFTPQueue::Manager::self()->getQueueEta();
+  if (eta >= 0)
+    statusBar()->changeItem(i18nc("Estimated time to finish the queue", "Queue: %1% (%2 left)", KFTPQueue::Manager::self()->getTransferPercentage(), KIO::convertSeconds(eta)), 4);
+  else
+    statusBar()->changeItem(QString(), 4);
 }
 
 void MainWindow::slotUpdateTrafficGraph()
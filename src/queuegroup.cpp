@@ -36,29 +36,135 @@
 #include "queuegroup.h"
 #include "queueobject.h"
 #include "kftptransfer.h"
+#include "kftptransferfile.h"
 #include "kftpsession.h"
+#include "kftpqueueprocessor.h"
+#include "statistics.h"
+
+#include "misc/config.h"
 
 using namespace KFTPSession;
 
 namespace KFTPQueue {
 
+/* Children of a group paired with their scheduling key */
+struct ScheduleEntry {
+  double key;
+  QueueObject *object;
+};
+
+static bool scheduleEntryLessThan(const ScheduleEntry &a, const ScheduleEntry &b)
+{
+  return a.key < b.key;
+}
+
+/**
+ * Returns the number of bytes that still have to be transferred for an
+ * object, taking journaled checkpoints of interrupted files into account.
+ */
+static filesize_t remainingSize(QueueObject *object)
+{
+  filesize_t done = object->getCompleted();
+  
+  if (object->getType() == QueueObject::File)
+    done = qMax(done, static_cast<TransferFile*>(object)->getCheckpoint());
+  
+  return object->getSize() > done ? object->getSize() - done : 0;
+}
+
 QueueGroup::QueueGroup(QueueObject *object)
   : QObject(object),
     m_object(object),
-    m_childIterator(QListIterator<QueueObject*>(m_object->m_children)),
-    m_directories(true)
+    m_policy(Default)
 {
 }
 
+QueueGroup::Policy QueueGroup::effectivePolicy() const
+{
+  if (m_policy != Default)
+    return m_policy;
+  
+  // Use the policy of the closest parent group that has one set
+  QueueObject *object = m_object;
+  while (object->hasParentObject()) {
+    object = object->parentObject();
+    
+    if (object->group() && object->group()->m_policy != Default)
+      return object->group()->m_policy;
+  }
+  
+  return static_cast<Policy>(KFTPCore::Config::queueSchedulingPolicy());
+}
+
 void QueueGroup::reset()
 {
-  m_childIterator.toFront();
+  m_pending.clear();
+  m_blockingDirectory = 0;
+  sortPending(effectivePolicy());
+}
+
+void QueueGroup::sortPending(Policy policy)
+{
+  if (policy == Fifo || policy == RoundRobin) {
+    foreach (QueueObject *child, m_object->m_children)
+      m_pending.append(child);
+    
+    return;
+  }
+  
+  // Objects that haven't transferred anything yet are expected to run at the
+  // speed the whole group is currently achieving, before the group starts the
+  // site's history is used instead
+  double groupSpeed = m_object->getSpeed();
+  
+  QList<ScheduleEntry> entries;
+  foreach (QueueObject *child, m_object->m_children) {
+    ScheduleEntry entry;
+    entry.object = child;
+    
+    switch (policy) {
+      case SmallestFirst: entry.key = remainingSize(child); break;
+      case LargestFirst: entry.key = -(double) remainingSize(child); break;
+      default: {
+        double speed = child->getSpeed() > 0 ? child->getSpeed() : groupSpeed;
+        
+        if (speed > 0) {
+          entry.key = remainingSize(child) / speed;
+        } else {
+          double estimate = Statistics::self()->estimate(static_cast<Transfer*>(child));
+          entry.key = estimate >= 0 ? estimate : remainingSize(child);
+        }
+        break;
+      }
+    }
+    
+    entries.append(entry);
+  }
+  
+  // Objects with equal keys keep their queue order
+  qStableSort(entries.begin(), entries.end(), scheduleEntryLessThan);
+  
+  foreach (const ScheduleEntry &entry, entries)
+    m_pending.append(entry.object);
+}
+
+void QueueGroup::dispatch()
+{
+  // Groups may still be waiting in a ready queue after being aborted
+  if (!m_object->isRunning() || m_object->isAborting())
+    return;
+  
+  while (executeNextTransfer() == 1) ;
 }
 
 int QueueGroup::executeNextTransfer()
 {
+  // Skip objects that have been removed since the group was reset
+  while (!m_pending.isEmpty() && !m_pending.first())
+    m_pending.removeFirst();
+  
   // Check if there is actually something to execute
-  if (!m_childIterator.hasNext()) {
+  if (m_pending.isEmpty()) {
     if (m_lastTransfer && m_lastTransfer->isRunning())
       return -1;
     
@@ -66,31 +172,53 @@ int QueueGroup::executeNextTransfer()
       emit done();
     
     return -1;
-  } else if (!m_directories && m_lastTransfer && m_lastTransfer->isDir()) {
+  } else if (m_blockingDirectory) {
+    // Wait for the directory to complete
     return 0;
   }
   
-  Transfer *transfer = static_cast<Transfer*>(m_childIterator.next());
+  Transfer *transfer = static_cast<Transfer*>(m_pending.first().data());
   
   // Check if we have enough connections available
   if (m_lastTransfer) {
     Session *sourceSession = m_lastTransfer->getSourceSession();
     Session *destinationSession = m_lastTransfer->getDestinationSession();
     
-    if ((sourceSession && !sourceSession->isFreeConnection()) || (destinationSession && !destinationSession->isFreeConnection()))
+    // Wait in the ready queue of the session that is out of connections
+    if (sourceSession && !sourceSession->isFreeConnection()) {
+      sourceSession->enqueueGroup(this);
       return 0;
+    }
+    
+    if (destinationSession && !destinationSession->isFreeConnection()) {
+      destinationSession->enqueueGroup(this);
+      return 0;
+    }
+    
+    // Respect the global connection limit shared by all processed sites
+    if (!KFTPQueueProcessor::isConnectionAvailable()) {
+      KFTPQueueProcessor::enqueueGroup(this);
+      return 0;
+    }
         
     // Reserve the connections immediately
     transfer->assignSessions(sourceSession, destinationSession);
   }
   
+  m_pending.removeFirst();
+  
   // Get the transfer instance and schedule it's execution
   transfer->QObject::disconnect(this);
   
-  connect(transfer, SIGNAL(transferComplete(long)), this, SLOT(incrementAndExecute()));
+  connect(transfer, SIGNAL(transferComplete(long)), this, SLOT(slotTransferComplete()));
   connect(transfer, SIGNAL(transferAbort(long)), this, SIGNAL(interrupted()));
-
-  transfer->delayedExecute();
+  
+  // Execute as soon as control returns to the event loop
+  transfer->delayedExecute(0);
+  
+  // Directories are processed one at a time unless they should run side by side
+  if (transfer->isDir() && effectivePolicy() != RoundRobin)
+    m_blockingDirectory = transfer;
   
   // Prepare for the next transfer
   m_lastTransfer = transfer;
@@ -98,29 +226,12 @@ int QueueGroup::executeNextTransfer()
   return 1;
 }
 
-void QueueGroup::incrementAndExecute()
+void QueueGroup::slotTransferComplete()
 {
-  if (QObject::sender()) {
-    const Transfer *transfer = static_cast<const Transfer*>(QObject::sender());
-    
-    if (!transfer->isDir())
-      m_directories = false;
-  }
-  
-  int result = executeNextTransfer();
-  
-  switch (result) {
-    case 0: m_childIterator.previous(); break;
-    case 1: {
-      m_directories = false;
-      incrementAndExecute();
-      break;
-    }
-    default: break;
-  }
+  if (QObject::sender() == m_blockingDirectory)
+    m_blockingDirectory = 0;
   
-  if (result != -1 && !m_directories)
-    m_directories = true;
+  dispatch();
 }
 
 }
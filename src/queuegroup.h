@@ -46,7 +46,14 @@ class Transfer;
 
 /**
  * This class manages a group of child queue objects so they get
- * executed in the proper order.
+ * executed in the proper order. The order is decided by the group's
+ * scheduling policy, which is inherited from the parent groups and
+ * finally from the configuration when not set.
+ *
+ * Children are started as long as connections are free. When the group
+ * runs out of connections it waits in the session's ready queue (or in
+ * the processor's ready list when the global connection limit is reached)
+ * and is dispatched again as soon as a connection is released.
  *
  * Note that all child transfers that are grouped together must be
  * part of the same session, otherwise unexpected behavior may
@@ -57,6 +64,18 @@ class Transfer;
 class QueueGroup : public QObject {
 Q_OBJECT
 public:
+    /**
+     * Available scheduling policies.
+     */
+    enum Policy {
+      Default = -1,
+      Fifo = 0,
+      SmallestFirst = 1,
+      LargestFirst = 2,
+      ShortestRemaining = 3,
+      RoundRobin = 4
+    };
+    
     /**
      * Class constructor.
      *
@@ -65,26 +84,48 @@ public:
     QueueGroup(QueueObject *object);
     
     /**
-     * Reset the group.
+     * Set the scheduling policy of this group. The policy is applied the
+     * next time the group is reset.
+     *
+     * @param policy The policy or Default to inherit it
      */
-    void reset();
-
+    void setPolicy(Policy policy) { m_policy = policy; }
+    
     /**
-     * Execute the next transfer in list.
+     * Returns the scheduling policy set for this group.
      *
-     * @return 1 if the transfer has been executed, 0 or -1 otherwise
+     * @return The policy, Default when inherited
      */
-    int executeNextTransfer();
+    Policy getPolicy() const { return m_policy; }
+    
+    /**
+     * Returns the scheduling policy that is actually used by this group.
+     *
+     * @return The policy set for this group or the one inherited
+     */
+    Policy effectivePolicy() const;
+    
+    /**
+     * Reset the group.
+     */
+    void reset();
+
 public slots:
     /**
-     * Increment the current iterator and call executeNextTransfer method.
+     * Start as many children as the available connections allow.
      */
-    void incrementAndExecute();
+    void dispatch();
 private:
     QueueObject *m_object;
-    QListIterator<QueueObject*> m_childIterator;
+    Policy m_policy;
+    QList<QPointer<QueueObject> > m_pending;
     QPointer<Transfer> m_lastTransfer;
-    bool m_directories;
+    QPointer<Transfer> m_blockingDirectory;
+    
+    void sortPending(Policy policy);
+    int executeNextTransfer();
+private slots:
+    void slotTransferComplete();
 signals:
     /**
      * This signal gets emitted when there is nothing more to do in the
@@ -45,6 +45,10 @@ QueueObject::QueueObject(QObject *parent, Type type)
    m_aborting(false),
    m_status(Unknown),
    m_type(type),
+   m_index(-1),
+   m_dirty(false),
+   m_indexBase(0),
+   m_staleIndex(-1),
    m_size(0),
    m_actualSize(0),
    m_completed(0),
@@ -64,19 +68,41 @@ QueueObject::~QueueObject()
 {
 }
 
+void QueueObject::setId(long id)
+{
+  // The toplevel object is created by the manager itself and is never looked up
+  if (m_type != Toplevel)
+    Manager::self()->registerObject(this, id);
+  
+  m_id = id;
+}
+
 int QueueObject::index() const
 {
   if (m_type == Toplevel)
     return 0;
   
-  QList<QueueObject*> children = parentObject()->getChildrenList();
+  int row = parentObject()->childRow(this);
   
-  for (int i = 0; i < children.size(); i++) {
-    if (children.at(i) == this)
-      return i;
+  Q_ASSERT(row != -1);
+  return row;
+}
+
+int QueueObject::childRow(const QueueObject *child)
+{
+  // The row index is kept up to date by the parent, so there is no need to
+  // search the list. Rows after a removal in the middle of the list are
+  // renumbered on demand.
+  int row = child->m_index - m_indexBase;
+  
+  if (m_staleIndex != -1 && row >= m_staleIndex) {
+    reindexChildren(m_staleIndex);
+    row = child->m_index - m_indexBase;
   }
   
-  Q_ASSERT(false);
+  if (m_children.value(row) == child)
+    return row;
+  
   return -1;
 }
 
@@ -125,7 +151,7 @@ void QueueObject::addActualSize(filesize_t size)
   if (hasParentObject())
     parentObject()->addActualSize(size);
     
-  statisticsUpdated();
+  markDirty();
 }
 
 void QueueObject::addSize(filesize_t size)
@@ -139,7 +165,7 @@ void QueueObject::addSize(filesize_t size)
   if (hasParentObject())
     parentObject()->addSize(size);
   
-  statisticsUpdated();
+  markDirty();
 }
 
 void QueueObject::addCompleted(filesize_t completed)
@@ -152,7 +178,7 @@ void QueueObject::addCompleted(filesize_t completed)
   if (hasParentObject())
     parentObject()->addCompleted(completed);
     
-  statisticsUpdated();
+  markDirty();
 }
 
 void QueueObject::setSpeed(filesize_t speed)
@@ -160,15 +186,70 @@ void QueueObject::setSpeed(filesize_t speed)
   if (speed != 0 && m_speed == speed)
     return;
   
-  m_speed = speed;
+  // Speed of objects with children is the sum of their speeds and will be
+  // recomputed on flush
+  if (!hasChildren()) {
+    m_speed = speed;
+    
+    if (isTransfer())
+      Manager::self()->updateTransferSpeed(static_cast<Transfer*>(this), speed);
+  }
+  
+  markDirty();
+}
+
+void QueueObject::markDirty()
+{
+  QueueObject *object = this;
+  
+  // All parents of a dirty object are dirty as well, so we can stop as soon
+  // as we reach one that is already marked
+  while (!object->m_dirty) {
+    object->m_dirty = true;
+    
+    if (!object->hasParentObject()) {
+      if (object->m_type == Toplevel)
+        Manager::self()->scheduleStatisticsFlush();
+      else
+        object->flushStatistics();
+      
+      break;
+    }
+    
+    object = object->parentObject();
+  }
+}
+
+void QueueObject::clearDirty()
+{
+  if (!m_dirty)
+    return;
+  
+  m_dirty = false;
   
   foreach (QueueObject *i, m_children) {
-    m_speed += i->getSpeed();
+    i->clearDirty();
   }
+}
+
+void QueueObject::flushStatistics()
+{
+  if (!m_dirty)
+    return;
   
-  if (hasParentObject())
-    parentObject()->setSpeed();
+  m_dirty = false;
+  
+  if (hasChildren()) {
+    filesize_t speed = 0;
+    
+    foreach (QueueObject *i, m_children) {
+      i->flushStatistics();
+      speed += i->getSpeed();
+    }
     
+    m_speed = speed;
+  }
+  
   statisticsUpdated();
 }
 
@@ -185,22 +266,91 @@ void QueueObject::abort()
 {
 }
 
+void QueueObject::reindexChildren(int from)
+{
+  // Rows that were left stale by earlier removals have to be renumbered too
+  if (m_staleIndex != -1)
+    from = qMin(from, m_staleIndex);
+  
+  for (int i = qMax(from, 0); i < m_children.size(); i++)
+    m_children.at(i)->m_index = i + m_indexBase;
+  
+  m_staleIndex = -1;
+}
+
+void QueueObject::removeChildAt(int pos)
+{
+  if (pos == 0) {
+    // Removing the head shifts all rows by one, which is recorded in the
+    // index base instead of renumbering every child
+    m_children.removeFirst();
+    m_indexBase++;
+    
+    if (m_staleIndex > 0)
+      m_staleIndex--;
+  } else if (pos == m_children.size() - 1) {
+    // Removing the tail doesn't change any other row
+    m_children.removeLast();
+  } else {
+    // Rows after the removed one are renumbered lazily by index()
+    m_children.removeAt(pos);
+    
+    if (m_staleIndex == -1 || pos < m_staleIndex)
+      m_staleIndex = pos;
+  }
+  
+  if (m_children.isEmpty()) {
+    m_indexBase = 0;
+    m_staleIndex = -1;
+  }
+}
+
 void QueueObject::addChildObject(QueueObject *object)
 {
   m_children.append(object);
+  object->m_index = m_children.size() - 1 + m_indexBase;
+  
+  // Keep parents of dirty objects dirty
+  if (object->m_dirty)
+    markDirty();
   
   connect(object, SIGNAL(destroyed(QObject*)), this, SLOT(slotChildDestroyed(QObject*)));
 }
 
 void QueueObject::delChildObject(QueueObject *object)
 {
-  m_children.removeAll(object);
+  // The object might already have been reparented, so ask for its row here
+  int pos = childRow(object);
+  if (pos == -1)
+    return;
+  
+  removeChildAt(pos);
+  
+  // The object is no longer our child, so we don't care when it goes away
+  disconnect(object, SIGNAL(destroyed(QObject*)), this, SLOT(slotChildDestroyed(QObject*)));
+  
+  // Detached objects must not keep pending notifications
+  object->clearDirty();
 }
 
 void QueueObject::slotChildDestroyed(QObject *child)
 {
-  // Remove the transfer
-  delChildObject(static_cast<QueueObject*>(child));
+  // Remove the transfer, the object is already gone so only its pointer may be
+  // used. Children are usually removed from either end of the list.
+  QueueObject *object = static_cast<QueueObject*>(child);
+  int pos;
+  
+  if (m_children.isEmpty())
+    return;
+  else if (m_children.first() == object)
+    pos = 0;
+  else if (m_children.last() == object)
+    pos = m_children.size() - 1;
+  else
+    pos = m_children.indexOf(object);
+  
+  if (pos != -1)
+    removeChildAt(pos);
 }
 
 QueueObject *QueueObject::findChildObject(long id)
@@ -220,17 +370,6 @@ QueueObject *QueueObject::findChildObject(long id)
   return NULL;
 }
 
-void QueueObject::removeMarkedTransfers()
-{
-  foreach (QueueObject *i, m_children) {
-    if (i->hasChildren())
-      i->removeMarkedTransfers();
-    
-    if (i->isTransfer() && static_cast<Transfer*>(i)->isDeleteMarked())
-      Manager::self()->removeTransfer(static_cast<Transfer*>(i));
-  }
-}
-
 bool QueueObject::canMove()
 {
   return true;
@@ -238,13 +377,14 @@ bool QueueObject::canMove()
 
 void QueueObject::moveChildUp(QueueObject *child)
 {
-  int pos = m_children.indexOf(child);
+  int pos = child->index();
   
   if (pos != -1) {
     emit KFTPQueue::Manager::self()->objectRemoved(child);
     
-    m_children.removeAll(child);
+    m_children.removeAt(pos);
     m_children.insert(pos - 1, child);
+    reindexChildren(pos - 1);
     
     emit KFTPQueue::Manager::self()->objectAdded(child);
   }
@@ -252,13 +392,14 @@ void QueueObject::moveChildUp(QueueObject *child)
 
 void QueueObject::moveChildDown(QueueObject *child)
 {
-  int pos = m_children.indexOf(child);
+  int pos = child->index();
   
   if (pos != -1) {
     emit KFTPQueue::Manager::self()->objectRemoved(child);
     
-    m_children.removeAll(child);
+    m_children.removeAt(pos);
     m_children.insert(pos + 1, child);
+    reindexChildren(pos);
     
     emit KFTPQueue::Manager::self()->objectAdded(child);
   }
@@ -270,20 +411,40 @@ void QueueObject::moveChildTop(QueueObject *child)
   
   m_children.removeAll(child);
   m_children.prepend(child);
+  reindexChildren(0);
   
   emit KFTPQueue::Manager::self()->objectAdded(child);
 }
 
 void QueueObject::moveChildBottom(QueueObject *child)
 {
+  int pos = child->index();
+  
   emit KFTPQueue::Manager::self()->objectRemoved(child);
   
   m_children.removeAll(child);
   m_children.append(child);
+  reindexChildren(pos);
   
   emit KFTPQueue::Manager::self()->objectAdded(child);
 }
 
+void QueueObject::moveChildTo(QueueObject *child, int position)
+{
+  int pos = child->index();
+  position = qBound(0, position, m_children.count() - 1);
+  
+  if (pos != -1 && pos != position) {
+    emit KFTPQueue::Manager::self()->objectRemoved(child);
+    
+    m_children.removeAt(pos);
+    m_children.insert(position, child);
+    reindexChildren(qMin(pos, position));
+    
+    emit KFTPQueue::Manager::self()->objectAdded(child);
+  }
+}
+
 bool QueueObject::canMoveChildUp(QueueObject *child)
 {
   if (!child->canMove())
@@ -292,7 +453,7 @@ bool QueueObject::canMoveChildUp(QueueObject *child)
   if (m_children.first() == child)
     return false;
   
-  QueueObject *upper = m_children.value(m_children.indexOf(child) - 1);
+  QueueObject *upper = m_children.value(child->index() - 1);
   
   if (upper && !upper->canMove())
     return false;
@@ -308,7 +469,7 @@ bool QueueObject::canMoveChildDown(QueueObject *child)
   if (m_children.last() == child)
     return false;
   
-  QueueObject *lower = m_children.value(m_children.indexOf(child) - 1);
+  QueueObject *lower = m_children.value(child->index() - 1);
   
   if (lower && !lower->canMove())
     return false;
@@ -70,7 +70,8 @@ public:
       Connecting,
       Locked,
       Failed,
-      Waiting
+      Waiting,
+      Verifying
     };
     
     /**
@@ -126,7 +127,7 @@ public:
      *
      * @return true if this object's status is set to Running or Connecting
      */
-    bool isRunning() const { return m_status == Running || m_status == Connecting || m_status == Waiting; }
+    bool isRunning() const { return m_status == Running || m_status == Connecting || m_status == Waiting || m_status == Verifying; }
     
     /**
      * Is this object currently connecting ?
@@ -143,6 +144,14 @@ public:
      */
     bool isWaiting() const { return m_status == Waiting; }
     
+    /**
+     * Is this object currently verifying the transferred data against the
+     * checksum reported by the server ?
+     *
+     * @return True if this object's status is set to Verifying
+     */
+    bool isVerifying() const { return m_status == Verifying; }
+    
     /**
      * Is the object currently locked ?
      *
@@ -220,7 +229,8 @@ public:
     void addCompleted(filesize_t completed);
     
     /**
-     * Set the current transfer speed. This will also update all parent transfers.
+     * Set the current transfer speed. Parent objects are only marked dirty,
+     * their speed is recomputed on the next statistics flush.
      *
      * @param speed Speed to set
      */
@@ -271,11 +281,12 @@ public:
     void delayedExecute(int msec = 100);
     
     /**
-     * Set transfer's ID.
+     * Set transfer's ID. The object is registered with the queue manager so it
+     * can be found by its id.
      *
      * @param id Transfer identifier (must be unique)
      */
-    void setId(long id) { m_id = id; }
+    void setId(long id);
     
     /**
      * Get transfer's ID.
@@ -312,11 +323,6 @@ public:
      */
     QueueObject *findChildObject(long id);
     
-    /**
-     * Removes all transfers that have been marked for deletion.
-     */
-    void removeMarkedTransfers();
-    
     /**
      * Move a child object up in the queue.
      *
@@ -345,6 +351,14 @@ public:
      */
     void moveChildBottom(QueueObject *child);
     
+    /**
+     * Move a child object to the given position.
+     *
+     * @param child The object to move
+     * @param position The child's new index
+     */
+    void moveChildTo(QueueObject *child, int position);
+    
     /**
      * Can a child be moved up ?
      *
@@ -377,7 +391,15 @@ public:
     QueueObject *getChildAt(int i) const { return m_children.at(i); }
     
     /**
-     * Returns this object's relative index to the parent object.
+     * Recomputes aggregated statistics of this object and all its dirty
+     * children and emits a single change notification for each object that
+     * has been updated since the last flush.
+     */
+    void flushStatistics();
+    
+    /**
+     * Returns this object's relative index to the parent object. This is a
+     * constant time operation as the parent keeps the index updated.
      */
     int index() const;
     
@@ -385,6 +407,12 @@ public:
      * Returns the number of child objects.
      */
     int childCount() const { return m_children.size(); }
+    
+    /**
+     * Returns the group that schedules this object's children or 0 if
+     * this object doesn't process its children itself.
+     */
+    virtual QueueGroup *group() const { return 0; }
 public slots:
     /**
      * Execute this queue object.
@@ -396,8 +424,15 @@ protected:
     
     long m_id;
     Type m_type;
+    int m_index;
+    bool m_dirty;
     QList<QueueObject*> m_children;
     
+    /* Offset of the children's cached row indices and the first row whose
+       cached index may be stale (-1 when all are up to date) */
+    int m_indexBase;
+    int m_staleIndex;
+    
     QTimer m_delayedExecuteTimer;
     
     /* Statistical information */
@@ -418,10 +453,46 @@ protected:
      */
     virtual void statisticsUpdated();
     
+    /**
+     * Marks this object and all its parents as having changed statistics. The
+     * notifications are emitted on the next flush.
+     */
+    void markDirty();
+    
+    /**
+     * Clears the dirty flags of this object and its children without emitting
+     * any notifications. Used when an object is detached from its parent.
+     */
+    void clearDirty();
+    
     /**
      * This method should return true if the object can be moved.
      */
     virtual bool canMove();
+    
+    /**
+     * Updates cached row indices of all children starting at the given
+     * position. Must be called after the children list has been modified.
+     *
+     * @param from First position that has changed
+     */
+    void reindexChildren(int from = 0);
+    
+    /**
+     * Removes the child at the given position. Removals at either end of the
+     * list don't renumber the other children.
+     *
+     * @param pos Position of the child
+     */
+    void removeChildAt(int pos);
+    
+    /**
+     * Returns the row of a child object using its cached index.
+     *
+     * @param child The child object
+     * @return The child's row or -1 if it isn't our child
+     */
+    int childRow(const QueueObject *child);
 private slots:
     void slotChildDestroyed(QObject *child);
 signals:
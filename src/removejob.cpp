@@ -0,0 +1,268 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2006 by the KFTPGrabber developers
+ * Copyright (C) 2003-2006 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include "removejob.h"
+#include "kftpsession.h"
+
+#include "engine/thread.h"
+
+using namespace KFTPEngine;
+
+namespace KFTPSession {
+
+RemoveJob::RemoveJob(Session *session, Connection *connection)
+  : QObject(session),
+    m_session(session),
+    m_connection(connection),
+    m_remaining(0),
+    m_failed(false),
+    m_finished(false)
+{
+}
+
+void RemoveJob::addDirectory(const KUrl &url)
+{
+  m_remaining++;
+  addNode(url, -1);
+}
+
+void RemoveJob::start()
+{
+  if (m_remaining == 0) {
+    finish();
+    return;
+  }
+  
+  // Connections that become free (or finish connecting) pick up more work
+  connect(m_session, SIGNAL(freeConnectionAvailable()), this, SLOT(dispatch()));
+  dispatch();
+}
+
+void RemoveJob::abort()
+{
+  m_finished = true;
+  disconnect(m_session, SIGNAL(freeConnectionAvailable()), this, SLOT(dispatch()));
+  
+  QList<Connection*> connections = m_active.keys();
+  m_active.clear();
+  m_ready.clear();
+  
+  foreach (Connection *connection, connections) {
+    connection->getClient()->eventHandler()->QObject::disconnect(this);
+    connection->abort();
+    releaseConnection(connection);
+  }
+  
+  deleteLater();
+}
+
+int RemoveJob::addNode(const KUrl &url, int parent)
+{
+  Node node;
+  node.url = url;
+  node.parent = parent;
+  node.pendingChildren = 0;
+  node.listed = false;
+  node.failed = false;
+  m_nodes.append(node);
+  
+  // Directories are only split up further while there isn't enough work to
+  // keep every connection busy, otherwise the whole subtree is removed at once
+  int maxConnections = m_session->getMaxThreadCount();
+  Step step = Remove;
+  
+  if (maxConnections > 1 && m_ready.count() + m_active.count() < maxConnections)
+    step = List;
+  
+  m_ready.append(Work(m_nodes.count() - 1, step));
+  return m_nodes.count() - 1;
+}
+
+Connection *RemoveJob::nextConnection()
+{
+  // The connection we have been given is used whenever it is idle
+  if (m_connection && !m_active.contains(m_connection) && m_connection->isConnected() &&
+      !m_connection->getClient()->socket()->isBusy())
+    return m_connection;
+  
+  // Connections that are still being established will announce themselves
+  // once they are ready
+  Connection *connection = m_session->assignConnection();
+  if (!connection || connection == m_connection || connection->isBusy() || !connection->isConnected())
+    return 0;
+  
+  connection->acquire(0);
+  return connection;
+}
+
+void RemoveJob::dispatch()
+{
+  if (m_finished)
+    return;
+  
+  while (!m_ready.isEmpty()) {
+    Connection *connection = nextConnection();
+    if (!connection)
+      break;
+    
+    run(connection, m_ready.takeFirst());
+  }
+}
+
+void RemoveJob::run(Connection *connection, const Work &work)
+{
+  m_active.insert(connection, work);
+  connect(connection->getClient()->eventHandler(), SIGNAL(engineEvent(KFTPEngine::Event*)), this, SLOT(slotEngineEvent(KFTPEngine::Event*)));
+  
+  if (work.step == List)
+    connection->getClient()->list(m_nodes.at(work.node).url);
+  else
+    connection->getClient()->remove(m_nodes.at(work.node).url);
+}
+
+void RemoveJob::childrenRemoved(int node)
+{
+  if (m_nodes.at(node).failed) {
+    // Something below could not be removed, so neither can this directory
+    completeNode(node);
+  } else {
+    // Removals of emptied directories go first so the tree shrinks bottom-up
+    m_ready.prepend(Work(node, Remove));
+  }
+}
+
+void RemoveJob::completeNode(int node)
+{
+  int parent = m_nodes.at(node).parent;
+  bool failed = m_nodes.at(node).failed;
+  
+  if (failed)
+    m_failed = true;
+  
+  if (parent < 0) {
+    if (--m_remaining == 0)
+      finish();
+    return;
+  }
+  
+  if (failed)
+    m_nodes[parent].failed = true;
+  
+  if (--m_nodes[parent].pendingChildren == 0 && m_nodes.at(parent).listed)
+    childrenRemoved(parent);
+}
+
+void RemoveJob::releaseConnection(Connection *connection)
+{
+  if (connection != m_connection)
+    connection->release();
+}
+
+void RemoveJob::finish()
+{
+  m_finished = true;
+  disconnect(m_session, SIGNAL(freeConnectionAvailable()), this, SLOT(dispatch()));
+  
+  emit finished(!m_failed);
+  deleteLater();
+}
+
+void RemoveJob::slotEngineEvent(KFTPEngine::Event *event)
+{
+  Connection *connection = 0;
+  
+  QHash<Connection*, Work>::const_iterator activeEnd = m_active.constEnd();
+  for (QHash<Connection*, Work>::const_iterator i = m_active.constBegin(); i != activeEnd; i++) {
+    if (i.key()->getClient()->eventHandler() == sender()) {
+      connection = i.key();
+      break;
+    }
+  }
+  
+  if (!connection)
+    return;
+  
+  Work work = m_active.value(connection);
+  
+  switch (event->type()) {
+    case Event::EventDirectoryListing: {
+      if (work.step != List)
+        break;
+      
+      // Every subdirectory becomes a unit of work of its own, files are
+      // removed together with their directory
+      QList<DirectoryEntry> list = event->getParameter(0).value<DirectoryListing>().list();
+      
+      QList<DirectoryEntry>::const_iterator listEnd = list.constEnd();
+      for (QList<DirectoryEntry>::const_iterator i = list.constBegin(); i != listEnd; i++) {
+        if (!(*i).isDirectory())
+          continue;
+        
+        KUrl url = m_nodes.at(work.node).url;
+        url.addPath((*i).filename());
+        
+        m_nodes[work.node].pendingChildren++;
+        addNode(url, work.node);
+      }
+      break;
+    }
+    case Event::EventError: {
+      m_nodes[work.node].failed = true;
+      break;
+    }
+    case Event::EventReady: {
+      connection->getClient()->eventHandler()->QObject::disconnect(this);
+      m_active.remove(connection);
+      releaseConnection(connection);
+      
+      if (work.step == Remove) {
+        completeNode(work.node);
+      } else {
+        m_nodes[work.node].listed = true;
+        
+        if (m_nodes.at(work.node).pendingChildren == 0)
+          childrenRemoved(work.node);
+      }
+      
+      dispatch();
+      break;
+    }
+    default: break;
+  }
+}
+
+}
+
+#include "removejob.moc"
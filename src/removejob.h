@@ -0,0 +1,145 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2006 by the KFTPGrabber developers
+ * Copyright (C) 2003-2006 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef KFTPSESSIONREMOVEJOB_H
+#define KFTPSESSIONREMOVEJOB_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+
+#include <KUrl>
+
+namespace KFTPEngine {
+  class Event;
+}
+
+namespace KFTPSession {
+
+class Session;
+class Connection;
+
+/**
+ * This class removes remote directory trees using all the connections a
+ * session is allowed to open. Directories are listed until there are enough
+ * independent subtrees to keep every connection busy, then whole subtrees are
+ * handed to free connections. A listed directory is removed once all of its
+ * subdirectories are gone.
+ *
+ * Errors are reported by the engine as usual. The job deletes itself after
+ * emitting the finished signal.
+ */
+class RemoveJob : public QObject {
+Q_OBJECT
+public:
+    /**
+     * Class constructor.
+     *
+     * @param session The session the directories belong to
+     * @param connection A connection the caller has already acquired and that
+     *                   may be used by this job whenever it is idle
+     */
+    RemoveJob(Session *session, Connection *connection);
+    
+    /**
+     * Adds a directory that should be removed together with its contents.
+     *
+     * @param url Remote directory URL
+     */
+    void addDirectory(const KUrl &url);
+    
+    /**
+     * Starts removing the added directories.
+     */
+    void start();
+    
+    /**
+     * Aborts all pending operations and deletes this job without emitting
+     * the finished signal.
+     */
+    void abort();
+private:
+    enum Step {
+      List,
+      Remove
+    };
+    
+    struct Node {
+      KUrl url;
+      int parent;
+      int pendingChildren;
+      bool listed;
+      bool failed;
+    };
+    
+    struct Work {
+      Work(int n = -1, Step s = List) : node(n), step(s) {}
+      
+      int node;
+      Step step;
+    };
+    
+    Session *m_session;
+    Connection *m_connection;
+    
+    QList<Node> m_nodes;
+    QList<Work> m_ready;
+    QHash<Connection*, Work> m_active;
+    int m_remaining;
+    bool m_failed;
+    bool m_finished;
+    
+    int addNode(const KUrl &url, int parent);
+    Connection *nextConnection();
+    void run(Connection *connection, const Work &work);
+    void childrenRemoved(int node);
+    void completeNode(int node);
+    void releaseConnection(Connection *connection);
+    void finish();
+private slots:
+    void dispatch();
+    void slotEngineEvent(KFTPEngine::Event *event);
+signals:
+    /**
+     * This signal is emitted when all directories have been processed.
+     *
+     * @param success True if all directories were removed
+     */
+    void finished(bool success);
+};
+
+}
+
+#endif
@@ -58,7 +58,7 @@ void Site::execute()
   
   // Reset and start the group
   m_group->reset();
-  m_group->executeNextTransfer();
+  m_group->dispatch();
 }
 
 void Site::abort()
@@ -75,6 +75,12 @@ public:
      * Abort transfer processing.
      */
     void abort();
+    
+    /**
+     * @overload
+     * Reimplemented from KFTPQueue::QueueObject.
+     */
+    QueueGroup *group() const { return m_group; }
 private:
     KUrl m_siteUrl;
     QueueGroup *m_group;
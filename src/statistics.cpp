@@ -35,11 +35,26 @@
  */
 
 #include "statistics.h"
+#include "kftptransferfile.h"
+
+#include <QFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QStringList>
 
 #include <KGlobal>
 
 namespace KFTPQueue {
 
+/* Statistics file header */
+static const quint32 StatisticsMagic = 0x4B465453;
+static const quint32 StatisticsVersion = 1;
+
+/* History bounds */
+static const int MaxTransferSamples = 64;
+static const int MaxConnectSamples = 16;
+static const int MaxSites = 128;
+
 class StatisticsPrivate {
 public:
     Statistics instance;
@@ -48,8 +63,193 @@ public:
 K_GLOBAL_STATIC(StatisticsPrivate, statisticsPrivate)
 
 StatisticsSite::StatisticsSite()
-  : m_lastFxpSpeed(0.0)
+  : m_lastUpdate(0),
+    m_dirty(true)
+{
+}
+
+void StatisticsSite::addTransfer(TransferType type, filesize_t bytes, int msec, int threads)
+{
+  if (msec <= 0)
+    return;
+  
+  Sample sample;
+  sample.time = QDateTime::currentDateTime().toTime_t();
+  sample.type = type;
+  sample.bytes = bytes;
+  sample.msec = msec;
+  sample.threads = qBound(1, threads, 255);
+  
+  m_samples.append(sample);
+  if (m_samples.count() > MaxTransferSamples)
+    m_samples.removeFirst();
+  
+  m_lastUpdate = sample.time;
+  m_dirty = true;
+}
+
+void StatisticsSite::addConnectTime(int msec)
+{
+  if (msec < 0)
+    return;
+  
+  m_connectTimes.append(msec);
+  if (m_connectTimes.count() > MaxConnectSamples)
+    m_connectTimes.removeFirst();
+  
+  m_lastUpdate = QDateTime::currentDateTime().toTime_t();
+}
+
+void StatisticsSite::updateModels() const
+{
+  if (!m_dirty)
+    return;
+  
+  for (int type = Download; type <= FXP; type++) {
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    int n = 0;
+    
+    foreach (const Sample &sample, m_samples) {
+      if (sample.type != type)
+        continue;
+      
+      double x = sample.bytes;
+      double y = sample.msec / 1000.0;
+      
+      sumX += x;
+      sumY += y;
+      sumXX += x * x;
+      sumXY += x * y;
+      n++;
+    }
+    
+    Model &model = m_models[type];
+    model.throughput = 0;
+    model.overhead = 0;
+    
+    if (n == 0 || sumY <= 0)
+      continue;
+    
+    // Transfer time is modelled as a fixed per-file overhead plus the time
+    // needed to move the data, which is fitted using least squares
+    double varX = n * sumXX - sumX * sumX;
+    
+    if (n >= 3 && varX > 0) {
+      double slope = (n * sumXY - sumX * sumY) / varX;
+      double intercept = (sumY - slope * sumX) / n;
+      
+      if (slope > 0 && intercept >= 0) {
+        model.throughput = 1.0 / slope;
+        model.overhead = intercept;
+        continue;
+      }
+    }
+    
+    // Not enough variation in file sizes, use the average throughput
+    model.throughput = sumX / sumY;
+  }
+  
+  m_dirty = false;
+}
+
+double StatisticsSite::throughput(TransferType type) const
+{
+  updateModels();
+  return m_models[type].throughput;
+}
+
+double StatisticsSite::fileOverhead(TransferType type) const
+{
+  updateModels();
+  return m_models[type].overhead;
+}
+
+double StatisticsSite::connectTime() const
+{
+  if (m_connectTimes.isEmpty())
+    return 0;
+  
+  double total = 0;
+  foreach (quint32 msec, m_connectTimes)
+    total += msec;
+  
+  return total / m_connectTimes.count() / 1000.0;
+}
+
+int StatisticsSite::bestThreadCount() const
+{
+  // Average total throughput achieved with each number of connections
+  QMap<int, QPair<double, int> > totals;
+  
+  foreach (const Sample &sample, m_samples) {
+    QPair<double, int> &total = totals[sample.threads];
+    total.first += sample.bytes / (sample.msec / 1000.0) * sample.threads;
+    total.second++;
+  }
+  
+  int best = 0;
+  double bestThroughput = 0;
+  
+  QMap<int, QPair<double, int> >::ConstIterator end = totals.constEnd();
+  for (QMap<int, QPair<double, int> >::ConstIterator i = totals.constBegin(); i != end; ++i) {
+    // A single sample is not representative
+    if (i.value().second < 2)
+      continue;
+    
+    double average = i.value().first / i.value().second;
+    if (average > bestThroughput) {
+      best = i.key();
+      bestThroughput = average;
+    }
+  }
+  
+  return best;
+}
+
+double StatisticsSite::estimate(TransferType type, filesize_t bytes, int files) const
+{
+  updateModels();
+  
+  const Model &model = m_models[type];
+  if (model.throughput <= 0)
+    return -1;
+  
+  return files * model.overhead + bytes / model.throughput;
+}
+
+QDataStream &operator<<(QDataStream &stream, const StatisticsSite &site)
 {
+  stream << (quint32) site.m_lastUpdate << (quint32) site.m_samples.count();
+  
+  foreach (const StatisticsSite::Sample &sample, site.m_samples)
+    stream << sample.time << sample.type << sample.bytes << sample.msec << sample.threads;
+  
+  stream << site.m_connectTimes;
+  return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, StatisticsSite &site)
+{
+  quint32 lastUpdate, count;
+  stream >> lastUpdate >> count;
+  
+  site.m_lastUpdate = lastUpdate;
+  site.m_samples.clear();
+  
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+    StatisticsSite::Sample sample;
+    stream >> sample.time >> sample.type >> sample.bytes >> sample.msec >> sample.threads;
+    
+    if (sample.type <= FXP && sample.msec > 0 && site.m_samples.count() < MaxTransferSamples)
+      site.m_samples.append(sample);
+  }
+  
+  stream >> site.m_connectTimes;
+  while (site.m_connectTimes.count() > MaxConnectSamples)
+    site.m_connectTimes.removeFirst();
+  
+  site.m_dirty = true;
+  return stream;
 }
 
 Statistics *Statistics::self()
@@ -66,22 +266,120 @@ Statistics::~Statistics()
   qDeleteAll(m_sites);
 }
 
-StatisticsSite *Statistics::getSite(const KUrl &url)
+QString Statistics::siteKey(const KUrl &url)
 {
-  // Reset the url's path and grab the site
+  // Sites are identified without path and password
   KUrl tmp = url;
   tmp.setPath("/");
+  tmp.setPass(QString::null);
   
-  StatisticsSite *site = m_sites[tmp.url()];
+  return tmp.url();
+}
+
+StatisticsSite *Statistics::getSite(const KUrl &url)
+{
+  QString key = siteKey(url);
+  StatisticsSite *site = m_sites.value(key);
   
   if (!site) {
     site = new StatisticsSite();
-    m_sites.insert(tmp.url(), site);
+    m_sites.insert(key, site);
   }
   
   return site;
 }
 
+StatisticsSite *Statistics::getSite(const Transfer *transfer)
+{
+  return getSite(transfer->getTransferType() == Upload ? transfer->getDestUrl() : transfer->getSourceUrl());
+}
+
+StatisticsSite *Statistics::findSite(const KUrl &url) const
+{
+  return m_sites.value(siteKey(url));
+}
+
+StatisticsSite *Statistics::findSite(const Transfer *transfer) const
+{
+  return findSite(transfer->getTransferType() == Upload ? transfer->getDestUrl() : transfer->getSourceUrl());
+}
+
+double Statistics::estimate(const Transfer *transfer) const
+{
+  StatisticsSite *site = findSite(transfer);
+  if (!site)
+    return -1;
+  
+  filesize_t done = transfer->getCompleted();
+  if (!transfer->isDir())
+    done = qMax(done, static_cast<const TransferFile*>(transfer)->getCheckpoint());
+  
+  filesize_t remaining = transfer->getSize() > done ? transfer->getSize() - done : 0;
+  return site->estimate(transfer->getTransferType(), remaining, qMax(1, transfer->childCount()));
+}
+
+void Statistics::load(const QString &filename)
+{
+  m_filename = filename;
+  
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+  
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_0);
+  
+  quint32 magic, version, count;
+  stream >> magic >> version >> count;
+  
+  if (stream.status() != QDataStream::Ok || magic != StatisticsMagic || version != StatisticsVersion) {
+    qDebug("WARNING: Statistics file is not valid, ignoring it!");
+    return;
+  }
+  
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+    QString key;
+    StatisticsSite *site = new StatisticsSite();
+    stream >> key >> *site;
+    
+    if (stream.status() != QDataStream::Ok || m_sites.contains(key)) {
+      delete site;
+      continue;
+    }
+    
+    m_sites.insert(key, site);
+  }
+}
+
+void Statistics::save()
+{
+  if (m_filename.isEmpty())
+    return;
+  
+  QFile file(m_filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qDebug("WARNING: Unable to open statistics file for writing!");
+    return;
+  }
+  
+  // Only keep the most recently used sites
+  QMultiMap<uint, QString> recent;
+  QMap<QString, StatisticsSite*>::ConstIterator end = m_sites.constEnd();
+  for (QMap<QString, StatisticsSite*>::ConstIterator i = m_sites.constBegin(); i != end; ++i)
+    recent.insert(i.value()->lastUpdate(), i.key());
+  
+  QStringList keys = recent.values();
+  while (keys.count() > MaxSites)
+    keys.removeFirst();
+  
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_0);
+  stream << StatisticsMagic << StatisticsVersion << (quint32) keys.count();
+  
+  foreach (const QString &key, keys)
+    stream << key << *m_sites.value(key);
+}
+
 }
 
 #include "statistics.moc"
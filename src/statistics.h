@@ -39,42 +39,124 @@
 
 #include <QObject>
 #include <QMap>
+#include <QList>
 
 #include <kurl.h>
 #include <kio/global.h>
 
+#include "kftptransfer.h"
+
+class QDataStream;
+
 namespace KFTPQueue {
 
 class StatisticsPrivate;
 
 /**
- * This class represents a statistics for a single site.
+ * This class represents a statistics for a single site. It keeps a bounded
+ * history of completed transfers and connection setups from which the site's
+ * throughput, per-file overhead and connect time are estimated.
  *
  * @author Jernej Kos <kostko@unimatrix-one.org>
  */
 class StatisticsSite {
+friend QDataStream &operator<<(QDataStream &stream, const StatisticsSite &site);
+friend QDataStream &operator>>(QDataStream &stream, StatisticsSite &site);
 public:
     StatisticsSite();
     
     /**
-     * Set the site's last FXP speed.
+     * Records a completed transfer.
+     *
+     * @param type Transfer direction
+     * @param bytes Number of bytes transferred
+     * @param msec Time from the start of the transfer to its completion
+     * @param threads Number of connections that were transferring from this site
+     */
+    void addTransfer(TransferType type, filesize_t bytes, int msec, int threads);
+    
+    /**
+     * Records the time needed to establish a connection to the site.
+     *
+     * @param msec Connect time in miliseconds
+     */
+    void addConnectTime(int msec);
+    
+    /**
+     * Returns the estimated throughput of a single connection.
+     *
+     * @param type Transfer direction
+     * @return Throughput in bytes per second or 0 if unknown
+     */
+    double throughput(TransferType type) const;
+    
+    /**
+     * Returns the estimated time spent on each file apart from moving data,
+     * like opening data connections and negotiating the transfer.
      *
-     * @param speed Site's last FXP speed
+     * @param type Transfer direction
+     * @return Overhead in seconds
      */
-    void setLastFxpSpeed(double speed) { m_lastFxpSpeed = speed; }
+    double fileOverhead(TransferType type) const;
     
     /**
-     * Get the site's last FXP speed.
+     * Returns the average time needed to establish a connection.
      *
-     * @return Site's last FXP speed
+     * @return Connect time in seconds
      */
-    double lastFxpSpeed() const { return m_lastFxpSpeed; }
+    double connectTime() const;
+    
+    /**
+     * Returns the number of concurrent connections that achieved the highest
+     * total throughput so far.
+     *
+     * @return Thread count or 0 if unknown
+     */
+    int bestThreadCount() const;
+    
+    /**
+     * Predicts how long it will take to transfer the given amount of data.
+     *
+     * @param type Transfer direction
+     * @param bytes Number of bytes to transfer
+     * @param files Number of files the data is split into
+     * @return Predicted number of seconds or -1 if there is not enough history
+     */
+    double estimate(TransferType type, filesize_t bytes, int files = 1) const;
+    
+    /**
+     * Returns the time of the last recorded sample.
+     */
+    uint lastUpdate() const { return m_lastUpdate; }
 private:
-    double m_lastFxpSpeed;
+    struct Sample {
+      quint32 time;
+      quint8 type;
+      quint64 bytes;
+      quint32 msec;
+      quint8 threads;
+    };
+    
+    struct Model {
+      double throughput;
+      double overhead;
+    };
+    
+    QList<Sample> m_samples;
+    QList<quint32> m_connectTimes;
+    uint m_lastUpdate;
+    
+    /* Estimates are recomputed from the samples when needed */
+    mutable bool m_dirty;
+    mutable Model m_models[3];
+    
+    void updateModels() const;
 };
 
 /**
- * This class provides different kind of per-site statistics.
+ * This class provides different kind of per-site statistics. The history
+ * is kept on disk so estimates are available as soon as a site is used
+ * again.
  *
  * @author Jernej Kos <kostko@unimatrix-one.org>
  */
@@ -96,6 +178,53 @@ public:
      * @return A valid StatisticsSite pointer
      */
     StatisticsSite *getSite(const KUrl &url);
+    
+    /**
+     * Returns the site responsible for the given transfer's remote end. If
+     * the site doesn't exist it is created.
+     *
+     * @param transfer The transfer
+     * @return A valid StatisticsSite pointer
+     */
+    StatisticsSite *getSite(const Transfer *transfer);
+    
+    /**
+     * Returns a site that corresponds to the given URL or 0 when there are
+     * no statistics for it.
+     *
+     * @param url The site's URL
+     * @return A StatisticsSite pointer or 0
+     */
+    StatisticsSite *findSite(const KUrl &url) const;
+    
+    /**
+     * Returns the site responsible for the given transfer's remote end.
+     *
+     * @param transfer The transfer
+     * @return A StatisticsSite pointer or 0
+     */
+    StatisticsSite *findSite(const Transfer *transfer) const;
+    
+    /**
+     * Predicts the number of seconds a queued transfer still needs.
+     *
+     * @param transfer The transfer
+     * @return Predicted number of seconds or -1 if unknown
+     */
+    double estimate(const Transfer *transfer) const;
+    
+    /**
+     * Load statistics from a file.
+     *
+     * @param filename The file to load from
+     */
+    void load(const QString &filename);
+    
+    /**
+     * Save statistics to the file they were loaded from. Only the most
+     * recently used sites are kept.
+     */
+    void save();
 protected:
     /**
      * Class constructor.
@@ -107,7 +236,10 @@ protected:
      */
     ~Statistics();
 private:
-    QMap<KUrl, StatisticsSite*> m_sites;
+    QMap<QString, StatisticsSite*> m_sites;
+    QString m_filename;
+    
+    static QString siteKey(const KUrl &url);
 };
 
 }
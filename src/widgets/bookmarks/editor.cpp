@@ -212,6 +212,9 @@ void Editor::slotItemClicked(const QModelIndex &index)
       m_layout.retryCount->setValue(site->getIntProperty("retryCount"));
       m_layout.keepalive->setChecked(site->getIntProperty("keepaliveEnabled"));
       m_layout.keepaliveFrequency->setValue(site->getIntProperty("keepaliveFrequency"));
+      m_layout.speedLimitDown->setValue(site->getIntProperty("speedLimitDown"));
+      m_layout.speedLimitUp->setValue(site->getIntProperty("speedLimitUp"));
+      m_layout.speedWeight->setValue(qMax(1, site->getIntProperty("speedWeight")));
       
       // Select the proper security widget
       slotProtocolChanged(site->protocol());
@@ -302,6 +305,9 @@ void Editor::saveCurrentItem()
     site->setProperty("retryCount", m_layout.retryCount->value());
     site->setProperty("keepaliveEnabled", m_layout.keepalive->isChecked());
     site->setProperty("keepaliveFrequency", m_layout.keepaliveFrequency->value());
+    site->setProperty("speedLimitDown", m_layout.speedLimitDown->value());
+    site->setProperty("speedLimitUp", m_layout.speedLimitUp->value());
+    site->setProperty("speedWeight", m_layout.speedWeight->value());
     
     switch (site->protocol()) {
       case Site::ProtoFtp: {
@@ -593,6 +593,24 @@ void Actions::slotQueueTransfer()
   */
 }
 
+void Actions::slotSynchronize(QAction *action)
+{
+  KFTPSession::Session *oppositeSession = m_view->session()->oppositeSession();
+  KUrl oppositeUrl = oppositeSession->getFileView()->locationNavigator()->url();
+  
+  // Synchronize each selected directory with its counterpart on the other side
+  foreach (QModelIndex index, m_view->selectedIndexes()) {
+    KFileItem item = index.data(DirModel::FileItemRole).value<KFileItem>();
+    if (!item.isDir())
+      continue;
+    
+    KUrl destinationUrl = oppositeUrl;
+    destinationUrl.addPath(item.name());
+    
+    KFTPQueue::Manager::self()->spawnSynchronization(item.url(), destinationUrl, action->data().toInt());
+  }
+}
+
 void Actions::slotCreateDir()
 {
   /*
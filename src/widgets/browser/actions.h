@@ -164,6 +164,7 @@ public slots:
 
     void slotTransfer();
     void slotQueueTransfer();
+    void slotSynchronize(QAction *action);
     void slotCreateDir();
     void slotFileEdit();
     void slotVerify();
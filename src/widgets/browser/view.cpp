@@ -47,6 +47,7 @@
 #include "kftpbookmarks.h"
 #include "misc/config.h"
 #include "kftpsession.h"
+#include "kftptransferdir.h"
 
 #include "engine/ftpsocket.h"
 
@@ -444,7 +445,7 @@ void View::slotEngineEvent(KFTPEngine::Event *event)
   switch (event->type()) {
     case Event::EventState: {
       // Set new state
-      m_statusMsg->setText(event->getParameter(0).toString());
+      m_statusMsg->setText(event->text());
       break;
     }
     case Event::EventConnect:
@@ -529,6 +530,27 @@ void View::openContextMenu(const QModelIndexList &indexes, const QPoint &pos)
   
   menu.addAction(KIcon("list-add"), i18n("&Queue Transfer"), m_actions, SLOT(slotQueueTransfer()));
   
+  // Directories can also be synchronized with the opposite side
+  bool directories = !indexes.isEmpty();
+  foreach (QModelIndex index, indexes) {
+    if (!index.data(DirModel::FileItemRole).value<KFileItem>().isDir()) {
+      directories = false;
+      break;
+    }
+  }
+  
+  if (directories) {
+    QMenu *syncMenu = menu.addMenu(KIcon("view-refresh"), i18n("S&ynchronize"));
+    
+    syncMenu->addAction(i18n("Transfer &Changed Files"))->setData(KFTPQueue::TransferDir::SyncNone);
+    syncMenu->addAction(i18n("Transfer Changed Files (Compare C&hecksums)"))->setData(KFTPQueue::TransferDir::SyncChecksum);
+    syncMenu->addSeparator();
+    syncMenu->addAction(i18n("&Mirror"))->setData(KFTPQueue::TransferDir::SyncDelete);
+    syncMenu->addAction(i18n("Mirror (Compare Ch&ecksums)"))->setData(KFTPQueue::TransferDir::SyncDelete | KFTPQueue::TransferDir::SyncChecksum);
+    
+    connect(syncMenu, SIGNAL(triggered(QAction*)), m_actions, SLOT(slotSynchronize(QAction*)));
+  }
+  
   menu.exec(pos);
 }
 
@@ -0,0 +1,126 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2008 by the KFTPGrabber developers
+ * Copyright (C) 2003-2008 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "logfilewriter.h"
+
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <KGlobal>
+
+namespace KFTPWidgets {
+
+class LogFileWriterPrivate
+{
+public:
+    LogFileWriter instance;
+};
+
+K_GLOBAL_STATIC(LogFileWriterPrivate, logFileWriterPrivate)
+
+LogFileWriter *LogFileWriter::self()
+{
+  return &logFileWriterPrivate->instance;
+}
+
+LogFileWriter::LogFileWriter()
+  : QThread(),
+    m_exit(false)
+{
+}
+
+LogFileWriter::~LogFileWriter()
+{
+  m_mutex.lock();
+  m_exit = true;
+  m_condition.wakeOne();
+  m_mutex.unlock();
+  
+  wait();
+}
+
+void LogFileWriter::write(const QString &filename, const QString &line)
+{
+  QMutexLocker locker(&m_mutex);
+  m_filename = filename;
+  m_lines.append(line);
+  m_condition.wakeOne();
+  
+  if (!isRunning())
+    start(QThread::LowPriority);
+}
+
+void LogFileWriter::run()
+{
+  for (;;) {
+    QStringList lines;
+    QString filename;
+    
+    m_mutex.lock();
+    while (m_lines.isEmpty() && !m_exit)
+      m_condition.wait(&m_mutex);
+    
+    lines.swap(m_lines);
+    filename = m_filename;
+    bool exit = m_exit;
+    m_mutex.unlock();
+    
+    if (!lines.isEmpty()) {
+      if (m_file.fileName() != filename || !m_file.isOpen()) {
+        m_file.close();
+        m_file.setFileName(filename);
+        m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+      }
+      
+      if (m_file.isOpen()) {
+        QTextStream stream(&m_file);
+        
+        foreach (const QString &line, lines) {
+          stream << line << '\n';
+        }
+        
+        stream.flush();
+      }
+    }
+    
+    if (exit)
+      break;
+  }
+  
+  m_file.close();
+}
+
+}
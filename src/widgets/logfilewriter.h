@@ -0,0 +1,100 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2008 by the KFTPGrabber developers
+ * Copyright (C) 2003-2008 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef KFTPLOGFILEWRITER_H
+#define KFTPLOGFILEWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QFile>
+
+namespace KFTPWidgets {
+
+class LogFileWriterPrivate;
+
+/**
+ * This class writes the raw log of all sessions to a file. Lines are only
+ * queued by the caller, the file is written by a background thread so the
+ * GUI never waits for the disk.
+ *
+ * @author Jernej Kos
+ */
+class LogFileWriter : public QThread {
+friend class LogFileWriterPrivate;
+public:
+    /**
+     * Returns the global writer instance.
+     */
+    static LogFileWriter *self();
+    
+    /**
+     * Queues a line to be appended to a log file. The thread is started
+     * when the first line is queued.
+     *
+     * @param filename Path of the log file
+     * @param line Line to append
+     */
+    void write(const QString &filename, const QString &line);
+protected:
+    /**
+     * Class constructor.
+     */
+    LogFileWriter();
+    
+    /**
+     * Class destructor. Writes the remaining lines before returning.
+     */
+    ~LogFileWriter();
+    
+    /**
+     * Thread entry point.
+     */
+    void run();
+private:
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    QString m_filename;
+    QStringList m_lines;
+    bool m_exit;
+    
+    QFile m_file;
+};
+
+}
+
+#endif
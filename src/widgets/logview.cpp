@@ -34,6 +34,7 @@
  */
 
 #include "logview.h"
+#include "logfilewriter.h"
 #include "misc/config.h"
 
 #include <klocale.h>
@@ -52,11 +53,29 @@
 #include <QScrollBar>
 #include <QAbstractSlider>
 #include <QMenu>
+#include <QTimer>
+#include <QTime>
+#include <QMultiMap>
+#include <QTextCursor>
 
 namespace KFTPWidgets {
 
+/* Time between two renderings of buffered lines (in miliseconds) */
+static const int flushInterval = 100;
+
+/* Number of distinct skipped status messages to mention in the summary */
+static const int summaryMessages = 3;
+
+/* Longest sequence of lines that is recognized as repeating */
+static const int maxSequenceLength = 8;
+
 LogView::LogView(QWidget *parent)
-  : QPlainTextEdit(parent)
+  : QPlainTextEdit(parent),
+    m_skipped(0),
+    m_runPeriod(0),
+    m_runCount(0),
+    m_runTransfers(false),
+    m_runSummaryStale(false)
 {
   setReadOnly(true);
   setMaximumBlockCount(200);
@@ -65,7 +84,11 @@ LogView::LogView(QWidget *parent)
 
   // Init actions
   m_saveToFileAction = KStandardAction::saveAs(this, SLOT(slotSaveToFile()), this);
-  m_clearLogAction = KStandardAction::clear(this, SLOT(clear()), this);
+  m_clearLogAction = KStandardAction::clear(this, SLOT(slotClear()), this);
+  
+  m_flushTimer = new QTimer(this);
+  m_flushTimer->setSingleShot(true);
+  connect(m_flushTimer, SIGNAL(timeout()), this, SLOT(slotFlush()));
 }
 
 LogView::~LogView()
@@ -74,47 +97,282 @@ LogView::~LogView()
 
 void LogView::append(const QString &str, LineType type)
 {
-  switch (type) {
+  // Hide password if this is a PASS command
+  QString text = str;
+  if (type == FtpCommand && text.left(4) == "PASS")
+    text = "PASS (hidden)";
+  
+  writeToFile(text, type);
+  
+  Line line;
+  line.type = type;
+  line.text = text;
+  line.repeat = 1;
+  
+  if (m_runPeriod) {
+    // Lines continuing the repeating sequence are only counted
+    QString signature = lineSignature(line);
+    
+    if (!signature.isEmpty() && signature == m_recent.at(m_recent.count() - m_runPeriod)) {
+      m_recent.append(signature);
+      m_recent.removeFirst();
+      m_runPartial.append(line);
+      
+      if (m_runPartial.count() == m_runPeriod) {
+        m_runPartial.clear();
+        countRun();
+      }
+      
+      return;
+    }
+    
+    endRun();
+  }
+  
+  appendLine(line);
+}
+
+void LogView::appendLine(const Line &line)
+{
+  // Coalesce identical consecutive lines
+  if (!m_pending.isEmpty() && m_pending.last().type == line.type && m_pending.last().text == line.text) {
+    m_pending.last().repeat++;
+  } else {
+    m_pending.append(line);
+    
+    QString signature = lineSignature(line);
+    
+    if (signature.isEmpty()) {
+      m_recent.clear();
+    } else {
+      m_recent.append(signature);
+      
+      if (m_recent.count() > 2 * maxSequenceLength)
+        m_recent.removeFirst();
+      
+      // Start a run when the last lines repeat the sequence before them
+      int count = m_recent.count();
+      
+      for (int period = 2; period <= maxSequenceLength && 2 * period <= count; period++) {
+        if (m_recent.mid(count - period) == m_recent.mid(count - 2 * period, period)) {
+          m_runPeriod = period;
+          m_runCount = 0;
+          
+          QStringList sequence = m_recent.mid(count - period);
+          QString command = QString::number(FtpCommand);
+          
+          m_runTransfers = sequence.contains(command + "RETR") || sequence.contains(command + "STOR") || sequence.contains(command + "APPE");
+          
+          break;
+        }
+      }
+    }
+  }
+  
+  // Lines that would be trimmed right away are never rendered
+  if (m_pending.count() > maximumBlockCount()) {
+    Line skipped = m_pending.takeFirst();
+    m_skipped += skipped.repeat;
+    
+    if (skipped.type == FtpStatus || skipped.type == FtpError)
+      m_skippedStatus[skipped.text] += skipped.repeat;
+  }
+  
+  if (isVisible() && !m_flushTimer->isActive())
+    m_flushTimer->start(flushInterval);
+}
+
+void LogView::endRun()
+{
+  QList<Line> partial = m_runPartial;
+  
+  m_runPeriod = 0;
+  m_runPartial.clear();
+  m_recent.clear();
+  
+  foreach (const Line &line, partial) {
+    appendLine(line);
+  }
+}
+
+void LogView::countRun()
+{
+  m_runCount++;
+  
+  m_runSummary.type = FtpStatus;
+  m_runSummary.repeat = 1;
+  
+  if (m_runTransfers)
+    m_runSummary.text = i18np("1 more file transferred.", "%1 more files transferred.", m_runCount);
+  else
+    m_runSummary.text = i18np("The last %2 lines repeated once more.", "The last %2 lines repeated %1 more times.", m_runCount, m_runPeriod);
+  
+  // Nothing is buffered after the running count, so it is either the last
+  // buffered line or the last rendered one
+  if (m_runCount == 1)
+    m_pending.append(m_runSummary);
+  else if (!m_pending.isEmpty())
+    m_pending.last() = m_runSummary;
+  else
+    m_runSummaryStale = true;
+  
+  if (isVisible() && !m_flushTimer->isActive())
+    m_flushTimer->start(flushInterval);
+}
+
+QString LogView::lineSignature(const Line &line) const
+{
+  switch (line.type) {
+    case FtpCommand:
+    case FtpResponse:
+    case FtpStatus: return QString::number(line.type) + line.text.section(' ', 0, 0).toUpper();
+    default: return QString();
+  }
+}
+
+void LogView::slotFlush()
+{
+  if (m_pending.isEmpty() && !m_skipped && !m_runSummaryStale)
+    return;
+  
+  setUpdatesEnabled(false);
+  
+  if (m_runSummaryStale) {
+    // The running count of repeated sequences is the last rendered line
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.select(QTextCursor::BlockUnderCursor);
+    cursor.removeSelectedText();
+    
+    appendHtml(formatLine(m_runSummary));
+    m_runSummaryStale = false;
+  }
+  
+  if (m_skipped) {
+    // Summarize the most frequent status messages among the skipped lines
+    QMultiMap<int, QString> frequent;
+    QHashIterator<QString, int> i(m_skippedStatus);
+    
+    while (i.hasNext()) {
+      i.next();
+      frequent.insert(i.value(), i.key());
+    }
+    
+    QStringList messages;
+    QMapIterator<int, QString> j(frequent);
+    j.toBack();
+    
+    while (j.hasPrevious() && messages.count() < summaryMessages) {
+      j.previous();
+      messages.append(i18n("%1 (%2 times)", j.value(), j.key()));
+    }
+    
+    Line summary;
+    summary.type = FtpStatus;
+    summary.repeat = 1;
+    summary.text = i18np("1 line skipped.", "%1 lines skipped.", m_skipped);
+    
+    if (!messages.isEmpty())
+      summary.text += " " + messages.join(", ");
+    
+    appendHtml(formatLine(summary));
+    
+    m_skipped = 0;
+    m_skippedStatus.clear();
+  }
+  
+  foreach (const Line &line, m_pending) {
+    appendHtml(formatLine(line));
+  }
+  
+  m_pending.clear();
+  setUpdatesEnabled(true);
+}
+
+void LogView::slotClear()
+{
+  m_pending.clear();
+  m_skipped = 0;
+  m_skippedStatus.clear();
+  
+  m_recent.clear();
+  m_runPeriod = 0;
+  m_runPartial.clear();
+  m_runSummaryStale = false;
+  
+  clear();
+}
+
+void LogView::showEvent(QShowEvent *event)
+{
+  QPlainTextEdit::showEvent(event);
+  
+  if (!m_pending.isEmpty() || m_skipped || m_runSummaryStale)
+    m_flushTimer->start(0);
+}
+
+QString LogView::formatLine(const Line &line) const
+{
+  QString text = line.text;
+  QString html;
+  
+  switch (line.type) {
     case FtpResponse: {
       // Break response into code and text to format them differently
-      QString prefix = str.section(" ", 0, 0);
-      QString text = str.mid(str.indexOf(' '));
+      QString prefix = text.section(" ", 0, 0);
+      QString message = text.mid(text.indexOf(' '));
 
-      appendHtml(QString("<font color='%1'><b>%2</b> %3</font><br/>").arg(KFTPCore::Config::logResponsesColor().name())
-                                                                     .arg(prefix)
-                                                                     .arg(text));
+      html = QString("<font color='%1'><b>%2</b> %3</font>").arg(KFTPCore::Config::logResponsesColor().name())
+                                                           .arg(prefix)
+                                                           .arg(message);
       break;
     }
     case FtpCommand: {
-      // Hide password if this is a PASS command
-      QString text = str;
-      if (text.left(4) == "PASS")
-        text = "PASS (hidden)";
-
-      appendHtml(QString("<font color='%1'><b>%2</b></font><br/>").arg(KFTPCore::Config::logCommandsColor().name())
-                                                                  .arg(text));
+      html = QString("<font color='%1'><b>%2</b></font>").arg(KFTPCore::Config::logCommandsColor().name())
+                                                        .arg(text);
       break;
     }
     case FtpMultiline: {
-      appendHtml(QString("<font color='%1'>%2</font><br/>").arg(KFTPCore::Config::logMultilineColor().name())
-                                                           .arg(str));
+      html = QString("<font color='%1'>%2</font>").arg(KFTPCore::Config::logMultilineColor().name())
+                                                 .arg(text);
       break;
     }
     case FtpStatus: {
-      appendHtml(QString("<font color='%1'><b>*** %2</b></font><br/>").arg(KFTPCore::Config::logStatusColor().name())
-                                                                      .arg(str));
+      html = QString("<font color='%1'><b>*** %2</b></font>").arg(KFTPCore::Config::logStatusColor().name())
+                                                            .arg(text);
       break;
     }
     case FtpError: {
-      appendHtml(QString("<font color='%1'><b>*** %2</b></font><br/>").arg(KFTPCore::Config::logErrorColor().name())
-                                                                      .arg(str));
+      html = QString("<font color='%1'><b>*** %2</b></font>").arg(KFTPCore::Config::logErrorColor().name())
+                                                            .arg(text);
       break;
     }
     case Plain: {
-      appendHtml(QString("%1<br/>").arg(str));
+      html = text;
       break;
     }
   }
+  
+  if (line.repeat > 1)
+    html += " " + i18n("(repeated %1 times)", line.repeat);
+  
+  return html + "<br/>";
+}
+
+void LogView::writeToFile(const QString &str, LineType type)
+{
+  if (!KFTPCore::Config::saveToFile() || KFTPCore::Config::outputFilename().isEmpty())
+    return;
+  
+  QString line = QTime::currentTime().toString("[hh:mm:ss] ");
+  
+  switch (type) {
+    case FtpStatus:
+    case FtpError: line += "*** " + str; break;
+    default: line += str; break;
+  }
+  
+  LogFileWriter::self()->write(KFTPCore::Config::outputFilename().toLocalFile(), line);
 }
 
 void LogView::contextMenuEvent(QContextMenuEvent *event)
@@ -130,6 +388,7 @@ void LogView::contextMenuEvent(QContextMenuEvent *event)
 void LogView::slotSaveToFile()
 {
   QString savePath = KFileDialog::getSaveFileName(KUrl(), "*.txt");
+  slotFlush();
   
   if (!savePath.isEmpty()) {
     QFile file(savePath);
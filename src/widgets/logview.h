@@ -39,12 +39,27 @@
 #include <KAction>
 
 #include <QPlainTextEdit>
+#include <QList>
+#include <QHash>
+#include <QStringList>
+
+class QTimer;
 
 namespace KFTPWidgets {
 
 /**
  * This class provides a simple log widget based on QPlainTextEdit.
  *
+ * Appended lines are buffered and rendered in batches. Identical consecutive
+ * lines are shown once with a repeat count. Sequences of lines that keep
+ * repeating with different details, like the commands and responses of
+ * every transferred file, are shown twice and then replaced by a single
+ * running count. Only the lines that would
+ * still be visible after trimming are rendered. Lines that never make it to
+ * the view are summarized by a single status line. While the view is hidden
+ * nothing is rendered at all. The complete raw log can also be written to
+ * a file (see LogFileWriter).
+ *
  * @author Jernej Kos
  */
 class LogView : public QPlainTextEdit
@@ -83,16 +98,94 @@ public:
      */
     void append(const QString &str, LineType type = Plain);
 protected:
+    /**
+     * A buffered line that hasn't been rendered yet.
+     */
+    struct Line {
+      LineType type;
+      QString text;
+      int repeat;
+    };
+    
     KAction *m_saveToFileAction;
     KAction *m_clearLogAction;
     
+    QTimer *m_flushTimer;
+    QList<Line> m_pending;
+    int m_skipped;
+    QHash<QString, int> m_skippedStatus;
+    
+    QStringList m_recent;
+    int m_runPeriod;
+    int m_runCount;
+    bool m_runTransfers;
+    QList<Line> m_runPartial;
+    Line m_runSummary;
+    bool m_runSummaryStale;
+    
     /**
      * @overload
      * Reimplemented from QAbstractScrollArea.
      */
     void contextMenuEvent(QContextMenuEvent *event);
+    
+    /**
+     * @overload
+     * Reimplemented from QWidget to render lines buffered while hidden.
+     */
+    void showEvent(QShowEvent *event);
+    
+    /**
+     * Buffers a line for rendering and starts a run when the last lines
+     * repeat the sequence before them.
+     *
+     * @param line The line to buffer
+     */
+    void appendLine(const Line &line);
+    
+    /**
+     * Ends the current run of repeating sequences, a partially repeated
+     * sequence is buffered as usual.
+     */
+    void endRun();
+    
+    /**
+     * Counts another repetition of the sequence of the current run.
+     */
+    void countRun();
+    
+    /**
+     * Returns what a line looks like when its details are ignored. Lines
+     * without a signature are never part of a repeating sequence.
+     *
+     * @param line The line
+     * @return The line's signature or an empty string
+     */
+    QString lineSignature(const Line &line) const;
+    
+    /**
+     * Formats a line as HTML.
+     *
+     * @param line The line to format
+     * @return HTML representation of the line
+     */
+    QString formatLine(const Line &line) const;
+    
+    /**
+     * Appends a line to the raw log file if enabled.
+     *
+     * @param str Line text
+     * @param type Line format type
+     */
+    void writeToFile(const QString &str, LineType type);
 private slots:
     void slotSaveToFile();
+    void slotClear();
+    
+    /**
+     * Renders all buffered lines.
+     */
+    void slotFlush();
 };
 
 }
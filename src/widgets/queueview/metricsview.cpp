@@ -0,0 +1,212 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2008 by the KFTPGrabber developers
+ * Copyright (C) 2003-2008 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include "metricsview.h"
+#include "engine/metrics.h"
+#include "engine/tracer.h"
+
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QVBoxLayout>
+#include <QTimer>
+
+#include <KLocale>
+#include <KPushButton>
+#include <KIcon>
+#include <KFileDialog>
+#include <KMessageBox>
+#include <KIO/Global>
+
+using namespace KFTPEngine;
+
+namespace KFTPWidgets {
+
+MetricsView::MetricsView(QWidget *parent)
+  : QWidget(parent)
+{
+  // Make sure the registry is created in the main thread
+  Metrics::self();
+  
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->setMargin(0);
+  
+  m_tree = new QTreeWidget(this);
+  m_tree->setHeaderLabels(QStringList() << i18n("Site") << i18n("Count") << i18n("Average")
+                                        << i18n("Median") << i18n("95th Percentile"));
+  m_tree->setFrameStyle(QFrame::NoFrame);
+  m_tree->setSelectionMode(QAbstractItemView::NoSelection);
+  m_tree->header()->setResizeMode(0, QHeaderView::Stretch);
+  m_tree->header()->setStretchLastSection(false);
+  layout->addWidget(m_tree);
+  
+  QHBoxLayout *buttons = new QHBoxLayout();
+  
+  m_traceButton = new KPushButton(KIcon("media-record"), i18n("Record Trace"), this);
+  m_traceButton->setCheckable(true);
+  m_traceButton->setChecked(Tracer::isEnabled());
+  connect(m_traceButton, SIGNAL(toggled(bool)), this, SLOT(slotTraceToggled(bool)));
+  buttons->addWidget(m_traceButton);
+  
+  KPushButton *exportButton = new KPushButton(KIcon("document-export"), i18n("Export Trace..."), this);
+  connect(exportButton, SIGNAL(clicked()), this, SLOT(slotExportTrace()));
+  buttons->addWidget(exportButton);
+  buttons->addStretch();
+  
+  KPushButton *dumpButton = new KPushButton(KIcon("document-save"), i18n("Dump to File..."), this);
+  connect(dumpButton, SIGNAL(clicked()), this, SLOT(slotDump()));
+  buttons->addWidget(dumpButton);
+  layout->addLayout(buttons);
+  
+  m_timer = new QTimer(this);
+  m_timer->setInterval(1000);
+  connect(m_timer, SIGNAL(timeout()), this, SLOT(slotRefresh()));
+}
+
+void MetricsView::showEvent(QShowEvent *event)
+{
+  slotRefresh();
+  m_timer->start();
+  
+  QWidget::showEvent(event);
+}
+
+void MetricsView::hideEvent(QHideEvent *event)
+{
+  m_timer->stop();
+  
+  QWidget::hideEvent(event);
+}
+
+QTreeWidgetItem *MetricsView::childItem(QTreeWidgetItem *parent, int index, const QString &name)
+{
+  QTreeWidgetItem *item = index < parent->childCount() ? parent->child(index) : new QTreeWidgetItem(parent);
+  item->setText(0, name);
+  
+  return item;
+}
+
+void MetricsView::setHistogram(QTreeWidgetItem *item, const MetricsHistogram &histogram)
+{
+  item->setText(1, QString::number(histogram.count()));
+  item->setText(2, i18n("%1 ms", KGlobal::locale()->formatNumber(histogram.average() / 1000.0, 2)));
+  item->setText(3, i18n("%1 ms", KGlobal::locale()->formatNumber(histogram.percentile(50) / 1000.0, 2)));
+  item->setText(4, i18n("%1 ms", KGlobal::locale()->formatNumber(histogram.percentile(95) / 1000.0, 2)));
+}
+
+void MetricsView::slotRefresh()
+{
+  // Sites are never removed, so existing items are updated in place and new
+  // sites are appended in registration order
+  QList<MetricsSite*> sites = Metrics::self()->sites();
+  
+  for (int i = 0; i < sites.count(); i++) {
+    MetricsSite *site = sites.at(i);
+    QTreeWidgetItem *siteItem = m_tree->topLevelItem(i);
+    
+    if (!siteItem) {
+      siteItem = new QTreeWidgetItem(m_tree);
+      siteItem->setText(0, site->name());
+      siteItem->setIcon(0, KIcon("network-server"));
+    }
+    
+    int row = 0;
+    for (int c = 0; c < MetricsSite::CounterCount; c++) {
+      MetricsSite::Counter counter = static_cast<MetricsSite::Counter>(c);
+      QTreeWidgetItem *item = childItem(siteItem, row++, MetricsSite::counterName(counter));
+      qint64 value = site->counter(counter).value();
+      
+      if (counter == MetricsSite::BytesDownloaded || counter == MetricsSite::BytesUploaded)
+        item->setText(1, KIO::convertSize(value));
+      else
+        item->setText(1, QString::number(value));
+    }
+    
+    for (int h = 0; h < MetricsSite::HistogramCount; h++) {
+      MetricsSite::Histogram histogram = static_cast<MetricsSite::Histogram>(h);
+      setHistogram(childItem(siteItem, row++, MetricsSite::histogramName(histogram)), site->histogram(histogram));
+    }
+    
+    for (int t = Commands::CmdNone; t <= Commands::CmdAbort; t++) {
+      Commands::Type type = static_cast<Commands::Type>(t);
+      QString name = MetricsSite::commandName(type);
+      
+      // Only show commands that have actually been executed
+      if (name.isEmpty() || site->command(type).count() == 0)
+        continue;
+      
+      setHistogram(childItem(siteItem, row++, name), site->command(type));
+    }
+  }
+}
+
+void MetricsView::slotDump()
+{
+  QString savePath = KFileDialog::getSaveFileName(KUrl(), "*.txt", this, i18n("Dump Statistics"));
+  
+  if (savePath.isEmpty())
+    return;
+  
+  if (!Metrics::self()->dumpToFile(savePath))
+    KMessageBox::error(this, i18n("Unable to write statistics to '%1'.", savePath));
+}
+
+void MetricsView::slotTraceToggled(bool enabled)
+{
+  // Every recording starts with an empty trace
+  if (enabled)
+    Tracer::self()->clear();
+  
+  Tracer::self()->setEnabled(enabled);
+}
+
+void MetricsView::slotExportTrace()
+{
+  if (Tracer::self()->count() == 0) {
+    KMessageBox::sorry(this, i18n("No trace has been recorded yet."));
+    return;
+  }
+  
+  QString savePath = KFileDialog::getSaveFileName(KUrl(), i18n("*.json|Chrome Trace Files"), this, i18n("Export Trace"));
+  
+  if (savePath.isEmpty())
+    return;
+  
+  if (!Tracer::self()->exportToFile(savePath))
+    KMessageBox::error(this, i18n("Unable to write trace to '%1'.", savePath));
+}
+
+}
+
+#include "metricsview.moc"
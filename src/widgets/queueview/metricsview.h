@@ -0,0 +1,88 @@
+/*
+ * This file is part of the KFTPGrabber project
+ *
+ * Copyright (C) 2003-2008 by the KFTPGrabber developers
+ * Copyright (C) 2003-2008 Jernej Kos <kostko@jweb-network.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef KFTPWIDGETS_METRICSVIEW_H
+#define KFTPWIDGETS_METRICSVIEW_H
+
+#include <QWidget>
+
+class QTreeWidget;
+class QTreeWidgetItem;
+class QTimer;
+class KPushButton;
+
+namespace KFTPEngine {
+  class MetricsHistogram;
+}
+
+namespace KFTPWidgets {
+
+/**
+ * This widget shows engine performance metrics of all sites. The view is
+ * refreshed every second while it is visible. It also controls recording
+ * of command traces.
+ *
+ * @author Jernej Kos
+ */
+class MetricsView : public QWidget
+{
+Q_OBJECT
+public:
+    /**
+     * Class constructor.
+     *
+     * @param parent An optional parent widget
+     */
+    MetricsView(QWidget *parent = 0);
+protected:
+    void showEvent(QShowEvent *event);
+    void hideEvent(QHideEvent *event);
+private:
+    QTreeWidget *m_tree;
+    QTimer *m_timer;
+    KPushButton *m_traceButton;
+    
+    QTreeWidgetItem *childItem(QTreeWidgetItem *parent, int index, const QString &name);
+    void setHistogram(QTreeWidgetItem *item, const KFTPEngine::MetricsHistogram &histogram);
+private slots:
+    void slotRefresh();
+    void slotDump();
+    void slotTraceToggled(bool enabled);
+    void slotExportTrace();
+};
+
+}
+
+#endif
@@ -37,6 +37,7 @@
 #include "kftptransfer.h"
 #include "kftpqueue.h"
 #include "site.h"
+#include "statistics.h"
 
 
 #include <KIcon>
@@ -116,6 +117,13 @@ QVariant Model::data(const QModelIndex &index, int role) const
           switch (index.column()) {
             case Source: return transfer->getSourceUrl().pathOrUrl();
             case Destination: return transfer->getDestUrl().pathOrUrl();
+            case ETA: {
+              // Transfers that are not running yet get a prediction from the site's history
+              double eta = Statistics::self()->estimate(transfer);
+              if (eta >= 0)
+                return i18nc("Predicted time to transfer", "~%1", KIO::convertSeconds((unsigned int) eta));
+              break;
+            }
             case Progress: {
               if (object->isDir() && object->isLocked()) {
                 return i18n("Scanning...");
@@ -123,6 +131,8 @@ QVariant Model::data(const QModelIndex &index, int role) const
                 return i18n("Connecting...");
               } else if (object->isWaiting()) {
                 return i18n("Waiting...");
+              } else if (object->isVerifying()) {
+                return i18n("Verifying...");
               } else if (object->isRunning()) {
                 return QString("%1 %%").arg(object->getProgress().first);
               }
@@ -152,7 +162,7 @@ QVariant Model::data(const QModelIndex &index, int role) const
           QFont font;
           font.setBold(true);
           return font;
-        } else if (index.column() == Progress && (object->isConnecting() || object->isWaiting())) {
+        } else if (index.column() == Progress && (object->isConnecting() || object->isWaiting() || object->isVerifying())) {
           QFont font;
           font.setBold(true);
           return font;
@@ -163,8 +173,8 @@ QVariant Model::data(const QModelIndex &index, int role) const
         if (object->isDir() && object->isLocked()) {
           // A directory scan is in progress
           return QColor(Qt::darkGreen);
-        } else if (object->isConnecting() || object->isWaiting()) {
-          // Object is connecting or waiting for a free connection
+        } else if (object->isConnecting() || object->isWaiting() || object->isVerifying()) {
+          // Object is connecting, waiting for a free connection or verifying
           return QColor(Qt::darkBlue);
         }
         break;
@@ -39,6 +39,7 @@
 #include "kftpserverlineedit.h"
 #include "kftpbookmarks.h"
 #include "kftpqueueeditorlayout.h"
+#include "kftpqueuejournal.h"
 
 #include <klineedit.h>
 #include <kpassworddialog.h>
@@ -252,6 +253,7 @@ void QueueEditor::saveData()
   m_transfer->setSourceUrl(sUrl);
   m_transfer->setDestUrl(dUrl);
   m_transfer->setTransferType(m_lastTransferType);
+  KFTPQueue::Manager::self()->getJournal()->recordAttributes(m_transfer);
   
   // If the transfer is a directory, we have to update all child transfers
   // as well.
@@ -282,6 +284,8 @@ void QueueEditor::recursiveSaveData(KFTPQueue::TransferDir *parent, const KUrl &
     i->setTransferType(m_lastTransferType);
     i->emitUpdate();
     
+    KFTPQueue::Manager::self()->getJournal()->recordAttributes(i);
+    
     if (i->isDir())
       recursiveSaveData(static_cast<KFTPQueue::TransferDir*>(i), sUrl, dUrl);
   }
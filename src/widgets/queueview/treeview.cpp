@@ -36,9 +36,13 @@
 #include "queueview/model.h"
 #include "queueview/delegate.h"
 #include "kftpqueue.h"
+#include "kftpqueuejournal.h"
+#include "queuegroup.h"
 
 #include <QEvent>
 #include <QMenu>
+#include <QActionGroup>
+#include <QPair>
 #include <QContextMenuEvent>
 
 #include <KLocale>
@@ -148,6 +152,55 @@ void TreeView::contextMenuEvent(QContextMenuEvent *event)
     menu.addAction(KIcon("go-bottom"), i18n("Move To &Bottom"), this, SLOT(slotMoveBottom()));
   }
   
+  if (object->group()) {
+    // Sites and directories can have their own transfer order
+    menu.addSeparator();
+    
+    QMenu *order = menu.addMenu(i18n("Transfer &Order"));
+    QActionGroup *policies = new QActionGroup(order);
+    
+    QStringList names;
+    names << i18n("&Inherited") << i18n("In &Queue Order") << i18n("&Smallest First") << i18n("&Largest First")
+          << i18n("Shortest &Remaining Time First") << i18n("&Directories Side by Side");
+    
+    for (int i = 0; i < names.count(); i++) {
+      QAction *action = order->addAction(names[i]);
+      action->setCheckable(true);
+      action->setData(QueueGroup::Default + i);
+      action->setChecked(object->group()->getPolicy() == QueueGroup::Default + i);
+      policies->addAction(action);
+    }
+    
+    connect(order, SIGNAL(triggered(QAction*)), this, SLOT(slotSetOrder(QAction*)));
+  }
+  
+  if (object->isTransfer()) {
+    Transfer *transfer = static_cast<Transfer*>(object);
+    
+    if (!object->group())
+      menu.addSeparator();
+    
+    QMenu *priority = menu.addMenu(i18n("&Bandwidth Priority"));
+    QActionGroup *priorities = new QActionGroup(priority);
+    
+    QList<QPair<QString, Transfer::SpeedPriority> > levels;
+    levels << qMakePair(i18n("&Inherited"), Transfer::PriorityDefault)
+           << qMakePair(i18n("&Low"), Transfer::PriorityLow)
+           << qMakePair(i18n("&Normal"), Transfer::PriorityNormal)
+           << qMakePair(i18n("&High"), Transfer::PriorityHigh);
+    
+    for (int i = 0; i < levels.count(); i++) {
+      QAction *action = priority->addAction(levels[i].first);
+      action->setCheckable(true);
+      action->setData(levels[i].second);
+      action->setChecked(transfer->getSpeedPriority() == levels[i].second);
+      priorities->addAction(action);
+    }
+    
+    connect(priority, SIGNAL(triggered(QAction*)), this, SLOT(slotSetPriority(QAction*)));
+    menu.addAction(i18n("Set Speed &Limit..."), this, SLOT(slotSetSpeedLimit()));
+  }
+  
   menu.exec(event->globalPos());
 }
 
@@ -213,6 +266,38 @@ void TreeView::slotMoveTop()
   scrollTo(m_currentIndex);
 }
 
+void TreeView::slotSetOrder(QAction *action)
+{
+  QueueObject *object = m_currentIndex.data(Model::ObjectRole).value<QueueObject*>();
+  object->group()->setPolicy(static_cast<QueueGroup::Policy>(action->data().toInt()));
+  
+  if (object->isTransfer())
+    Manager::self()->getJournal()->recordAttributes(static_cast<Transfer*>(object));
+}
+
+void TreeView::slotSetPriority(QAction *action)
+{
+  Transfer *transfer = static_cast<Transfer*>(m_currentIndex.data(Model::ObjectRole).value<QueueObject*>());
+  transfer->setSpeedPriority(static_cast<Transfer::SpeedPriority>(action->data().toInt()));
+  
+  Manager::self()->getJournal()->recordAttributes(transfer);
+}
+
+void TreeView::slotSetSpeedLimit()
+{
+  Transfer *transfer = static_cast<Transfer*>(m_currentIndex.data(Model::ObjectRole).value<QueueObject*>());
+  
+  bool ok;
+  int limit = KInputDialog::getInteger(i18n("Speed Limit"),
+                                       i18n("Maximum transfer speed in KB/s (0 = no own limit):"),
+                                       transfer->getSpeedLimit() / 1024, 0, 999999, 1, &ok, this);
+  
+  if (ok) {
+    transfer->setSpeedLimit(limit * 1024);
+    Manager::self()->getJournal()->recordAttributes(transfer);
+  }
+}
+
 void TreeView::slotMoveBottom()
 {
   QueueObject *object = m_currentIndex.data(Model::ObjectRole).value<QueueObject*>();
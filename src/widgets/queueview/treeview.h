@@ -38,6 +38,8 @@
 
 #include <QTreeView>
 
+class QAction;
+
 namespace KFTPWidgets {
 
 namespace Queue {
@@ -117,6 +119,25 @@ private slots:
      * Moves the current transfer to to bottom.
      */
     void slotMoveBottom();
+    
+    /**
+     * Changes the scheduling policy of the current site or directory.
+     *
+     * @param action The chosen policy action
+     */
+    void slotSetOrder(QAction *action);
+    
+    /**
+     * Changes the bandwidth priority of the current transfer.
+     *
+     * @param action The chosen priority action
+     */
+    void slotSetPriority(QAction *action);
+    
+    /**
+     * Asks for and sets the speed limit of the current transfer.
+     */
+    void slotSetSpeedLimit();
 };
 
 }
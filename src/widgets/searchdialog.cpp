@@ -38,6 +38,7 @@
 #include "kftpserverlineedit.h"
 #include "kftpbookmarks.h"
 #include "kftpqueue.h"
+#include "kftpqueuejournal.h"
 
 #include <qcheckbox.h>
 #include <q3groupbox.h>
@@ -109,6 +110,7 @@ void SearchDialog::replace(KFTPQueue::Transfer *i)
     i->setDestUrl(newDest);
     
     i->emitUpdate();
+    KFTPQueue::Manager::self()->getJournal()->recordAttributes(i);
   }
 }
 